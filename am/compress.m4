@@ -0,0 +1,36 @@
+# Checks for in-process compression libraries used by paxlib.
+
+# Copyright (C) 2025 Free Software Foundation, Inc.
+# This file is free software; the Free Software Foundation
+# gives unlimited permission to copy and/or distribute it,
+# with or without modifications, as long as this notice is preserved.
+
+AC_DEFUN([PU_COMPRESS],[
+  AC_ARG_WITH([zlib],
+              AS_HELP_STRING([--without-zlib],
+                             [do not use zlib for in-process gzip (de)compression]),
+              [], [with_zlib=yes])
+  LIBZ=
+  if test "$with_zlib" != no; then
+    AC_CHECK_HEADERS([zlib.h],
+      [AC_CHECK_LIB([z], [inflateReset],
+         [LIBZ=-lz
+          AC_DEFINE([HAVE_LIBZ], 1,
+                    [Define to 1 if zlib is available.])])])
+  fi
+  AC_SUBST(LIBZ)
+
+  AC_ARG_WITH([zstd],
+              AS_HELP_STRING([--without-zstd],
+                             [do not use libzstd for in-process zstd (de)compression]),
+              [], [with_zstd=yes])
+  LIBZSTD=
+  if test "$with_zstd" != no; then
+    AC_CHECK_HEADERS([zstd.h],
+      [AC_CHECK_LIB([zstd], [ZSTD_findFrameCompressedSize],
+         [LIBZSTD=-lzstd
+          AC_DEFINE([HAVE_LIBZSTD], 1,
+                    [Define to 1 if libzstd is available.])])])
+  fi
+  AC_SUBST(LIBZSTD)
+])
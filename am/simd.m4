@@ -0,0 +1,37 @@
+# Checks for SIMD code paths selected at run time.
+
+# Copyright (C) 2025 Free Software Foundation, Inc.
+# This file is free software; the Free Software Foundation
+# gives unlimited permission to copy and/or distribute it,
+# with or without modifications, as long as this notice is preserved.
+
+AC_DEFUN([PU_SIMD],[
+  AC_ARG_ENABLE([simd],
+                AS_HELP_STRING([--disable-simd],
+                               [do not use vectorized code paths]),
+                [], [enable_simd=yes])
+  if test "$enable_simd" != no; then
+    AC_CACHE_CHECK([for x86 SIMD intrinsics with run-time dispatch],
+      [pu_cv_x86_simd],
+      [AC_LINK_IFELSE(
+         [AC_LANG_PROGRAM([[
+#include <immintrin.h>
+__attribute__ ((target ("avx2"))) static int
+f (void)
+{
+  __m256i x = _mm256_setzero_si256 ();
+  return _mm256_movemask_epi8 (_mm256_sad_epu8 (x, x));
+}
+]], [[
+  __builtin_cpu_init ();
+  return __builtin_cpu_supports ("avx2") ? f () : 0;
+]])],
+         [pu_cv_x86_simd=yes],
+         [pu_cv_x86_simd=no])])
+    if test $pu_cv_x86_simd = yes; then
+      AC_DEFINE([HAVE_X86_SIMD], 1,
+                [Define to 1 if SSE2 and AVX2 code can be compiled with
+                 function target attributes and selected at run time.])
+    fi
+  fi
+])
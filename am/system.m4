@@ -6,10 +6,11 @@
 # with or without modifications, as long as this notice is preserved.
 
 AC_DEFUN([PU_SYSTEM],[
-  AC_CHECK_HEADERS_ONCE([grp.h pwd.h sys/mtio.h])
+  AC_CHECK_HEADERS_ONCE([grp.h linux/fiemap.h linux/io_uring.h pwd.h
+                         sys/mtio.h])
 
   AC_CHECK_MEMBERS([struct stat.st_blksize])
   AC_REQUIRE([AC_STRUCT_ST_BLOCKS])
 
-  AC_CHECK_FUNCS_ONCE([mkfifo])
+  AC_CHECK_FUNCS_ONCE([fallocate mkfifo statx syncfs])
 ])
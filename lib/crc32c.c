@@ -0,0 +1,197 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* CRC-32C.
+
+   The CRC is computed by the crc32 instruction of SSE4.2 where the CPU
+   has it, and eight bytes at a time through tables otherwise.  Both
+   work on the bit-reversed register, without the initial and final
+   inversions, which pax_crc32c applies.
+
+   Combining uses the method of zlib: appending LEN bytes to data
+   multiplies the register by x^(8*LEN) modulo the polynomial, and that
+   power is obtained from a table of x^(2^K) by LEN's binary digits.  */
+
+#include <system.h>
+#include <pthread.h>
+#include <crc32c.h>
+#if HAVE_X86_SIMD
+# include <immintrin.h>
+#endif
+
+/* The polynomial, bit-reversed */
+#define CRC32C_POLY 0x82f63b78
+
+typedef uint_least32_t (*crc_fp) (uint_least32_t crc, unsigned char const *p,
+				  idx_t len);
+
+static uint_least32_t crc_table[8][256];
+static uint_least32_t x2n_table[32];
+
+/* Return A * B modulo the polynomial */
+static uint_least32_t
+multmodp (uint_least32_t a, uint_least32_t b)
+{
+  uint_least32_t m = UINT32_C (1) << 31, p = 0;
+
+  for (;;)
+    {
+      if (a & m)
+	{
+	  p ^= b;
+	  if (!(a & (m - 1)))
+	    break;
+	}
+      m >>= 1;
+      b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+  return p;
+}
+
+/* Return x^(N * 2^K) modulo the polynomial */
+static uint_least32_t
+x2nmodp (off_t n, int k)
+{
+  uint_least32_t p = UINT32_C (1) << 31;
+
+  for (; n; n >>= 1, k++)
+    if (n & 1)
+      p = multmodp (x2n_table[k & 31], p);
+  return p;
+}
+
+/* Slicing by 8: table K gives the effect of a byte followed by K zero
+   bytes, so that eight bytes are done with eight lookups.  */
+static uint_least32_t
+crc_generic (uint_least32_t crc, unsigned char const *p, idx_t len)
+{
+  for (; len >= 8; p += 8, len -= 8)
+    {
+      uint_least32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16
+				 | (uint_least32_t) p[3] << 24);
+      crc = (crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff]
+	     ^ crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24]
+	     ^ crc_table[3][p[4]] ^ crc_table[2][p[5]]
+	     ^ crc_table[1][p[6]] ^ crc_table[0][p[7]]);
+    }
+  for (; len > 0; p++, len--)
+    crc = (crc >> 8) ^ crc_table[0][(crc ^ *p) & 0xff];
+  return crc;
+}
+
+#if HAVE_X86_SIMD && defined __x86_64__
+/* The crc32 instruction takes three cycles, but a new one can start
+   every cycle: three streams of CRC_STRIDE bytes are done at once,
+   then put together by multiplying the first two by x^(16*CRC_STRIDE)
+   and x^(8*CRC_STRIDE).  */
+enum { CRC_STRIDE = 4096 };
+static uint_least32_t crc_shift1, crc_shift2;
+
+__attribute__ ((target ("sse4.2")))
+static uint_least32_t
+crc_sse42 (uint_least32_t crc, unsigned char const *p, idx_t len)
+{
+  unsigned long long c = crc;
+
+  for (; len > 0 && (uintptr_t) p % 8; p++, len--)
+    c = _mm_crc32_u8 (c, *p);
+  for (; len >= 3 * CRC_STRIDE; p += 3 * CRC_STRIDE, len -= 3 * CRC_STRIDE)
+    {
+      unsigned long long c1 = 0, c2 = 0;
+      for (int i = 0; i < CRC_STRIDE; i += 8)
+	{
+	  unsigned long long v0, v1, v2;
+	  memcpy (&v0, p + i, 8);
+	  memcpy (&v1, p + CRC_STRIDE + i, 8);
+	  memcpy (&v2, p + 2 * CRC_STRIDE + i, 8);
+	  c = _mm_crc32_u64 (c, v0);
+	  c1 = _mm_crc32_u64 (c1, v1);
+	  c2 = _mm_crc32_u64 (c2, v2);
+	}
+      c = multmodp (crc_shift2, c) ^ multmodp (crc_shift1, c1) ^ c2;
+    }
+  for (; len >= 8; p += 8, len -= 8)
+    {
+      unsigned long long v;
+      memcpy (&v, p, sizeof v);
+      c = _mm_crc32_u64 (c, v);
+    }
+  for (; len > 0; p++, len--)
+    c = _mm_crc32_u8 (c, *p);
+  return c;
+}
+#endif
+
+static crc_fp crc_kernel = crc_generic;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void
+crc_init (void)
+{
+  for (int n = 0; n < 256; n++)
+    {
+      uint_least32_t c = n;
+      for (int k = 0; k < 8; k++)
+	c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+      crc_table[0][n] = c;
+    }
+  for (int n = 0; n < 256; n++)
+    for (int k = 1; k < 8; k++)
+      crc_table[k][n] = ((crc_table[k - 1][n] >> 8)
+			 ^ crc_table[0][crc_table[k - 1][n] & 0xff]);
+
+  uint_least32_t p = UINT32_C (1) << 30;
+  x2n_table[0] = p;
+  for (int n = 1; n < 32; n++)
+    x2n_table[n] = p = multmodp (p, p);
+
+#if HAVE_X86_SIMD && defined __x86_64__
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("sse4.2"))
+    {
+      crc_shift1 = x2nmodp (CRC_STRIDE, 3);
+      crc_shift2 = x2nmodp (2 * CRC_STRIDE, 3);
+      crc_kernel = crc_sse42;
+    }
+#endif
+}
+
+/* Return the CRC of LEN bytes at BUF following data whose CRC is
+   CRC.  */
+uint_least32_t
+pax_crc32c (uint_least32_t crc, void const *buf, idx_t len)
+{
+  pthread_once (&crc_once, crc_init);
+  return ~crc_kernel (~crc & 0xffffffff, buf, len) & 0xffffffff;
+}
+
+/* Return the CRC of two pieces of data, given the CRC of each, CRC1
+   and CRC2, and the length of the second, LEN2.  */
+uint_least32_t
+pax_crc32c_combine (uint_least32_t crc1, uint_least32_t crc2, off_t len2)
+{
+  pthread_once (&crc_once, crc_init);
+  return multmodp (x2nmodp (len2, 3), crc1) ^ crc2;
+}
+
+/* Return the CRC of LEN zero bytes, without going over them */
+uint_least32_t
+pax_crc32c_zeros (off_t len)
+{
+  pthread_once (&crc_once, crc_init);
+  return ~multmodp (x2nmodp (len, 3), 0xffffffff) & 0xffffffff;
+}
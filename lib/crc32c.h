@@ -0,0 +1,27 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* CRC-32C (Castagnoli), as used by iSCSI and ext4.
+
+   The CRC of data is pax_crc32c (0, data, len); pass the result back
+   in to continue with more data.  The CRCs of consecutive pieces
+   computed independently are put together by pax_crc32c_combine.  */
+
+uint_least32_t pax_crc32c (uint_least32_t crc, void const *buf, idx_t len);
+uint_least32_t pax_crc32c_combine (uint_least32_t crc1, uint_least32_t crc2,
+				   off_t len2);
+uint_least32_t pax_crc32c_zeros (off_t len);
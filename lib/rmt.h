@@ -26,6 +26,7 @@ off_t rmt_lseek__ (int, off_t, int);
 int rmt_ioctl__ (int, unsigned long int, void *);
 
 extern bool force_local_option;
+extern bool rmt_checksum_option;
 
 _GL_INLINE_HEADER_BEGIN
 #ifndef RMT_INLINE
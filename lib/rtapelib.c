@@ -32,6 +32,7 @@
 
 #include "system.h"
 
+#include <crc32c.h>
 #include <verify.h>
 
 #include <signal.h>
@@ -62,6 +63,12 @@ static int from_remote[MAXUNIT][2] = {{-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}};
 /* The pipes for sending data to remote tape drives.  */
 static int to_remote[MAXUNIT][2] = {{-1, -1}, {-1, -1}, {-1, -1}, {-1, -1}};
 
+/* Whether the records of each connection carry a CRC-32C.  */
+static bool checksum[MAXUNIT];
+
+/* Number of times a record whose CRC does not match is sent again.  */
+enum { CHECKSUM_RETRIES = 3 };
+
 /* The parent's read side of remote tape connection Fd.  */
 static int
 read_side (int handle)
@@ -101,6 +108,10 @@ bool force_local_option;
     rmt_ioctl__ (handle, operation, argument)
 #endif
 
+/* If true, ask the remote rmt to check the records transferred with a
+   CRC-32C, if it can.  */
+bool rmt_checksum_option;
+
 
 
 /* Close remote tape connection HANDLE, and reset errno to ERRNO_VALUE.  */
@@ -111,6 +122,7 @@ _rmt_shutdown (int handle, int errno_value)
   close (write_side (handle));
   from_remote[handle][PREAD] = -1;
   to_remote[handle][PWRITE] = -1;
+  checksum[handle] = false;
   errno = errno_value;
 }
 
@@ -166,9 +178,12 @@ dectointmax (char const *s, intmax_t smax)
 /* Get from HANDLE a response string into COMMAND_BUFFER, terminated by '\n'.
    If the response is a successful command, starting with 'A',
    return the address of the byte following the 'A'.
-   Otherwise, set errno and return a null pointer.  */
+   Otherwise, set errno and return a null pointer.  If DAMAGED is not
+   null, a response C<count>, telling that the record written did not
+   match its CRC and was dropped, sets *DAMAGED as well.  */
 static char *
-get_status_string (int handle, char command_buffer[COMMAND_BUFFER_SIZE])
+get_status_string (int handle, char command_buffer[COMMAND_BUFFER_SIZE],
+		   bool *damaged)
 {
   char *cursor;
 
@@ -207,7 +222,7 @@ get_status_string (int handle, char command_buffer[COMMAND_BUFFER_SIZE])
 	      return nullptr;
 	    }
 	}
-      while (character == '\n');
+      while (character != '\n');
 
       /* This assumes remote errno values are the same as local,
 	 which is wrong in general, but does work in common cases
@@ -221,6 +236,13 @@ get_status_string (int handle, char command_buffer[COMMAND_BUFFER_SIZE])
       return nullptr;
     }
 
+  if (*cursor == 'C' && damaged && 0 <= dectointmax (cursor + 1, INTMAX_MAX))
+    {
+      *damaged = true;
+      errno = EBADMSG;
+      return nullptr;
+    }
+
   /* Check for mis-synced pipes.  */
 
   if (*cursor != 'A')
@@ -236,12 +258,14 @@ get_status_string (int handle, char command_buffer[COMMAND_BUFFER_SIZE])
 
 /* Read and return the status from remote tape connection HANDLE.
    The status must be in the range 0..STATUS_MAX.  If
-   an error occurred, return -1 and set errno.  */
+   an error occurred, return -1 and set errno.  If DAMAGED is not null,
+   accept the reply to a write command in checksum mode, and set
+   *DAMAGED if the record written was damaged on the way.  */
 static intmax_t
-get_status (int handle, intmax_t status_max)
+get_write_status (int handle, intmax_t status_max, bool *damaged)
 {
   char command_buffer[COMMAND_BUFFER_SIZE];
-  const char *status = get_status_string (handle, command_buffer);
+  const char *status = get_status_string (handle, command_buffer, damaged);
   if (status)
     {
       intmax_t result = dectointmax (status, status_max);
@@ -252,6 +276,52 @@ get_status (int handle, intmax_t status_max)
   return -1;
 }
 
+/* Likewise, for any command but a write in checksum mode */
+static intmax_t
+get_status (int handle, intmax_t status_max)
+{
+  return get_write_status (handle, status_max, nullptr);
+}
+
+/* Read from HANDLE the reply to a read command in checksum mode,
+   A<count> <crc>.  The count must be in the range 0..STATUS_MAX.
+   Return it and store the CRC in *CRC; if an error occurred, return -1
+   and set errno.  */
+static intmax_t
+get_record_status (int handle, intmax_t status_max, uint_least32_t *crc)
+{
+  char command_buffer[COMMAND_BUFFER_SIZE];
+  const char *status = get_status_string (handle, command_buffer, nullptr);
+  if (status)
+    {
+      intmax_t result = dectointmax (status, status_max);
+      char *p = strchr (status, ' ');
+      if (0 <= result && p)
+	{
+	  errno = 0;
+	  uintmax_t n = strtoumax (p + 1, &p, 16);
+	  if (!errno && *p == '\n' && n <= 0xffffffff)
+	    {
+	      *crc = n;
+	      return result;
+	    }
+	}
+      errno = EIO;
+    }
+  return -1;
+}
+
+/* Ask the remote end of HANDLE to check the records transferred with a
+   CRC-32C.  Return true if it agreed.  */
+static bool
+negotiate_checksum (int handle)
+{
+  if (do_command (handle, "K1\n", 3) < 0 || get_status (handle, 1) != 1)
+    return false;
+  checksum[handle] = true;
+  return true;
+}
+
 #if WITH_REXEC
 
 /* Execute /etc/rmt as user USER on remote system HOST using rexec.
@@ -597,6 +667,19 @@ rmt_open (char const *file_name, int oflags, int bias,
   }
 
   free (file_name_copy);
+
+  if (rmt_checksum_option && !negotiate_checksum (remote_pipe_number))
+    {
+      /* An rmt without the checksum mode exits on the unknown command:
+	 start over without it.  The file was created by the first try,
+	 if at all, so it is not to be created exclusively again.  */
+      _rmt_shutdown (remote_pipe_number, 0);
+      rmt_checksum_option = false;
+      int handle = rmt_open (file_name, oflags & ~O_EXCL, bias,
+			     remote_shell, rmt_command);
+      rmt_checksum_option = true;
+      return handle;
+    }
   return remote_pipe_number + bias;
 }
 
@@ -625,27 +708,43 @@ rmt_read (int handle, void *buffer, idx_t length)
   if (done < 0)
     return done;
 
-  ptrdiff_t status = get_status (handle, length);
-  if (status < 0)
-    {
-      _rmt_shutdown (handle, EIO);
-      return -1;
-    }
-
-  char *buf = buffer;
-  for (idx_t counter = 0; counter < status; )
+  for (int retries = 0; ; retries++)
     {
-      ptrdiff_t rlen = safe_read (read_side (handle),
-				  buf + counter, status - counter);
-      if (rlen <= 0)
+      uint_least32_t crc = 0;
+      ptrdiff_t status = (checksum[handle]
+			  ? get_record_status (handle, length, &crc)
+			  : get_status (handle, length));
+      if (status < 0)
 	{
 	  _rmt_shutdown (handle, EIO);
 	  return -1;
 	}
-      counter += rlen;
-    }
 
-  return status;
+      char *buf = buffer;
+      for (idx_t counter = 0; counter < status; )
+	{
+	  ptrdiff_t rlen = safe_read (read_side (handle),
+				      buf + counter, status - counter);
+	  if (rlen <= 0)
+	    {
+	      _rmt_shutdown (handle, EIO);
+	      return -1;
+	    }
+	  counter += rlen;
+	}
+
+      if (!checksum[handle] || pax_crc32c (0, buffer, status) == crc)
+	return status;
+
+      /* Ask for the record again */
+      if (retries == CHECKSUM_RETRIES)
+	{
+	  _rmt_shutdown (handle, EBADMSG);
+	  return -1;
+	}
+      if (do_command (handle, "T\n", 2) < 0)
+	return -1;
+    }
 }
 
 /* Write LENGTH bytes from BUFFER to remote tape connection HANDLE.
@@ -653,23 +752,42 @@ rmt_read (int handle, void *buffer, idx_t length)
 idx_t
 rmt_write (int handle, void const *buffer, idx_t length)
 {
-  char command_buffer[sizeof "W\n" + INT_STRLEN_BOUND (idx_t)];
+  char command_buffer[sizeof "W \n" + INT_STRLEN_BOUND (idx_t) + 8];
   void (*pipe_handler) (int);
-  int buflen = sprintf (command_buffer, "W%td\n", length);
-  if (do_command (handle, command_buffer, buflen) < 0)
-    return 0;
+  int buflen;
+  idx_t written;
 
-  pipe_handler = signal (SIGPIPE, SIG_IGN);
-  idx_t written = full_write (write_side (handle), buffer, length);
-  signal (SIGPIPE, pipe_handler);
-  if (written == length)
+  if (checksum[handle])
+    buflen = sprintf (command_buffer, "W%td %08jx\n", length,
+		      (uintmax_t) pax_crc32c (0, buffer, length));
+  else
+    buflen = sprintf (command_buffer, "W%td\n", length);
+
+  for (int retries = 0; ; retries++)
     {
-      ptrdiff_t r = get_status (handle, length);
-      if (r < 0)
+      if (do_command (handle, command_buffer, buflen) < 0)
 	return 0;
+
+      pipe_handler = signal (SIGPIPE, SIG_IGN);
+      written = full_write (write_side (handle), buffer, length);
+      signal (SIGPIPE, pipe_handler);
+      if (written != length)
+	break;
+
+      bool damaged = false;
+      ptrdiff_t r = get_write_status (handle, length,
+				      checksum[handle] ? &damaged : nullptr);
       if (r == length)
 	return length;
-      written = r;
+      if (0 <= r)
+	{
+	  written = r;
+	  break;
+	}
+      /* The record was damaged on the way, and not written: send it
+	 again.  */
+      if (!(damaged && retries < CHECKSUM_RETRIES))
+	return 0;
     }
 
   /* Write error.  */
@@ -0,0 +1,222 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Header checksums.
+
+   The checksum of a header is the sum of its bytes, with the checksum
+   field counted as blanks.  Old tars summed signed chars.  Since a
+   signed char equals the unsigned one minus 256 if its high bit is
+   set, both sums are obtained from the unsigned sum and the number of
+   bytes with the high bit set.  These two are computed by a kernel
+   chosen at run time according to the capabilities of the CPU.  */
+
+#include <system.h>
+#include <pthread.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+#if HAVE_X86_SIMD
+# include <immintrin.h>
+#endif
+
+/* Raw sums of a block */
+struct block_sum
+{
+  int usum;                   /* Sum of the bytes, as unsigned chars */
+  int nhigh;                  /* Number of bytes with the high bit set */
+};
+
+typedef void (*block_sum_fp) (union block const *blk, idx_t n,
+			      struct block_sum *sums);
+
+static void
+sum_generic (union block const *blk, idx_t n, struct block_sum *sums)
+{
+  for (idx_t i = 0; i < n; i++)
+    {
+      unsigned char const *p = (unsigned char const *) blk[i].buffer;
+      int usum = 0, nhigh = 0;
+
+      for (int j = 0; j < BLOCKSIZE; j++)
+	{
+	  usum += p[j];
+	  nhigh += p[j] >> 7;
+	}
+      sums[i].usum = usum;
+      sums[i].nhigh = nhigh;
+    }
+}
+
+#if HAVE_X86_SIMD
+/* _mm_sad_epu8 against zero adds up groups of 8 bytes.  The high bits
+   are counted the same way, after shifting them to bit 0.  */
+__attribute__ ((target ("sse2")))
+static void
+sum_sse2 (union block const *blk, idx_t n, struct block_sum *sums)
+{
+  __m128i const zero = _mm_setzero_si128 ();
+  __m128i const one = _mm_set1_epi8 (1);
+
+  for (idx_t i = 0; i < n; i++)
+    {
+      __m128i const *p = (__m128i const *) blk[i].buffer;
+      __m128i usum = zero, nhigh = zero;
+
+      for (int j = 0; j < BLOCKSIZE / sizeof (__m128i); j++)
+	{
+	  __m128i v = _mm_loadu_si128 (p + j);
+	  usum = _mm_add_epi64 (usum, _mm_sad_epu8 (v, zero));
+	  v = _mm_and_si128 (_mm_srli_epi16 (v, 7), one);
+	  nhigh = _mm_add_epi64 (nhigh, _mm_sad_epu8 (v, zero));
+	}
+      usum = _mm_add_epi64 (usum, _mm_unpackhi_epi64 (usum, usum));
+      nhigh = _mm_add_epi64 (nhigh, _mm_unpackhi_epi64 (nhigh, nhigh));
+      sums[i].usum = _mm_cvtsi128_si32 (usum);
+      sums[i].nhigh = _mm_cvtsi128_si32 (nhigh);
+    }
+}
+
+__attribute__ ((target ("avx2")))
+static void
+sum_avx2 (union block const *blk, idx_t n, struct block_sum *sums)
+{
+  __m256i const zero = _mm256_setzero_si256 ();
+  __m256i const one = _mm256_set1_epi8 (1);
+
+  for (idx_t i = 0; i < n; i++)
+    {
+      __m256i const *p = (__m256i const *) blk[i].buffer;
+      __m256i usum = zero, nhigh = zero;
+
+      for (int j = 0; j < BLOCKSIZE / sizeof (__m256i); j++)
+	{
+	  __m256i v = _mm256_loadu_si256 (p + j);
+	  usum = _mm256_add_epi64 (usum, _mm256_sad_epu8 (v, zero));
+	  v = _mm256_and_si256 (_mm256_srli_epi16 (v, 7), one);
+	  nhigh = _mm256_add_epi64 (nhigh, _mm256_sad_epu8 (v, zero));
+	}
+      /* Both sums fit in 32 bits: pack them and add up the lanes */
+      __m256i s = _mm256_or_si256 (usum, _mm256_slli_epi64 (nhigh, 32));
+      __m128i t = _mm_add_epi64 (_mm256_castsi256_si128 (s),
+				 _mm256_extracti128_si256 (s, 1));
+      t = _mm_add_epi64 (t, _mm_unpackhi_epi64 (t, t));
+      sums[i].usum = _mm_cvtsi128_si32 (t);
+      sums[i].nhigh = _mm_cvtsi128_si32 (_mm_srli_epi64 (t, 32));
+    }
+}
+#endif
+
+static block_sum_fp block_sum_kernel = sum_generic;
+static pthread_once_t block_sum_once = PTHREAD_ONCE_INIT;
+
+static void
+block_sum_select (void)
+{
+#if HAVE_X86_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    block_sum_kernel = sum_avx2;
+  else if (__builtin_cpu_supports ("sse2"))
+    block_sum_kernel = sum_sse2;
+#endif
+}
+
+static void
+block_sums (union block const *blk, idx_t n, struct block_sum *sums)
+{
+  pthread_once (&block_sum_once, block_sum_select);
+  block_sum_kernel (blk, n, sums);
+}
+
+/* Count the checksum field of BLK, whose raw sums are in *SUM, as
+   blanks.  */
+static void
+blank_chksum (union block const *blk, struct block_sum *sum)
+{
+  for (int i = 0; i < sizeof blk->header.chksum; i++)
+    {
+      unsigned char c = blk->header.chksum[i];
+      sum->usum -= c;
+      sum->nhigh -= c >> 7;
+    }
+  sum->usum += ' ' * sizeof blk->header.chksum;
+}
+
+/* Return the checksum of the header BLK as computed by tar, with the
+   checksum field counted as blanks.  If SSUM is not null, store there
+   the checksum computed with signed chars.  */
+int
+pax_header_sum (union block const *blk, int *ssum)
+{
+  struct block_sum sum;
+
+  block_sums (blk, 1, &sum);
+  blank_chksum (blk, &sum);
+  if (ssum)
+    *ssum = sum.usum - 256 * sum.nhigh;
+  return sum.usum;
+}
+
+static enum pax_header_status
+header_status (union block const *blk, struct block_sum sum)
+{
+  intmax_t recorded;
+
+  if (sum.usum == 0)
+    return PAX_HEADER_ZERO_BLOCK;
+  blank_chksum (blk, &sum);
+  if (!pax_decode_number (blk->header.chksum, sizeof blk->header.chksum,
+			  0, INTMAX_MAX, &recorded)
+      || (recorded != sum.usum && recorded != sum.usum - 256 * sum.nhigh))
+    return PAX_HEADER_FAILURE;
+  return PAX_HEADER_SUCCESS;
+}
+
+/* Verify the checksum of the header BLK.  Old tars computed it using
+   signed chars; both sums are accepted.  */
+enum pax_header_status
+pax_header_checksum (union block const *blk)
+{
+  struct block_sum sum;
+
+  block_sums (blk, 1, &sum);
+  return header_status (blk, sum);
+}
+
+/* Verify the checksums of the N blocks at BLK, e.g. a whole record,
+   storing the result for each in STATUS.  Return the number of valid
+   headers.  */
+idx_t
+pax_header_checksum_n (union block const *blk, idx_t n,
+		       enum pax_header_status *status)
+{
+  enum { CHUNK = 64 };
+  struct block_sum sums[CHUNK];
+  idx_t nvalid = 0;
+
+  for (idx_t i = 0; i < n; i += CHUNK)
+    {
+      idx_t k = n - i < CHUNK ? n - i : CHUNK;
+      block_sums (blk + i, k, sums);
+      for (idx_t j = 0; j < k; j++)
+	{
+	  status[i + j] = header_status (blk + i + j, sums[j]);
+	  nvalid += status[i + j] == PAX_HEADER_SUCCESS;
+	}
+    }
+  return nvalid;
+}
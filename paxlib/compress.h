@@ -0,0 +1,57 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* In-process compression filters for paxbuf */
+
+enum pax_compression
+  {
+    PAX_COMPRESS_NONE,
+    PAX_COMPRESS_AUTO,          /* Detect from the data (reading only) */
+    PAX_COMPRESS_GZIP,
+    PAX_COMPRESS_ZSTD
+  };
+
+/* A gzip member can declare its own total length in an extra subfield,
+   which allows a reader to split the stream without inflating it.  Two
+   such subfields are recognized: the 'BC' one used by BGZF (2 bytes,
+   length minus one) and the 'PX' one written by paxutils (4 bytes,
+   length). */
+#define GZIP_SI_BGZF1 'B'
+#define GZIP_SI_BGZF2 'C'
+#define GZIP_SI_PAX1  'P'
+#define GZIP_SI_PAX2  'X'
+
+/* Seekable zstd streams end with a skippable frame holding the
+   compressed and decompressed size of each frame, followed by a footer
+   of 9 bytes: the number of frames, a descriptor byte and the magic
+   number.  */
+#define ZSTD_SEEK_TABLE_MAGIC  0x184D2A5E
+#define ZSTD_SEEKABLE_MAGIC    0x8F92EAB1
+enum
+  {
+    ZSTD_SEEK_TABLE_ENTRY = 8,
+    ZSTD_SEEK_TABLE_FOOTER = 9
+  };
+
+/* Default size of an independently compressed frame */
+enum { PAX_COMPRESS_FRAME_SIZE = 1024 * 1024 };
+
+enum pax_compression pax_compression_detect (const char *data, idx_t size);
+int paxbuf_set_decompress (paxbuf_t buf, enum pax_compression type,
+			   int nthreads);
+int paxbuf_set_compress (paxbuf_t buf, enum pax_compression type,
+			 int level, idx_t frame_size, int nthreads);
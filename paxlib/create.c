@@ -0,0 +1,801 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Parallel archive creation.
+
+   Members are prepared on a pool of worker threads: each worker stats
+   the file, encodes its headers and reads its contents into a chunk
+   buffer private to the member.  The calling thread commits the chunks
+   to the paxbuf in the order the members were added, so the archive is
+   the same whatever the number of threads.  The contents of a file
+   larger than PAX_CREATE_CHUNK are only partly read by the worker; the
+   rest is copied by the committing thread, which bounds the memory in
+   use to about PAX_CREATE_CHUNK per slot.
+
+   A file with several links is archived once; its other names become
+   hard links to the first member, found in a table of the files seen
+   so far.  The committing thread enters files in that table in the
+   order of the members, and makes any member a link whose file is
+   there, so that which member holds the contents does not depend on
+   the number of threads.  A worker that finds the file there already
+   does not read its contents at all.
+
+   If given an index, the committing thread enters each member in it
+   with the offset of its first header, as it writes the member.  */
+
+#include <system.h>
+#include <pthread.h>
+#include <quotearg.h>
+#include <paxbuf.h>
+#include <pool.h>
+#include <hlink.h>
+#include <mindex.h>
+#include <tar.h>
+#include <pax.h>
+
+/* A member being prepared or waiting to be committed */
+struct create_slot
+{
+  struct pax_create *pc;      /* Owning pipeline */
+  char *file_name;            /* File to archive */
+  char *archive_name;         /* Name of the member */
+  idx_t names_size;           /* Allocated size of file_name */
+  struct tar_stat_info st;
+  char *data;                 /* Headers and contents */
+  idx_t data_len;             /* Length of data */
+  idx_t data_size;            /* Allocated size of data */
+  int fd;                     /* File whose contents continue, or -1 */
+  off_t remaining;            /* Contents still to be read from fd */
+  off_t shrunk;               /* Bytes missing from a file that shrank */
+  int err;                    /* errno value of a failure */
+  void (*diag) (char const *);/* Function reporting the failure */
+  char const *skip_reason;    /* Why the member is not archived */
+  char typeflag;              /* Type flag of the member header */
+  bool hard_link;             /* The member is a hard link */
+  bool have_stat;             /* st.stat was given by the caller */
+  bool done;                  /* The worker is finished with the slot */
+};
+
+struct pax_create
+{
+  paxbuf_t buf;
+  enum archive_format format;
+  int stat_flags;             /* Flags of pax_stat_capture */
+  pax_pool_t pool;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;        /* Signalled when a slot is done */
+  struct create_slot *ring;
+  idx_t depth;                /* Number of slots in ring */
+  idx_t head;                 /* Next member to be committed */
+  idx_t tail;                 /* Next free slot */
+  char *copy_buf;             /* Buffer for the contents left in files */
+  pax_hlink_t links;          /* Files with several links, by the name
+				 of their first member */
+  pax_mindex_t mindex;        /* Index of the members, or null */
+};
+
+static char *
+slot_grow (struct create_slot *slot, idx_t len)
+{
+  if (slot->data_size - slot->data_len < len)
+    slot->data = xpalloc (slot->data, &slot->data_size,
+			  len - (slot->data_size - slot->data_len), -1, 1);
+  char *p = slot->data + slot->data_len;
+  slot->data_len += len;
+  return p;
+}
+
+/* Append to SLOT the LEN bytes at P, padded to a block boundary */
+static void
+slot_add_padded (struct create_slot *slot, char const *p, idx_t len)
+{
+  idx_t padded = (len + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE;
+  char *q = slot_grow (slot, padded);
+  memcpy (q, p, len);
+  memset (q + len, 0, padded - len);
+}
+
+
+/* Headers */
+
+/* Append to SLOT a GNU long name header of the given TYPEFLAG, with the
+   null-terminated NAME as data.  */
+static void
+create_long_name (struct create_slot *slot, char typeflag, char const *name)
+{
+  struct tar_stat_info hst = { 0 };
+  idx_t len = strlen (name) + 1;
+
+  /* What tar puts in its private headers */
+  hst.file_name = (char *) "././@LongLink";
+  hst.uname = hst.gname = (char *) "root";
+  hst.stat.st_mode = S_IFREG | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+  hst.archive_file_size = len;
+  pax_encode_header ((union block *) slot_grow (slot, BLOCKSIZE), &hst,
+		     typeflag, slot->pc->format);
+  slot_add_padded (slot, name, len);
+}
+
+/* Append a "LEN KEYWORD=VALUE\n" record to the buffer *X, holding *XLEN
+   bytes out of *XSIZE.  */
+static void
+xrecord_add (char **x, idx_t *xlen, idx_t *xsize,
+	     char const *keyword, char const *value)
+{
+  idx_t klen = strlen (keyword), vlen = strlen (value);
+  idx_t len = klen + vlen + 3;   /* Space, equal sign and newline */
+  char digits[INT_BUFSIZE_BOUND (idx_t)];
+  int ndigits = sprintf (digits, "%td", len);
+
+  /* The length counts its own digits */
+  len += ndigits;
+  ndigits = sprintf (digits, "%td", len);
+  if (len - klen - vlen - 3 != ndigits)
+    ndigits = sprintf (digits, "%td", ++len);
+
+  if (*xsize - *xlen < len)
+    *x = xpalloc (*x, xsize, len - (*xsize - *xlen), -1, 1);
+  sprintf (*x + *xlen, "%s %s=", digits, keyword);
+  memcpy (*x + *xlen + ndigits + klen + 2, value, vlen);
+  (*x)[*xlen + len - 1] = '\n';
+  *xlen += len;
+}
+
+static void
+xrecord_add_number (char **x, idx_t *xlen, idx_t *xsize,
+		    char const *keyword, intmax_t n)
+{
+  char buf[INT_BUFSIZE_BOUND (intmax_t)];
+  sprintf (buf, "%jd", n);
+  xrecord_add (x, xlen, xsize, keyword, buf);
+}
+
+/* Add a time record, with as many decimals as NSEC needs */
+static void
+xrecord_add_time (char **x, idx_t *xlen, idx_t *xsize,
+		  char const *keyword, time_t sec, unsigned long nsec)
+{
+  char buf[INT_BUFSIZE_BOUND (intmax_t) + 10];
+  char const *sign = "";
+  intmax_t s = sec;
+
+  if (nsec == 0)
+    {
+      xrecord_add_number (x, xlen, xsize, keyword, s);
+      return;
+    }
+  if (s < 0)
+    {
+      /* -1.25 is -2 seconds plus 750000000 nanoseconds */
+      sign = "-";
+      s = -(s + 1);
+      nsec = 1000000000 - nsec;
+    }
+  int len = sprintf (buf, "%s%jd.%09lu", sign, s, nsec);
+  while (buf[len - 1] == '0')
+    buf[--len] = '\0';
+  xrecord_add (x, xlen, xsize, keyword, buf);
+}
+
+/* Append to SLOT an extended header supplying the fields of ST that
+   are flagged in OVERFLOW.  */
+static void
+create_xheader (struct create_slot *slot, int overflow)
+{
+  struct tar_stat_info const *st = &slot->st;
+  char *x = nullptr;
+  idx_t xlen = 0, xsize = 0;
+
+  if (overflow & PAX_ENCODE_NAME)
+    xrecord_add (&x, &xlen, &xsize, "path", st->file_name);
+  if (overflow & PAX_ENCODE_LINKNAME)
+    xrecord_add (&x, &xlen, &xsize, "linkpath", st->link_name);
+  if (overflow & PAX_ENCODE_SIZE)
+    xrecord_add_number (&x, &xlen, &xsize, "size", st->archive_file_size);
+  if (overflow & PAX_ENCODE_UID)
+    xrecord_add_number (&x, &xlen, &xsize, "uid", st->stat.st_uid);
+  if (overflow & PAX_ENCODE_GID)
+    xrecord_add_number (&x, &xlen, &xsize, "gid", st->stat.st_gid);
+  if (overflow & PAX_ENCODE_UNAME)
+    xrecord_add (&x, &xlen, &xsize, "uname", st->uname);
+  if (overflow & PAX_ENCODE_GNAME)
+    xrecord_add (&x, &xlen, &xsize, "gname", st->gname);
+  if (overflow & PAX_ENCODE_DEV)
+    {
+      xrecord_add_number (&x, &xlen, &xsize, "SCHILY.devmajor",
+			  st->devmajor);
+      xrecord_add_number (&x, &xlen, &xsize, "SCHILY.devminor",
+			  st->devminor);
+    }
+
+  /* The header could not hold the fraction of the time, or the time
+     itself.  Readers that find an extended header expect it to be
+     exact.  */
+  xrecord_add_time (&x, &xlen, &xsize, "mtime", st->stat.st_mtime,
+		    st->mtime_nsec);
+
+  /* Name the header DIR/PaxHeaders/BASE, as tar does by default */
+  struct tar_stat_info hst = *st;
+  char const *base = last_component (st->file_name);
+  idx_t dirlen = base - st->file_name;
+  static char const pax_dir[] = "PaxHeaders/";
+  char *name = ximalloc ((dirlen ? dirlen : 2) + sizeof pax_dir - 1
+			 + strlen (base) + 1);
+  if (dirlen)
+    memcpy (name, st->file_name, dirlen);
+  else
+    memcpy (name, "./", dirlen = 2);
+  strcpy (stpcpy (name + dirlen, pax_dir), base);
+
+  hst.file_name = name;
+  hst.link_name = nullptr;
+  hst.stat.st_mode = S_IFREG | S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+  hst.archive_file_size = xlen;
+  pax_encode_header ((union block *) slot_grow (slot, BLOCKSIZE), &hst,
+		     XHDTYPE, slot->pc->format);
+  slot_add_padded (slot, x, xlen);
+  free (name);
+  free (x);
+}
+
+/* Append to SLOT the headers of its member, of the given TYPEFLAG, or
+   of the type of the file if TYPEFLAG is 0.  Return false if the member
+   cannot be represented in the archive format.  */
+static bool
+create_headers (struct create_slot *slot, char typeflag)
+{
+  struct tar_stat_info *st = &slot->st;
+  enum archive_format format = slot->pc->format;
+  union block blk;
+  int overflow = pax_encode_header (&blk, st, typeflag, format);
+
+  if (overflow)
+    switch (format)
+      {
+      case OLDGNU_FORMAT:
+      case GNU_FORMAT:
+	/* Numbers are in base-256 already; only names may overflow.
+	   Owner names are left truncated, as tar does.  */
+	if (overflow & ~(PAX_ENCODE_NAME | PAX_ENCODE_LINKNAME
+			 | PAX_ENCODE_UNAME | PAX_ENCODE_GNAME))
+	  return false;
+	if (overflow & PAX_ENCODE_LINKNAME)
+	  create_long_name (slot, GNUTYPE_LONGLINK, st->link_name);
+	if (overflow & PAX_ENCODE_NAME)
+	  create_long_name (slot, GNUTYPE_LONGNAME, st->file_name);
+	break;
+
+      case POSIX_FORMAT:
+	create_xheader (slot, overflow);
+	break;
+
+      default:
+	return false;
+      }
+
+  memcpy (slot_grow (slot, BLOCKSIZE), &blk, BLOCKSIZE);
+  slot->typeflag = blk.header.typeflag;
+  return true;
+}
+
+
+/* Hard links */
+
+/* Return true if the file of SLOT may have been archived already */
+static bool
+create_link_candidate (struct create_slot const *slot)
+{
+  return (!S_ISDIR (slot->st.stat.st_mode) && slot->st.stat.st_nlink > 1
+	  && !slot->hard_link);
+}
+
+/* Look the file of SLOT up in the table of links, and return a copy of
+   the name of its first member, if any.  If ADD, and there is none,
+   enter the member of SLOT as the first for the file.  */
+static char *
+create_link_target (struct create_slot *slot, bool add)
+{
+  struct pax_create *pc = slot->pc;
+  struct tar_stat_info *st = &slot->st;
+  char *target = nullptr;
+
+  pthread_mutex_lock (&pc->mutex);
+  char const *name;
+  if (add)
+    name = pax_hlink_add_stat (pc->links, &st->stat, st->file_name);
+  else
+    name = pax_hlink_find_stat (pc->links, &st->stat);
+  if (name)
+    target = pax_stat_memdup0 (st, name, strlen (name));
+  pthread_mutex_unlock (&pc->mutex);
+  return target;
+}
+
+/* Replace the headers of SLOT, if any, with those of a hard link to the
+   member TARGET.  Return false, leaving SLOT alone, if the archive
+   format cannot represent the link.  */
+static bool
+create_link (struct create_slot *slot, char *target)
+{
+  struct tar_stat_info *st = &slot->st;
+  char *link_name = st->link_name;
+  off_t size = st->archive_file_size;
+  idx_t len = slot->data_len;
+
+  st->link_name = target;
+  st->archive_file_size = 0;
+  if (!create_headers (slot, LNKTYPE))
+    {
+      st->link_name = link_name;
+      st->archive_file_size = size;
+      return false;
+    }
+  memmove (slot->data, slot->data + len, slot->data_len - len);
+  slot->data_len -= len;
+  slot->hard_link = true;
+  return true;
+}
+
+
+/* Workers */
+
+static void
+slot_fail (struct create_slot *slot, void (*diag) (char const *))
+{
+  slot->err = errno;
+  slot->diag = diag;
+}
+
+/* Fill the fields of the member of SLOT that depend on the type of its
+   file.  Return false on failure.  */
+static bool
+create_type (struct create_slot *slot)
+{
+  struct tar_stat_info *st = &slot->st;
+
+  switch (st->stat.st_mode & S_IFMT)
+    {
+    case S_IFREG:
+      st->archive_file_size = st->stat.st_size;
+      break;
+
+    case S_IFLNK:
+      {
+	idx_t size = st->stat.st_size + 1;
+	char *link = pax_stat_alloc (st, size);
+	ssize_t n = readlink (slot->file_name, link, size);
+	if (n < 0)
+	  {
+	    slot_fail (slot, readlink_error);
+	    return false;
+	  }
+	if (n == size)
+	  {
+	    /* The link changed under us */
+	    errno = ENAMETOOLONG;
+	    slot_fail (slot, readlink_error);
+	    return false;
+	  }
+	link[n] = '\0';
+	st->link_name = link;
+      }
+      break;
+
+    case S_IFCHR:
+    case S_IFBLK:
+      st->devmajor = major (st->stat.st_rdev);
+      st->devminor = minor (st->stat.st_rdev);
+      break;
+
+    case S_IFDIR:
+    case S_IFIFO:
+      break;
+
+    case S_IFSOCK:
+      slot->skip_reason = N_("%s: socket ignored");
+      return false;
+
+    default:
+      slot->skip_reason = N_("%s: Unknown file type; file ignored");
+      return false;
+    }
+  return true;
+}
+
+/* Fill ST from the file of SLOT and append the member headers.  Return
+   false on failure.  */
+static bool
+create_stat (struct create_slot *slot)
+{
+  struct tar_stat_info *st = &slot->st;
+  char const *name = slot->archive_name;
+  idx_t len = strlen (name);
+
+  if (slot->have_stat)
+    pax_stat_set_times (st, slot->pc->format, slot->pc->stat_flags);
+  else
+    {
+      int rc = pax_stat_capture (st, AT_FDCWD, slot->file_name,
+				 slot->pc->format, slot->pc->stat_flags);
+      if (rc)
+	{
+	  errno = rc;
+	  slot_fail (slot, stat_error);
+	  return false;
+	}
+    }
+
+  /* Like tar, mark directories with a trailing slash */
+  if (S_ISDIR (st->stat.st_mode) && !(len > 0 && name[len - 1] == '/'))
+    {
+      st->file_name = pax_stat_alloc (st, len + 2);
+      memcpy (st->file_name, name, len);
+      strcpy (st->file_name + len, "/");
+    }
+  else
+    st->file_name = pax_stat_memdup0 (st, name, len);
+  st->orig_file_name = st->file_name;
+  pax_stat_set_owner_names (st);
+
+  if (create_link_candidate (slot))
+    {
+      char *target = create_link_target (slot, false);
+      if (target && create_link (slot, target))
+	return true;
+    }
+  if (!create_type (slot))
+    return false;
+  if (!create_headers (slot, 0))
+    {
+      slot->skip_reason = N_("%s: Cannot be represented in this archive "
+			     "format; not dumped");
+      return false;
+    }
+  return true;
+}
+
+/* Read up to PAX_CREATE_CHUNK bytes of the contents of SLOT */
+static void
+create_read (struct create_slot *slot)
+{
+  off_t size = slot->st.archive_file_size;
+  int fd = open (slot->file_name, O_RDONLY | O_NOCTTY);
+
+  if (fd < 0)
+    {
+      slot_fail (slot, open_error);
+      return;
+    }
+
+  idx_t len = size < PAX_CREATE_CHUNK ? size : PAX_CREATE_CHUNK;
+  idx_t padded = (len + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE;
+  char *p = slot_grow (slot, padded);
+  idx_t got = 0;
+
+  while (got < len)
+    {
+      size_t n = safe_read (fd, p + got, len - got);
+      if (n == SAFE_READ_ERROR)
+	{
+	  slot_fail (slot, read_error);
+	  close (fd);
+	  return;
+	}
+      if (n == 0)
+	break;
+      got += n;
+    }
+  memset (p + got, 0, padded - got);
+
+  if (got < len)
+    {
+      slot->shrunk = size - got;
+      close (fd);
+    }
+  else if (len < size)
+    {
+      slot->fd = fd;
+      slot->remaining = size - len;
+    }
+  else
+    close (fd);
+}
+
+static void
+create_job (void *arg)
+{
+  struct create_slot *slot = arg;
+  struct pax_create *pc = slot->pc;
+
+  if (create_stat (slot) && S_ISREG (slot->st.stat.st_mode)
+      && slot->st.archive_file_size > 0)
+    create_read (slot);
+
+  pthread_mutex_lock (&pc->mutex);
+  slot->done = true;
+  pthread_cond_broadcast (&pc->cond);
+  pthread_mutex_unlock (&pc->mutex);
+}
+
+
+/* Committing */
+
+static int
+create_write (struct pax_create *pc, char *data, idx_t len)
+{
+  idx_t n;
+
+  if (paxbuf_write (pc->buf, data, len, &n) != pax_io_success || n != len)
+    return EIO;
+  return 0;
+}
+
+/* Copy the contents of SLOT left in its file to the archive.  */
+static int
+create_copy_rest (struct pax_create *pc, struct create_slot *slot)
+{
+  bool pad = false;
+  int rc = 0;
+
+  if (!pc->copy_buf)
+    pc->copy_buf = ximalloc (PAX_CREATE_CHUNK);
+  while (rc == 0 && slot->remaining > 0)
+    {
+      idx_t len = (slot->remaining < PAX_CREATE_CHUNK
+		   ? slot->remaining : PAX_CREATE_CHUNK);
+      size_t n = pad ? 0 : safe_read (slot->fd, pc->copy_buf, len);
+
+      /* The header is out already, so the member is padded with zeros
+	 up to the size it declares, as tar does.  */
+      if (n == SAFE_READ_ERROR)
+	{
+	  read_error (slot->file_name);
+	  pad = true;
+	  n = 0;
+	}
+      else if (n == 0 && !pad)
+	{
+	  slot->shrunk = slot->remaining;
+	  pad = true;
+	}
+      if (n == 0)
+	{
+	  n = len;
+	  memset (pc->copy_buf, 0, n);
+	}
+      idx_t padded = n;
+      if (n == slot->remaining)
+	{
+	  padded = (n + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE;
+	  memset (pc->copy_buf + n, 0, padded - n);
+	}
+      slot->remaining -= n;
+      rc = create_write (pc, pc->copy_buf, padded);
+    }
+  return rc;
+}
+
+/* Wait for the oldest member to be prepared, and write it out.  */
+static int
+create_commit (struct pax_create *pc)
+{
+  struct create_slot *slot = &pc->ring[pc->head % pc->depth];
+  int rc = 0;
+
+  pthread_mutex_lock (&pc->mutex);
+  while (!slot->done)
+    pthread_cond_wait (&pc->cond, &pc->mutex);
+  pthread_mutex_unlock (&pc->mutex);
+
+  if (slot->err)
+    {
+      errno = slot->err;
+      slot->diag (slot->file_name);
+    }
+  else if (slot->skip_reason)
+    paxwarn (0, _(slot->skip_reason), quotearg_colon (slot->file_name));
+  else
+    {
+      if (create_link_candidate (slot))
+	{
+	  char *target = create_link_target (slot, true);
+	  if (target && create_link (slot, target))
+	    {
+	      if (slot->fd >= 0)
+		{
+		  close (slot->fd);
+		  slot->fd = -1;
+		}
+	      slot->remaining = slot->shrunk = 0;
+	    }
+	}
+      off_t offset = paxbuf_tell (pc->buf);
+      rc = create_write (pc, slot->data, slot->data_len);
+      if (rc == 0 && pc->mindex)
+	pax_mindex_add (pc->mindex, slot->st.file_name, offset,
+			slot->st.archive_file_size, slot->typeflag);
+      if (rc == 0 && slot->fd >= 0)
+	rc = create_copy_rest (pc, slot);
+      if (slot->shrunk)
+	paxerror (0, _("%s: File shrank by %jd bytes; padding with zeros"),
+		  quotearg_colon (slot->file_name), (intmax_t) slot->shrunk);
+    }
+
+  if (slot->fd >= 0)
+    {
+      close (slot->fd);
+      slot->fd = -1;
+    }
+  pax_stat_reset (&slot->st);
+  pc->head++;
+  return rc;
+}
+
+
+/* Interface */
+
+/* Create in *PPC a pipeline writing members to BUF in the given FORMAT,
+   using NTHREADS worker threads (all available processors if NTHREADS
+   is not positive).  Return 0 on success, an errno value otherwise.  */
+int
+pax_create_open (pax_create_t *ppc, paxbuf_t buf, enum archive_format format,
+		 int nthreads)
+{
+  struct pax_create *pc = calloc (1, sizeof *pc);
+  if (!pc)
+    return ENOMEM;
+  int rc = pax_pool_create (&pc->pool, nthreads);
+  if (rc)
+    {
+      free (pc);
+      return rc;
+    }
+  pc->buf = buf;
+  pc->format = format;
+  pc->depth = 2 * pax_pool_size (pc->pool);
+  pc->ring = calloc (pc->depth, sizeof pc->ring[0]);
+  if (!pc->ring)
+    {
+      pax_pool_destroy (&pc->pool);
+      free (pc);
+      return ENOMEM;
+    }
+  for (idx_t i = 0; i < pc->depth; i++)
+    {
+      pc->ring[i].pc = pc;
+      pc->ring[i].fd = -1;
+    }
+  pc->links = pax_hlink_create (PAX_CREATE_HLINK_MEMORY);
+  pthread_mutex_init (&pc->mutex, nullptr);
+  pthread_cond_init (&pc->cond, nullptr);
+  *ppc = pc;
+  return 0;
+}
+
+/* Make PC get the status of files by pax_stat_capture with FLAGS, or
+   take the times given to pax_create_add_stat according to FLAGS.  */
+void
+pax_create_set_stat_flags (pax_create_t pc, int flags)
+{
+  pc->stat_flags = flags;
+}
+
+/* Make PC enter the members it writes in the index IDX, which the
+   caller writes out once the archive is finished.  */
+void
+pax_create_set_mindex (pax_create_t pc, struct pax_mindex *idx)
+{
+  pc->mindex = idx;
+}
+
+/* Queue the file FILE_NAME to be archived as ARCHIVE_NAME, or under
+   its own name if ARCHIVE_NAME is null.  Files that cannot be read are
+   diagnosed and left out of the archive.  Return 0 on success, an errno
+   value if writing the archive failed.  */
+int
+pax_create_add (pax_create_t pc, char const *file_name,
+		char const *archive_name)
+{
+  return pax_create_add_stat (pc, file_name, archive_name, nullptr);
+}
+
+/* Likewise, but if ST is not null, take it as the status of the file,
+   as from pax_stat_lstat, instead of getting it again.  */
+int
+pax_create_add_stat (pax_create_t pc, char const *file_name,
+		     char const *archive_name, struct stat const *st)
+{
+  int rc = 0;
+
+  if (pc->tail - pc->head == pc->depth)
+    rc = create_commit (pc);
+
+  struct create_slot *slot = &pc->ring[pc->tail % pc->depth];
+  idx_t flen = strlen (file_name) + 1;
+  idx_t alen = archive_name ? strlen (archive_name) + 1 : 0;
+  if (slot->names_size < flen + alen)
+    {
+      free (slot->file_name);
+      slot->file_name = xpalloc (nullptr, &slot->names_size,
+				 flen + alen - slot->names_size, -1, 1);
+    }
+  memcpy (slot->file_name, file_name, flen);
+  if (archive_name)
+    {
+      slot->archive_name = slot->file_name + flen;
+      memcpy (slot->archive_name, archive_name, alen);
+    }
+  else
+    slot->archive_name = slot->file_name;
+  slot->data_len = 0;
+  slot->remaining = slot->shrunk = 0;
+  slot->err = 0;
+  slot->diag = nullptr;
+  slot->skip_reason = nullptr;
+  slot->hard_link = false;
+  slot->have_stat = st != nullptr;
+  if (st)
+    slot->st.stat = *st;
+  slot->done = false;
+  pc->tail++;
+  pax_pool_submit (pc->pool, create_job, slot);
+  return rc;
+}
+
+/* Write out all queued members, followed by the end-of-archive marker.
+   Return 0 on success, an errno value otherwise.  */
+int
+pax_create_finish (pax_create_t pc)
+{
+  static char const eoa[2 * BLOCKSIZE];
+  int rc = 0;
+
+  while (pc->head < pc->tail)
+    {
+      int r = create_commit (pc);
+      if (!rc)
+	rc = r;
+    }
+  if (!rc)
+    rc = create_write (pc, (char *) eoa, sizeof eoa);
+  return rc;
+}
+
+/* Free *PPC.  Members not yet committed are discarded.  */
+void
+pax_create_destroy (pax_create_t *ppc)
+{
+  struct pax_create *pc = *ppc;
+
+  pax_pool_destroy (&pc->pool);
+  for (idx_t i = 0; i < pc->depth; i++)
+    {
+      struct create_slot *slot = &pc->ring[i];
+      if (slot->fd >= 0)
+	close (slot->fd);
+      pax_stat_destroy (&slot->st);
+      free (slot->file_name);
+      free (slot->data);
+    }
+  pthread_cond_destroy (&pc->cond);
+  pthread_mutex_destroy (&pc->mutex);
+  free (pc->ring);
+  free (pc->copy_buf);
+  pax_hlink_destroy (&pc->links);
+  free (pc);
+  *ppc = nullptr;
+}
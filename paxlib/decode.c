@@ -0,0 +1,292 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Decoding of tar headers */
+
+#include <system.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+
+/* Number of bits in a base-256 digit */
+enum { LG_256 = 8 };
+
+/* Decode the numeric header field WHERE, DIGS bytes long.  The field is
+   either octal, optionally preceded by blanks and terminated by a blank
+   or null, or base-256: in the latter case the high bit of the first
+   byte is set and the rest of the field is a big-endian two's
+   complement number.  If the field is valid and its value lies in
+   [MINVAL, MAXVAL], store it in *VAL and return true.  Otherwise return
+   false.  */
+bool
+pax_decode_number (char const *where, idx_t digs,
+		   intmax_t minval, uintmax_t maxval, intmax_t *val)
+{
+  unsigned char const *p = (unsigned char const *) where;
+  unsigned char const *lim = p + digs;
+
+  if (digs <= 0)
+    return false;
+
+  if (*p & 0x80)
+    {
+      /* Base-256.  Bit 6 of the first byte is the sign.  */
+      bool negative = *p & 0x40;
+      uintmax_t u = *p & 0x3f;
+      if (negative)
+	u |= ~(uintmax_t) 0x3f;
+      while (++p < lim)
+	{
+	  /* The bits shifted out, along with the new sign bit, must all
+	     equal the sign.  */
+	  intmax_t top = u;
+	  if (top >> (TYPE_WIDTH (uintmax_t) - LG_256 - 1) != -negative)
+	    return false;
+	  u = (u << LG_256) | *p;
+	}
+      intmax_t v = u;
+      if (negative ? v < minval : u > maxval)
+	return false;
+      *val = v;
+      return true;
+    }
+
+  while (p < lim && *p == ' ')
+    p++;
+  if (p == lim)
+    return false;
+
+  /* The longest numeric field is 12 bytes, or 36 bits: no overflow
+     check is needed in the loop.  */
+  uintmax_t u = 0;
+  unsigned char const *start = p;
+  unsigned d;
+  if (lim - p > TYPE_WIDTH (uintmax_t) / 3)
+    return false;
+  for (; p < lim && (d = *p - '0') < 8; p++)
+    u = (u << 3) | d;
+  if (p == start || (p < lim && *p != ' ' && *p != '\0') || u > maxval)
+    return false;
+  *val = u;
+  return true;
+}
+
+/* Return the format of the header BLK */
+enum archive_format
+pax_header_format (union block const *blk)
+{
+  struct posix_header const *h = &blk->header;
+
+  if (memcmp (h->magic, TMAGIC, TMAGLEN) == 0)
+    {
+      struct star_header const *sh = &blk->star_header;
+      if (sh->prefix[sizeof sh->prefix - 1] == 0
+	  && (unsigned char) (sh->atime[0] - '0') < 8
+	  && sh->atime[sizeof sh->atime - 1] == ' '
+	  && (unsigned char) (sh->ctime[0] - '0') < 8
+	  && sh->ctime[sizeof sh->ctime - 1] == ' ')
+	return STAR_FORMAT;
+      if (h->typeflag == XHDTYPE || h->typeflag == XGLTYPE)
+	return POSIX_FORMAT;
+      return USTAR_FORMAT;
+    }
+  if (memcmp (h->magic, OLDGNU_MAGIC, sizeof OLDGNU_MAGIC) == 0)
+    return OLDGNU_FORMAT;
+  return V7_FORMAT;
+}
+
+/* Return a copy of the SIZE-byte header field SRC, which need not be
+   null-terminated, allocated in the arena of ST.  */
+static char *
+field_dup (struct tar_stat_info *st, char const *src, idx_t size)
+{
+  return pax_stat_memdup0 (st, src, strnlen (src, size));
+}
+
+static mode_t
+type_mode (char typeflag)
+{
+  switch (typeflag)
+    {
+    case DIRTYPE:
+    case GNUTYPE_DUMPDIR:
+      return S_IFDIR;
+    case SYMTYPE:
+      return S_IFLNK;
+    case CHRTYPE:
+      return S_IFCHR;
+    case BLKTYPE:
+      return S_IFBLK;
+    case FIFOTYPE:
+      return S_IFIFO;
+    default:
+      return S_IFREG;
+    }
+}
+
+static bool
+decode_time (char const *field, idx_t size, time_t *t)
+{
+  intmax_t v;
+
+  if (!pax_decode_number (field, size, TYPE_MINIMUM (time_t),
+			  TYPE_MAXIMUM (time_t), &v))
+    return false;
+  *t = v;
+  return true;
+}
+
+/* Append to the sparse map of ST the N descriptors at SP, stopping at
+   the first empty one.  Return false if a descriptor is malformed.  */
+bool
+pax_decode_sparse (struct tar_stat_info *st, struct sparse const *sp, int n)
+{
+  for (int i = 0; i < n && sp[i].offset[0]; i++)
+    {
+      intmax_t offset, numbytes;
+
+      if (!pax_decode_number (sp[i].offset, sizeof sp[i].offset,
+			      0, TYPE_MAXIMUM (off_t), &offset)
+	  || !pax_decode_number (sp[i].numbytes, sizeof sp[i].numbytes,
+				 0, TYPE_MAXIMUM (off_t), &numbytes))
+	return false;
+      pax_stat_sparse_add (st, offset, numbytes);
+    }
+  return true;
+}
+
+/* Verify the header BLK and decode it into ST, which is reset first:
+   its strings are allocated in its arena.  The format of the header is
+   stored in *PFORMAT, unless PFORMAT is null.  Extended
+   headers (long names, pax headers, sparse extension headers) are not
+   interpreted: ST describes the header block itself.  */
+enum pax_header_status
+pax_decode_header (union block const *blk, struct tar_stat_info *st,
+		   enum archive_format *pformat)
+{
+  struct posix_header const *h = &blk->header;
+  enum pax_header_status status = pax_header_checksum (blk);
+  enum archive_format format;
+  intmax_t mode, uid, gid, size;
+
+  if (status != PAX_HEADER_SUCCESS)
+    return status;
+  format = pax_header_format (blk);
+  if (pformat)
+    *pformat = format;
+  pax_stat_reset (st);
+
+  if (!pax_decode_number (h->mode, sizeof h->mode, 0, INTMAX_MAX, &mode)
+      || !pax_decode_number (h->uid, sizeof h->uid, 0,
+			     TYPE_MAXIMUM (uid_t), &uid)
+      || !pax_decode_number (h->gid, sizeof h->gid, 0,
+			     TYPE_MAXIMUM (gid_t), &gid)
+      || !pax_decode_number (h->size, sizeof h->size, 0,
+			     TYPE_MAXIMUM (off_t), &size)
+      || !decode_time (h->mtime, sizeof h->mtime, &st->stat.st_mtime))
+    return PAX_HEADER_FAILURE;
+
+  /* Name */
+  idx_t prefix_size = 0;
+  if (format == USTAR_FORMAT || format == POSIX_FORMAT)
+    prefix_size = sizeof h->prefix;
+  else if (format == STAR_FORMAT)
+    prefix_size = sizeof blk->star_header.prefix;
+  if (prefix_size && h->prefix[0])
+    {
+      idx_t plen = strnlen (h->prefix, prefix_size);
+      idx_t nlen = strnlen (h->name, sizeof h->name);
+      char *name = pax_stat_alloc (st, plen + nlen + 2);
+      memcpy (name, h->prefix, plen);
+      name[plen] = '/';
+      memcpy (name + plen + 1, h->name, nlen);
+      name[plen + 1 + nlen] = 0;
+      st->orig_file_name = name;
+    }
+  else
+    st->orig_file_name = field_dup (st, h->name, sizeof h->name);
+  st->file_name = pax_stat_memdup0 (st, st->orig_file_name,
+				    strlen (st->orig_file_name));
+  st->link_name = field_dup (st, h->linkname, sizeof h->linkname);
+
+  /* Owner names are meaningful only if there is a magic */
+  if (format != V7_FORMAT)
+    {
+      st->uname = field_dup (st, h->uname, sizeof h->uname);
+      st->gname = field_dup (st, h->gname, sizeof h->gname);
+    }
+
+  st->stat.st_mode = (mode & 07777) | type_mode (h->typeflag);
+  /* Old tars mark directories with a trailing slash */
+  if (h->typeflag == AREGTYPE)
+    {
+      idx_t len = strlen (st->orig_file_name);
+      if (len > 0 && st->orig_file_name[len - 1] == '/')
+	st->stat.st_mode = (mode & 07777) | S_IFDIR;
+    }
+  st->stat.st_uid = uid;
+  st->stat.st_gid = gid;
+  st->stat.st_size = st->archive_file_size = size;
+  st->stat.st_atime = st->stat.st_ctime = st->stat.st_mtime;
+
+  if (format != V7_FORMAT
+      && (h->typeflag == CHRTYPE || h->typeflag == BLKTYPE))
+    {
+      intmax_t major, minor;
+      if (!pax_decode_number (h->devmajor, sizeof h->devmajor,
+			      0, UINT_MAX, &major)
+	  || !pax_decode_number (h->devminor, sizeof h->devminor,
+				 0, UINT_MAX, &minor))
+	return PAX_HEADER_FAILURE;
+      st->devmajor = major;
+      st->devminor = minor;
+    }
+
+  /* Additional times: incremental archives in old GNU format, and star */
+  if (format == OLDGNU_FORMAT)
+    {
+      struct oldgnu_header const *gh = &blk->oldgnu_header;
+      if (gh->atime[0] && !decode_time (gh->atime, sizeof gh->atime,
+					&st->stat.st_atime))
+	return PAX_HEADER_FAILURE;
+      if (gh->ctime[0] && !decode_time (gh->ctime, sizeof gh->ctime,
+					&st->stat.st_ctime))
+	return PAX_HEADER_FAILURE;
+    }
+  else if (format == STAR_FORMAT)
+    {
+      struct star_header const *sh = &blk->star_header;
+      if (!decode_time (sh->atime, sizeof sh->atime, &st->stat.st_atime)
+	  || !decode_time (sh->ctime, sizeof sh->ctime, &st->stat.st_ctime))
+	return PAX_HEADER_FAILURE;
+    }
+
+  /* Old GNU sparse files */
+  if (h->typeflag == GNUTYPE_SPARSE)
+    {
+      struct oldgnu_header const *gh = &blk->oldgnu_header;
+      intmax_t realsize;
+      if (!pax_decode_number (gh->realsize, sizeof gh->realsize,
+			      0, TYPE_MAXIMUM (off_t), &realsize)
+	  || !pax_decode_sparse (st, gh->sp, SPARSES_IN_OLDGNU_HEADER))
+	return PAX_HEADER_FAILURE;
+      st->is_sparse = true;
+      st->stat.st_size = realsize;
+    }
+
+  return PAX_HEADER_SUCCESS;
+}
@@ -0,0 +1,613 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Chunks are cut with a gear hash, as in FastCDC: the hash is shifted
+   left by one bit per byte and added a random value for that byte, so
+   that its top bits depend on the last few dozen bytes only.  A chunk
+   ends where those bits are all zero, with a stricter mask before the
+   average size than after it, which narrows the spread of sizes.  The
+   hash is restarted at each cut, so the cuts depend on the data only,
+   not on how they were handed to the filter.
+
+   A chunk file is written under a temporary name and renamed, so that
+   a file of the store always holds a whole chunk.  The store is synced
+   once, before the end of the manifest is written.
+
+   Manifest layout.  All numbers are little-endian.
+     magic        8 bytes
+     version      4      1
+     reserved     4
+   followed by one record (DEDUP_RECORD bytes) per chunk:
+     digest       32     SHA-256 of the chunk
+     length       4      length of the chunk  */
+
+#include <system.h>
+#include <pthread.h>
+#include <hash.h>
+#include <obstack.h>
+#include <sha256.h>
+#include <paxbuf.h>
+#include <dedup.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+static char const dedup_magic[8] = "PAXDEDUP";
+enum
+  {
+    DEDUP_HEADER = 16,
+    DEDUP_RECORD = SHA256_DIGEST_SIZE + 4
+  };
+
+/* Masks of the top bits tested before and after the average size */
+#define DEDUP_MASK_S (((UINT64_C (1) << 18) - 1) << 46)
+#define DEDUP_MASK_L (((UINT64_C (1) << 14) - 1) << 50)
+
+static uint_least64_t gear[256];
+
+static void
+gear_init (void)
+{
+  /* splitmix64, from a fixed seed: the cuts must not change between
+     runs or builds.  */
+  uint_least64_t x = 0x7061787574696c73;
+  for (int i = 0; i < 256; i++)
+    {
+      uint_least64_t z = (x += 0x9e3779b97f4a7c15);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+      gear[i] = (z ^ (z >> 31)) & UINT64_MAX;
+    }
+}
+
+static void
+put_le (unsigned char *p, uint_least64_t v, int n)
+{
+  while (n--)
+    {
+      *p++ = v & 0xff;
+      v >>= 8;
+    }
+}
+
+static uint_least64_t
+get_le (unsigned char const *p, int n)
+{
+  uint_least64_t v = 0;
+  while (n--)
+    v = (v << 8) | p[n];
+  return v;
+}
+
+/* Store in NAME, of at least STORE_LEN + 2 * SHA256_DIGEST_SIZE + 3
+   bytes, the file name of the chunk of the given DIGEST in STORE: a
+   directory named after its first byte, holding a file named after the
+   others.  Return the length of the directory part.  */
+static idx_t
+chunk_file_name (char *name, char const *store, idx_t store_len,
+		 unsigned char const *digest)
+{
+  static char const hex[] = "0123456789abcdef";
+  char *p = mempcpy (name, store, store_len);
+
+  *p++ = '/';
+  for (int i = 0; i < SHA256_DIGEST_SIZE; i++)
+    {
+      if (i == 1)
+	*p++ = '/';
+      *p++ = hex[digest[i] >> 4];
+      *p++ = hex[digest[i] & 0xf];
+    }
+  *p = '\0';
+  return store_len + 3;
+}
+
+
+/* Writing */
+
+struct dedup
+{
+  char *store;                /* Store directory */
+  idx_t store_len;
+  char *name;                 /* Chunk file name */
+  unsigned char *data;        /* Data not yet cut into chunks */
+  idx_t len;                  /* Length of data */
+  idx_t scan;                 /* Bytes of data hashed so far */
+  uint_least64_t hash;        /* Hash at scan */
+  bool started;               /* The manifest header was written */
+  Hash_table *seen;           /* Digests stored by this run */
+  struct obstack digests;
+};
+
+static size_t
+digest_hasher (void const *entry, size_t n)
+{
+  return get_le (entry, 8) % n;
+}
+
+static bool
+digest_compare (void const *a, void const *b)
+{
+  return memcmp (a, b, SHA256_DIGEST_SIZE) == 0;
+}
+
+static pax_io_status_t
+dedup_out (paxbuf_t buf, void const *data, idx_t size)
+{
+  char const *p = data;
+
+  while (size > 0)
+    {
+      idx_t n;
+      if (paxbuf_transport_write (buf, (void *) p, size, &n) != pax_io_success)
+	return pax_io_failure;
+      if (n == 0)
+	return pax_io_failure;
+      p += n;
+      size -= n;
+    }
+  return pax_io_success;
+}
+
+/* Return the length of the chunk at the start of the data of DD, or 0
+   if more data are needed to tell.  At EOF, the rest of the data make
+   the last chunk.  */
+static idx_t
+dedup_cut (struct dedup *dd, bool eof)
+{
+  unsigned char const *p = dd->data;
+  idx_t n = dd->len;
+  idx_t i = dd->scan;
+  uint_least64_t h = dd->hash;
+  idx_t avg = n < PAX_DEDUP_AVG_CHUNK ? n : PAX_DEDUP_AVG_CHUNK;
+  idx_t max = n < PAX_DEDUP_MAX_CHUNK ? n : PAX_DEDUP_MAX_CHUNK;
+
+  if (i < PAX_DEDUP_MIN_CHUNK)
+    i = n < PAX_DEDUP_MIN_CHUNK ? n : PAX_DEDUP_MIN_CHUNK;
+  for (; i < avg; i++)
+    {
+      h = ((h << 1) + gear[p[i]]) & UINT64_MAX;
+      if (!(h & DEDUP_MASK_S))
+	return i + 1;
+    }
+  for (; i < max; i++)
+    {
+      h = ((h << 1) + gear[p[i]]) & UINT64_MAX;
+      if (!(h & DEDUP_MASK_L))
+	return i + 1;
+    }
+  if (i == PAX_DEDUP_MAX_CHUNK)
+    return i;
+
+  dd->scan = i;
+  dd->hash = h;
+  return eof ? n : 0;
+}
+
+/* Write the chunk of LEN bytes at DATA, of the given DIGEST, to the
+   store.  Return 0 on success, an errno value otherwise.  */
+static int
+chunk_store (struct dedup *dd, unsigned char const *data, idx_t len,
+	     unsigned char const *digest)
+{
+  char *name = dd->name;
+  idx_t dirlen = chunk_file_name (name, dd->store, dd->store_len, digest);
+  idx_t namelen = strlen (name);
+  struct stat st;
+
+  /* Already there from an earlier archive */
+  if (stat (name, &st) == 0 && st.st_size == len)
+    return 0;
+
+  sprintf (name + namelen, ".%jd", (intmax_t) getpid ());
+  int fd = open (name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0 && errno == ENOENT)
+    {
+      name[dirlen] = '\0';
+      if (mkdir (name, 0777) != 0 && errno != EEXIST)
+	return errno;
+      name[dirlen] = '/';
+      fd = open (name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    }
+  if (fd < 0)
+    return errno;
+
+  int rc = 0;
+  if (full_write (fd, data, len) != len)
+    rc = errno ? errno : EIO;
+  if (close (fd) != 0 && rc == 0)
+    rc = errno;
+  if (rc == 0)
+    {
+      char *tmp = ximemdup0 (name, strlen (name));
+      name[namelen] = '\0';
+      if (rename (tmp, name) != 0)
+	rc = errno;
+      free (tmp);
+    }
+  if (rc)
+    {
+      sprintf (name + namelen, ".%jd", (intmax_t) getpid ());
+      unlink (name);
+    }
+  return rc;
+}
+
+/* Store the chunk of LEN bytes at the start of the data of DD, if it is
+   not there already, and list it in the manifest.  */
+static pax_io_status_t
+dedup_chunk (paxbuf_t buf, struct dedup *dd, idx_t len)
+{
+  unsigned char rec[DEDUP_RECORD];
+
+  sha256_buffer ((char const *) dd->data, len, rec);
+  if (!hash_lookup (dd->seen, rec))
+    {
+      int rc = chunk_store (dd, dd->data, len, rec);
+      if (rc)
+	{
+	  errno = rc;
+	  return pax_io_failure;
+	}
+      void *key = obstack_copy (&dd->digests, rec, SHA256_DIGEST_SIZE);
+      if (!hash_insert (dd->seen, key))
+	xalloc_die ();
+    }
+  put_le (rec + SHA256_DIGEST_SIZE, len, 4);
+  if (dedup_out (buf, rec, DEDUP_RECORD) != pax_io_success)
+    return pax_io_failure;
+
+  dd->len -= len;
+  memmove (dd->data, dd->data + len, dd->len);
+  dd->scan = 0;
+  dd->hash = 0;
+  return pax_io_success;
+}
+
+static pax_io_status_t
+dedup_start (paxbuf_t buf, struct dedup *dd)
+{
+  unsigned char head[DEDUP_HEADER];
+
+  if (dd->started)
+    return pax_io_success;
+  dd->started = true;
+  memcpy (head, dedup_magic, sizeof dedup_magic);
+  put_le (head + 8, 1, 4);
+  put_le (head + 12, 0, 4);
+  return dedup_out (buf, head, sizeof head);
+}
+
+static pax_io_status_t
+dedup_writer (paxbuf_t buf, void *fclosure, void *data, idx_t size,
+	      idx_t *ret_size)
+{
+  struct dedup *dd = fclosure;
+  char const *p = data;
+
+  *ret_size = 0;
+  if (dedup_start (buf, dd) != pax_io_success)
+    return pax_io_failure;
+  while (size > 0)
+    {
+      idx_t n = PAX_DEDUP_MAX_CHUNK - dd->len;
+      if (n > size)
+	n = size;
+      memcpy (dd->data + dd->len, p, n);
+      dd->len += n;
+      p += n;
+      size -= n;
+      *ret_size += n;
+
+      idx_t len;
+      while ((len = dedup_cut (dd, false)) > 0)
+	if (dedup_chunk (buf, dd, len) != pax_io_success)
+	  return pax_io_failure;
+    }
+  return pax_io_success;
+}
+
+static int
+dedup_close (paxbuf_t buf, void *fclosure, int mode)
+{
+  struct dedup *dd = fclosure;
+  idx_t len;
+
+  if (!(mode & PAXBUF_WRITE))
+    return 0;
+  if (dedup_start (buf, dd) != pax_io_success)
+    return -1;
+  while ((len = dedup_cut (dd, true)) > 0)
+    if (dedup_chunk (buf, dd, len) != pax_io_success)
+      return -1;
+
+  /* Make the chunks durable before the archive that refers to them */
+  int fd = open (dd->store, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+#if HAVE_SYNCFS
+  int rc = syncfs (fd);
+#else
+  int rc = fsync (fd);
+  sync ();
+#endif
+  close (fd);
+  return rc == 0 ? 0 : -1;
+}
+
+static int
+dedup_destroy (void *fclosure)
+{
+  struct dedup *dd = fclosure;
+
+  hash_free (dd->seen);
+  obstack_free (&dd->digests, nullptr);
+  free (dd->data);
+  free (dd->name);
+  free (dd->store);
+  free (dd);
+  return 0;
+}
+
+/* Install on BUF a filter keeping the data written to it in the chunk
+   store STORE, which is created if need be, and writing their manifest
+   instead.  Return 0 on success, an errno value otherwise.  */
+int
+paxbuf_set_dedup (paxbuf_t buf, char const *store)
+{
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+  if (!(paxbuf_get_mode (buf) & PAXBUF_WRITE))
+    return EINVAL;
+  if (mkdir (store, 0777) != 0 && errno != EEXIST)
+    return errno;
+  pthread_once (&once, gear_init);
+
+  struct dedup *dd = xzalloc (sizeof *dd);
+  dd->store_len = strlen (store);
+  dd->store = ximemdup0 (store, dd->store_len);
+  dd->name = ximalloc (dd->store_len + 2 * SHA256_DIGEST_SIZE + 3
+		       + INT_BUFSIZE_BOUND (intmax_t));
+  dd->data = ximalloc (PAX_DEDUP_MAX_CHUNK);
+  dd->seen = hash_initialize (0, nullptr, digest_hasher, digest_compare,
+			      nullptr);
+  if (!dd->seen)
+    xalloc_die ();
+  obstack_init (&dd->digests);
+  paxbuf_set_filter (buf, dd, nullptr, dedup_writer, dedup_destroy);
+  paxbuf_set_filter_close (buf, dedup_close);
+  return 0;
+}
+
+
+/* Reading */
+
+struct undedup
+{
+  char *store;
+  idx_t store_len;
+  char *name;                 /* Chunk file name */
+  bool loaded;                /* The manifest was read */
+  unsigned char *manifest;    /* Records of the manifest */
+  idx_t nchunks;
+  off_t *offsets;             /* Offset of each chunk, and the total */
+  idx_t cur;                  /* Chunk in data, or -1 */
+  char *data;
+  idx_t data_len;
+  off_t pos;                  /* Offset of the next byte to read */
+};
+
+/* Read the whole manifest.  Return false on failure.  */
+static bool
+undedup_load (paxbuf_t buf, struct undedup *ud)
+{
+  unsigned char head[DEDUP_HEADER];
+  idx_t size = 0, len = 0, n;
+  pax_io_status_t status;
+
+  if (ud->loaded)
+    return true;
+
+  for (idx_t got = 0; got < DEDUP_HEADER; got += n)
+    {
+      status = paxbuf_transport_read (buf, head + got, DEDUP_HEADER - got, &n);
+      if (status != pax_io_success || n == 0)
+	{
+	  errno = EINVAL;
+	  return false;
+	}
+    }
+  if (memcmp (head, dedup_magic, sizeof dedup_magic) != 0
+      || get_le (head + 8, 4) != 1)
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  for (;;)
+    {
+      if (size - len < DEDUP_RECORD)
+	ud->manifest = xpalloc (ud->manifest, &size, DEDUP_RECORD, -1, 1);
+      status = paxbuf_transport_read (buf, ud->manifest + len, size - len,
+				      &n);
+      if (status == pax_io_failure)
+	return false;
+      if (status == pax_io_eof || n == 0)
+	break;
+      len += n;
+    }
+  if (len % DEDUP_RECORD)
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  ud->nchunks = len / DEDUP_RECORD;
+  ud->offsets = xinmalloc (ud->nchunks + 1, sizeof *ud->offsets);
+  ud->offsets[0] = 0;
+  for (idx_t i = 0; i < ud->nchunks; i++)
+    {
+      idx_t clen = get_le (ud->manifest + i * DEDUP_RECORD
+			   + SHA256_DIGEST_SIZE, 4);
+      if (clen == 0 || clen > PAX_DEDUP_MAX_CHUNK)
+	{
+	  errno = EINVAL;
+	  return false;
+	}
+      ud->offsets[i + 1] = ud->offsets[i] + clen;
+    }
+  ud->loaded = true;
+  return true;
+}
+
+/* Read chunk I from the store and check its digest.  Return false on
+   failure.  */
+static bool
+undedup_fetch (struct undedup *ud, idx_t i)
+{
+  unsigned char const *rec = ud->manifest + i * DEDUP_RECORD;
+  unsigned char digest[SHA256_DIGEST_SIZE];
+  idx_t len = ud->offsets[i + 1] - ud->offsets[i];
+  struct stat st;
+  int err = 0;
+
+  chunk_file_name (ud->name, ud->store, ud->store_len, rec);
+  int fd = open (ud->name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  if (fstat (fd, &st) != 0)
+    err = errno;
+  else if (st.st_size != len)
+    err = EIO;
+  for (idx_t n = 0; !err && n < len; )
+    {
+      ssize_t rc = read (fd, ud->data + n, len - n);
+      if (rc <= 0)
+	err = rc == 0 ? EIO : errno;
+      else
+	n += rc;
+    }
+  close (fd);
+  if (!err)
+    {
+      sha256_buffer (ud->data, len, digest);
+      if (memcmp (digest, rec, SHA256_DIGEST_SIZE) != 0)
+	err = EIO;
+    }
+  if (err)
+    {
+      ud->cur = -1;
+      errno = err;
+      return false;
+    }
+  ud->cur = i;
+  ud->data_len = len;
+  return true;
+}
+
+static pax_io_status_t
+undedup_reader (paxbuf_t buf, void *fclosure, void *data, idx_t size,
+		idx_t *ret_size)
+{
+  struct undedup *ud = fclosure;
+  char *p = data;
+
+  *ret_size = 0;
+  if (!undedup_load (buf, ud))
+    return pax_io_failure;
+
+  while (size > 0 && ud->pos < ud->offsets[ud->nchunks])
+    {
+      if (ud->cur < 0 || ud->pos < ud->offsets[ud->cur]
+	  || ud->pos >= ud->offsets[ud->cur + 1])
+	{
+	  /* Find the chunk holding pos */
+	  idx_t lo = 0, hi = ud->nchunks;
+	  while (hi - lo > 1)
+	    {
+	      idx_t mid = lo + (hi - lo) / 2;
+	      if (ud->offsets[mid] <= ud->pos)
+		lo = mid;
+	      else
+		hi = mid;
+	    }
+	  if (!undedup_fetch (ud, lo))
+	    return pax_io_failure;
+	}
+
+      idx_t off = ud->pos - ud->offsets[ud->cur];
+      idx_t n = ud->data_len - off;
+      if (n > size)
+	n = size;
+      memcpy (p, ud->data + off, n);
+      p += n;
+      size -= n;
+      ud->pos += n;
+      *ret_size += n;
+    }
+  return *ret_size > 0 ? pax_io_success : pax_io_eof;
+}
+
+static int
+undedup_seek (paxbuf_t buf, void *fclosure, off_t offset)
+{
+  struct undedup *ud = fclosure;
+
+  if (!undedup_load (buf, ud))
+    return -1;
+  if (offset < 0 || offset > ud->offsets[ud->nchunks])
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  ud->pos = offset;
+  return 0;
+}
+
+static int
+undedup_destroy (void *fclosure)
+{
+  struct undedup *ud = fclosure;
+
+  free (ud->manifest);
+  free (ud->offsets);
+  free (ud->data);
+  free (ud->name);
+  free (ud->store);
+  free (ud);
+  return 0;
+}
+
+/* Install on BUF a filter reading the manifest written by the filter
+   of paxbuf_set_dedup, and returning the data it lists from the chunk
+   store STORE.  Return 0 on success, an errno value otherwise.  */
+int
+paxbuf_set_undedup (paxbuf_t buf, char const *store)
+{
+  if (!(paxbuf_get_mode (buf) & PAXBUF_READ))
+    return EINVAL;
+
+  struct undedup *ud = xzalloc (sizeof *ud);
+  ud->store_len = strlen (store);
+  ud->store = ximemdup0 (store, ud->store_len);
+  ud->name = ximalloc (ud->store_len + 2 * SHA256_DIGEST_SIZE + 3);
+  ud->data = ximalloc (PAX_DEDUP_MAX_CHUNK);
+  ud->cur = -1;
+  paxbuf_set_filter (buf, ud, undedup_reader, nullptr, undedup_destroy);
+  paxbuf_set_filter_seek (buf, undedup_seek);
+  return 0;
+}
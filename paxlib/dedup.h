@@ -0,0 +1,37 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Deduplication of archive data into a chunk store.
+
+   On writing, the data are cut into chunks at places chosen by their
+   contents, so that data repeated from an earlier archive give the
+   same chunks even when shifted.  Each chunk is kept in the store
+   directory under its SHA-256 digest, once however many archives hold
+   it, and the archive itself becomes a manifest listing the digests
+   and lengths of its chunks.  On reading, the data are put together
+   again from the store.  */
+
+/* Chunk sizes */
+enum
+  {
+    PAX_DEDUP_MIN_CHUNK = 16 * 1024,
+    PAX_DEDUP_AVG_CHUNK = 64 * 1024,
+    PAX_DEDUP_MAX_CHUNK = 256 * 1024
+  };
+
+int paxbuf_set_dedup (paxbuf_t buf, char const *store);
+int paxbuf_set_undedup (paxbuf_t buf, char const *store);
@@ -0,0 +1,272 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Encoding of tar headers.
+
+   A header is built by copying a template holding the constant fields
+   of its format, and storing the member-specific fields over it.  The
+   checksum is accumulated while the fields are stored, starting from
+   the precomputed sum of the template, so that the header is never
+   scanned again.  */
+
+#include <system.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+
+/* The checksum field counts as blanks */
+#define CHKBLANKS (' ' * 8)
+
+static union block const ustar_template = {
+  .header = { .magic = TMAGIC, .version = TVERSION }
+};
+#define USTAR_TEMPLATE_SUM \
+  ('u' + 's' + 't' + 'a' + 'r' + '0' + '0' + CHKBLANKS)
+
+/* OLDGNU_MAGIC spans the magic and version fields */
+static union block const gnu_template = {
+  .header = { .magic = "ustar ", .version = " " }
+};
+#define GNU_TEMPLATE_SUM \
+  ('u' + 's' + 't' + 'a' + 'r' + ' ' + ' ' + CHKBLANKS)
+
+static union block const v7_template;
+#define V7_TEMPLATE_SUM CHKBLANKS
+
+/* Pairs of octal digits, indexed by twice a 6-bit value */
+static char const octal_pairs[] =
+  "00010203040506071011121314151617"
+  "20212223242526273031323334353637"
+  "40414243444546475051525354555657"
+  "60616263646566677071727374757677";
+
+/* Store V in octal in the SIZE-byte field WHERE, as SIZE - 1 digits and
+   a null.  V must fit.  Return the sum of the bytes stored.  */
+static int
+to_octal (char *where, idx_t size, uintmax_t v)
+{
+  char *p = where + size - 1;
+  int sum = 0;
+
+  *p = '\0';
+  while (p - where >= 2)
+    {
+      unsigned d = v & 077;
+      p -= 2;
+      memcpy (p, octal_pairs + 2 * d, 2);
+      sum += 2 * '0' + (d >> 3) + (d & 7);
+      v >>= 6;
+    }
+  if (p > where)
+    {
+      *--p = '0' + (v & 7);
+      sum += *p;
+    }
+  return sum;
+}
+
+/* Store V in base-256 in the SIZE-byte field WHERE.  Return the sum of
+   the bytes stored.  */
+static int
+to_base256 (char *where, idx_t size, intmax_t v)
+{
+  unsigned char *p = (unsigned char *) where;
+  uintmax_t u = v;
+  uintmax_t sign = v < 0 ? ~(UINTMAX_MAX >> 8) : 0;
+  int sum = 0;
+
+  for (idx_t i = size - 1; i > 0; i--)
+    {
+      p[i] = u & 0xff;
+      sum += p[i];
+      u = (u >> 8) | sign;
+    }
+  p[0] = v < 0 ? 0xff : 0x80;
+  return sum + p[0];
+}
+
+/* Store V in the numeric field WHERE of SIZE bytes, in octal if it
+   fits, otherwise in base-256 if BASE256 is true.  Add the sum of the
+   bytes stored to *SUM.  Return false if V cannot be represented, in
+   which case the field is left zeroed.  */
+static bool
+to_field (char *where, idx_t size, intmax_t v, bool base256, int *sum)
+{
+  /* No numeric field is wider than 12 bytes, so the shift is safe */
+  if (0 <= v && (uintmax_t) v < (uintmax_t) 1 << 3 * (size - 1))
+    *sum += to_octal (where, size, v);
+  else if (base256)
+    *sum += to_base256 (where, size, v);
+  else
+    return false;
+  return true;
+}
+
+/* Copy the string SRC of LEN bytes to the SIZE-byte field WHERE.  Add
+   the sum of the bytes copied to *SUM.  Return false if SRC had to be
+   truncated.  */
+static bool
+to_string (char *where, idx_t size, char const *src, idx_t len, int *sum)
+{
+  bool fits = len <= size;
+
+  if (!fits)
+    len = size;
+  for (idx_t i = 0; i < len; i++)
+    *sum += (unsigned char) (where[i] = src[i]);
+  return fits;
+}
+
+static char
+mode_typeflag (mode_t mode, enum archive_format format)
+{
+  if (S_ISDIR (mode))
+    return DIRTYPE;
+  if (S_ISLNK (mode))
+    return SYMTYPE;
+  if (S_ISCHR (mode))
+    return CHRTYPE;
+  if (S_ISBLK (mode))
+    return BLKTYPE;
+  if (S_ISFIFO (mode))
+    return FIFOTYPE;
+  return format == V7_FORMAT ? AREGTYPE : REGTYPE;
+}
+
+/* Store NAME, of LEN bytes, in the name field of H, splitting it
+   between the prefix and name fields if FORMAT allows it.  */
+static bool
+encode_name (struct posix_header *h, char const *name, idx_t len,
+	     enum archive_format format, int *sum)
+{
+  idx_t name_size = sizeof h->name, prefix_size = sizeof h->prefix;
+
+  if (len > name_size
+      && (format == USTAR_FORMAT || format == POSIX_FORMAT))
+    {
+      /* Split at the first slash that leaves at most NAME_SIZE bytes
+	 after it, as tar does */
+      for (idx_t i = len - name_size - 1; i < len && i <= prefix_size; i++)
+	if (name[i] == '/')
+	  {
+	    if (i == 0 || i == len - 1)
+	      break;
+	    to_string (h->prefix, prefix_size, name, i, sum);
+	    return to_string (h->name, name_size, name + i + 1, len - i - 1,
+			      sum);
+	  }
+    }
+  return to_string (h->name, name_size, name, len, sum);
+}
+
+/* Fill BLK with the header describing ST in the given FORMAT, one of
+   V7_FORMAT, OLDGNU_FORMAT, GNU_FORMAT, USTAR_FORMAT or POSIX_FORMAT.
+   TYPEFLAG is the header type; if it is 0, it is derived from the file
+   mode.  The data size is taken from ST->archive_file_size.
+
+   Return 0 if ST was fully represented.  Otherwise, return a bitmask
+   of PAX_ENCODE_* values for the fields that did not fit: the caller is
+   expected to supply them in a GNU long name header or a POSIX
+   extended header.  Such string fields are truncated, and such numeric
+   fields are zeroed.  */
+int
+pax_encode_header (union block *blk, struct tar_stat_info const *st,
+		   char typeflag, enum archive_format format)
+{
+  struct posix_header *h = &blk->header;
+  bool base256 = format == OLDGNU_FORMAT || format == GNU_FORMAT;
+  bool names = format != V7_FORMAT;
+  int sum, overflow = 0;
+
+  switch (format)
+    {
+    case OLDGNU_FORMAT:
+    case GNU_FORMAT:
+      *blk = gnu_template;
+      sum = GNU_TEMPLATE_SUM;
+      break;
+
+    case V7_FORMAT:
+      *blk = v7_template;
+      sum = V7_TEMPLATE_SUM;
+      break;
+
+    default:
+      *blk = ustar_template;
+      sum = USTAR_TEMPLATE_SUM;
+      break;
+    }
+
+  if (!typeflag)
+    typeflag = mode_typeflag (st->stat.st_mode, format);
+  h->typeflag = typeflag;
+  sum += (unsigned char) typeflag;
+
+  if (!encode_name (h, st->file_name, strlen (st->file_name), format, &sum))
+    overflow |= PAX_ENCODE_NAME;
+  if (st->link_name
+      && !to_string (h->linkname, sizeof h->linkname,
+		     st->link_name, strlen (st->link_name), &sum))
+    overflow |= PAX_ENCODE_LINKNAME;
+
+  sum += to_octal (h->mode, sizeof h->mode, st->stat.st_mode & 07777);
+  if (!to_field (h->uid, sizeof h->uid, st->stat.st_uid, base256, &sum))
+    overflow |= PAX_ENCODE_UID;
+  if (!to_field (h->gid, sizeof h->gid, st->stat.st_gid, base256, &sum))
+    overflow |= PAX_ENCODE_GID;
+  if (!to_field (h->size, sizeof h->size, st->archive_file_size, base256,
+		 &sum))
+    overflow |= PAX_ENCODE_SIZE;
+  if (!to_field (h->mtime, sizeof h->mtime, st->stat.st_mtime, base256,
+		 &sum))
+    overflow |= PAX_ENCODE_MTIME;
+
+  /* Unlike the other names, owner names always end with a null, which
+     readers of the GNU format rely on */
+  if (names)
+    {
+      if (st->uname
+	  && !to_string (h->uname, sizeof h->uname - 1,
+			 st->uname, strlen (st->uname), &sum))
+	overflow |= PAX_ENCODE_UNAME;
+      if (st->gname
+	  && !to_string (h->gname, sizeof h->gname - 1,
+			 st->gname, strlen (st->gname), &sum))
+	overflow |= PAX_ENCODE_GNAME;
+    }
+
+  /* Like tar, fill the device fields of other members with zeros,
+     except in the GNU formats and in extended headers */
+  if (typeflag == CHRTYPE || typeflag == BLKTYPE)
+    {
+      if (!to_field (h->devmajor, sizeof h->devmajor, st->devmajor,
+		     base256, &sum)
+	  || !to_field (h->devminor, sizeof h->devminor, st->devminor,
+			base256, &sum))
+	overflow |= PAX_ENCODE_DEV;
+    }
+  else if (!base256 && typeflag != XHDTYPE && typeflag != XGLTYPE)
+    {
+      sum += to_octal (h->devmajor, sizeof h->devmajor, 0);
+      sum += to_octal (h->devminor, sizeof h->devminor, 0);
+    }
+
+  /* Six digits, a null and a space */
+  to_octal (h->chksum, sizeof h->chksum - 1, sum);
+  h->chksum[sizeof h->chksum - 1] = ' ';
+  return overflow;
+}
@@ -0,0 +1,1140 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Parallel extraction.
+
+   The thread reading the archive only decodes headers and copies the
+   data of each member into a job, which a worker thread of the pool
+   turns into a file: creating it, writing it and restoring its owner,
+   mode and times.  Jobs for different files run concurrently, so the
+   latency of these system calls overlaps.  The data held by the jobs
+   in progress are bounded by EXTRACT_BYTES per thread.
+
+   The order of the archive matters in three cases.  A member is not
+   started while an earlier member of the same name, or of the name of
+   one of its ancestors, is in progress.  Directories are created by
+   the reading thread, before the members they contain, and their
+   metadata are restored after all members have been extracted, deepest
+   first, as tar does.  A hard link waits for its target to be
+   complete.  Members larger than PAX_EXTRACT_CHUNK and sparse members
+   are extracted by the reading thread itself, which streams them from
+   the archive.
+
+   A symbolic link whose target is absolute or has a ".." component
+   could lead later members out of the working directory.  As tar does,
+   it is first created as an empty regular file, which later members
+   cannot be put through, and made into a link once all members have
+   been extracted, if that file is still there.
+
+   Where io_uring is available, small regular files are handed to the
+   workers in batches of up to EXTRACT_BATCH.  A worker opens all the
+   files of a batch with a single system call, then writes them with
+   another and closes them with a third; only the owners, modes and
+   times, for which io_uring has no operations, are set one file at a
+   time.  */
+
+#include <system.h>
+#include <hash.h>
+#include <obstack.h>
+#include <pthread.h>
+#include <quotearg.h>
+#include <stat-time.h>
+#include <paxbuf.h>
+#include <pool.h>
+#include <uring.h>
+#include <tar.h>
+#include <pax.h>
+#include <reader.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+/* A member handed to a worker */
+struct extract_job
+{
+  struct pax_extract *px;
+  char *file_name;
+  char *link_name;            /* Symbolic link contents, or null */
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  dev_t rdev;
+  struct timespec times[2];   /* Access and modification times */
+  idx_t size;                 /* Length of data */
+  char *data;                 /* Contents of a regular file */
+  char buf[];                 /* Storage for the above */
+};
+
+/* Small regular files created together through io_uring */
+enum
+  {
+    EXTRACT_BATCH = 64,
+    EXTRACT_BATCH_BYTES = 4 * 1024 * 1024
+  };
+
+/* Member data in progress per worker thread */
+enum { EXTRACT_BYTES = 2 * EXTRACT_BATCH_BYTES };
+
+struct extract_batch
+{
+  struct pax_extract *px;
+  idx_t n;                    /* Number of jobs */
+  idx_t bytes;                /* Their total data size */
+  struct extract_job *jobs[EXTRACT_BATCH];
+};
+
+/* A symbolic link created at the end, and the placeholder standing
+   for it until then */
+struct extract_symlink
+{
+  struct extract_symlink *next;
+  dev_t dev;                  /* The placeholder */
+  ino_t ino;
+  struct timespec ctime;
+  uid_t uid;
+  gid_t gid;
+  struct timespec times[2];
+  char *target;
+  char name[];
+};
+
+/* An io_uring instance not in use by any worker */
+struct extract_ring
+{
+  struct extract_ring *next;
+  pax_uring_t ring;
+};
+
+/* Metadata of a directory, restored at the end */
+struct extract_dir
+{
+  struct extract_dir *next;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  struct timespec times[2];
+  char name[];
+};
+
+struct pax_extract
+{
+  paxbuf_t buf;
+  pax_pool_t pool;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;        /* Signalled when a job finishes */
+  Hash_table *busy;           /* Jobs in progress, by file name */
+  idx_t njobs;                /* Number of jobs in progress */
+  idx_t max_jobs;             /* Bound on njobs */
+  idx_t bytes;                /* Data size of the jobs in progress */
+  idx_t max_bytes;            /* Bound on bytes */
+  bool same_owner;            /* Restore the owners */
+  mode_t umask;               /* Cleared from modes, unless same_owner */
+  struct extract_dir *dirs;   /* Directories, last extracted first */
+  struct extract_symlink *symlinks; /* Delayed links, last first */
+  bool use_uring;             /* Batch small files through io_uring */
+  struct extract_batch *batch;/* Batch being filled, or null */
+  struct extract_ring *rings; /* Free io_uring instances */
+  pax_reader_t reader;        /* Members of the archive */
+  struct tar_stat_info *st;   /* Current member */
+  struct obstack names;       /* Normalized names of the current member */
+  void *names_mark;           /* First object in names */
+  char *copy_buf;             /* Buffer for large members */
+};
+
+static size_t
+job_hasher (void const *entry, size_t n_buckets)
+{
+  struct extract_job const *job = entry;
+  return hash_string (job->file_name, n_buckets);
+}
+
+static bool
+job_compare (void const *a, void const *b)
+{
+  struct extract_job const *ja = a;
+  struct extract_job const *jb = b;
+  return strcmp (ja->file_name, jb->file_name) == 0;
+}
+
+
+/* Diagnostics of the workers and the reading thread alike */
+#define EXTRACT_REPORT(px, report) PAX_REPORT (&(px)->mutex, report)
+
+
+/* File system operations */
+
+/* Create the missing parent directories of NAME.  Return true if any
+   was created, so that the failed operation is worth retrying.  */
+static bool
+make_parents (struct pax_extract *px, char const *name)
+{
+  char *dir = xstrdup (name);
+  bool made = false;
+
+  for (char *p = dir; (p = strchr (p + 1, '/')); )
+    {
+      *p = '\0';
+      if (mkdir (dir, 0777 & ~px->umask) == 0)
+	made = true;
+      else if (errno != EEXIST)
+	{
+	  *p = '/';
+	  break;
+	}
+      *p = '/';
+    }
+  free (dir);
+  return made;
+}
+
+/* Called after an operation on NAME failed with errno.  Make room for
+   a new attempt by creating the parents of NAME or, if REPLACE,
+   removing the file in the way.  Return true if it is worth retrying. */
+static bool
+extract_retry (struct pax_extract *px, char const *name, bool replace)
+{
+  if (errno == ENOENT)
+    return make_parents (px, name);
+  if (errno == EEXIST && replace)
+    {
+      struct stat st;
+      if (lstat (name, &st) == 0 && !S_ISDIR (st.st_mode)
+	  && unlink (name) == 0)
+	return true;
+      errno = EEXIST;
+    }
+  return false;
+}
+
+/* Restore the owner of NAME, which is open on FD if FD is not
+   negative.  */
+static void
+set_owner (struct pax_extract *px, int fd, char const *name,
+	   uid_t uid, gid_t gid, bool symlink)
+{
+  int r;
+
+  if (!px->same_owner)
+    return;
+  if (fd >= 0)
+    r = fchown (fd, uid, gid);
+  else
+    r = fchownat (AT_FDCWD, name, uid, gid,
+		  symlink ? AT_SYMLINK_NOFOLLOW : 0);
+  if (r != 0)
+    EXTRACT_REPORT (px, chown_error_details (name, uid, gid));
+}
+
+/* Restore the mode of NAME, after its owner since changing the owner
+   may clear the set-user-ID bits.  */
+static void
+set_mode (struct pax_extract *px, int fd, char const *name, mode_t mode)
+{
+  mode_t m = mode & (px->same_owner ? 07777 : ~px->umask & 07777);
+  if ((fd >= 0 ? fchmod (fd, m) : chmod (name, m)) != 0)
+    EXTRACT_REPORT (px, chmod_error_details (name, m));
+}
+
+static void
+set_times (struct pax_extract *px, int fd, char const *name,
+	   struct timespec const times[2], bool symlink)
+{
+  if ((fd >= 0
+       ? futimens (fd, times)
+       : utimensat (AT_FDCWD, name, times,
+		    symlink ? AT_SYMLINK_NOFOLLOW : 0)) != 0)
+    EXTRACT_REPORT (px, utime_error (name));
+}
+
+static void
+set_mode_times (struct pax_extract *px, int fd, char const *name,
+		mode_t mode, struct timespec const times[2], bool symlink)
+{
+  if (!symlink)
+    set_mode (px, fd, name, mode);
+  set_times (px, fd, name, times, symlink);
+}
+
+/* Write the LEN bytes at DATA to FD, open on NAME */
+static bool
+write_data (struct pax_extract *px, int fd, char const *name,
+	    char const *data, idx_t len)
+{
+  if (full_write (fd, data, len) != len)
+    {
+      EXTRACT_REPORT (px, write_error (name));
+      return false;
+    }
+  return true;
+}
+
+/* Create the regular file NAME and return a descriptor open on it for
+   writing, or -1 on failure.  */
+static int
+create_file (struct pax_extract *px, char const *name)
+{
+  int fd;
+
+  while ((fd = open (name, O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY,
+		     S_IRUSR | S_IWUSR)) < 0)
+    if (!extract_retry (px, name, true))
+      {
+	EXTRACT_REPORT (px, open_error (name));
+	return -1;
+      }
+  return fd;
+}
+
+/* Create the file of JOB */
+static void
+extract_job_apply (struct pax_extract *px, struct extract_job *job)
+{
+  char const *name = job->file_name;
+  int fd = -1;
+  bool ok = true;
+
+  switch (job->mode & S_IFMT)
+    {
+    case S_IFREG:
+      fd = create_file (px, name);
+      ok = fd >= 0 && write_data (px, fd, name, job->data, job->size);
+      break;
+
+    case S_IFLNK:
+      while (!(ok = symlink (job->link_name, name) == 0))
+	if (!extract_retry (px, name, true))
+	  {
+	    EXTRACT_REPORT (px, symlink_error (job->link_name, name));
+	    break;
+	  }
+      break;
+
+    case S_IFIFO:
+      while (!(ok = mkfifo (name, job->mode & 07777) == 0))
+	if (!extract_retry (px, name, true))
+	  {
+	    EXTRACT_REPORT (px, mkfifo_error (name));
+	    break;
+	  }
+      break;
+
+    default:
+      while (!(ok = mknod (name, job->mode & (S_IFMT | 07777),
+			   job->rdev) == 0))
+	if (!extract_retry (px, name, true))
+	  {
+	    EXTRACT_REPORT (px, mknod_error (name));
+	    break;
+	  }
+      break;
+    }
+
+  if (ok)
+    {
+      bool symlink = S_ISLNK (job->mode);
+      set_owner (px, fd, name, job->uid, job->gid, symlink);
+      set_mode_times (px, fd, name, job->mode, job->times, symlink);
+    }
+  if (fd >= 0 && close (fd) != 0)
+    EXTRACT_REPORT (px, close_error (name));
+}
+
+/* Mark the N JOBS as finished and free them */
+static void
+extract_done (struct pax_extract *px, struct extract_job **jobs, idx_t n)
+{
+  pthread_mutex_lock (&px->mutex);
+  for (idx_t i = 0; i < n; i++)
+    {
+      hash_remove (px->busy, jobs[i]);
+      px->bytes -= jobs[i]->size;
+    }
+  px->njobs -= n;
+  pthread_cond_broadcast (&px->cond);
+  pthread_mutex_unlock (&px->mutex);
+  for (idx_t i = 0; i < n; i++)
+    free (jobs[i]);
+}
+
+static void
+extract_job_run (void *arg)
+{
+  struct extract_job *job = arg;
+
+  extract_job_apply (job->px, job);
+  extract_done (job->px, &job, 1);
+}
+
+
+/* Batches */
+
+static pax_uring_t
+ring_get (struct pax_extract *px)
+{
+  struct extract_ring *r;
+  pax_uring_t ring = nullptr;
+
+  pthread_mutex_lock (&px->mutex);
+  r = px->rings;
+  if (r)
+    px->rings = r->next;
+  pthread_mutex_unlock (&px->mutex);
+  if (r)
+    {
+      ring = r->ring;
+      free (r);
+    }
+  else if (pax_uring_create (&ring, EXTRACT_BATCH) != 0)
+    ring = nullptr;
+  return ring;
+}
+
+static void
+ring_put (struct pax_extract *px, pax_uring_t ring)
+{
+  struct extract_ring *r = xmalloc (sizeof *r);
+
+  r->ring = ring;
+  pthread_mutex_lock (&px->mutex);
+  r->next = px->rings;
+  px->rings = r;
+  pthread_mutex_unlock (&px->mutex);
+}
+
+/* Submit the operations queued in RING, N in number, wait for them and
+   store the result of each in RES, indexed by the data it was queued
+   with.  The results of operations that did not run are left alone. */
+static void
+ring_run (pax_uring_t ring, idx_t n, int *res)
+{
+  uint64_t data;
+  int r;
+
+  if (n == 0)
+    return;
+  pax_uring_submit (ring, n);
+  while (pax_uring_reap (ring, &data, &r))
+    res[data] = r;
+}
+
+static void
+extract_batch_run (void *arg)
+{
+  struct extract_batch *batch = arg;
+  struct pax_extract *px = batch->px;
+  idx_t n = batch->n;
+  pax_uring_t ring = ring_get (px);
+  int res[EXTRACT_BATCH];
+  int fd[EXTRACT_BATCH];
+  bool mode_ok[EXTRACT_BATCH];
+  idx_t m;
+
+  if (!ring)
+    {
+      for (idx_t i = 0; i < n; i++)
+	extract_job_apply (px, batch->jobs[i]);
+      extract_done (px, batch->jobs, n);
+      free (batch);
+      return;
+    }
+
+  /* Open the files.  Those in the way or lacking a directory are dealt
+     with as in extract_job_apply.  Without the same_owner option, the
+     mode given to open is the final one, less the umask.  */
+  for (idx_t i = 0; i < EXTRACT_BATCH; i++)
+    res[i] = INT_MIN;
+  for (idx_t i = 0; i < n; i++)
+    pax_uring_openat (ring, AT_FDCWD, batch->jobs[i]->file_name,
+		      O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY,
+		      (px->same_owner
+		       ? S_IRUSR | S_IWUSR : batch->jobs[i]->mode & 07777),
+		      i);
+  ring_run (ring, n, res);
+  for (idx_t i = 0; i < n; i++)
+    {
+      char const *name = batch->jobs[i]->file_name;
+      fd[i] = res[i];
+      mode_ok[i] = !px->same_owner;
+      if (fd[i] < 0)
+	{
+	  errno = -res[i];
+	  mode_ok[i] = false;
+	  if (res[i] == INT_MIN || extract_retry (px, name, true))
+	    fd[i] = create_file (px, name);
+	  else
+	    EXTRACT_REPORT (px, open_error (name));
+	}
+    }
+
+  /* Write them.  The writes start at the current position, so that a
+     short write can be completed by write_data.  */
+  m = 0;
+  for (idx_t i = 0; i < n; i++)
+    {
+      res[i] = INT_MIN;
+      if (fd[i] >= 0 && batch->jobs[i]->size > 0)
+	{
+	  pax_uring_write (ring, fd[i], batch->jobs[i]->data,
+			   batch->jobs[i]->size, -1, i);
+	  m++;
+	}
+    }
+  ring_run (ring, m, res);
+  for (idx_t i = 0; i < n; i++)
+    {
+      struct extract_job *job = batch->jobs[i];
+      bool ok = fd[i] >= 0;
+
+      if (ok && job->size > 0 && res[i] != job->size)
+	{
+	  if (res[i] == INT_MIN)
+	    ok = write_data (px, fd[i], job->file_name, job->data,
+			     job->size);
+	  else if (res[i] < 0)
+	    {
+	      errno = -res[i];
+	      EXTRACT_REPORT (px, write_error (job->file_name));
+	      ok = false;
+	    }
+	  else
+	    ok = write_data (px, fd[i], job->file_name, job->data + res[i],
+			     job->size - res[i]);
+	}
+      if (ok)
+	{
+	  set_owner (px, fd[i], job->file_name, job->uid, job->gid, false);
+	  if (!mode_ok[i])
+	    set_mode (px, fd[i], job->file_name, job->mode);
+	  set_times (px, fd[i], job->file_name, job->times, false);
+	}
+    }
+
+  /* Close them */
+  m = 0;
+  for (idx_t i = 0; i < n; i++)
+    {
+      res[i] = INT_MIN;
+      if (fd[i] >= 0)
+	{
+	  pax_uring_close (ring, fd[i], i);
+	  m++;
+	}
+    }
+  ring_run (ring, m, res);
+  for (idx_t i = 0; i < n; i++)
+    if (fd[i] >= 0 && res[i] < 0)
+      {
+	if (res[i] == INT_MIN)
+	  {
+	    if (close (fd[i]) == 0)
+	      continue;
+	  }
+	else
+	  errno = -res[i];
+	EXTRACT_REPORT (px, close_error (batch->jobs[i]->file_name));
+      }
+
+  ring_put (px, ring);
+  extract_done (px, batch->jobs, n);
+  free (batch);
+}
+
+/* Hand the batch being filled to a worker */
+static void
+extract_flush (struct pax_extract *px)
+{
+  if (px->batch)
+    {
+      pax_pool_submit (px->pool, extract_batch_run, px->batch);
+      px->batch = nullptr;
+    }
+}
+
+
+/* Ordering */
+
+/* Return true if there is room for JOB among the jobs in progress.  A
+   job is always let in when there are none, whatever its size.  */
+static bool
+extract_room_p (struct pax_extract const *px, struct extract_job const *job)
+{
+  return (px->njobs == 0
+	  || (px->njobs < px->max_jobs
+	      && job->size <= px->max_bytes - px->bytes));
+}
+
+/* Return true if a job works on the file of KEY or on one of its
+   ancestors, which may yet become a symbolic link or a file that the
+   name of KEY goes through.  */
+static bool
+extract_busy_p (struct pax_extract const *px, struct extract_job const *key)
+{
+  if (px->njobs == 0)
+    return false;
+  if (hash_lookup (px->busy, key))
+    return true;
+  if (!strchr (key->file_name, '/'))
+    return false;
+
+  char *dir = xstrdup (key->file_name);
+  struct extract_job dkey = { .file_name = dir };
+  bool busy = false;
+
+  for (char *p = dir; !busy && (p = strchr (p + 1, '/')); )
+    {
+      *p = '\0';
+      busy = hash_lookup (px->busy, &dkey) != nullptr;
+      *p = '/';
+    }
+  free (dir);
+  return busy;
+}
+
+/* Wait, with the mutex held, until no job works on the file of KEY or
+   its ancestors and, if SLOT, there is room for KEY as one more job.
+   The batch being filled is submitted first if need be, as it may hold
+   the jobs waited for.  */
+static void
+extract_wait (struct pax_extract *px, struct extract_job const *key,
+	      bool slot)
+{
+  while ((slot && !extract_room_p (px, key)) || extract_busy_p (px, key))
+    if (px->batch)
+      {
+	pthread_mutex_unlock (&px->mutex);
+	extract_flush (px);
+	pthread_mutex_lock (&px->mutex);
+      }
+    else
+      pthread_cond_wait (&px->cond, &px->mutex);
+}
+
+/* Wait until no job is working on NAME or its ancestors */
+static void
+extract_wait_name (struct pax_extract *px, char const *name)
+{
+  struct extract_job key = { .file_name = (char *) name };
+
+  pthread_mutex_lock (&px->mutex);
+  extract_wait (px, &key, false);
+  pthread_mutex_unlock (&px->mutex);
+}
+
+/* Queue JOB, once no earlier job works on the same file or on one of
+   its ancestors and there is room for it.  */
+static void
+extract_submit (struct pax_extract *px, struct extract_job *job)
+{
+  pthread_mutex_lock (&px->mutex);
+  extract_wait (px, job, true);
+  if (!hash_insert (px->busy, job))
+    xalloc_die ();
+  px->njobs++;
+  px->bytes += job->size;
+  pthread_mutex_unlock (&px->mutex);
+
+  if (!(px->use_uring && S_ISREG (job->mode)))
+    {
+      pax_pool_submit (px->pool, extract_job_run, job);
+      return;
+    }
+  if (!px->batch)
+    {
+      px->batch = xmalloc (sizeof *px->batch);
+      px->batch->px = px;
+      px->batch->n = px->batch->bytes = 0;
+    }
+  px->batch->jobs[px->batch->n++] = job;
+  px->batch->bytes += job->size;
+  if (px->batch->n == EXTRACT_BATCH
+      || px->batch->bytes >= EXTRACT_BATCH_BYTES)
+    extract_flush (px);
+}
+
+
+/* Members */
+
+static void
+timespecs_from_stat (struct timespec times[2], struct tar_stat_info const *st)
+{
+  times[0].tv_sec = st->stat.st_atime;
+  times[0].tv_nsec = st->atime_nsec;
+  times[1].tv_sec = st->stat.st_mtime;
+  times[1].tv_nsec = st->mtime_nsec;
+}
+
+/* Hand the member in ST, named NAME, to a worker */
+static int
+extract_to_job (struct pax_extract *px, char const *name)
+{
+  struct tar_stat_info const *st = px->st;
+  bool reg = S_ISREG (st->stat.st_mode);
+  idx_t nlen = strlen (name) + 1;
+  idx_t llen = st->link_name ? strlen (st->link_name) + 1 : 0;
+  idx_t dlen = (reg
+		? (st->archive_file_size + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE
+		: 0);
+  struct extract_job *job = ximalloc (offsetof (struct extract_job, buf)
+				      + dlen + nlen + llen);
+
+  job->px = px;
+  job->data = job->buf;
+  job->file_name = memcpy (job->buf + dlen, name, nlen);
+  job->link_name = (llen
+		    ? memcpy (job->buf + dlen + nlen, st->link_name, llen)
+		    : nullptr);
+  job->mode = st->stat.st_mode;
+  job->uid = st->stat.st_uid;
+  job->gid = st->stat.st_gid;
+  job->rdev = makedev (st->devmajor, st->devminor);
+  timespecs_from_stat (job->times, st);
+  job->size = reg ? st->archive_file_size : 0;
+
+  int rc = (reg
+	    ? pax_reader_read (px->reader, job->data, job->size)
+	    : pax_reader_skip (px->reader, st->archive_file_size));
+  if (rc)
+    {
+      free (job);
+      return rc;
+    }
+  extract_submit (px, job);
+  return 0;
+}
+
+/* Extract the regular member in ST, named NAME, in this thread */
+static int
+extract_large (struct pax_extract *px, char const *name)
+{
+  struct tar_stat_info const *st = px->st;
+  off_t start = paxbuf_tell (px->buf);
+  off_t end = (start
+	       + (st->archive_file_size + BLOCKSIZE - 1) / BLOCKSIZE
+	       * BLOCKSIZE);
+  int rc = 0;
+
+  if (st->is_sparse)
+    {
+      if (st->sparse_map_avail == 0)
+	rc = pax_sparse_read_map (px->buf, px->st);
+      if (rc == 0
+	  && !pax_sparse_map_valid (st, (st->archive_file_size
+					 - (paxbuf_tell (px->buf) - start))))
+	rc = EINVAL;
+      if (rc == EINVAL)
+	{
+	  EXTRACT_REPORT (px, paxerror (0, _("%s: Malformed sparse map;"
+					     " skipped"),
+					quotearg_colon (name)));
+	  return pax_reader_skip_to (px->reader, end);
+	}
+      if (rc)
+	return rc;
+    }
+
+  extract_wait_name (px, name);
+  int fd = create_file (px, name);
+  if (fd < 0)
+    return pax_reader_skip_to (px->reader, end);
+
+  if (st->is_sparse)
+    {
+      rc = pax_sparse_extract (px->buf, fd, st);
+      if (rc != 0 && rc != EIO)
+	{
+	  errno = rc;
+	  EXTRACT_REPORT (px, write_error (name));
+	}
+      if (rc != EIO)
+	rc = pax_reader_skip_to (px->reader, end);
+    }
+  else
+    {
+      bool ok = true;
+      for (off_t left = st->archive_file_size; rc == 0 && left > 0; )
+	{
+	  idx_t len = left < PAX_EXTRACT_CHUNK ? left : PAX_EXTRACT_CHUNK;
+	  rc = pax_reader_read (px->reader, px->copy_buf, len);
+	  if (rc == 0 && ok)
+	    ok = write_data (px, fd, name, px->copy_buf, len);
+	  left -= len;
+	}
+    }
+
+  if (rc == 0)
+    {
+      struct timespec times[2];
+      timespecs_from_stat (times, st);
+      set_owner (px, fd, name, st->stat.st_uid, st->stat.st_gid, false);
+      set_mode_times (px, fd, name, st->stat.st_mode, times, false);
+    }
+  if (close (fd) != 0)
+    EXTRACT_REPORT (px, close_error (name));
+  return rc;
+}
+
+/* Create the directory in ST, named NAME, and remember to restore its
+   metadata.  */
+static void
+extract_dir (struct pax_extract *px, char const *name)
+{
+  struct tar_stat_info const *st = px->st;
+  idx_t len = strlen (name);
+
+  extract_wait_name (px, name);
+  /* The directory must stay writable until its members are in */
+  while (mkdir (name, (st->stat.st_mode | S_IRWXU) & 07777) != 0)
+    {
+      struct stat dst;
+      if (errno == EEXIST && stat (name, &dst) == 0 && S_ISDIR (dst.st_mode))
+	break;
+      if (!extract_retry (px, name, true))
+	{
+	  EXTRACT_REPORT (px, mkdir_error (name));
+	  return;
+	}
+    }
+
+  struct extract_dir *d = ximalloc (offsetof (struct extract_dir, name)
+				    + len + 1);
+  memcpy (d->name, name, len + 1);
+  d->mode = st->stat.st_mode;
+  d->uid = st->stat.st_uid;
+  d->gid = st->stat.st_gid;
+  timespecs_from_stat (d->times, st);
+  d->next = px->dirs;
+  px->dirs = d;
+}
+
+/* Link NAME to the earlier member TARGET */
+static void
+extract_link (struct pax_extract *px, char const *name, char const *target)
+{
+  extract_wait_name (px, target);
+  extract_wait_name (px, name);
+  while (link (target, name) != 0)
+    if (!extract_retry (px, name, true))
+      {
+	EXTRACT_REPORT (px, link_error (target, name));
+	break;
+      }
+}
+
+/* Normalize the member name NAME with FLAGS, as pax_normalize_names
+   does, into the names of the current member of PX.  */
+static struct pax_name
+extract_name (struct pax_extract *px, char const *name, int flags)
+{
+  struct pax_name r;
+
+  /* The names may be diagnosed */
+  pthread_mutex_lock (&px->mutex);
+  pax_normalize_names (&px->names, &name, 1, flags, &r);
+  pthread_mutex_unlock (&px->mutex);
+  return r;
+}
+
+/* Create an empty file in place of the symbolic link in ST, named
+   NAME, and remember to make the link at the end.  */
+static void
+extract_symlink_delayed (struct pax_extract *px, char const *name)
+{
+  struct tar_stat_info const *st = px->st;
+  struct stat pst;
+  int fd;
+
+  extract_wait_name (px, name);
+  while ((fd = open (name, O_WRONLY | O_CREAT | O_EXCL | O_NOCTTY, 0)) < 0)
+    if (!extract_retry (px, name, true))
+      {
+	EXTRACT_REPORT (px, open_error (name));
+	return;
+      }
+  if (fstat (fd, &pst) != 0)
+    {
+      EXTRACT_REPORT (px, stat_error (name));
+      close (fd);
+      return;
+    }
+  if (close (fd) != 0)
+    EXTRACT_REPORT (px, close_error (name));
+
+  idx_t len = strlen (name) + 1;
+  idx_t tlen = strlen (st->link_name) + 1;
+  struct extract_symlink *l = ximalloc (offsetof (struct extract_symlink,
+						  name) + len + tlen);
+  memcpy (l->name, name, len);
+  l->target = memcpy (l->name + len, st->link_name, tlen);
+  l->dev = pst.st_dev;
+  l->ino = pst.st_ino;
+  l->ctime = get_stat_ctime (&pst);
+  l->uid = st->stat.st_uid;
+  l->gid = st->stat.st_gid;
+  timespecs_from_stat (l->times, st);
+  l->next = px->symlinks;
+  px->symlinks = l;
+}
+
+/* Replace the placeholders of the delayed links by the links, in the
+   order of the archive.  A placeholder that is gone, or was replaced by
+   a later member, is left alone.  */
+static void
+extract_fix_symlinks (struct pax_extract *px)
+{
+  struct extract_symlink *list = nullptr, *l;
+
+  while ((l = px->symlinks))
+    {
+      px->symlinks = l->next;
+      l->next = list;
+      list = l;
+    }
+  while ((l = list))
+    {
+      struct stat st;
+      list = l->next;
+      if (lstat (l->name, &st) == 0 && S_ISREG (st.st_mode)
+	  && st.st_size == 0 && st.st_dev == l->dev && st.st_ino == l->ino
+	  && get_stat_ctime (&st).tv_sec == l->ctime.tv_sec
+	  && get_stat_ctime (&st).tv_nsec == l->ctime.tv_nsec)
+	{
+	  if (unlink (l->name) != 0)
+	    EXTRACT_REPORT (px, unlink_error (l->name));
+	  else if (symlink (l->target, l->name) != 0)
+	    EXTRACT_REPORT (px, symlink_error (l->target, l->name));
+	  else
+	    {
+	      set_owner (px, -1, l->name, l->uid, l->gid, true);
+	      set_times (px, -1, l->name, l->times, true);
+	    }
+	}
+      free (l);
+    }
+}
+
+/* Extract the member described by ST and BLK, whose data follow in the
+   archive.  */
+static int
+extract_member (struct pax_extract *px, union block const *blk)
+{
+  struct tar_stat_info *st = px->st;
+  char typeflag = blk->header.typeflag;
+  off_t data_size = typeflag == LNKTYPE ? 0 : st->archive_file_size;
+
+  obstack_free (&px->names, px->names_mark);
+  px->names_mark = obstack_alloc (&px->names, 0);
+  struct pax_name pn = extract_name (px, st->file_name, 0);
+  char const *name = pn.name;
+  if (pn.dot_dot)
+    {
+      EXTRACT_REPORT (px, paxerror (0, _("%s: Member name contains '..'"),
+				    quotearg_colon (st->file_name)));
+      return pax_reader_skip (px->reader, data_size);
+    }
+  pax_stat_resolve_owner (st);
+
+  switch (typeflag)
+    {
+    case LNKTYPE:
+      {
+	struct pax_name target = extract_name (px, st->link_name,
+					       PAX_NAME_LINK_TARGET);
+	if (target.dot_dot)
+	  {
+	    EXTRACT_REPORT (px,
+			    paxerror (0, _("%s: Hard link target contains"
+					   " '..'"),
+				      quotearg_colon (st->link_name)));
+	    return 0;
+	  }
+	extract_link (px, name, target.name);
+      }
+      return 0;
+
+    case DIRTYPE:
+    case GNUTYPE_DUMPDIR:
+      extract_dir (px, name);
+      return pax_reader_skip (px->reader, data_size);
+
+    case SYMTYPE:
+      if (ISSLASH (st->link_name[0])
+	  || (*st->link_name
+	      && extract_name (px, st->link_name, PAX_NAME_ABSOLUTE).dot_dot))
+	{
+	  extract_symlink_delayed (px, name);
+	  return pax_reader_skip (px->reader, data_size);
+	}
+      break;
+
+    case CHRTYPE:
+    case BLKTYPE:
+    case FIFOTYPE:
+      st->link_name = nullptr;
+      break;
+
+    case REGTYPE:
+    case AREGTYPE:
+    case CONTTYPE:
+    case GNUTYPE_SPARSE:
+      if (S_ISDIR (st->stat.st_mode))
+	{
+	  extract_dir (px, name);
+	  return pax_reader_skip (px->reader, data_size);
+	}
+      st->link_name = nullptr;
+      if (st->is_sparse || data_size > PAX_EXTRACT_CHUNK)
+	return extract_large (px, name);
+      break;
+
+    default:
+      EXTRACT_REPORT (px,
+		      paxwarn (0, _("%s: Unknown file type '%c', extracted"
+				    " as normal file"),
+			       quotearg_colon (name), typeflag));
+      st->stat.st_mode = (st->stat.st_mode & 07777) | S_IFREG;
+      st->link_name = nullptr;
+      if (data_size > PAX_EXTRACT_CHUNK)
+	return extract_large (px, name);
+      break;
+    }
+  return extract_to_job (px, name);
+}
+
+/* Restore the metadata of the directories, deepest first */
+static void
+extract_fix_dirs (struct pax_extract *px)
+{
+  struct extract_dir *d;
+
+  while ((d = px->dirs))
+    {
+      px->dirs = d->next;
+      set_owner (px, -1, d->name, d->uid, d->gid, false);
+      set_mode_times (px, -1, d->name, d->mode, d->times, false);
+      free (d);
+    }
+}
+
+
+/* Interface */
+
+/* Create in *PPX an extractor of the archive read from BUF, using
+   NTHREADS worker threads (all available processors if NTHREADS is not
+   positive).  Files are created relative to the working directory.
+   Owners are restored when running as root; modes are restored less
+   the umask otherwise, as tar does.  Return 0 on success, an errno
+   value otherwise.  */
+int
+pax_extract_open (pax_extract_t *ppx, paxbuf_t buf, int nthreads)
+{
+  struct pax_extract *px = calloc (1, sizeof *px);
+  if (!px)
+    return ENOMEM;
+  int rc = pax_pool_create (&px->pool, nthreads);
+  if (rc)
+    {
+      free (px);
+      return rc;
+    }
+  px->busy = hash_initialize (0, nullptr, job_hasher, job_compare, nullptr);
+  if (!px->busy)
+    xalloc_die ();
+  px->buf = buf;
+  pthread_mutex_init (&px->mutex, nullptr);
+  pthread_cond_init (&px->cond, nullptr);
+  pax_uring_t ring;
+  if (pax_uring_create (&ring, EXTRACT_BATCH) == 0)
+    {
+      px->use_uring = true;
+      ring_put (px, ring);
+    }
+  px->max_jobs = ((px->use_uring ? 2 * EXTRACT_BATCH : 4)
+		  * pax_pool_size (px->pool));
+  px->max_bytes = (idx_t) EXTRACT_BYTES * pax_pool_size (px->pool);
+  px->same_owner = geteuid () == 0;
+  px->umask = umask (0);
+  umask (px->umask);
+  rc = pax_reader_open (&px->reader, buf, &px->mutex);
+  if (rc)
+    xalloc_die ();
+  px->st = pax_reader_stat (px->reader);
+  obstack_init (&px->names);
+  px->names_mark = obstack_alloc (&px->names, 0);
+  px->copy_buf = ximalloc (PAX_EXTRACT_CHUNK);
+  *ppx = px;
+  return 0;
+}
+
+/* Extract all members of the archive.  Failures to create files are
+   diagnosed, and extraction goes on.  Return 0 on success, EIO if the
+   archive cannot be read and EINVAL if it is malformed.  */
+int
+pax_extract_run (pax_extract_t px)
+{
+  union block const *blk;
+  int rc;
+
+  while ((rc = pax_reader_next (px->reader, &blk)) == 0 && blk)
+    {
+      rc = extract_member (px, blk);
+      if (rc)
+	break;
+    }
+
+  extract_flush (px);
+  pax_pool_wait (px->pool);
+  extract_fix_symlinks (px);
+  extract_fix_dirs (px);
+  return rc;
+}
+
+/* Wait for the jobs in progress and free *PPX */
+void
+pax_extract_destroy (pax_extract_t *ppx)
+{
+  struct pax_extract *px = *ppx;
+
+  extract_flush (px);
+  pax_pool_destroy (&px->pool);
+  while (px->rings)
+    {
+      struct extract_ring *r = px->rings;
+      px->rings = r->next;
+      pax_uring_destroy (&r->ring);
+      free (r);
+    }
+  while (px->dirs)
+    {
+      struct extract_dir *d = px->dirs;
+      px->dirs = d->next;
+      free (d);
+    }
+  while (px->symlinks)
+    {
+      struct extract_symlink *l = px->symlinks;
+      px->symlinks = l->next;
+      free (l);
+    }
+  hash_free (px->busy);
+  pax_reader_destroy (&px->reader);
+  obstack_free (&px->names, nullptr);
+  pthread_cond_destroy (&px->cond);
+  pthread_mutex_destroy (&px->mutex);
+  free (px->copy_buf);
+  free (px);
+  *ppx = nullptr;
+}
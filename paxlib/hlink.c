@@ -0,0 +1,372 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tables of hard links.
+
+   The index is an open-addressing hash table of slots, each holding the
+   full hash of a key and the location of its record, so that probing
+   and growing never look at the records themselves.  A record holds the
+   key and the name.  Records are allocated in an arena until their
+   size exceeds the limit given at creation; the arena is then written
+   out to a temporary file, whose records are read back only when a
+   probe finds their hash.  The memory in use is thus about the limit
+   plus 16 bytes per slot, however many links there are.  */
+
+#include <system.h>
+#include <obstack.h>
+#include <paxlib.h>
+#include <hlink.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+/* A slot of the index.  LOC is 0 for a free slot; otherwise, it is the
+   address of the record in the arena, or, if its lowest bit is set,
+   twice its offset in the spill file, plus one.  */
+struct hlink_slot
+{
+  uint64_t hash;
+  uint64_t loc;
+};
+
+/* The header of a record, followed by KEYLEN bytes of key and the
+   null-terminated name, in the arena as in the spill file.  */
+struct hlink_record
+{
+  uint64_t hash;
+  idx_t keylen;
+  idx_t namelen;
+};
+
+struct pax_hlink
+{
+  struct hlink_slot *slots;
+  idx_t nslots;               /* A power of two */
+  idx_t count;                /* Number of records */
+  struct obstack arena;
+  void *mark;                 /* First object in arena */
+  idx_t arena_size;           /* Bytes allocated in arena */
+  struct hlink_record **held; /* Records in the arena, in order */
+  idx_t nheld;
+  idx_t heldsize;
+  idx_t limit;                /* Maximum of arena_size, or 0 */
+  int fd;                     /* Spill file, or -1 */
+  off_t spill_size;           /* Bytes written to the spill file */
+  char *buf;                  /* Record read back from the spill file */
+  idx_t bufsize;
+};
+
+enum { HLINK_SPILL_BUFSIZE = 64 * 1024 };
+
+/* Create a table keeping up to LIMIT bytes of records in memory, or
+   all of them if LIMIT is 0.  */
+pax_hlink_t
+pax_hlink_create (idx_t limit)
+{
+  struct pax_hlink *h = xzalloc (sizeof *h);
+
+  h->nslots = 1024;
+  h->slots = xicalloc (h->nslots, sizeof *h->slots);
+  obstack_init (&h->arena);
+  h->mark = obstack_alloc (&h->arena, 0);
+  h->limit = limit;
+  h->fd = -1;
+  return h;
+}
+
+void
+pax_hlink_destroy (pax_hlink_t *ph)
+{
+  struct pax_hlink *h = *ph;
+
+  if (h->fd >= 0)
+    close (h->fd);
+  obstack_free (&h->arena, nullptr);
+  free (h->slots);
+  free (h->held);
+  free (h->buf);
+  free (h);
+  *ph = nullptr;
+}
+
+/* Return the number of records in H */
+idx_t
+pax_hlink_count (pax_hlink_t h)
+{
+  return h->count;
+}
+
+/* FNV-1a */
+static uint64_t
+hlink_hash (void const *key, idx_t keylen)
+{
+  unsigned char const *p = key;
+  uint64_t hash = 0xcbf29ce484222325;
+
+  for (idx_t i = 0; i < keylen; i++)
+    hash = (hash ^ p[i]) * 0x100000001b3;
+  return hash;
+}
+
+static idx_t
+record_size (struct hlink_record const *r)
+{
+  return sizeof *r + r->keylen + r->namelen + 1;
+}
+
+/* Return the record at LOC, reading it from the spill file if need be */
+static struct hlink_record const *
+hlink_record (struct pax_hlink *h, uint64_t loc)
+{
+  if (!(loc & 1))
+    return (struct hlink_record const *) (uintptr_t) loc;
+
+  off_t off = loc >> 1;
+  struct hlink_record r;
+  if (pread (h->fd, &r, sizeof r, off) != sizeof r)
+    paxfatal (errno, _("Cannot read the hard link table"));
+  idx_t size = record_size (&r);
+  if (h->bufsize < size)
+    {
+      free (h->buf);
+      h->buf = xpalloc (nullptr, &h->bufsize, size - h->bufsize, -1, 1);
+    }
+  if (pread (h->fd, h->buf, size, off) != size)
+    paxfatal (errno, _("Cannot read the hard link table"));
+  return (struct hlink_record const *) h->buf;
+}
+
+static char const *
+record_key (struct hlink_record const *r)
+{
+  return (char const *) (r + 1);
+}
+
+static char const *
+record_name (struct hlink_record const *r)
+{
+  return record_key (r) + r->keylen;
+}
+
+/* Return the slot for KEY of the given HASH: the one holding it, or
+   the free one where it would go.  */
+static struct hlink_slot *
+hlink_probe (struct pax_hlink *h, uint64_t hash, void const *key,
+	     idx_t keylen)
+{
+  idx_t mask = h->nslots - 1;
+
+  for (idx_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+      struct hlink_slot *s = &h->slots[i];
+      if (!s->loc)
+	return s;
+      if (s->hash == hash)
+	{
+	  struct hlink_record const *r = hlink_record (h, s->loc);
+	  if (r->keylen == keylen && memcmp (record_key (r), key, keylen) == 0)
+	    return s;
+	}
+    }
+}
+
+/* Double the size of the index */
+static void
+hlink_grow (struct pax_hlink *h)
+{
+  struct hlink_slot *old = h->slots;
+  idx_t n = h->nslots;
+
+  h->nslots = 2 * n;
+  h->slots = xicalloc (h->nslots, sizeof *h->slots);
+  for (idx_t i = 0; i < n; i++)
+    if (old[i].loc)
+      {
+	idx_t mask = h->nslots - 1;
+	idx_t j = old[i].hash & mask;
+	while (h->slots[j].loc)
+	  j = (j + 1) & mask;
+	h->slots[j] = old[i];
+      }
+  free (old);
+}
+
+/* Write the LEN bytes at BUF to the spill file at offset *OFF, and
+   advance *OFF.  Return false on failure.  */
+static bool
+spill_write (struct pax_hlink *h, void const *buf, idx_t len, off_t *off)
+{
+  if (len > 0 && pwrite (h->fd, buf, len, *off) != len)
+    return false;
+  *off += len;
+  return true;
+}
+
+/* Append the records in the arena to the spill file, point their slots
+   there, and empty the arena.  If that fails, keep all records in
+   memory from now on.  */
+static void
+hlink_spill (struct pax_hlink *h)
+{
+  if (h->fd < 0)
+    {
+      FILE *fp = tmpfile ();
+      if (fp)
+	{
+	  h->fd = dup (fileno (fp));
+	  fclose (fp);
+	}
+      if (h->fd < 0)
+	{
+	  paxerror (errno, _("Cannot create a file for the hard link table"));
+	  h->limit = 0;
+	  return;
+	}
+    }
+
+  /* Write the records in the order of their creation.  Those larger
+     than the buffer are written on their own.  */
+  char *buf = ximalloc (HLINK_SPILL_BUFSIZE);
+  idx_t len = 0;
+  off_t off = h->spill_size;
+  bool ok = true;
+  for (idx_t i = 0; ok && i < h->nheld; i++)
+    {
+      struct hlink_record const *r = h->held[i];
+      idx_t size = record_size (r);
+      if (HLINK_SPILL_BUFSIZE - len < size)
+	{
+	  ok = spill_write (h, buf, len, &off);
+	  len = 0;
+	}
+      if (size > HLINK_SPILL_BUFSIZE)
+	ok = ok && spill_write (h, r, size, &off);
+      else
+	{
+	  memcpy (buf + len, r, size);
+	  len += size;
+	}
+    }
+  ok = ok && spill_write (h, buf, len, &off);
+  free (buf);
+  if (!ok)
+    {
+      paxerror (errno, _("Cannot write the hard link table"));
+      h->limit = 0;
+      return;
+    }
+
+  /* Now that they are all out, point their slots to the file */
+  for (idx_t i = 0; i < h->nheld; i++)
+    {
+      struct hlink_record const *r = h->held[i];
+      struct hlink_slot *s = hlink_probe (h, r->hash, record_key (r),
+					  r->keylen);
+      s->loc = (uint64_t) h->spill_size << 1 | 1;
+      h->spill_size += record_size (r);
+    }
+  h->nheld = 0;
+  obstack_free (&h->arena, h->mark);
+  h->mark = obstack_alloc (&h->arena, 0);
+  h->arena_size = 0;
+}
+
+/* Return the name recorded for the KEYLEN bytes at KEY, or null if
+   there is none.  The name remains valid until the next call on H.  */
+char const *
+pax_hlink_find (pax_hlink_t h, void const *key, idx_t keylen)
+{
+  struct hlink_slot *s = hlink_probe (h, hlink_hash (key, keylen),
+				      key, keylen);
+  return s->loc ? record_name (hlink_record (h, s->loc)) : nullptr;
+}
+
+/* Return the name recorded for the KEYLEN bytes at KEY if there is
+   one.  Otherwise, record NAME for the key and return null.  The name
+   returned remains valid until the next call on H.  */
+char const *
+pax_hlink_add (pax_hlink_t h, void const *key, idx_t keylen,
+	       char const *name)
+{
+  uint64_t hash = hlink_hash (key, keylen);
+  struct hlink_slot *s = hlink_probe (h, hash, key, keylen);
+
+  if (s->loc)
+    return record_name (hlink_record (h, s->loc));
+
+  struct hlink_record *r;
+  idx_t namelen = strlen (name);
+  idx_t size = sizeof *r + keylen + namelen + 1;
+  r = obstack_alloc (&h->arena, size);
+  r->hash = hash;
+  r->keylen = keylen;
+  r->namelen = namelen;
+  memcpy ((char *) record_key (r), key, keylen);
+  memcpy ((char *) record_name (r), name, namelen + 1);
+  h->arena_size += size;
+  s->hash = hash;
+  s->loc = (uintptr_t) r;
+  h->count++;
+  if (h->limit)
+    {
+      if (h->nheld == h->heldsize)
+	h->held = xpalloc (h->held, &h->heldsize, 1, -1, sizeof *h->held);
+      h->held[h->nheld++] = r;
+    }
+
+  /* Keep the load under three quarters */
+  if (4 * h->count > 3 * h->nslots)
+    hlink_grow (h);
+  if (h->limit && h->arena_size > h->limit)
+    hlink_spill (h);
+  return nullptr;
+}
+
+/* The key of a file on creation */
+struct hlink_stat_key
+{
+  dev_t dev;
+  ino_t ino;
+};
+
+static struct hlink_stat_key
+stat_key (struct stat const *st)
+{
+  struct hlink_stat_key key;
+
+  memset (&key, 0, sizeof key);
+  key.dev = st->st_dev;
+  key.ino = st->st_ino;
+  return key;
+}
+
+/* Return the name recorded for the file of ST, or null */
+char const *
+pax_hlink_find_stat (pax_hlink_t h, struct stat const *st)
+{
+  struct hlink_stat_key key = stat_key (st);
+  return pax_hlink_find (h, &key, sizeof key);
+}
+
+/* Return the name recorded for the file of ST if there is one;
+   otherwise, record NAME for it and return null.  */
+char const *
+pax_hlink_add_stat (pax_hlink_t h, struct stat const *st, char const *name)
+{
+  struct hlink_stat_key key = stat_key (st);
+  return pax_hlink_add (h, &key, sizeof key, name);
+}
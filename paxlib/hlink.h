@@ -0,0 +1,33 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tables of hard links, mapping keys to names.  On creation, the key
+   of a file is its device and inode numbers, and the name that of the
+   first member for the file; on extraction, the key is the name of a
+   member, and the name that of the file extracted for it.  */
+
+typedef struct pax_hlink *pax_hlink_t;
+
+pax_hlink_t pax_hlink_create (idx_t limit);
+void pax_hlink_destroy (pax_hlink_t *ph);
+char const *pax_hlink_find (pax_hlink_t h, void const *key, idx_t keylen);
+char const *pax_hlink_add (pax_hlink_t h, void const *key, idx_t keylen,
+			   char const *name);
+char const *pax_hlink_find_stat (pax_hlink_t h, struct stat const *st);
+char const *pax_hlink_add_stat (pax_hlink_t h, struct stat const *st,
+				char const *name);
+idx_t pax_hlink_count (pax_hlink_t h);
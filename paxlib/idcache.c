@@ -0,0 +1,316 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Caches of user and group names.
+
+   Looking up a user or group may go through NSS to a directory
+   service, which is slow.  The results of the lookups, including
+   those finding no such user or group, are cached in both directions.
+   Lookups that fail otherwise, as when the service cannot be reached,
+   are not cached, so that they are tried again.  A cache that reaches
+   IDCACHE_MAX entries is emptied, which bounds the memory used when
+   archiving files of many owners.  The caches are shared by all
+   threads, but the lock on them is not held across the lookups
+   themselves.  */
+
+#include <system.h>
+#include <hash.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <grp.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+
+enum { IDCACHE_MAX = 4096 };
+
+struct identry
+{
+  uintmax_t id;
+  bool found;                 /* The lookup succeeded */
+  char const *name;           /* Points to buf, except in lookup keys */
+  char buf[];
+};
+
+enum idcache_kind
+  {
+    UID_TO_NAME,
+    GID_TO_NAME,
+    NAME_TO_UID,
+    NAME_TO_GID,
+    IDCACHE_KINDS
+  };
+
+static Hash_table *idcache[IDCACHE_KINDS];
+static pthread_mutex_t idcache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t
+id_hasher (void const *entry, size_t n_buckets)
+{
+  struct identry const *e = entry;
+  return e->id % n_buckets;
+}
+
+static bool
+id_compare (void const *a, void const *b)
+{
+  struct identry const *ea = a;
+  struct identry const *eb = b;
+  return ea->id == eb->id;
+}
+
+static size_t
+name_hasher (void const *entry, size_t n_buckets)
+{
+  struct identry const *e = entry;
+  return hash_string (e->name, n_buckets);
+}
+
+static bool
+name_compare (void const *a, void const *b)
+{
+  struct identry const *ea = a;
+  struct identry const *eb = b;
+  return strcmp (ea->name, eb->name) == 0;
+}
+
+static struct identry *
+identry_new (uintmax_t id, bool found, char const *name)
+{
+  idx_t len = name ? strlen (name) : 0;
+  struct identry *e = ximalloc (offsetof (struct identry, buf) + len + 1);
+
+  e->id = id;
+  e->found = found;
+  memcpy (e->buf, name ? name : "", len);
+  e->buf[len] = '\0';
+  e->name = e->buf;
+  return e;
+}
+
+/* Add E to the cache of the given KIND, emptying it first if it is
+   full.  If another thread added the same entry meanwhile, free E.
+   Return the entry in the cache.  */
+static struct identry const *
+idcache_add (enum idcache_kind kind, struct identry *e)
+{
+  bool by_id = kind == UID_TO_NAME || kind == GID_TO_NAME;
+  Hash_table *t = idcache[kind];
+
+  if (!t)
+    {
+      t = hash_initialize (0, nullptr,
+			   by_id ? id_hasher : name_hasher,
+			   by_id ? id_compare : name_compare, free);
+      if (!t)
+	xalloc_die ();
+      idcache[kind] = t;
+    }
+  else if (hash_get_n_entries (t) >= IDCACHE_MAX)
+    hash_clear (t);
+  struct identry *old = hash_insert (t, e);
+  if (!old)
+    xalloc_die ();
+  if (old != e)
+    free (e);
+  return old;
+}
+
+/* Look up the user or group ID or NAME in the system databases,
+   according to KIND, and return a new cache entry for the result, or
+   null if the lookup failed for another reason than there being no
+   such user or group.  The reentrant functions are used, so that
+   lookups in different threads need not be serialized.  */
+static struct identry *
+idcache_lookup (enum idcache_kind kind, uintmax_t id, char const *name)
+{
+  idx_t size = 1024;
+  char *buf = ximalloc (size);
+  struct passwd pw, *pwres = nullptr;
+  struct group gr, *grres = nullptr;
+  struct identry *e;
+  int err;
+
+  for (;;)
+    {
+      switch (kind)
+	{
+	case UID_TO_NAME:
+	  err = getpwuid_r (id, &pw, buf, size, &pwres);
+	  break;
+
+	case GID_TO_NAME:
+	  err = getgrgid_r (id, &gr, buf, size, &grres);
+	  break;
+
+	case NAME_TO_UID:
+	  err = getpwnam_r (name, &pw, buf, size, &pwres);
+	  break;
+
+	default:
+	  err = getgrnam_r (name, &gr, buf, size, &grres);
+	  break;
+	}
+      if (err != ERANGE)
+	break;
+      buf = xpalloc (buf, &size, 1, -1, 1);
+    }
+  if (err != 0)
+    {
+      free (buf);
+      return nullptr;
+    }
+
+  switch (kind)
+    {
+    case UID_TO_NAME:
+      e = identry_new (id, pwres != nullptr, pwres ? pwres->pw_name : nullptr);
+      break;
+
+    case GID_TO_NAME:
+      e = identry_new (id, grres != nullptr, grres ? grres->gr_name : nullptr);
+      break;
+
+    case NAME_TO_UID:
+      e = identry_new (pwres ? pwres->pw_uid : 0, pwres != nullptr, name);
+      break;
+
+    default:
+      e = identry_new (grres ? grres->gr_gid : 0, grres != nullptr, name);
+      break;
+    }
+  free (buf);
+  return e;
+}
+
+/* Return the name of the user or group ID, according to KIND, copied
+   into the arena of ST, or null if it is unknown or cannot be looked
+   up.
+
+   The lock is not held during the lookup, so that a slow one does not
+   hold up the threads that find their ids in the cache; two threads
+   may then look up the same id at times.  */
+static char *
+id_to_name (enum idcache_kind kind, uintmax_t id, struct tar_stat_info *st)
+{
+  struct identry key = { .id = id };
+  struct identry const *e;
+  char *name;
+
+  pthread_mutex_lock (&idcache_mutex);
+  e = idcache[kind] ? hash_lookup (idcache[kind], &key) : nullptr;
+  if (!e)
+    {
+      pthread_mutex_unlock (&idcache_mutex);
+      struct identry *ne = idcache_lookup (kind, id, nullptr);
+      if (!ne)
+	return nullptr;
+      pthread_mutex_lock (&idcache_mutex);
+      e = idcache_add (kind, ne);
+    }
+  name = e->found ? pax_stat_memdup0 (st, e->name, strlen (e->name)) : nullptr;
+  pthread_mutex_unlock (&idcache_mutex);
+  return name;
+}
+
+/* Look up the user or group NAME, according to KIND, and store its id
+   in *ID.  Return false if there is no such user or group, or if it
+   cannot be looked up.  */
+static bool
+name_to_id (enum idcache_kind kind, char const *name, uintmax_t *id)
+{
+  struct identry key = { .name = name };
+  struct identry const *e;
+  bool found;
+
+  pthread_mutex_lock (&idcache_mutex);
+  e = idcache[kind] ? hash_lookup (idcache[kind], &key) : nullptr;
+  if (!e)
+    {
+      pthread_mutex_unlock (&idcache_mutex);
+      struct identry *ne = idcache_lookup (kind, 0, name);
+      if (!ne)
+	return false;
+      pthread_mutex_lock (&idcache_mutex);
+      e = idcache_add (kind, ne);
+    }
+  found = e->found;
+  *id = e->id;
+  pthread_mutex_unlock (&idcache_mutex);
+  return found;
+}
+
+/* Set the owner names of ST from its owner ids, as needed when
+   archiving.  Unknown owners get null names.  */
+void
+pax_stat_set_owner_names (struct tar_stat_info *st)
+{
+  st->uname = id_to_name (UID_TO_NAME, st->stat.st_uid, st);
+  st->gname = id_to_name (GID_TO_NAME, st->stat.st_gid, st);
+}
+
+/* Return in *UID the id of the user NAME.  Return false if there is no
+   such user.  */
+bool
+pax_name_to_uid (char const *name, uid_t *uid)
+{
+  uintmax_t id;
+  if (!name_to_id (NAME_TO_UID, name, &id))
+    return false;
+  *uid = id;
+  return true;
+}
+
+/* Return in *GID the id of the group NAME.  Return false if there is no
+   such group.  */
+bool
+pax_name_to_gid (char const *name, gid_t *gid)
+{
+  uintmax_t id;
+  if (!name_to_id (NAME_TO_GID, name, &id))
+    return false;
+  *gid = id;
+  return true;
+}
+
+/* Map the owner names of ST to ids on this system, as needed when
+   extracting.  The ids of ST are kept for unknown or missing names.  */
+void
+pax_stat_resolve_owner (struct tar_stat_info *st)
+{
+  uid_t uid;
+  gid_t gid;
+
+  if (st->uname && *st->uname && pax_name_to_uid (st->uname, &uid))
+    st->stat.st_uid = uid;
+  if (st->gname && *st->gname && pax_name_to_gid (st->gname, &gid))
+    st->stat.st_gid = gid;
+}
+
+/* Free the caches */
+void
+pax_idcache_clear (void)
+{
+  pthread_mutex_lock (&idcache_mutex);
+  for (int i = 0; i < IDCACHE_KINDS; i++)
+    if (idcache[i])
+      {
+	hash_free (idcache[i]);
+	idcache[i] = nullptr;
+      }
+  pthread_mutex_unlock (&idcache_mutex);
+}
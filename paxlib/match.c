@@ -0,0 +1,712 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Selection of members by patterns.
+
+   Trying each pattern of a list in turn against each member costs the
+   product of their numbers, which becomes prohibitive for lists of
+   thousands of names.  Instead, the patterns of each of the include and
+   exclude sets are sorted by kind when added:
+
+   - anchored patterns without wildcards go into a hash table, probed
+     with the name and each of its leading directories;
+   - anchored patterns whose only wildcards end them go into a trie of
+     prefixes, walked along the name;
+   - the others are translated to extended regular expressions, and
+     compiled into a single one, whose automaton tests them all in one
+     pass over the name.
+
+   The time taken to test a name thus depends on its length, and hardly
+   on the number of patterns.  */
+
+#include <system.h>
+#include <hash.h>
+#include <obstack.h>
+#include <regex.h>
+#include <match.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+/* A name of LEN bytes at STR.  In the keys used for lookups, STR
+   points into the member name.  */
+struct match_literal
+{
+  char const *str;
+  idx_t len;
+};
+
+/* An edge of the trie, from node PARENT to node CHILD for byte C */
+struct trie_edge
+{
+  idx_t parent;
+  unsigned char c;
+  idx_t child;
+};
+
+/* A pattern left for the regular expression */
+struct match_glob
+{
+  char const *pattern;
+  int flags;
+};
+
+struct match_set
+{
+  Hash_table *literals;         /* Literal names */
+  Hash_table *edges;            /* Edges of the trie of prefixes */
+  bool *terminal;               /* Whether each node ends a prefix */
+  idx_t nnodes;                 /* Number of nodes, the root included */
+  idx_t nodes_alloc;
+  struct match_glob *globs;     /* Patterns for the regular expression */
+  idx_t nglobs;
+  idx_t globs_alloc;
+  regex_t re;                   /* Compiled from GLOBS, if RE_VALID */
+  bool re_valid;
+  bool empty;                   /* No pattern was added */
+};
+
+struct pax_match
+{
+  struct obstack stk;           /* Storage for strings and edges */
+  struct match_set set[2];      /* Include and exclude patterns */
+  bool compiled;                /* No pattern was added since compiling */
+};
+
+
+/* Hash tables */
+
+static size_t
+literal_hasher (void const *entry, size_t n_buckets)
+{
+  struct match_literal const *l = entry;
+  size_t value = 0;
+
+  /* Reduce only once: a division per byte would cost more than the
+     probe itself.  */
+  for (idx_t i = 0; i < l->len; i++)
+    value = value * 31 + (unsigned char) l->str[i];
+  return value % n_buckets;
+}
+
+static bool
+literal_compare (void const *entry1, void const *entry2)
+{
+  struct match_literal const *l1 = entry1;
+  struct match_literal const *l2 = entry2;
+  return l1->len == l2->len && memcmp (l1->str, l2->str, l1->len) == 0;
+}
+
+static size_t
+edge_hasher (void const *entry, size_t n_buckets)
+{
+  struct trie_edge const *e = entry;
+  return ((size_t) e->parent * 257 + e->c) % n_buckets;
+}
+
+static bool
+edge_compare (void const *entry1, void const *entry2)
+{
+  struct trie_edge const *e1 = entry1;
+  struct trie_edge const *e2 = entry2;
+  return e1->parent == e2->parent && e1->c == e2->c;
+}
+
+static Hash_table *
+match_hash (Hash_table **table, Hash_hasher hasher, Hash_comparator compare)
+{
+  if (!*table)
+    {
+      *table = hash_initialize (0, nullptr, hasher, compare, nullptr);
+      if (!*table)
+	xalloc_die ();
+    }
+  return *table;
+}
+
+
+/* Adding patterns */
+
+pax_match_t
+pax_match_create (void)
+{
+  struct pax_match *m = xzalloc (sizeof *m);
+
+  obstack_init (&m->stk);
+  for (int i = 0; i < 2; i++)
+    m->set[i].empty = true;
+  m->compiled = true;
+  return m;
+}
+
+/* Add the name of LEN bytes at STR, which must live as long as M, to
+   the literals of SET.  */
+static void
+add_literal (struct pax_match *m, struct match_set *set,
+	     char const *str, idx_t len)
+{
+  struct match_literal *l = obstack_alloc (&m->stk, sizeof *l);
+
+  l->str = str;
+  l->len = len;
+  struct match_literal const *e
+    = hash_insert (match_hash (&set->literals, literal_hasher,
+			       literal_compare), l);
+  if (!e)
+    xalloc_die ();
+  if (e != l)
+    obstack_free (&m->stk, l);
+}
+
+/* Add the prefix of LEN bytes at STR to the trie of SET */
+static void
+add_prefix (struct pax_match *m, struct match_set *set,
+	    char const *str, idx_t len)
+{
+  Hash_table *edges = match_hash (&set->edges, edge_hasher, edge_compare);
+  idx_t node = 0;
+
+  if (set->nnodes == 0)
+    {
+      set->terminal = xpalloc (nullptr, &set->nodes_alloc, 1, -1,
+			       sizeof *set->terminal);
+      set->terminal[0] = false;
+      set->nnodes = 1;
+    }
+  for (idx_t i = 0; i < len && !set->terminal[node]; i++)
+    {
+      struct trie_edge key = { .parent = node, .c = str[i] };
+      struct trie_edge const *e = hash_lookup (edges, &key);
+
+      if (e)
+	node = e->child;
+      else
+	{
+	  if (set->nnodes == set->nodes_alloc)
+	    set->terminal = xpalloc (set->terminal, &set->nodes_alloc, 1, -1,
+				     sizeof *set->terminal);
+	  struct trie_edge *edge = obstack_alloc (&m->stk, sizeof *edge);
+	  *edge = key;
+	  edge->child = set->nnodes++;
+	  set->terminal[edge->child] = false;
+	  if (!hash_insert (edges, edge))
+	    xalloc_die ();
+	  node = edge->child;
+	}
+    }
+  set->terminal[node] = true;
+}
+
+/* Return the end of the character class, equivalence class or collating
+   symbol at P, or null if there is none there.  Its name may not be
+   empty.  */
+static char const *
+bracket_class (char const *p)
+{
+  if (p[0] == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=') && p[2])
+    {
+      char const *end = strstr (p + 3, (char const []) { p[1], ']', 0 });
+      if (end)
+	return end + 2;
+    }
+  return nullptr;
+}
+
+/* Return the length of the bracket expression at P, or 0 if the '['
+   there does not start one.  As for fnmatch, a backslash quotes the
+   character after it.  */
+static idx_t
+bracket_len (char const *p)
+{
+  char const *q = p + 1;
+
+  if (*q == '!' || *q == '^')
+    q++;
+  if (*q == ']')
+    q++;
+  for (; *q != ']'; q++)
+    {
+      if (!*q)
+	return 0;
+      if (q[0] == '\\' && q[1])
+	q++;
+      else if (q[0] == '[' && (q[1] == ':' || q[1] == '.' || q[1] == '='))
+	{
+	  char const *end = bracket_class (q);
+	  if (!end)
+	    return 0;
+	  q = end - 1;
+	}
+    }
+  return q + 1 - p;
+}
+
+/* Analyze PATTERN.  If it has no wildcards, replace it with the name
+   it stands for and return 0.  If its only wildcards are the stars that
+   end it, replace it with the prefix before them and return 1.  Store
+   the length of the name or prefix in *PLEN.  Otherwise, return -1,
+   leaving PATTERN in an unspecified state.  */
+static int
+pattern_kind (char *pattern, int flags, idx_t *plen)
+{
+  char const *p = pattern;
+  char *q = pattern;
+
+  if (flags & PAX_MATCH_LITERAL)
+    {
+      *plen = strlen (pattern);
+      return 0;
+    }
+  for (; *p; p++)
+    switch (*p)
+      {
+      case '\\':
+	if (p[1])
+	  p++;
+	*q++ = *p;
+	break;
+
+      case '*':
+	while (*p == '*')
+	  p++;
+	if (*p)
+	  return -1;
+	*plen = q - pattern;
+	return 1;
+
+      case '?':
+	return -1;
+
+      case '[':
+	if (bracket_len (p))
+	  return -1;
+	*q++ = *p;
+	break;
+
+      default:
+	*q++ = *p;
+      }
+  *plen = q - pattern;
+  return 0;
+}
+
+/* Add PATTERN to M, in the set of excluded patterns if FLAGS has
+   PAX_MATCH_EXCLUDE, else in the set of included ones.  Trailing
+   slashes of PATTERN are ignored.  As for fnmatch, a pattern that ends
+   with a backslash quoting nothing matches no name.  */
+void
+pax_match_add (pax_match_t m, char const *pattern, int flags)
+{
+  struct match_set *set = &m->set[!!(flags & PAX_MATCH_EXCLUDE)];
+  bool literal = flags & PAX_MATCH_LITERAL;
+  idx_t len = strlen (pattern);
+  idx_t nbs = 0;
+
+  while (len > 1 && ISSLASH (pattern[len - 1])
+	 && (literal || pattern[len - 2] != '\\'))
+    len--;
+  while (nbs < len && pattern[len - 1 - nbs] == '\\')
+    nbs++;
+
+  set->empty = false;
+  m->compiled = false;
+  if (!literal && nbs % 2)
+    return;
+
+  char *pat = obstack_copy0 (&m->stk, pattern, len);
+  if (! (flags & PAX_MATCH_UNANCHORED))
+    {
+      idx_t n;
+      switch (pattern_kind (pat, flags, &n))
+	{
+	case 0:
+	  add_literal (m, set, pat, n);
+	  return;
+
+	case 1:
+	  add_prefix (m, set, pat, n);
+	  return;
+
+	default:
+	  obstack_free (&m->stk, pat);
+	  pat = obstack_copy0 (&m->stk, pattern, len);
+	}
+    }
+  if (set->nglobs == set->globs_alloc)
+    set->globs = xpalloc (set->globs, &set->globs_alloc, 1, -1,
+			  sizeof *set->globs);
+  set->globs[set->nglobs++] = (struct match_glob) { pat, flags };
+}
+
+
+/* Compiling
+
+   The regular expression is built from a trie of the patterns, once
+   translated into tokens of extended regular expressions, so that the
+   patterns that start alike share the states of the automaton.  */
+
+/* A node of the trie of tokens */
+struct ere_node
+{
+  char const *tok;              /* The token leading to this node */
+  struct ere_node *child;       /* First child */
+  struct ere_node *next;        /* Next sibling */
+  bool terminal;                /* A pattern ends here */
+};
+
+static void
+ere_char (struct obstack *stk, char c)
+{
+  if (strchr (".[]\\()*+?{}|^$", c))
+    obstack_1grow (stk, '\\');
+  obstack_1grow (stk, c);
+}
+
+/* Read the item of a bracket expression at P, which ends before END:
+   a character, quoted or not, or a range of them.  Store its bounds in
+   *LO and *HI, and return the end of the item.  */
+static char const *
+bracket_item (char const *p, char const *end,
+	      unsigned char *lo, unsigned char *hi)
+{
+  if (*p == '\\')
+    p++;
+  *lo = *hi = *p++;
+  if (p[0] == '-' && p + 1 < end)
+    {
+      p++;
+      if (*p == '\\')
+	p++;
+      *hi = *p++;
+    }
+  return p;
+}
+
+/* Grow the object in STK with the extended regular expression for the
+   bracket expression of N bytes at P.
+
+   In brackets, the backslash is an ordinary character for regular
+   expressions, so the characters that a backslash quotes in P go where
+   they have no special meaning: ']' first, '[' and '-' last, and '^'
+   anywhere but first.  A reversed range matches nothing for fnmatch,
+   but is an error for regcomp: it is left out, and a bracket
+   expression left empty becomes an expression that matches nothing,
+   or any character if negated.  */
+static void
+ere_bracket (struct obstack *stk, char const *p, idx_t n)
+{
+  char const *end = p + n - 1;
+  char const *q = p + 1;
+  bool negate = *q == '!' || *q == '^';
+  bool close = false, bracket = false, dash = false;
+  unsigned char lo, hi;
+
+  q += negate;
+  for (char const *r = q, *c; r < end; )
+    if ((c = bracket_class (r)))
+      r = c;
+    else
+      {
+	r = bracket_item (r, end, &lo, &hi);
+	if (lo <= hi)
+	  {
+	    close |= lo <= ']' && ']' <= hi;
+	    bracket |= lo == '[' && hi == '[';
+	    dash |= lo <= '-' && '-' <= hi;
+	  }
+      }
+
+  obstack_1grow (stk, '[');
+  if (negate)
+    obstack_1grow (stk, '^');
+  idx_t start = obstack_object_size (stk);
+  if (close)
+    obstack_1grow (stk, ']');
+  while (q < end)
+    {
+      char const *c = bracket_class (q);
+      if (c)
+	{
+	  obstack_grow (stk, q, c - q);
+	  q = c;
+	  continue;
+	}
+      q = bracket_item (q, end, &lo, &hi);
+
+      /* ']' and '-' are added apart, so ranges stop short of them */
+      if (lo == ']' || lo == '-')
+	lo++;
+      if (hi == ']' || hi == '-')
+	hi--;
+      if (lo > hi || (lo == '[' && hi == '['))
+	continue;
+      if (lo == '^' && obstack_object_size (stk) == start)
+	obstack_grow (stk, "[.^.]", 5);
+      else
+	obstack_1grow (stk, lo);
+      if (lo < hi)
+	{
+	  obstack_1grow (stk, '-');
+	  obstack_1grow (stk, hi);
+	}
+    }
+  if (bracket)
+    obstack_1grow (stk, '[');
+  if (dash)
+    obstack_1grow (stk, '-');
+  if (obstack_object_size (stk) == start)
+    {
+      obstack_blank (stk, -1 - negate);
+      obstack_grow (stk, negate ? "." : "$.", 2 - negate);
+    }
+  else
+    obstack_1grow (stk, ']');
+}
+
+/* Grow the object in STK with the extended regular expression for the
+   token of a pattern with FLAGS at P.  Return the length of the token
+   in the pattern.  */
+static idx_t
+ere_token (struct obstack *stk, char const *p, int flags)
+{
+  idx_t n;
+
+  if (flags & PAX_MATCH_LITERAL)
+    ere_char (stk, *p);
+  else if (*p == '\\' && p[1])
+    {
+      ere_char (stk, p[1]);
+      return 2;
+    }
+  else if (*p == '*')
+    {
+      for (n = 1; p[n] == '*'; n++)
+	continue;
+      obstack_grow (stk, ".*", 2);
+      return n;
+    }
+  else if (*p == '?')
+    obstack_1grow (stk, '.');
+  else if (*p == '[' && (n = bracket_len (p)))
+    {
+      ere_bracket (stk, p, n);
+      return n;
+    }
+  else
+    ere_char (stk, *p);
+  return 1;
+}
+
+/* Add the tokens of PATTERN, which has FLAGS, below the node ROOT */
+static void
+ere_add (struct obstack *stk, struct ere_node *root, char const *pattern,
+	 int flags)
+{
+  struct ere_node *node = root;
+
+  for (char const *p = pattern; *p; )
+    {
+      struct ere_node *child;
+
+      p += ere_token (stk, p, flags);
+      obstack_1grow (stk, '\0');
+      char *tok = obstack_finish (stk);
+      for (child = node->child; child; child = child->next)
+	if (strcmp (child->tok, tok) == 0)
+	  break;
+      if (child)
+	obstack_free (stk, tok);
+      else
+	{
+	  child = obstack_alloc (stk, sizeof *child);
+	  *child = (struct ere_node) { .tok = tok, .next = node->child };
+	  node->child = child;
+	}
+      node = child;
+    }
+  node->terminal = true;
+}
+
+/* Grow the object in STK with the alternation of the continuations of
+   NODE.  A pattern matches if the name ends where it does, or goes on
+   with a slash.  */
+static void
+ere_emit (struct obstack *stk, struct ere_node const *node)
+{
+  int n = node->terminal;
+  bool first = true;
+
+  for (struct ere_node const *c = node->child; c && n < 2; c = c->next)
+    n++;
+  if (n > 1)
+    obstack_1grow (stk, '(');
+  if (node->terminal)
+    {
+      obstack_grow (stk, "(/|$)", 5);
+      first = false;
+    }
+  for (struct ere_node const *c = node->child; c; c = c->next)
+    {
+      if (!first)
+	obstack_1grow (stk, '|');
+      first = false;
+      obstack_grow (stk, c->tok, strlen (c->tok));
+      ere_emit (stk, c);
+    }
+  if (n > 1)
+    obstack_1grow (stk, ')');
+}
+
+/* Compile the patterns of SET that are neither literal names nor
+   prefixes into a regular expression of the form
+     ^(A1|A2...)|(^|/)(U1|U2...)
+   where the Ai are the anchored patterns and the Ui the others, each
+   followed by (/|$), and with their common prefixes factored.  */
+static int
+set_compile (struct pax_match *m, struct match_set *set)
+{
+  struct obstack *stk = &m->stk;
+  char *mark = obstack_alloc (stk, 0);
+  struct ere_node root[2] = { 0 };
+
+  if (set->re_valid)
+    {
+      regfree (&set->re);
+      set->re_valid = false;
+    }
+  if (set->nglobs == 0)
+    return 0;
+
+  for (idx_t i = 0; i < set->nglobs; i++)
+    {
+      struct match_glob const *g = &set->globs[i];
+      ere_add (stk, &root[!!(g->flags & PAX_MATCH_UNANCHORED)],
+	       g->pattern, g->flags);
+    }
+  if (root[0].child || root[0].terminal)
+    {
+      obstack_1grow (stk, '^');
+      ere_emit (stk, &root[0]);
+    }
+  if (root[1].child || root[1].terminal)
+    {
+      if (obstack_object_size (stk))
+	obstack_1grow (stk, '|');
+      obstack_grow (stk, "(^|/)", 5);
+      ere_emit (stk, &root[1]);
+    }
+  obstack_1grow (stk, '\0');
+  char *re = obstack_finish (stk);
+
+  int rc = regcomp (&set->re, re, REG_EXTENDED | REG_NOSUB);
+  obstack_free (stk, mark);
+  if (rc == 0)
+    set->re_valid = true;
+  return (rc == 0 ? 0
+	  : rc == REG_ESPACE ? ENOMEM
+	  : EINVAL);
+}
+
+/* Compile the patterns added to M.  Return 0 on success, an errno
+   value otherwise.  */
+int
+pax_match_compile (pax_match_t m)
+{
+  if (!m->compiled)
+    {
+      for (int i = 0; i < 2; i++)
+	{
+	  int rc = set_compile (m, &m->set[i]);
+	  if (rc)
+	    return rc;
+	}
+      m->compiled = true;
+    }
+  return 0;
+}
+
+
+/* Matching */
+
+static bool
+set_match (struct match_set const *set, char const *name)
+{
+  idx_t len = strlen (name);
+
+  if (set->literals)
+    {
+      struct match_literal key = { .str = name };
+      for (idx_t i = 1; i <= len; i++)
+	if (i == len || ISSLASH (name[i]))
+	  {
+	    key.len = i;
+	    if (hash_lookup (set->literals, &key))
+	      return true;
+	  }
+    }
+
+  if (set->nnodes)
+    {
+      idx_t node = 0;
+      for (idx_t i = 0; !set->terminal[node]; i++)
+	{
+	  struct trie_edge key = { .parent = node, .c = name[i] };
+	  struct trie_edge const *e;
+	  if (i == len || !(e = hash_lookup (set->edges, &key)))
+	    break;
+	  node = e->child;
+	}
+      if (set->terminal[node])
+	return true;
+    }
+
+  return set->re_valid && regexec (&set->re, name, 0, nullptr, 0) == 0;
+}
+
+/* Return true if NAME is selected by M: if it is matched by one of the
+   included patterns, or none was added, and by none of the excluded
+   ones.  The patterns must have been compiled by pax_match_compile
+   since the last of them was added.  */
+bool
+pax_match_p (pax_match_t m, char const *name)
+{
+  if (!m->set[1].empty && set_match (&m->set[1], name))
+    return false;
+  return m->set[0].empty || set_match (&m->set[0], name);
+}
+
+void
+pax_match_destroy (pax_match_t *pm)
+{
+  struct pax_match *m = *pm;
+
+  for (int i = 0; i < 2; i++)
+    {
+      struct match_set *set = &m->set[i];
+      if (set->literals)
+	hash_free (set->literals);
+      if (set->edges)
+	hash_free (set->edges);
+      if (set->re_valid)
+	regfree (&set->re);
+      free (set->terminal);
+      free (set->globs);
+    }
+  obstack_free (&m->stk, nullptr);
+  free (m);
+  *pm = nullptr;
+}
@@ -0,0 +1,37 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Selection of members by sets of include and exclude patterns.
+
+   A pattern selects a member if it matches its name or one of the
+   directories leading to it.  In patterns, '*' and '?' match slashes
+   too, as in the default of tar.  */
+
+typedef struct pax_match *pax_match_t;
+
+enum
+  {
+    PAX_MATCH_EXCLUDE    = 0x1, /* Deselect the members that match */
+    PAX_MATCH_UNANCHORED = 0x2, /* Match after any slash, too */
+    PAX_MATCH_LITERAL    = 0x4  /* No character is a wildcard */
+  };
+
+pax_match_t pax_match_create (void);
+void pax_match_add (pax_match_t m, char const *pattern, int flags);
+int pax_match_compile (pax_match_t m);
+bool pax_match_p (pax_match_t m, char const *name);
+void pax_match_destroy (pax_match_t *pm);
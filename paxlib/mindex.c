@@ -0,0 +1,362 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <system.h>
+#include <sys/mman.h>
+#include <paxbuf.h>
+#include <mindex.h>
+
+/* Index file layout.  All numbers are little-endian.
+
+   Header (MINDEX_HEADER bytes):
+     magic        8 bytes
+     count        8      number of entries
+     names_off    8      offset of the name area
+     names_len    8      length of the name area
+
+   Entries (MINDEX_ENTRY bytes each), sorted by name and, for equal
+   names, by offset:
+     offset       8      offset of the member header in the archive
+     size         8      size of the member data
+     name_off     8      offset of the name in the name area
+     name_len     4      length of the name
+     type         1      header type flag
+     reserved     3
+
+   Name area: the names, without terminating nulls.  */
+
+static char const mindex_magic[8] = "PAXMIDX\1";
+enum
+  {
+    MINDEX_HEADER = 32,
+    MINDEX_ENTRY = 32
+  };
+
+/* An entry of the index being built */
+struct mentry
+{
+  off_t offset;
+  off_t size;
+  idx_t name_off;             /* Offset of the name in the names buffer */
+  idx_t name_len;
+  char const *name;           /* Name, set when the index is written */
+  char type;
+};
+
+struct pax_mindex
+{
+    /* Building */
+  struct mentry *ents;
+  idx_t nents;
+  idx_t ents_size;
+  char *names;
+  idx_t names_len;
+  idx_t names_size;
+
+    /* Reading */
+  unsigned char *map;         /* Contents of the index file */
+  idx_t map_size;
+  bool mapped;                /* map was obtained by mmap */
+  idx_t count;                /* Number of entries */
+  unsigned char const *table; /* First entry */
+  char const *strtab;         /* Name area */
+  idx_t strtab_len;
+};
+
+static uint_least64_t
+get_u64 (unsigned char const *p, int n)
+{
+  uint_least64_t v = 0;
+  while (n--)
+    v = (v << 8) | p[n];
+  return v;
+}
+
+static void
+put_u64 (unsigned char *p, uint_least64_t v, int n)
+{
+  while (n--)
+    {
+      *p++ = v & 0xff;
+      v >>= 8;
+    }
+}
+
+pax_mindex_t
+pax_mindex_create (void)
+{
+  return xzalloc (sizeof (struct pax_mindex));
+}
+
+/* Record a member NAME, whose header is at OFFSET in the archive.  The
+   member carries SIZE bytes of data, its header type flag is TYPE.  */
+void
+pax_mindex_add (pax_mindex_t idx, char const *name, off_t offset, off_t size,
+		char type)
+{
+  idx_t len = strlen (name);
+
+  if (idx->nents == idx->ents_size)
+    idx->ents = xpalloc (idx->ents, &idx->ents_size, 1, -1,
+			 sizeof idx->ents[0]);
+  if (idx->names_size - idx->names_len < len)
+    idx->names = xpalloc (idx->names, &idx->names_size,
+			  len - (idx->names_size - idx->names_len), -1, 1);
+  memcpy (idx->names + idx->names_len, name, len);
+
+  struct mentry *ent = &idx->ents[idx->nents++];
+  ent->offset = offset;
+  ent->size = size;
+  ent->name_off = idx->names_len;
+  ent->name_len = len;
+  ent->type = type;
+  idx->names_len += len;
+}
+
+static int
+name_cmp (char const *a, idx_t alen, char const *b, idx_t blen)
+{
+  int rc = memcmp (a, b, alen < blen ? alen : blen);
+  if (rc == 0)
+    rc = (alen > blen) - (alen < blen);
+  return rc;
+}
+
+static int
+mentry_cmp (void const *a, void const *b)
+{
+  struct mentry const *ea = a;
+  struct mentry const *eb = b;
+  int rc = name_cmp (ea->name, ea->name_len, eb->name, eb->name_len);
+  if (rc == 0)
+    rc = (ea->offset > eb->offset) - (ea->offset < eb->offset);
+  return rc;
+}
+
+/* Sort the entries collected so far and write them to FILE_NAME.
+   Return 0 on success, an errno value otherwise.  */
+int
+pax_mindex_write (pax_mindex_t idx, char const *file_name)
+{
+  unsigned char rec[MINDEX_HEADER];
+  FILE *fp;
+  int rc = 0;
+
+  for (idx_t i = 0; i < idx->nents; i++)
+    idx->ents[i].name = idx->names + idx->ents[i].name_off;
+  qsort (idx->ents, idx->nents, sizeof idx->ents[0], mentry_cmp);
+
+  fp = fopen (file_name, "wb");
+  if (!fp)
+    return errno;
+
+  memcpy (rec, mindex_magic, sizeof mindex_magic);
+  put_u64 (rec + 8, idx->nents, 8);
+  put_u64 (rec + 16,
+	   MINDEX_HEADER + idx->nents * (uint_least64_t) MINDEX_ENTRY, 8);
+  put_u64 (rec + 24, idx->names_len, 8);
+  fwrite (rec, MINDEX_HEADER, 1, fp);
+
+  /* Names are written in the order of entries, so that a lookup touches
+     as few pages as possible.  */
+  uint_least64_t name_off = 0;
+  for (idx_t i = 0; i < idx->nents; i++)
+    {
+      struct mentry const *ent = &idx->ents[i];
+      put_u64 (rec, ent->offset, 8);
+      put_u64 (rec + 8, ent->size, 8);
+      put_u64 (rec + 16, name_off, 8);
+      put_u64 (rec + 24, ent->name_len, 4);
+      rec[28] = ent->type;
+      rec[29] = rec[30] = rec[31] = 0;
+      fwrite (rec, MINDEX_ENTRY, 1, fp);
+      name_off += ent->name_len;
+    }
+  for (idx_t i = 0; i < idx->nents; i++)
+    fwrite (idx->ents[i].name, 1, idx->ents[i].name_len, fp);
+
+  if (ferror (fp))
+    rc = errno ? errno : EIO;
+  if (fclose (fp) && rc == 0)
+    rc = errno;
+  return rc;
+}
+
+/* Read the contents of the index file FD of SIZE bytes into IDX */
+static int
+mindex_load (pax_mindex_t idx, int fd, idx_t size)
+{
+  void *p = mmap (nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (p != MAP_FAILED)
+    {
+      idx->map = p;
+      idx->mapped = true;
+      return 0;
+    }
+
+  idx->map = ximalloc (size);
+  for (idx_t n = 0; n < size; )
+    {
+      ssize_t rc = read (fd, idx->map + n, size - n);
+      if (rc <= 0)
+	return rc == 0 ? EINVAL : errno;
+      n += rc;
+    }
+  return 0;
+}
+
+/* Open the index file FILE_NAME and store its handle in *PIDX.  Return
+   0 on success, an errno value otherwise.  EINVAL means the file is
+   not a valid index.  */
+int
+pax_mindex_open (pax_mindex_t *pidx, char const *file_name)
+{
+  struct stat st;
+  pax_mindex_t idx;
+  int fd, rc;
+
+  fd = open (file_name, O_RDONLY);
+  if (fd == -1)
+    return errno;
+  if (fstat (fd, &st))
+    {
+      rc = errno;
+      close (fd);
+      return rc;
+    }
+  if (st.st_size < MINDEX_HEADER || IDX_MAX < st.st_size)
+    {
+      close (fd);
+      return EINVAL;
+    }
+
+  idx = pax_mindex_create ();
+  idx->map_size = st.st_size;
+  rc = mindex_load (idx, fd, idx->map_size);
+  close (fd);
+  if (rc == 0)
+    {
+      unsigned char const *p = idx->map;
+      uint_least64_t count = get_u64 (p + 8, 8);
+      uint_least64_t names_off = get_u64 (p + 16, 8);
+      uint_least64_t names_len = get_u64 (p + 24, 8);
+
+      if (memcmp (p, mindex_magic, sizeof mindex_magic) != 0
+	  || count > (idx->map_size - MINDEX_HEADER) / MINDEX_ENTRY
+	  || names_off != MINDEX_HEADER + count * MINDEX_ENTRY
+	  || names_len > idx->map_size - names_off)
+	rc = EINVAL;
+      else
+	{
+	  idx->count = count;
+	  idx->table = p + MINDEX_HEADER;
+	  idx->strtab = (char const *) p + names_off;
+	  idx->strtab_len = names_len;
+	}
+    }
+
+  if (rc)
+    pax_mindex_destroy (&idx);
+  else
+    *pidx = idx;
+  return rc;
+}
+
+idx_t
+pax_mindex_count (pax_mindex_t idx)
+{
+  return idx->count;
+}
+
+/* Store in ENT the Nth entry of the index, in name order.  Return false
+   if there is no such entry or it is malformed.  */
+bool
+pax_mindex_entry (pax_mindex_t idx, idx_t n, struct pax_mindex_entry *ent)
+{
+  if (n < 0 || n >= idx->count)
+    return false;
+
+  unsigned char const *p = idx->table + n * MINDEX_ENTRY;
+  uint_least64_t name_off = get_u64 (p + 16, 8);
+  uint_least64_t name_len = get_u64 (p + 24, 4);
+  if (name_off > idx->strtab_len || name_len > idx->strtab_len - name_off)
+    return false;
+
+  ent->name = idx->strtab + name_off;
+  ent->name_len = name_len;
+  ent->offset = get_u64 (p, 8);
+  ent->size = get_u64 (p + 8, 8);
+  ent->type = p[28];
+  return true;
+}
+
+/* Look up the member NAME.  If the archive holds several members of
+   that name, the last one is returned, as it is the one that wins on
+   extraction.  */
+bool
+pax_mindex_lookup (pax_mindex_t idx, char const *name,
+		   struct pax_mindex_entry *ent)
+{
+  idx_t len = strlen (name);
+  idx_t lo = 0, hi = idx->count;
+
+  /* Find the first entry greater than NAME */
+  while (lo < hi)
+    {
+      idx_t mid = lo + (hi - lo) / 2;
+      if (!pax_mindex_entry (idx, mid, ent))
+	return false;
+      if (name_cmp (ent->name, ent->name_len, name, len) <= 0)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo > 0
+    && pax_mindex_entry (idx, lo - 1, ent)
+    && name_cmp (ent->name, ent->name_len, name, len) == 0;
+}
+
+/* Look up the member NAME and position BUF at its header.  Return 0 on
+   success, ENOENT if there is no such member, and EIO if BUF cannot be
+   positioned.  */
+int
+pax_mindex_seek (pax_mindex_t idx, paxbuf_t buf, char const *name,
+		 struct pax_mindex_entry *ent)
+{
+  if (!pax_mindex_lookup (idx, name, ent))
+    return ENOENT;
+  if (paxbuf_seek (buf, ent->offset))
+    return EIO;
+  return 0;
+}
+
+void
+pax_mindex_destroy (pax_mindex_t *pidx)
+{
+  pax_mindex_t idx = *pidx;
+
+  if (!idx)
+    return;
+  if (idx->mapped)
+    munmap (idx->map, idx->map_size);
+  else
+    free (idx->map);
+  free (idx->ents);
+  free (idx->names);
+  free (idx);
+  *pidx = nullptr;
+}
@@ -0,0 +1,53 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Archive member index.
+
+   The index is kept in a separate file next to the archive.  It maps
+   member names, in sorted order, to the offset of the member header in
+   the (uncompressed) archive, the size of the member data and its type
+   flag.  The file is mapped in memory when read and looked up by
+   binary search.  */
+
+typedef struct pax_mindex *pax_mindex_t;
+
+struct pax_mindex_entry
+{
+  char const *name;           /* Member name, not null-terminated */
+  idx_t name_len;             /* Length of name */
+  off_t offset;               /* Offset of the member header */
+  off_t size;                 /* Size of the member data */
+  char type;                  /* Type flag from the header */
+};
+
+/* Building the index while writing the archive */
+pax_mindex_t pax_mindex_create (void);
+void pax_mindex_add (pax_mindex_t idx, char const *name,
+		     off_t offset, off_t size, char type);
+int pax_mindex_write (pax_mindex_t idx, char const *file_name);
+
+/* Using the index when reading the archive */
+int pax_mindex_open (pax_mindex_t *pidx, char const *file_name);
+idx_t pax_mindex_count (pax_mindex_t idx);
+bool pax_mindex_entry (pax_mindex_t idx, idx_t n,
+		       struct pax_mindex_entry *ent);
+bool pax_mindex_lookup (pax_mindex_t idx, char const *name,
+			struct pax_mindex_entry *ent);
+int pax_mindex_seek (pax_mindex_t idx, paxbuf_t buf, char const *name,
+		     struct pax_mindex_entry *ent);
+
+void pax_mindex_destroy (pax_mindex_t *pidx);
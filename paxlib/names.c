@@ -16,54 +16,78 @@
 
 #include <system.h>
 #include <hash.h>
+#include <obstack.h>
+#include <pthread.h>
 #include <paxlib.h>
+#if HAVE_X86_SIMD
+# include <immintrin.h>
+#endif
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
 
 
-/* Hash tables of strings.  */
+/* Hash tables of file name prefixes.  */
+
+/* A prefix of LEN bytes at STR.  In the keys used for lookups, STR
+   points into the member name and is not null-terminated; entries of
+   the tables own a null-terminated copy in BUF.  */
+struct name_prefix
+{
+  char const *str;
+  idx_t len;
+  char buf[];
+};
 
-/* Calculate the hash of a string.  */
+/* Calculate the hash of a prefix, as hash_string would of a copy.  */
 static size_t
-hash_string_hasher (void const *name, size_t n_buckets)
+name_prefix_hasher (void const *entry, size_t n_buckets)
 {
-  return hash_string (name, n_buckets);
+  struct name_prefix const *p = entry;
+  size_t value = 0;
+
+  for (idx_t i = 0; i < p->len; i++)
+    value = (value * 31 + (unsigned char) p->str[i]) % n_buckets;
+  return value;
 }
 
-/* Compare two strings for equality.  */
+/* Compare two prefixes for equality.  */
 static bool
-hash_string_compare (void const *name1, void const *name2)
+name_prefix_compare (void const *entry1, void const *entry2)
 {
-  return strcmp (name1, name2) == 0;
+  struct name_prefix const *p1 = entry1;
+  struct name_prefix const *p2 = entry2;
+  return p1->len == p2->len && memcmp (p1->str, p2->str, p1->len) == 0;
 }
 
-/* Return zero if TABLE contains a LEN-character long prefix of STRING,
-   otherwise, insert a newly allocated copy of this prefix to TABLE and
+/* Return false if TABLE contains the LEN-byte long prefix of STRING.
+   Otherwise, insert a newly allocated copy of this prefix to TABLE and
    return true.  If RETURN_PREFIX is nonnull, point it to the allocated
-   copy. */
+   copy.  Only the first insertion of a prefix allocates memory.  */
 static bool
-hash_string_insert_prefix (Hash_table **table, char const *string, size_t len,
+hash_string_insert_prefix (Hash_table **table, char const *string, idx_t len,
 			   const char **return_prefix)
 {
   Hash_table *t = *table;
-  char *s = ximemdup0 (string, len);
-  char *e;
+  struct name_prefix key = { .str = string, .len = len };
+  struct name_prefix *e;
 
-  if (! ((t
-	  || (*table = t = hash_initialize (0, nullptr, hash_string_hasher,
-					    hash_string_compare, nullptr)))
-	 && (e = hash_insert (t, s))))
+  if (t && hash_lookup (t, &key))
+    return false;
+  if (! (t
+	 || (*table = t = hash_initialize (0, nullptr, name_prefix_hasher,
+					   name_prefix_compare, nullptr))))
     xalloc_die ();
 
-  if (e == s)
-    {
-      if (return_prefix)
-	*return_prefix = s;
-      return true;
-    }
-  else
-    {
-      free (s);
-      return false;
-    }
+  e = xmalloc (offsetof (struct name_prefix, buf) + len + 1);
+  e->str = memcpy (e->buf, string, len);
+  e->buf[len] = '\0';
+  e->len = len;
+  if (hash_insert (t, e) != e)
+    xalloc_die ();
+  if (return_prefix)
+    *return_prefix = e->buf;
+  return true;
 }
 
 
@@ -80,6 +104,62 @@ removed_prefixes_p (void)
          || (prefix_table[1] && hash_get_n_entries (prefix_table[1]) != 0);
 }
 
+/* Return the length of the sequence of prefixes of FILE_NAME each of
+   which would cause the file name to escape the working directory on
+   this platform.  */
+static idx_t
+unsafe_prefix_len (char const *file_name)
+{
+  char const *p = file_name;
+
+  for (;;)
+    {
+      if (ISSLASH (*p))
+	p++;
+      else if (p[0] == '.' && p[1] == '.' && (ISSLASH (p[2]) || !p[2]))
+	p += 2;
+      else
+	{
+	  int prefix_len = FILE_SYSTEM_PREFIX_LEN (p);
+	  if (prefix_len == 0)
+	    break;
+	  p += prefix_len;
+	}
+    }
+  return p - file_name;
+}
+
+/* Record that the LEN-byte long prefix of FILE_NAME was removed, and
+   warn the user the first time it is.  */
+static void
+note_removed_prefix (char const *file_name, idx_t len, bool link_target)
+{
+  const char *prefix;
+
+  if (hash_string_insert_prefix (&prefix_table[link_target], file_name,
+				 len, &prefix))
+    {
+      static char const *const diagnostic[] =
+      {
+	N_("Removing leading '%s' from member names"),
+	N_("Removing leading '%s' from hard link targets")
+      };
+      paxwarn (0, _(diagnostic[link_target]), prefix);
+    }
+}
+
+/* Warn the user that '.' stands for an empty name */
+static void
+note_empty_name (bool link_target)
+{
+  static char const *const diagnostic[] =
+  {
+    N_("Substituting '.' for empty member name"),
+    N_("Substituting '.' for empty hard link target")
+  };
+  paxwarn (0, "%s", _(diagnostic[link_target]));
+}
+
 /* Return a safer suffix of FILE_NAME, or "." if it has no safer suffix.
    Skip any sequence of prefixes each of which would cause
    the file name to escape the working directory on this platform.
@@ -96,54 +176,198 @@ safer_name_suffix (char const *file_name, bool link_target,
 
   if (!absolute_names)
     {
-      /* Skip any sequences of prefixes each of which would cause the
-	 resulting file name to escape the working directory on this platform.
-         The resulting file name is relative, not absolute.  */
-      for (;;)
-	{
-	  if (ISSLASH (*p))
-	    p++;
-	  else if (p[0] == '.' && p[1] == '.' && (ISSLASH (p[2]) || !p[2]))
-	    p += 2;
-	  else
-	    {
-	      int prefix_len = FILE_SYSTEM_PREFIX_LEN (p);
-	      if (prefix_len == 0)
-		break;
-	      p += prefix_len;
-	    }
-	}
-
+      p += unsafe_prefix_len (file_name);
       if (p != file_name)
-	{
-	  const char *prefix;
-	  if (hash_string_insert_prefix (&prefix_table[link_target], file_name,
-					 p - file_name, &prefix))
-	    {
-	      static char const *const diagnostic[] =
-	      {
-		N_("Removing leading '%s' from member names"),
-		N_("Removing leading '%s' from hard link targets")
-	      };
-	      paxwarn (0, _(diagnostic[link_target]), prefix);
-	    }
-	}
+	note_removed_prefix (file_name, p - file_name, link_target);
     }
 
   if (! *p)
     {
       if (p == file_name)
-	{
-	  static char const *const diagnostic[] =
-	  {
-	    N_("Substituting '.' for empty member name"),
-	    N_("Substituting '.' for empty hard link target")
-	  };
-	  paxwarn (0, "%s", _(diagnostic[link_target]));
-	}
+	note_empty_name (link_target);
 
       p = ".";
     }
 
   return (char *) p;
 }
+
+
+/* Batch normalization.
+
+   Most member names need nothing more than a copy: they are relative,
+   and have no empty or "." components and no trailing slash.  Such
+   names are told from the others by looking for a slash followed by a
+   slash, a dot or the terminating null, a test the vector kernels below
+   do 16 or 32 bytes at a time.  The kernel is chosen at run time
+   according to the capabilities of the CPU, as for the header
+   checksums.  The others are rebuilt component by component.  */
+
+/* Return the index of the first slash among the LEN bytes at P that is
+   followed by a slash, a dot or a null byte, or LEN if there is none.
+   P[LEN] must be a null byte.  */
+typedef idx_t (*name_scan_fp) (char const *p, idx_t len);
+
+static idx_t
+name_scan_generic (char const *p, idx_t len)
+{
+  for (idx_t i = 0; i < len; i++)
+    if (ISSLASH (p[i])
+	&& (ISSLASH (p[i + 1]) || p[i + 1] == '.' || !p[i + 1]))
+      return i;
+  return len;
+}
+
+#if HAVE_X86_SIMD
+/* The kernels load each vector at P + I and P + I + 1, so that the
+   byte after each one is at hand.  The second load reads at most up to
+   the terminating null.  */
+__attribute__ ((target ("sse2")))
+static idx_t
+name_scan_sse2 (char const *p, idx_t len)
+{
+  __m128i const slash = _mm_set1_epi8 ('/');
+  __m128i const dot = _mm_set1_epi8 ('.');
+  __m128i const nul = _mm_setzero_si128 ();
+  idx_t i = 0;
+
+  for (; len - i >= (idx_t) sizeof (__m128i); i += sizeof (__m128i))
+    {
+      __m128i v = _mm_loadu_si128 ((__m128i const *) (p + i));
+      __m128i w = _mm_loadu_si128 ((__m128i const *) (p + i + 1));
+      __m128i next = _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (w, slash),
+						 _mm_cmpeq_epi8 (w, dot)),
+				   _mm_cmpeq_epi8 (w, nul));
+      int mask = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (v, slash),
+						   next));
+      if (mask)
+	return i + __builtin_ctz (mask);
+    }
+  return i + name_scan_generic (p + i, len - i);
+}
+
+__attribute__ ((target ("avx2")))
+static idx_t
+name_scan_avx2 (char const *p, idx_t len)
+{
+  __m256i const slash = _mm256_set1_epi8 ('/');
+  __m256i const dot = _mm256_set1_epi8 ('.');
+  __m256i const nul = _mm256_setzero_si256 ();
+  idx_t i = 0;
+
+  for (; len - i >= (idx_t) sizeof (__m256i); i += sizeof (__m256i))
+    {
+      __m256i v = _mm256_loadu_si256 ((__m256i const *) (p + i));
+      __m256i w = _mm256_loadu_si256 ((__m256i const *) (p + i + 1));
+      __m256i next = _mm256_or_si256
+	(_mm256_or_si256 (_mm256_cmpeq_epi8 (w, slash),
+			  _mm256_cmpeq_epi8 (w, dot)),
+	 _mm256_cmpeq_epi8 (w, nul));
+      unsigned mask = _mm256_movemask_epi8
+	(_mm256_and_si256 (_mm256_cmpeq_epi8 (v, slash), next));
+      if (mask)
+	return i + __builtin_ctz (mask);
+    }
+  return i + name_scan_generic (p + i, len - i);
+}
+#endif
+
+static name_scan_fp name_scan = name_scan_generic;
+static pthread_once_t name_scan_once = PTHREAD_ONCE_INIT;
+
+static void
+name_scan_select (void)
+{
+  /* The vector kernels know of no separator but the slash */
+#if HAVE_X86_SIMD && ! ISSLASH ('\\')
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    name_scan = name_scan_avx2;
+  else if (__builtin_cpu_supports ("sse2"))
+    name_scan = name_scan_sse2;
+#endif
+}
+
+/* Grow the object in STK with the components of P that are neither
+   empty nor ".", separated by single slashes.  Set *DOT_DOT if one of
+   them is "..".  */
+static void
+name_components (struct obstack *stk, char const *p, bool *dot_dot)
+{
+  idx_t start = obstack_object_size (stk);
+
+  while (*p)
+    {
+      char const *q;
+
+      while (ISSLASH (*p))
+	p++;
+      for (q = p; *q && !ISSLASH (*q); q++)
+	continue;
+      idx_t len = q - p;
+      if (len == 0)
+	break;
+      if (! (len == 1 && p[0] == '.'))
+	{
+	  if (len == 2 && p[0] == '.' && p[1] == '.')
+	    *dot_dot = true;
+	  if (obstack_object_size (stk) > start)
+	    obstack_1grow (stk, '/');
+	  obstack_grow (stk, p, len);
+	}
+      p = q;
+    }
+}
+
+/* Normalize the N member names in NAMES, storing the results in RESULT
+   and their strings in ARENA.  Each name is first shortened as by
+   safer_name_suffix, unless FLAGS has PAX_NAME_ABSOLUTE, and with the
+   same diagnostics.  Repeated slashes, "." components and trailing
+   slashes are then removed.  A name that ends up empty becomes ".".
+   No object may be growing in ARENA.  */
+void
+pax_normalize_names (struct obstack *arena, char const *const *names,
+		     idx_t n, int flags, struct pax_name *result)
+{
+  bool link_target = flags & PAX_NAME_LINK_TARGET;
+
+  pthread_once (&name_scan_once, name_scan_select);
+  for (idx_t i = 0; i < n; i++)
+    {
+      char const *file_name = names[i];
+      char const *p = file_name;
+      struct pax_name *r = &result[i];
+      bool rooted = false;
+
+      if (flags & PAX_NAME_ABSOLUTE)
+	rooted = ISSLASH (*p);
+      else
+	{
+	  p += unsafe_prefix_len (file_name);
+	  if (p != file_name)
+	    note_removed_prefix (file_name, p - file_name, link_target);
+	}
+
+      idx_t len = strlen (p);
+      r->dot_dot = false;
+      if (len > 0 && !rooted && p[0] != '.' && name_scan (p, len) == len)
+	obstack_grow (arena, p, len);
+      else
+	{
+	  if (rooted)
+	    obstack_1grow (arena, '/');
+	  name_components (arena, p, &r->dot_dot);
+	  if (obstack_object_size (arena) == 0)
+	    {
+	      if (!*file_name)
+		note_empty_name (link_target);
+	      obstack_1grow (arena, '.');
+	    }
+	}
+      r->len = obstack_object_size (arena);
+      r->had_trailing_slash = (len > 0 && ISSLASH (p[len - 1])
+			       && r->len > rooted);
+      obstack_1grow (arena, '\0');
+      r->name = obstack_finish (arena);
+    }
+}
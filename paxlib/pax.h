@@ -17,6 +17,8 @@
    You should have received a copy of the GNU General Public License along
    with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
 
+#include <tar.h>
+
 struct tar_stat_info
 {
   char *orig_file_name;     /* name of file read from the archive header */
@@ -47,8 +49,31 @@ struct tar_stat_info
 			       not sparse */
   idx_t sparse_map_size;   /* Size of the sparse map */
   struct sp_array *sparse_map;
+
+  struct pax_stat_arena *arena; /* Storage for the strings above */
 };
 
+void pax_stat_init (struct tar_stat_info *st);
+void *pax_stat_alloc (struct tar_stat_info *st, idx_t size);
+char *pax_stat_memdup0 (struct tar_stat_info *st, char const *s, idx_t len);
+void pax_stat_sparse_add (struct tar_stat_info *st, off_t offset,
+			  off_t numbytes);
+void pax_stat_reset (struct tar_stat_info *st);
+void pax_stat_destroy (struct tar_stat_info *st);
+
+/* Capturing the status of files */
+enum
+  {
+    PAX_STAT_TIMES     = 0x1, /* Access and status change times too */
+    PAX_STAT_DONT_SYNC = 0x2  /* Cached attributes will do */
+  };
+
+int pax_stat_lstat (struct stat *sb, int dirfd, char const *name, int flags);
+void pax_stat_set_times (struct tar_stat_info *st, enum archive_format format,
+			 int flags);
+int pax_stat_capture (struct tar_stat_info *st, int dirfd, char const *name,
+		      enum archive_format format, int flags);
+
 
 /* Remote device manipulations */
 int rmt_open (const char *file_name, int open_mode, int bias,
@@ -58,6 +83,7 @@ ptrdiff_t rmt_read (int handle, char *buffer, idx_t length);
 idx_t rmt_write (int handle, char *buffer, idx_t length);
 off_t rmt_lseek (int handle, off_t offset, int whence);
 int rmt_ioctl (int handle, unsigned long int operation, char *argument);
+extern bool rmt_checksum_option;
 
 
 /* Tar-specific functions */
@@ -65,3 +91,202 @@ void tar_archive_create (paxbuf_t *pbuf, const char *filename,
 			 int remote, int mode, idx_t bfactor);
 void tar_set_rmt (paxbuf_t pbuf, const char *rmt);
 void tar_set_rsh (paxbuf_t pbuf, const char *rsh);
+
+
+/* Header decoding */
+enum pax_header_status
+  {
+    PAX_HEADER_SUCCESS,         /* Valid header */
+    PAX_HEADER_ZERO_BLOCK,      /* Block of zeros */
+    PAX_HEADER_FAILURE          /* Invalid header or bad checksum */
+  };
+
+bool pax_decode_number (char const *where, idx_t digs,
+			intmax_t minval, uintmax_t maxval, intmax_t *val);
+int pax_header_sum (union block const *blk, int *ssum);
+enum pax_header_status pax_header_checksum (union block const *blk);
+idx_t pax_header_checksum_n (union block const *blk, idx_t n,
+			     enum pax_header_status *status);
+enum archive_format pax_header_format (union block const *blk);
+bool pax_decode_sparse (struct tar_stat_info *st, struct sparse const *sp,
+			int n);
+enum pax_header_status pax_decode_header (union block const *blk,
+					  struct tar_stat_info *st,
+					  enum archive_format *pformat);
+
+
+/* Header encoding */
+enum
+  {
+    PAX_ENCODE_NAME     = 0x001,
+    PAX_ENCODE_LINKNAME = 0x002,
+    PAX_ENCODE_SIZE     = 0x004,
+    PAX_ENCODE_UID      = 0x008,
+    PAX_ENCODE_GID      = 0x010,
+    PAX_ENCODE_MTIME    = 0x020,
+    PAX_ENCODE_UNAME    = 0x040,
+    PAX_ENCODE_GNAME    = 0x080,
+    PAX_ENCODE_DEV      = 0x100
+  };
+
+int pax_encode_header (union block *blk, struct tar_stat_info const *st,
+		       char typeflag, enum archive_format format);
+
+
+/* POSIX extended headers */
+typedef struct pax_xheader *pax_xheader_t;
+
+enum pax_xkeyword
+  {
+    PAX_XK_UNKNOWN,
+    PAX_XK_ATIME,
+    PAX_XK_CHARSET,
+    PAX_XK_COMMENT,
+    PAX_XK_CTIME,
+    PAX_XK_GID,
+    PAX_XK_GNAME,
+    PAX_XK_HDRCHARSET,
+    PAX_XK_LINKPATH,
+    PAX_XK_MTIME,
+    PAX_XK_PATH,
+    PAX_XK_SIZE,
+    PAX_XK_UID,
+    PAX_XK_UNAME,
+    PAX_XK_GNU_DUMPDIR,
+    PAX_XK_GNU_SPARSE_MAJOR,
+    PAX_XK_GNU_SPARSE_MINOR,
+    PAX_XK_GNU_SPARSE_NAME,
+    PAX_XK_GNU_SPARSE_REALSIZE,
+    PAX_XK_GNU_SPARSE_SIZE,
+    PAX_XK_GNU_SPARSE_NUMBLOCKS,
+    PAX_XK_GNU_SPARSE_OFFSET,
+    PAX_XK_GNU_SPARSE_NUMBYTES,
+    PAX_XK_GNU_SPARSE_MAP,
+    PAX_XK_GNU_VOLUME_LABEL,
+    PAX_XK_GNU_VOLUME_FILENAME,
+    PAX_XK_GNU_VOLUME_SIZE,
+    PAX_XK_GNU_VOLUME_OFFSET,
+    PAX_XK_SCHILY_DEV,
+    PAX_XK_SCHILY_DEVMAJOR,
+    PAX_XK_SCHILY_DEVMINOR,
+    PAX_XK_SCHILY_INO,
+    PAX_XK_SCHILY_NLINK,
+    PAX_XK_SCHILY_FILETYPE,
+    PAX_XK_SCHILY_REALSIZE,
+    PAX_XK_SCHILY_FFLAGS,
+    PAX_XK_SCHILY_ACL_ACCESS,
+    PAX_XK_SCHILY_ACL_DEFAULT,
+    PAX_XK_SCHILY_ACL_ACE,
+    PAX_XK_SELINUX,             /* RHT.security.selinux */
+    PAX_XK_SCHILY_XATTR,        /* SCHILY.xattr.NAME */
+    PAX_XK_LIBARCHIVE_XATTR,    /* LIBARCHIVE.xattr.NAME */
+    PAX_XK_COUNT
+  };
+
+/* A record of an extended header.  The strings point into the arena of
+   the header and are null-terminated.  */
+struct pax_xrecord
+{
+  enum pax_xkeyword keyword;
+  char const *key;
+  idx_t key_len;
+  char const *value;          /* May contain nulls (e.g. xattr values) */
+  idx_t value_len;
+  bool global;                /* Comes from a global header */
+};
+
+pax_xheader_t pax_xheader_create (void);
+void pax_xheader_destroy (pax_xheader_t *pxh);
+void pax_xheader_reset (pax_xheader_t xh);
+enum pax_xkeyword pax_xkeyword_lookup (char const *key, idx_t len);
+int pax_xheader_parse (pax_xheader_t xh, char const *data, idx_t size,
+		       bool global);
+int pax_xheader_read (pax_xheader_t xh, paxbuf_t buf, union block const *blk);
+struct pax_xrecord const *pax_xheader_records (pax_xheader_t xh,
+					       idx_t *count);
+struct pax_xrecord const *pax_xheader_find (pax_xheader_t xh,
+					    enum pax_xkeyword kw);
+int pax_xheader_apply (pax_xheader_t xh, struct tar_stat_info *st);
+
+
+/* User and group name caches */
+void pax_stat_set_owner_names (struct tar_stat_info *st);
+void pax_stat_resolve_owner (struct tar_stat_info *st);
+bool pax_name_to_uid (char const *name, uid_t *uid);
+bool pax_name_to_gid (char const *name, gid_t *gid);
+void pax_idcache_clear (void);
+
+
+/* Sparse files */
+int pax_sparse_map (int fd, struct tar_stat_info *st);
+off_t pax_sparse_data_size (struct tar_stat_info const *st);
+bool pax_sparse_map_valid (struct tar_stat_info const *st, off_t size);
+int pax_sparse_read_map (paxbuf_t buf, struct tar_stat_info *st);
+int pax_sparse_extract (paxbuf_t buf, int fd, struct tar_stat_info const *st);
+
+
+/* Zero detection */
+idx_t pax_zero_blocks (union block const *blk, idx_t n, bool *zero);
+idx_t pax_nonzero_block (union block const *blk, idx_t n);
+bool pax_end_of_archive_p (union block const *blk, idx_t n);
+
+
+/* Parallel archive creation */
+typedef struct pax_create *pax_create_t;
+struct pax_mindex;
+
+/* Contents of a member read ahead by a worker thread */
+enum { PAX_CREATE_CHUNK = 1024 * 1024 };
+
+/* Names of hard-linked files kept in memory; more go to a temporary
+   file */
+enum { PAX_CREATE_HLINK_MEMORY = 64 * 1024 * 1024 };
+
+int pax_create_open (pax_create_t *pc, paxbuf_t buf,
+		     enum archive_format format, int nthreads);
+void pax_create_set_stat_flags (pax_create_t pc, int flags);
+void pax_create_set_mindex (pax_create_t pc, struct pax_mindex *idx);
+int pax_create_add (pax_create_t pc, char const *file_name,
+		    char const *archive_name);
+int pax_create_add_stat (pax_create_t pc, char const *file_name,
+			 char const *archive_name, struct stat const *st);
+int pax_create_finish (pax_create_t pc);
+void pax_create_destroy (pax_create_t *pc);
+
+
+/* Diagnostics from threads.  The helpers of error.c quote names in the
+   static buffer of quotearg_colon and paxerror sets exit_status, so
+   threads issue them through this macro, which holds the mutex LOCK
+   around REPORT and keeps errno for it.  */
+#define PAX_REPORT(lock, report)		\
+  do						\
+    {						\
+      int pax_err_ = errno;			\
+      pthread_mutex_lock (lock);		\
+      errno = pax_err_;				\
+      report;					\
+      pthread_mutex_unlock (lock);		\
+    }						\
+  while (0)
+
+
+/* Parallel extraction */
+typedef struct pax_extract *pax_extract_t;
+
+/* Members larger than this are extracted by the reading thread */
+enum { PAX_EXTRACT_CHUNK = 1024 * 1024 };
+
+int pax_extract_open (pax_extract_t *px, paxbuf_t buf, int nthreads);
+int pax_extract_run (pax_extract_t px);
+void pax_extract_destroy (pax_extract_t *px);
+
+
+/* Parallel verification */
+typedef struct pax_verify *pax_verify_t;
+
+/* Slices of member data hashed by the workers */
+enum { PAX_VERIFY_CHUNK = 1024 * 1024 };
+
+int pax_verify_open (pax_verify_t *pv, paxbuf_t buf, int nthreads);
+int pax_verify_run (pax_verify_t pv);
+void pax_verify_destroy (pax_verify_t *pv);
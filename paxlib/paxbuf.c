@@ -33,6 +33,7 @@ struct pax_buffer
   idx_t record_size;	      /* Size of a record, bytes */
   idx_t record_level;	      /* Number of bytes stored in the record */
   idx_t pos;		      /* Current position in buffer */
+  off_t base;                 /* Archive offset of the record start */
   char  *record;              /* Record buffer, record_size bytes long */
 
   int status;                 /* Return code from the latest I/O */
@@ -41,12 +42,20 @@ struct pax_buffer
   paxbuf_io_fp writer;        /* Writes data */
   paxbuf_io_fp reader;        /* Reads data */
   paxbuf_seek_fp seek;        /* Seeks the underlying transport layer */
+  paxbuf_size_fp size;        /* Returns the size of the transport data */
     /* Terminal functions */
   paxbuf_term_fp open;        /* Open a new volume */
   paxbuf_term_fp close;       /* Close the existing volume */
   paxbuf_destroy_fp destroy;  /* Destroy the closure data */
     /* Other callbacks */
   paxbuf_wrapper_fp wrapper;  /* Called when writer or reader returns EOF */
+    /* Filter */
+  paxbuf_filter_fp filter_reader; /* Reads data through the filter */
+  paxbuf_filter_fp filter_writer; /* Writes data through the filter */
+  paxbuf_filter_seek_fp filter_seek; /* Seeks in the filtered data */
+  paxbuf_filter_term_fp filter_close; /* Flushes the filter on close */
+  paxbuf_destroy_fp filter_destroy; /* Destroys the filter data */
+  void *filter_closure;       /* Filter-specific data */
 
   void *closure;              /* Implementation-specific data */
   int mode;                   /* Working mode */
@@ -143,8 +152,17 @@ paxbuf_create (paxbuf_t *pbuf, int mode, void *closure, idx_t record_size)
 
   buf->record_size = record_size;
   buf->record_level = 0;
+  buf->pos = 0;
+  buf->base = 0;
+  buf->size = nullptr;
   buf->closure = closure;
   buf->mode = mode;
+  buf->filter_reader = nullptr;
+  buf->filter_writer = nullptr;
+  buf->filter_seek = nullptr;
+  buf->filter_close = nullptr;
+  buf->filter_destroy = nullptr;
+  buf->filter_closure = nullptr;
 
   paxbuf_set_io (buf, default_reader, default_writer, default_seek);
   paxbuf_set_term (buf, default_open, default_close, default_destroy);
@@ -159,6 +177,8 @@ paxbuf_destroy (paxbuf_t *pbuf)
 {
   paxbuf_t buf = *pbuf;
   free (buf->record);
+  if (buf->filter_destroy)
+    buf->filter_destroy (buf->filter_closure);
   if (buf->destroy)
     buf->destroy (buf->closure);
   free (buf);
@@ -190,20 +210,106 @@ paxbuf_set_wrapper (paxbuf_t buf, paxbuf_wrapper_fp wrap)
   buf->wrapper = wrap;
 }
 
+/* Install a filter on BUF.  RD and WR are called in place of the
+   transport reader and writer, either of them may be null, in which
+   case data in that direction bypass the filter.  DESTROY, if not null,
+   is called on FCLOSURE when BUF is destroyed.  A buffer has at most
+   one filter; installing a new one replaces (without destroying) the
+   previous one.  */
+void
+paxbuf_set_filter (paxbuf_t buf, void *fclosure,
+		   paxbuf_filter_fp rd, paxbuf_filter_fp wr,
+		   paxbuf_destroy_fp destroy)
+{
+  buf->filter_closure = fclosure;
+  buf->filter_reader = rd;
+  buf->filter_writer = wr;
+  buf->filter_seek = nullptr;
+  buf->filter_close = nullptr;
+  buf->filter_destroy = destroy;
+}
+
+/* Set the function that paxbuf_seek calls instead of the transport seek
+   while the filter is installed.  Offsets passed to it refer to the
+   filtered (e.g. decompressed) data.  */
+void
+paxbuf_set_filter_seek (paxbuf_t buf, paxbuf_filter_seek_fp seek)
+{
+  buf->filter_seek = seek;
+}
+
+/* Set the function called by paxbuf_close after the last record has
+   been flushed and before the transport is closed.  */
+void
+paxbuf_set_filter_close (paxbuf_t buf, paxbuf_filter_term_fp close)
+{
+  buf->filter_close = close;
+}
+
+void
+paxbuf_set_size (paxbuf_t buf, paxbuf_size_fp size)
+{
+  buf->size = size;
+}
+
 
 /* 2. I/O operations and seek */
 
+/* Raw transport I/O, for use by filters */
+pax_io_status_t
+paxbuf_transport_read (paxbuf_t buf, void *data, idx_t size, idx_t *rsize)
+{
+  return buf->reader (buf->closure, data, size, rsize);
+}
+
+pax_io_status_t
+paxbuf_transport_write (paxbuf_t buf, void *data, idx_t size, idx_t *wsize)
+{
+  return buf->writer (buf->closure, data, size, wsize);
+}
+
+int
+paxbuf_transport_seek (paxbuf_t buf, off_t offset)
+{
+  return buf->seek (buf->closure, offset);
+}
+
+/* Return the size of the data available from the transport, or -1 if
+   it is not known.  */
+off_t
+paxbuf_transport_size (paxbuf_t buf)
+{
+  return buf->size ? buf->size (buf->closure) : -1;
+}
+
+static pax_io_status_t
+buffer_read (paxbuf_t buf, void *data, idx_t size, idx_t *rsize)
+{
+  if (buf->filter_reader)
+    return buf->filter_reader (buf, buf->filter_closure, data, size, rsize);
+  return buf->reader (buf->closure, data, size, rsize);
+}
+
+static pax_io_status_t
+buffer_write (paxbuf_t buf, void *data, idx_t size, idx_t *wsize)
+{
+  if (buf->filter_writer)
+    return buf->filter_writer (buf, buf->filter_closure, data, size, wsize);
+  return buf->writer (buf->closure, data, size, wsize);
+}
+
 static pax_io_status_t
 fill_buffer (paxbuf_t buf)
 {
   pax_io_status_t status = pax_io_success;
 
+  buf->base += buf->record_level;
   buf->record_level = 0;
   do
     {
       idx_t s = 0;
 
-      status = buf->reader (buf->closure, buf->record + buf->record_level,
+      status = buffer_read (buf, buf->record + buf->record_level,
 			    buf->record_size - buf->record_level, &s);
       buf->record_level += s;
     }
@@ -225,14 +331,16 @@ flush_buffer (paxbuf_t buf)
   do
     {
       idx_t s = 0;
-      status = buf->writer (buf->closure, buf->record + buf->record_level,
-			    buf->record_size - buf->record_level, &s);
+      status = buffer_write (buf, buf->record + buf->record_level,
+			     buf->record_size - buf->record_level, &s);
       buf->record_level += s;
     }
   while ((status == pax_io_success && buf->record_level < buf->record_size)
 	 || (status == pax_io_eof
 	     && buf->wrapper
 	     && buf->wrapper (buf->closure) == 0));
+  buf->base += buf->record_level;
+  buf->record_level = 0;
   buf->pos = 0;
   return status;
 }
@@ -294,10 +402,22 @@ paxbuf_write (paxbuf_t buf, char *data, idx_t size, idx_t *wsize)
 int
 paxbuf_seek (paxbuf_t buf, off_t offset)
 {
-  /* FIXME */
+  /* FIXME: Offset should be rounded to the record boundary for devices
+     that cannot seek within a record. */
+  buf->record_level = buf->pos = 0;
+  buf->base = offset;
+  if (buf->filter_seek)
+    return buf->filter_seek (buf, buf->filter_closure, offset);
   return buf->seek (buf->closure, offset);
 }
 
+/* Return the archive offset of the next byte to be read or written */
+off_t
+paxbuf_tell (paxbuf_t buf)
+{
+  return buf->base + buf->pos;
+}
+
 
 /* 3. Open/close */
 int
@@ -309,10 +429,13 @@ paxbuf_open (paxbuf_t buf)
 int
 paxbuf_close (paxbuf_t buf)
 {
-  pax_io_status_t status;
+  pax_io_status_t status = pax_io_success;
+  int rc = 0;
   if ((buf->mode & PAXBUF_WRITE) && buf->pos != 0)
     status = flush_buffer (buf);
-  return buf->close (buf->closure, buf->mode) || status != pax_io_success;
+  if (buf->filter_close)
+    rc = buf->filter_close (buf, buf->filter_closure, buf->mode);
+  return buf->close (buf->closure, buf->mode) || rc || status != pax_io_success;
 }
 
 
@@ -329,3 +452,24 @@ paxbuf_get_mode (paxbuf_t buf)
 {
   return buf->mode;
 }
+
+void *
+paxbuf_get_filter_data (paxbuf_t buf)
+{
+  return buf->filter_closure;
+}
+
+idx_t
+paxbuf_get_record_size (paxbuf_t buf)
+{
+  return buf->record_size;
+}
+
+/* Return true if the part of the current record that has been read in
+   but not yet consumed is all zeros, as the rest of the last record of
+   an archive should be.  */
+bool
+paxbuf_record_zero_p (paxbuf_t buf)
+{
+  return pax_zero_p (buf->record + buf->pos, buf->record_level - buf->pos);
+}
@@ -36,11 +36,24 @@ typedef pax_io_status_t (*paxbuf_io_fp) (void *closure,
 					 void *data, idx_t size,
 					 idx_t *ret_size);
 typedef int (*paxbuf_seek_fp) (void *closure, off_t offset);
+typedef off_t (*paxbuf_size_fp) (void *closure);
 typedef int (*paxbuf_term_fp) (void *closure, int mode);
 typedef int (*paxbuf_destroy_fp) (void *closure);
 typedef int (*paxbuf_wrapper_fp) (void *closure);
 typedef const char * (*paxbuf_error_fp) (void *closure);
 
+/* A filter sits between the record buffer and the transport layer.
+   Its reader and writer are called instead of the transport ones and
+   use paxbuf_transport_read and paxbuf_transport_write to get to the
+   underlying data. */
+typedef pax_io_status_t (*paxbuf_filter_fp) (paxbuf_t buf, void *fclosure,
+					     void *data, idx_t size,
+					     idx_t *ret_size);
+typedef int (*paxbuf_filter_seek_fp) (paxbuf_t buf, void *fclosure,
+				      off_t offset);
+typedef int (*paxbuf_filter_term_fp) (paxbuf_t buf, void *fclosure,
+				      int mode);
+
 int paxbuf_create (paxbuf_t *buf, int mode, void *closure, idx_t record_size);
 int paxbuf_open (paxbuf_t buf);
 int paxbuf_close (paxbuf_t buf);
@@ -51,14 +64,32 @@ void paxbuf_set_term (paxbuf_t buf,
 		      paxbuf_destroy_fp destroy);
 void paxbuf_set_wrapper (paxbuf_t buf, paxbuf_wrapper_fp wrap);
 void paxbuf_set_error (paxbuf_t buf, paxbuf_error_fp err);
+void paxbuf_set_filter (paxbuf_t buf, void *fclosure,
+			paxbuf_filter_fp rd, paxbuf_filter_fp wr,
+			paxbuf_destroy_fp destroy);
+void paxbuf_set_filter_seek (paxbuf_t buf, paxbuf_filter_seek_fp seek);
+void paxbuf_set_filter_close (paxbuf_t buf, paxbuf_filter_term_fp close);
+void paxbuf_set_size (paxbuf_t buf, paxbuf_size_fp size);
 
 pax_io_status_t paxbuf_read (paxbuf_t pbuf, char *buf, idx_t size,
 			     idx_t *rsize);
 pax_io_status_t paxbuf_write (paxbuf_t pbuf, char *buf, idx_t size,
 			      idx_t *rsize);
 int paxbuf_seek (paxbuf_t buf, off_t offset);
+off_t paxbuf_tell (paxbuf_t buf);
+pax_io_status_t paxbuf_transport_read (paxbuf_t pbuf, void *buf, idx_t size,
+				       idx_t *rsize);
+pax_io_status_t paxbuf_transport_write (paxbuf_t pbuf, void *buf, idx_t size,
+					idx_t *rsize);
+int paxbuf_transport_seek (paxbuf_t buf, off_t offset);
+off_t paxbuf_transport_size (paxbuf_t buf);
 
 void paxbuf_destroy (paxbuf_t *buf);
 
 void *paxbuf_get_data (paxbuf_t buf);
+void *paxbuf_get_filter_data (paxbuf_t buf);
+idx_t paxbuf_get_record_size (paxbuf_t buf);
 int paxbuf_get_mode (paxbuf_t buf);
+bool paxbuf_record_zero_p (paxbuf_t buf);
+
+bool pax_zero_p (void const *buf, idx_t n);
@@ -120,4 +120,23 @@ _Noreturn void fatal_exit (void);
 bool removed_prefixes_p (void);
 char *safer_name_suffix (char const *file_name, bool link_target, bool absolute_names);
 
+/* A member name normalized by pax_normalize_names */
+struct pax_name
+{
+  char *name;               /* The normalized name, in the arena */
+  idx_t len;                /* Its length */
+  bool had_trailing_slash;  /* The name ended with a slash */
+  bool dot_dot;             /* One of the components of NAME is ".." */
+};
+
+enum
+  {
+    PAX_NAME_LINK_TARGET = 0x1, /* The names are hard link targets */
+    PAX_NAME_ABSOLUTE    = 0x2  /* Keep leading slashes and ".." */
+  };
+
+struct obstack;
+void pax_normalize_names (struct obstack *arena, char const *const *names,
+			  idx_t n, int flags, struct pax_name *result);
+
 #endif
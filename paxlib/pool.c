@@ -0,0 +1,190 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <system.h>
+#include <pthread.h>
+#include <nproc.h>
+#include <pool.h>
+
+struct pax_job
+{
+  struct pax_job *next;
+  pax_job_fp fn;
+  void *arg;
+};
+
+struct pax_pool
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond;   /* Signalled when a job is queued */
+  pthread_cond_t idle_cond;   /* Signalled when the pool becomes idle */
+  struct pax_job *head;       /* Queue of pending jobs */
+  struct pax_job *tail;
+  struct pax_job *free_jobs;  /* Recycled job descriptors */
+  idx_t pending;              /* Jobs queued or running */
+  bool stop;                  /* Workers must exit */
+  int nthreads;
+  pthread_t *threads;
+};
+
+static void *
+pool_worker (void *closure)
+{
+  pax_pool_t pool = closure;
+
+  pthread_mutex_lock (&pool->mutex);
+  for (;;)
+    {
+      while (!pool->head && !pool->stop)
+	pthread_cond_wait (&pool->work_cond, &pool->mutex);
+      if (!pool->head)
+	break;
+
+      struct pax_job *job = pool->head;
+      pool->head = job->next;
+      if (!pool->head)
+	pool->tail = nullptr;
+      pax_job_fp fn = job->fn;
+      void *arg = job->arg;
+      job->next = pool->free_jobs;
+      pool->free_jobs = job;
+
+      pthread_mutex_unlock (&pool->mutex);
+      fn (arg);
+      pthread_mutex_lock (&pool->mutex);
+
+      if (--pool->pending == 0)
+	pthread_cond_broadcast (&pool->idle_cond);
+    }
+  pthread_mutex_unlock (&pool->mutex);
+  return nullptr;
+}
+
+/* Create a pool of NTHREADS workers and store it in *POOL.  If NTHREADS
+   is not positive, use the number of available processors.  Return 0 on
+   success, an errno value otherwise.  */
+int
+pax_pool_create (pax_pool_t *ppool, int nthreads)
+{
+  pax_pool_t pool;
+  int rc;
+
+  if (nthreads <= 0)
+    {
+      unsigned long n = num_processors (NPROC_CURRENT);
+      nthreads = n < INT_MAX ? n : INT_MAX;
+    }
+
+  pool = calloc (1, sizeof *pool);
+  if (!pool)
+    return ENOMEM;
+  pool->threads = calloc (nthreads, sizeof pool->threads[0]);
+  if (!pool->threads)
+    {
+      free (pool);
+      return ENOMEM;
+    }
+  pthread_mutex_init (&pool->mutex, nullptr);
+  pthread_cond_init (&pool->work_cond, nullptr);
+  pthread_cond_init (&pool->idle_cond, nullptr);
+
+  for (pool->nthreads = 0; pool->nthreads < nthreads; pool->nthreads++)
+    {
+      rc = pthread_create (&pool->threads[pool->nthreads], nullptr,
+			   pool_worker, pool);
+      if (rc)
+	{
+	  /* Run with whatever we managed to start, unless that is nothing */
+	  if (pool->nthreads > 0)
+	    break;
+	  pax_pool_destroy (&pool);
+	  return rc;
+	}
+    }
+
+  *ppool = pool;
+  return 0;
+}
+
+/* Queue JOB to be called with ARG by one of the workers of POOL.  */
+void
+pax_pool_submit (pax_pool_t pool, pax_job_fp fn, void *arg)
+{
+  struct pax_job *job;
+
+  pthread_mutex_lock (&pool->mutex);
+  job = pool->free_jobs;
+  if (job)
+    pool->free_jobs = job->next;
+  else
+    job = xmalloc (sizeof *job);
+  job->fn = fn;
+  job->arg = arg;
+  job->next = nullptr;
+  if (pool->tail)
+    pool->tail->next = job;
+  else
+    pool->head = job;
+  pool->tail = job;
+  pool->pending++;
+  pthread_cond_signal (&pool->work_cond);
+  pthread_mutex_unlock (&pool->mutex);
+}
+
+/* Wait until all jobs submitted to POOL have finished.  */
+void
+pax_pool_wait (pax_pool_t pool)
+{
+  pthread_mutex_lock (&pool->mutex);
+  while (pool->pending)
+    pthread_cond_wait (&pool->idle_cond, &pool->mutex);
+  pthread_mutex_unlock (&pool->mutex);
+}
+
+/* Finish all pending jobs, stop the workers and free *POOL.  */
+void
+pax_pool_destroy (pax_pool_t *ppool)
+{
+  pax_pool_t pool = *ppool;
+  struct pax_job *job;
+
+  pthread_mutex_lock (&pool->mutex);
+  pool->stop = true;
+  pthread_cond_broadcast (&pool->work_cond);
+  pthread_mutex_unlock (&pool->mutex);
+
+  for (int i = 0; i < pool->nthreads; i++)
+    pthread_join (pool->threads[i], nullptr);
+
+  while ((job = pool->free_jobs))
+    {
+      pool->free_jobs = job->next;
+      free (job);
+    }
+  pthread_cond_destroy (&pool->idle_cond);
+  pthread_cond_destroy (&pool->work_cond);
+  pthread_mutex_destroy (&pool->mutex);
+  free (pool->threads);
+  free (pool);
+  *ppool = nullptr;
+}
+
+int
+pax_pool_size (pax_pool_t pool)
+{
+  return pool->nthreads;
+}
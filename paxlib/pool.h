@@ -0,0 +1,28 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* A fixed-size pool of worker threads executing jobs in FIFO order.  */
+
+typedef struct pax_pool *pax_pool_t;
+
+typedef void (*pax_job_fp) (void *arg);
+
+int pax_pool_create (pax_pool_t *pool, int nthreads);
+void pax_pool_submit (pax_pool_t pool, pax_job_fp job, void *arg);
+void pax_pool_wait (pax_pool_t pool);
+void pax_pool_destroy (pax_pool_t *pool);
+int pax_pool_size (pax_pool_t pool);
@@ -0,0 +1,291 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The reader is shared by extraction and verification, whose worker
+   threads issue diagnostics of their own while it runs: its own are
+   issued with the lock of its caller held.  */
+
+#include <system.h>
+#include <pthread.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+#include <reader.h>
+
+/* Data skipped at a time */
+enum { READER_SKIP_CHUNK = 64 * 1024 };
+
+struct pax_reader
+{
+  paxbuf_t buf;
+  pthread_mutex_t *lock;      /* Held around diagnostics */
+  pax_xheader_t xh;           /* Extended headers */
+  struct tar_stat_info st;    /* Current member */
+  union block blk[2];         /* Its header, and the block after it */
+  bool pending;               /* blk[0] was read after a lone zero block */
+  bool skipping;              /* Looking for a valid header */
+  bool member;                /* A member was handed out */
+  bool end;                   /* The end of the archive was reached */
+  char *long_name;            /* Name from a GNU long name header */
+  char *long_link;            /* Link from a GNU long link header */
+  char *skip_buf;             /* Buffer for skipped data, or null */
+};
+
+/* Read the data of a member of SIZE bytes, and the padding after them,
+   into DATA.  Return 0 on success, EIO otherwise.  */
+int
+pax_reader_read (pax_reader_t r, char *data, idx_t size)
+{
+  idx_t padded = (size + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE;
+  idx_t n;
+
+  if (paxbuf_read (r->buf, data, padded, &n) == pax_io_failure
+      || n != padded)
+    return EIO;
+  return 0;
+}
+
+/* Skip archive data up to the offset END */
+int
+pax_reader_skip_to (pax_reader_t r, off_t end)
+{
+  off_t left = end - paxbuf_tell (r->buf);
+
+  if (left > 0 && !r->skip_buf)
+    r->skip_buf = ximalloc (READER_SKIP_CHUNK);
+  while (left > 0)
+    {
+      idx_t len = left < READER_SKIP_CHUNK ? left : READER_SKIP_CHUNK;
+      idx_t n;
+      if (paxbuf_read (r->buf, r->skip_buf, len, &n) == pax_io_failure
+	  || n != len)
+	return EIO;
+      left -= len;
+    }
+  return 0;
+}
+
+/* Skip SIZE bytes of member data, and their padding */
+int
+pax_reader_skip (pax_reader_t r, off_t size)
+{
+  off_t padded = (size + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE;
+  return pax_reader_skip_to (r, paxbuf_tell (r->buf) + padded);
+}
+
+/* Read the data of the GNU long name header in R into *PNAME */
+static int
+read_long_name (pax_reader_t r, char **pname)
+{
+  union block const *blk = r->blk;
+  intmax_t size;
+
+  if (!pax_decode_number (blk->header.size, sizeof blk->header.size,
+			  1, IDX_MAX - BLOCKSIZE, &size))
+    return EINVAL;
+  free (*pname);
+  *pname = ximalloc ((size + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE);
+  int rc = pax_reader_read (r, *pname, size);
+  if (rc == 0)
+    (*pname)[size - 1] = '\0';
+  return rc;
+}
+
+/* Read the extension headers of the old GNU sparse member in R */
+static int
+read_sparse_ext (pax_reader_t r)
+{
+  bool more = r->blk->oldgnu_header.isextended;
+  union block blk;
+
+  while (more)
+    {
+      int rc = pax_reader_read (r, blk.buffer, BLOCKSIZE);
+      if (rc)
+	return rc;
+      if (!pax_decode_sparse (&r->st, blk.sparse_header.sp,
+			      SPARSES_IN_SPARSE_HEADER))
+	return EINVAL;
+      more = blk.sparse_header.isextended;
+    }
+  return 0;
+}
+
+/* Complete the member whose header is in R with the extended headers
+   and long names before it, and hand it out in *PBLK.  */
+static int
+reader_member (pax_reader_t r, union block const **pblk)
+{
+  struct tar_stat_info *st = &r->st;
+  int rc = pax_xheader_apply (r->xh, st);
+
+  if (rc)
+    return rc;
+  if (r->long_name)
+    st->file_name = pax_stat_memdup0 (st, r->long_name,
+				      strlen (r->long_name));
+  if (r->long_link)
+    st->link_name = pax_stat_memdup0 (st, r->long_link,
+				      strlen (r->long_link));
+  r->member = true;
+  *pblk = r->blk;
+  return 0;
+}
+
+/* Create in *PR a reader of the archive read from BUF, whose
+   diagnostics are issued with LOCK held.  Return 0 on success, an
+   errno value otherwise.  */
+int
+pax_reader_open (pax_reader_t *pr, paxbuf_t buf, pthread_mutex_t *lock)
+{
+  struct pax_reader *r = calloc (1, sizeof *r);
+  if (!r)
+    return ENOMEM;
+  r->buf = buf;
+  r->lock = lock;
+  r->xh = pax_xheader_create ();
+  *pr = r;
+  return 0;
+}
+
+/* Read the headers of the next member, and store in *PBLK its header,
+   valid until the next call, or null at the end of the archive.  The
+   data of the previous member must have been read or skipped.  Return 0
+   on success, EIO if the archive cannot be read and EINVAL if it is
+   malformed.  */
+int
+pax_reader_next (pax_reader_t r, union block const **pblk)
+{
+  struct tar_stat_info *st = &r->st;
+  union block *blk = r->blk;
+  int rc = 0;
+
+  *pblk = nullptr;
+  if (r->member)
+    {
+      pax_xheader_reset (r->xh);
+      free (r->long_name);
+      free (r->long_link);
+      r->long_name = r->long_link = nullptr;
+      r->member = false;
+    }
+
+  while (!r->end)
+    {
+      enum pax_header_status status;
+
+      if (r->pending)
+	r->pending = false;
+      else
+	{
+	  rc = pax_reader_read (r, blk->buffer, BLOCKSIZE);
+	  if (rc)
+	    return rc;
+	}
+      status = pax_decode_header (blk, st, nullptr);
+      if (status == PAX_HEADER_ZERO_BLOCK)
+	{
+	  /* Like tar, end at two zero blocks, and warn of a lone one,
+	     going on after it if the archive does.  */
+	  intmax_t block = paxbuf_tell (r->buf) / BLOCKSIZE - 1;
+	  bool more = pax_reader_read (r, blk[1].buffer, BLOCKSIZE) == 0;
+	  r->end = true;
+	  if (more && pax_end_of_archive_p (blk, 2))
+	    {
+	      /* The rest of the last record is padding, and should be
+		 zeros as well */
+	      if (!paxbuf_record_zero_p (r->buf))
+		PAX_REPORT (r->lock,
+			    paxwarn (0, _("Garbage after the end of the"
+					  " archive")));
+	      break;
+	    }
+	  PAX_REPORT (r->lock, paxwarn (0, _("A lone zero block at %jd"),
+					block));
+	  if (!more)
+	    break;
+	  r->end = false;
+	  blk[0] = blk[1];
+	  r->pending = true;
+	  continue;
+	}
+      if (status == PAX_HEADER_FAILURE)
+	{
+	  if (!r->skipping)
+	    PAX_REPORT (r->lock,
+			paxerror (0, _("Skipping to next header")));
+	  r->skipping = true;
+	  continue;
+	}
+      r->skipping = false;
+
+      switch (blk->header.typeflag)
+	{
+	case XHDTYPE:
+	case XGLTYPE:
+	  rc = pax_xheader_read (r->xh, r->buf, blk);
+	  break;
+
+	case GNUTYPE_LONGNAME:
+	  rc = read_long_name (r, &r->long_name);
+	  break;
+
+	case GNUTYPE_LONGLINK:
+	  rc = read_long_name (r, &r->long_link);
+	  break;
+
+	case GNUTYPE_VOLHDR:
+	case GNUTYPE_MULTIVOL:
+	  rc = pax_reader_skip (r, st->archive_file_size);
+	  break;
+
+	case GNUTYPE_SPARSE:
+	  rc = read_sparse_ext (r);
+	  if (rc == 0)
+	    return reader_member (r, pblk);
+	  break;
+
+	default:
+	  return reader_member (r, pblk);
+	}
+      if (rc)
+	return rc;
+    }
+  return 0;
+}
+
+/* Return the status of the current member, which the caller may
+   change until the next call to pax_reader_next.  */
+struct tar_stat_info *
+pax_reader_stat (pax_reader_t r)
+{
+  return &r->st;
+}
+
+void
+pax_reader_destroy (pax_reader_t *pr)
+{
+  struct pax_reader *r = *pr;
+
+  pax_xheader_destroy (&r->xh);
+  pax_stat_destroy (&r->st);
+  free (r->long_name);
+  free (r->long_link);
+  free (r->skip_buf);
+  free (r);
+  *pr = nullptr;
+}
@@ -0,0 +1,34 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Reading the members of an archive.
+
+   The headers of each member are read and decoded, together with the
+   extended headers, GNU long names and old GNU sparse headers before
+   it, and the archive ends at two zero blocks, as tar does.  The caller
+   gets the members one at a time, and reads or skips the data of each
+   before asking for the next.  */
+
+typedef struct pax_reader *pax_reader_t;
+
+int pax_reader_open (pax_reader_t *pr, paxbuf_t buf, pthread_mutex_t *lock);
+int pax_reader_next (pax_reader_t r, union block const **pblk);
+struct tar_stat_info *pax_reader_stat (pax_reader_t r);
+int pax_reader_read (pax_reader_t r, char *data, idx_t size);
+int pax_reader_skip_to (pax_reader_t r, off_t end);
+int pax_reader_skip (pax_reader_t r, off_t size);
+void pax_reader_destroy (pax_reader_t *pr);
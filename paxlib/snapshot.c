@@ -0,0 +1,847 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <system.h>
+#include <sys/mman.h>
+#include <obstack.h>
+#include <snapshot.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+/* Snapshot file layout.  All numbers are little-endian.
+
+   Header (SNAP_HEADER bytes):
+     magic        8 bytes
+     last         8      offset of the newest segment
+     nsegs        8      number of segments
+     base_size    8      size of the oldest segment
+
+   Each segment is a sorted table of directories, newer segments
+   overriding older ones.  Segment header (SNAP_SEGMENT bytes):
+     prev         8      offset of the previous segment, or 0
+     size         8      size of the segment
+     count        8      number of entries
+     ninodes      8      number of entries in the inode table
+     strs_len     8      length of the string area
+
+   Entries (SNAP_ENTRY bytes each), sorted by name:
+     dev          8      device number
+     ino          8      inode number
+     mtime        8      modification time, seconds
+     mtime_nsec   4      nanoseconds
+     flags        4      SNAP_REMOVED if the directory is gone
+     str_off      8      offset of the name in the string area
+     name_len     4      length of the name
+     reserved     4
+     contents_len 8      length of the contents, following the name
+
+   Inode table (4 bytes each): the numbers of the entries that are not
+   removed, sorted by device and inode.
+
+   String area: the names and contents of the entries, in the order of
+   the entries, without terminating nulls.  */
+
+static char const snap_magic[8] = "PAXSNAP\1";
+enum
+  {
+    SNAP_HEADER = 32,
+    SNAP_SEGMENT = 40,
+    SNAP_ENTRY = 56,
+    SNAP_INODE = 4
+  };
+
+enum { SNAP_REMOVED = 0x1 };
+
+/* Merge the segments when there would be more than this many, or when
+   the newer ones would take more than a quarter of the oldest.  */
+enum { SNAP_SEGMENTS_MAX = 8 };
+
+/* A segment of the mapped file */
+struct snap_segment
+{
+  off_t offset;               /* Offset in the file */
+  idx_t count;
+  unsigned char const *table; /* First entry */
+  idx_t ninodes;
+  unsigned char const *inodes;
+  char const *strtab;
+  idx_t strtab_len;
+};
+
+/* An entry of a segment or a pending change */
+struct snap_entry
+{
+  struct pax_snapshot_dir dir;
+  bool removed;
+  idx_t seq;                  /* Order of a pending change */
+};
+
+struct pax_snapshot
+{
+  char *file_name;
+
+    /* Reading */
+  unsigned char *map;         /* Contents of the file */
+  idx_t map_size;
+  bool mapped;                /* map was obtained by mmap */
+  struct snap_segment *segs;  /* Segments, newest first */
+  idx_t nsegs;
+  off_t base_size;            /* Size of the oldest segment */
+
+    /* Changes not yet written */
+  struct snap_entry *pend;
+  idx_t npend;
+  idx_t pend_size;
+  idx_t pend_bytes;           /* Their size once written */
+  idx_t pend_seq;             /* Order of the next change */
+  struct obstack strs;        /* Their names and contents */
+};
+
+static uint_least64_t
+get_u64 (unsigned char const *p, int n)
+{
+  uint_least64_t v = 0;
+  while (n--)
+    v = (v << 8) | p[n];
+  return v;
+}
+
+static void
+put_u64 (unsigned char *p, uint_least64_t v, int n)
+{
+  while (n--)
+    {
+      *p++ = v & 0xff;
+      v >>= 8;
+    }
+}
+
+static int
+name_cmp (char const *a, idx_t alen, char const *b, idx_t blen)
+{
+  int rc = memcmp (a, b, alen < blen ? alen : blen);
+  if (rc == 0)
+    rc = (alen > blen) - (alen < blen);
+  return rc;
+}
+
+static int
+inode_cmp (dev_t adev, ino_t aino, dev_t bdev, ino_t bino)
+{
+  if (adev != bdev)
+    return adev < bdev ? -1 : 1;
+  return (aino > bino) - (aino < bino);
+}
+
+
+/* Reading */
+
+/* Store in ENT the Nth entry of SEG.  Return false if it is
+   malformed.  */
+static bool
+segment_entry (struct snap_segment const *seg, idx_t n,
+	       struct snap_entry *ent)
+{
+  unsigned char const *p = seg->table + n * SNAP_ENTRY;
+  uint_least64_t str_off = get_u64 (p + 32, 8);
+  uint_least64_t name_len = get_u64 (p + 40, 4);
+  uint_least64_t contents_len = get_u64 (p + 48, 8);
+
+  if (str_off > seg->strtab_len
+      || name_len > seg->strtab_len - str_off
+      || contents_len > seg->strtab_len - str_off - name_len)
+    return false;
+
+  ent->dir.name = seg->strtab + str_off;
+  ent->dir.name_len = name_len;
+  ent->dir.dev = get_u64 (p, 8);
+  ent->dir.ino = get_u64 (p + 8, 8);
+  ent->dir.mtime.tv_sec = (int_least64_t) get_u64 (p + 16, 8);
+  ent->dir.mtime.tv_nsec = get_u64 (p + 24, 4);
+  ent->dir.contents = ent->dir.name + name_len;
+  ent->dir.contents_len = contents_len;
+  ent->removed = get_u64 (p + 28, 4) & SNAP_REMOVED;
+  return true;
+}
+
+/* Look NAME of length LEN up in SEG.  Return 1 and store its entry in
+   ENT if found, 0 if not, and -1 if the segment is malformed.  */
+static int
+segment_lookup (struct snap_segment const *seg, char const *name, idx_t len,
+		struct snap_entry *ent)
+{
+  idx_t lo = 0, hi = seg->count;
+
+  while (lo < hi)
+    {
+      idx_t mid = lo + (hi - lo) / 2;
+      if (!segment_entry (seg, mid, ent))
+	return -1;
+      int rc = name_cmp (ent->dir.name, ent->dir.name_len, name, len);
+      if (rc == 0)
+	return 1;
+      if (rc < 0)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return 0;
+}
+
+/* Look NAME of length LEN up in SNAP, and store in ENT the newest entry
+   for it.  Return false if there is none.  */
+static bool
+snap_lookup (pax_snapshot_t snap, char const *name, idx_t len,
+	     struct snap_entry *ent)
+{
+  for (idx_t i = 0; i < snap->nsegs; i++)
+    {
+      int rc = segment_lookup (&snap->segs[i], name, len, ent);
+      if (rc < 0)
+	return false;
+      if (rc > 0)
+	return true;
+    }
+  return false;
+}
+
+/* Look up the directory NAME and store it in DIR.  Return false if the
+   snapshot does not hold it.  */
+bool
+pax_snapshot_lookup (pax_snapshot_t snap, char const *name,
+		     struct pax_snapshot_dir *dir)
+{
+  struct snap_entry ent;
+
+  if (!snap_lookup (snap, name, strlen (name), &ent) || ent.removed)
+    return false;
+  *dir = ent.dir;
+  return true;
+}
+
+/* Return the number of the entry at position N of the inode table of
+   SEG, or -1 if it is malformed.  */
+static idx_t
+segment_inode (struct snap_segment const *seg, idx_t n)
+{
+  uint_least64_t k = get_u64 (seg->inodes + n * SNAP_INODE, SNAP_INODE);
+  return k < seg->count ? k : -1;
+}
+
+/* Look up the directory whose device and inode numbers are DEV and INO
+   and store it in DIR.  Return false if the snapshot does not hold it.
+   An entry counts only if no newer segment holds another entry of the
+   same name, so that a directory renamed or replaced is not found under
+   its old name.  */
+bool
+pax_snapshot_lookup_inode (pax_snapshot_t snap, dev_t dev, ino_t ino,
+			   struct pax_snapshot_dir *dir)
+{
+  for (idx_t i = 0; i < snap->nsegs; i++)
+    {
+      struct snap_segment const *seg = &snap->segs[i];
+      struct snap_entry ent, cur;
+      idx_t lo = 0, hi = seg->ninodes;
+
+      /* Find the first entry not less than DEV and INO */
+      while (lo < hi)
+	{
+	  idx_t mid = lo + (hi - lo) / 2;
+	  idx_t k = segment_inode (seg, mid);
+	  if (k < 0 || !segment_entry (seg, k, &ent))
+	    return false;
+	  if (inode_cmp (ent.dir.dev, ent.dir.ino, dev, ino) < 0)
+	    lo = mid + 1;
+	  else
+	    hi = mid;
+	}
+
+      for (; lo < seg->ninodes; lo++)
+	{
+	  idx_t k = segment_inode (seg, lo);
+	  if (k < 0 || !segment_entry (seg, k, &ent))
+	    return false;
+	  if (inode_cmp (ent.dir.dev, ent.dir.ino, dev, ino) != 0)
+	    break;
+	  if (snap_lookup (snap, ent.dir.name, ent.dir.name_len, &cur)
+	      && cur.dir.name == ent.dir.name)
+	    {
+	      *dir = ent.dir;
+	      return true;
+	    }
+	}
+    }
+  return false;
+}
+
+/* Read the contents of the snapshot file FD of SIZE bytes into SNAP */
+static int
+snap_load (pax_snapshot_t snap, int fd, idx_t size)
+{
+  void *p = mmap (nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (p != MAP_FAILED)
+    {
+      snap->map = p;
+      snap->mapped = true;
+      return 0;
+    }
+
+  snap->map = ximalloc (size);
+  for (idx_t n = 0; n < size; )
+    {
+      ssize_t rc = read (fd, snap->map + n, size - n);
+      if (rc <= 0)
+	return rc == 0 ? EINVAL : errno;
+      n += rc;
+    }
+  return 0;
+}
+
+/* Check the header of the segment at OFFSET in the mapped file, and
+   fill SEG from it.  Return the offset of the previous segment, or -1
+   if the segment is malformed.  */
+static off_t
+snap_segment (pax_snapshot_t snap, uint_least64_t offset,
+	      struct snap_segment *seg)
+{
+  if (offset < SNAP_HEADER || offset > snap->map_size - SNAP_SEGMENT)
+    return -1;
+
+  unsigned char const *p = snap->map + offset;
+  uint_least64_t prev = get_u64 (p, 8);
+  uint_least64_t size = get_u64 (p + 8, 8);
+  uint_least64_t count = get_u64 (p + 16, 8);
+  uint_least64_t ninodes = get_u64 (p + 24, 8);
+  uint_least64_t strs_len = get_u64 (p + 32, 8);
+  uint_least64_t avail = snap->map_size - offset;
+
+  if (size < SNAP_SEGMENT || size > avail
+      || count > (size - SNAP_SEGMENT) / SNAP_ENTRY
+      || ninodes > count
+      || ninodes > (size - SNAP_SEGMENT - count * SNAP_ENTRY) / SNAP_INODE
+      || strs_len != (size - SNAP_SEGMENT - count * SNAP_ENTRY
+		      - ninodes * SNAP_INODE)
+      || (prev && prev + SNAP_SEGMENT > offset))
+    return -1;
+
+  seg->offset = offset;
+  seg->count = count;
+  seg->table = p + SNAP_SEGMENT;
+  seg->ninodes = ninodes;
+  seg->inodes = seg->table + count * SNAP_ENTRY;
+  seg->strtab = (char const *) seg->inodes + ninodes * SNAP_INODE;
+  seg->strtab_len = strs_len;
+  return prev;
+}
+
+/* Map the file of SNAP, if any, and find its segments.  Return 0 on
+   success, an errno value otherwise.  */
+static int
+snap_map (pax_snapshot_t snap)
+{
+  struct stat st;
+  int fd, rc;
+
+  fd = open (snap->file_name, O_RDONLY);
+  if (fd == -1)
+    return errno == ENOENT ? 0 : errno;
+  if (fstat (fd, &st))
+    {
+      rc = errno;
+      close (fd);
+      return rc;
+    }
+  if (st.st_size < SNAP_HEADER || IDX_MAX < st.st_size)
+    {
+      close (fd);
+      return EINVAL;
+    }
+
+  snap->map_size = st.st_size;
+  rc = snap_load (snap, fd, snap->map_size);
+  close (fd);
+  if (rc)
+    return rc;
+
+  unsigned char const *p = snap->map;
+  uint_least64_t last = get_u64 (p + 8, 8);
+  uint_least64_t nsegs = get_u64 (p + 16, 8);
+  if (memcmp (p, snap_magic, sizeof snap_magic) != 0
+      || nsegs == 0
+      || nsegs > (snap->map_size - SNAP_HEADER) / SNAP_SEGMENT)
+    return EINVAL;
+
+  snap->segs = xinmalloc (nsegs, sizeof *snap->segs);
+  off_t offset = last;
+  for (idx_t i = 0; i < nsegs; i++)
+    {
+      if (offset <= 0)
+	return EINVAL;
+      offset = snap_segment (snap, offset, &snap->segs[i]);
+    }
+  if (offset != 0)
+    return EINVAL;
+  snap->nsegs = nsegs;
+  snap->base_size = get_u64 (p + 24, 8);
+  return 0;
+}
+
+static void
+snap_unmap (pax_snapshot_t snap)
+{
+  if (snap->mapped)
+    munmap (snap->map, snap->map_size);
+  else
+    free (snap->map);
+  snap->map = nullptr;
+  snap->map_size = 0;
+  snap->mapped = false;
+  free (snap->segs);
+  snap->segs = nullptr;
+  snap->nsegs = 0;
+  snap->base_size = 0;
+}
+
+/* Open the snapshot file FILE_NAME and store its handle in *PSNAP.  If
+   the file does not exist, the snapshot is empty, and the file is
+   created when it is first written.  Return 0 on success, an errno
+   value otherwise.  EINVAL means the file is not a valid snapshot.  */
+int
+pax_snapshot_open (pax_snapshot_t *psnap, char const *file_name)
+{
+  pax_snapshot_t snap = xzalloc (sizeof *snap);
+  int rc;
+
+  snap->file_name = xstrdup (file_name);
+  obstack_init (&snap->strs);
+  rc = snap_map (snap);
+  if (rc)
+    pax_snapshot_destroy (&snap);
+  else
+    *psnap = snap;
+  return rc;
+}
+
+void
+pax_snapshot_destroy (pax_snapshot_t *psnap)
+{
+  pax_snapshot_t snap = *psnap;
+
+  if (!snap)
+    return;
+  snap_unmap (snap);
+  free (snap->pend);
+  obstack_free (&snap->strs, nullptr);
+  free (snap->file_name);
+  free (snap);
+  *psnap = nullptr;
+}
+
+
+/* Changes */
+
+static struct snap_entry *
+snap_pending (pax_snapshot_t snap, char const *name, idx_t name_len,
+	      char const *contents, idx_t contents_len)
+{
+  if (snap->npend == snap->pend_size)
+    snap->pend = xpalloc (snap->pend, &snap->pend_size, 1, -1,
+			  sizeof *snap->pend);
+  struct snap_entry *ent = &snap->pend[snap->npend++];
+  ent->seq = snap->pend_seq++;
+  char *p = obstack_alloc (&snap->strs, name_len + contents_len);
+  memcpy (p, name, name_len);
+  memcpy (p + name_len, contents, contents_len);
+  ent->dir.name = p;
+  ent->dir.name_len = name_len;
+  ent->dir.contents = p + name_len;
+  ent->dir.contents_len = contents_len;
+  snap->pend_bytes += SNAP_ENTRY + SNAP_INODE + name_len + contents_len;
+  return ent;
+}
+
+/* Record DIR as the new state of its directory.  The change is seen by
+   lookups once written.  */
+void
+pax_snapshot_update (pax_snapshot_t snap, struct pax_snapshot_dir const *dir)
+{
+  struct snap_entry *ent = snap_pending (snap, dir->name, dir->name_len,
+					 dir->contents, dir->contents_len);
+  ent->dir.dev = dir->dev;
+  ent->dir.ino = dir->ino;
+  ent->dir.mtime = dir->mtime;
+  ent->removed = false;
+}
+
+/* Record that the directory NAME is gone */
+void
+pax_snapshot_remove (pax_snapshot_t snap, char const *name)
+{
+  struct snap_entry *ent = snap_pending (snap, name, strlen (name), "", 0);
+  ent->dir.dev = 0;
+  ent->dir.ino = 0;
+  ent->dir.mtime = (struct timespec) { 0 };
+  ent->removed = true;
+}
+
+static int
+pending_cmp (void const *a, void const *b)
+{
+  struct snap_entry const *ea = a;
+  struct snap_entry const *eb = b;
+  int rc = name_cmp (ea->dir.name, ea->dir.name_len,
+		     eb->dir.name, eb->dir.name_len);
+  if (rc == 0)
+    rc = (ea->seq > eb->seq) - (ea->seq < eb->seq);
+  return rc;
+}
+
+/* Sort the pending changes by name, keeping only the last change to
+   each directory.  */
+static void
+pending_sort (pax_snapshot_t snap)
+{
+  idx_t n = 0;
+
+  qsort (snap->pend, snap->npend, sizeof *snap->pend, pending_cmp);
+  for (idx_t i = 0; i < snap->npend; i++)
+    {
+      if (i + 1 < snap->npend
+	  && name_cmp (snap->pend[i].dir.name, snap->pend[i].dir.name_len,
+		       snap->pend[i + 1].dir.name,
+		       snap->pend[i + 1].dir.name_len) == 0)
+	continue;
+      snap->pend[n++] = snap->pend[i];
+    }
+  snap->npend = n;
+}
+
+
+/* Writing */
+
+/* A sorted run of entries to merge: a segment, or the pending changes
+   if SEG is null.  */
+struct snap_run
+{
+  struct snap_segment const *seg;
+  idx_t pos;
+  idx_t count;
+  struct snap_entry cur;      /* Entry at pos, if pos < count */
+};
+
+static bool
+run_fetch (pax_snapshot_t snap, struct snap_run *run)
+{
+  if (run->pos >= run->count)
+    return true;
+  if (!run->seg)
+    {
+      run->cur = snap->pend[run->pos];
+      return true;
+    }
+  return segment_entry (run->seg, run->pos, &run->cur);
+}
+
+/* Set up RUNS to merge the pending changes and, if ALL, every segment
+   of SNAP, newest first.  Return the number of runs, or -1 if a segment
+   is malformed.  */
+static int
+runs_init (pax_snapshot_t snap, struct snap_run *runs, bool all)
+{
+  int n = 0;
+
+  runs[n++] = (struct snap_run) { .count = snap->npend };
+  if (all)
+    for (idx_t i = 0; i < snap->nsegs; i++)
+      runs[n++] = (struct snap_run) { .seg = &snap->segs[i],
+				      .count = snap->segs[i].count };
+  for (int i = 0; i < n; i++)
+    if (!run_fetch (snap, &runs[i]))
+      return -1;
+  return n;
+}
+
+/* Store in ENT the least entry of the NRUNS RUNS, taking it from the
+   newest run that has it, and advance past it.  Return 1 on success, 0
+   at the end, and -1 if a segment is malformed.  */
+static int
+runs_next (pax_snapshot_t snap, struct snap_run *runs, int nruns,
+	   struct snap_entry *ent)
+{
+  int min = -1;
+
+  for (int i = 0; i < nruns; i++)
+    if (runs[i].pos < runs[i].count
+	&& (min < 0
+	    || name_cmp (runs[i].cur.dir.name, runs[i].cur.dir.name_len,
+			 runs[min].cur.dir.name,
+			 runs[min].cur.dir.name_len) < 0))
+      min = i;
+  if (min < 0)
+    return 0;
+
+  *ent = runs[min].cur;
+  for (int i = min; i < nruns; i++)
+    if (runs[i].pos < runs[i].count
+	&& name_cmp (runs[i].cur.dir.name, runs[i].cur.dir.name_len,
+		     ent->dir.name, ent->dir.name_len) == 0)
+      {
+	runs[i].pos++;
+	if (!run_fetch (snap, &runs[i]))
+	  return -1;
+      }
+  return 1;
+}
+
+/* A key of the inode table being written */
+struct inode_key
+{
+  dev_t dev;
+  ino_t ino;
+  uint_least32_t n;
+};
+
+static int
+inode_key_cmp (void const *a, void const *b)
+{
+  struct inode_key const *ka = a;
+  struct inode_key const *kb = b;
+  int rc = inode_cmp (ka->dev, ka->ino, kb->dev, kb->ino);
+  if (rc == 0)
+    rc = (ka->n > kb->n) - (ka->n < kb->n);
+  return rc;
+}
+
+/* Write to FP, at its current position OFFSET, a segment merging the
+   pending changes and, if ALL, every segment of SNAP.  When merging
+   them all, drop the removed directories.  PREV is the offset of the
+   previous segment.  Store the size of the segment in *PSIZE.  Return
+   0 on success, an errno value otherwise.  */
+static int
+snap_write_segment (pax_snapshot_t snap, FILE *fp, off_t offset, off_t prev,
+		    bool all, off_t *psize)
+{
+  struct snap_run *runs = xinmalloc (snap->nsegs + 1, sizeof *runs);
+  struct inode_key *keys = nullptr;
+  idx_t nkeys = 0, keys_size = 0;
+  unsigned char rec[SNAP_ENTRY];
+  uint_least64_t count = 0, str_off = 0;
+  struct snap_entry ent;
+  int nruns, rc = 0;
+
+  /* The header is written last, once the sizes are known */
+  memset (rec, 0, SNAP_SEGMENT);
+  fwrite (rec, SNAP_SEGMENT, 1, fp);
+
+  /* Entries, collecting the inode table */
+  nruns = runs_init (snap, runs, all);
+  while (nruns > 0 && (rc = runs_next (snap, runs, nruns, &ent)) > 0)
+    {
+      if (all && ent.removed)
+	continue;
+      if (count == UINT_LEAST32_MAX)
+	{
+	  rc = EOVERFLOW;
+	  goto out;
+	}
+      if (!ent.removed)
+	{
+	  if (nkeys == keys_size)
+	    keys = xpalloc (keys, &keys_size, 1, -1, sizeof *keys);
+	  keys[nkeys++] = (struct inode_key) { ent.dir.dev, ent.dir.ino,
+					       count };
+	}
+      put_u64 (rec, ent.dir.dev, 8);
+      put_u64 (rec + 8, ent.dir.ino, 8);
+      put_u64 (rec + 16, ent.dir.mtime.tv_sec, 8);
+      put_u64 (rec + 24, ent.dir.mtime.tv_nsec, 4);
+      put_u64 (rec + 28, ent.removed ? SNAP_REMOVED : 0, 4);
+      put_u64 (rec + 32, str_off, 8);
+      put_u64 (rec + 40, ent.dir.name_len, 4);
+      put_u64 (rec + 44, 0, 4);
+      put_u64 (rec + 48, ent.dir.contents_len, 8);
+      fwrite (rec, SNAP_ENTRY, 1, fp);
+      str_off += ent.dir.name_len + ent.dir.contents_len;
+      count++;
+    }
+  if (nruns < 0 || rc < 0)
+    {
+      rc = EINVAL;
+      goto out;
+    }
+
+  qsort (keys, nkeys, sizeof *keys, inode_key_cmp);
+  for (idx_t i = 0; i < nkeys; i++)
+    {
+      put_u64 (rec, keys[i].n, SNAP_INODE);
+      fwrite (rec, SNAP_INODE, 1, fp);
+    }
+
+  /* Strings, merging again in the same order */
+  nruns = runs_init (snap, runs, all);
+  while (nruns > 0 && (rc = runs_next (snap, runs, nruns, &ent)) > 0)
+    {
+      if (all && ent.removed)
+	continue;
+      fwrite (ent.dir.name, 1, ent.dir.name_len, fp);
+      fwrite (ent.dir.contents, 1, ent.dir.contents_len, fp);
+    }
+  if (nruns < 0 || rc < 0)
+    {
+      rc = EINVAL;
+      goto out;
+    }
+
+  *psize = (SNAP_SEGMENT + count * SNAP_ENTRY + nkeys * SNAP_INODE
+	    + str_off);
+  put_u64 (rec, prev, 8);
+  put_u64 (rec + 8, *psize, 8);
+  put_u64 (rec + 16, count, 8);
+  put_u64 (rec + 24, nkeys, 8);
+  put_u64 (rec + 32, str_off, 8);
+  if (fseeko (fp, offset, SEEK_SET) == 0)
+    fwrite (rec, SNAP_SEGMENT, 1, fp);
+  rc = ferror (fp) ? (errno ? errno : EIO) : 0;
+
+ out:
+  free (keys);
+  free (runs);
+  return rc;
+}
+
+static void
+snap_header (unsigned char *rec, off_t last, idx_t nsegs, off_t base_size)
+{
+  memcpy (rec, snap_magic, sizeof snap_magic);
+  put_u64 (rec + 8, last, 8);
+  put_u64 (rec + 16, nsegs, 8);
+  put_u64 (rec + 24, base_size, 8);
+}
+
+/* Flush FP to disk and close it.  RC is the status so far.  */
+static int
+snap_close (FILE *fp, int rc)
+{
+  if (rc == 0 && (fflush (fp) || fsync (fileno (fp))))
+    rc = errno;
+  if (fclose (fp) && rc == 0)
+    rc = errno;
+  return rc;
+}
+
+/* Append the pending changes to the file of SNAP as a new segment.  The
+   header is updated only once the segment is on disk, so that the file
+   stays valid if the run is interrupted.  */
+static int
+snap_append (pax_snapshot_t snap)
+{
+  unsigned char rec[SNAP_HEADER];
+  off_t size;
+  int rc;
+
+  FILE *fp = fopen (snap->file_name, "r+b");
+  if (!fp)
+    return errno;
+
+  off_t offset = snap->map_size;
+  if (fseeko (fp, offset, SEEK_SET))
+    rc = errno;
+  else
+    rc = snap_write_segment (snap, fp, offset, snap->segs[0].offset, false,
+			     &size);
+  if (rc == 0 && (fflush (fp) || fsync (fileno (fp))))
+    rc = errno;
+  if (rc == 0)
+    {
+      snap_header (rec, offset, snap->nsegs + 1, snap->base_size);
+      if (fseeko (fp, 0, SEEK_SET) == 0)
+	fwrite (rec, SNAP_HEADER, 1, fp);
+      if (ferror (fp))
+	rc = errno ? errno : EIO;
+    }
+  return snap_close (fp, rc);
+}
+
+/* Write the whole snapshot, merged into one segment, to a new file
+   replacing that of SNAP.  */
+static int
+snap_rewrite (pax_snapshot_t snap)
+{
+  unsigned char rec[SNAP_HEADER];
+  idx_t len = strlen (snap->file_name);
+  char *tmp = ximalloc (len + sizeof ".tmp");
+  off_t size;
+  int rc;
+
+  strcpy (stpcpy (tmp, snap->file_name), ".tmp");
+  FILE *fp = fopen (tmp, "wb");
+  if (!fp)
+    {
+      rc = errno;
+      free (tmp);
+      return rc;
+    }
+
+  memset (rec, 0, SNAP_HEADER);
+  fwrite (rec, SNAP_HEADER, 1, fp);
+  rc = snap_write_segment (snap, fp, SNAP_HEADER, 0, true, &size);
+  if (rc == 0)
+    {
+      snap_header (rec, SNAP_HEADER, 1, size);
+      if (fseeko (fp, 0, SEEK_SET) == 0)
+	fwrite (rec, SNAP_HEADER, 1, fp);
+      if (ferror (fp))
+	rc = errno ? errno : EIO;
+    }
+  rc = snap_close (fp, rc);
+  if (rc == 0 && rename (tmp, snap->file_name))
+    rc = errno;
+  if (rc)
+    unlink (tmp);
+  free (tmp);
+  return rc;
+}
+
+/* Write the pending changes to the file of SNAP, and make them visible
+   to lookups.  Return 0 on success, an errno value otherwise; the
+   changes are then kept pending.  */
+int
+pax_snapshot_write (pax_snapshot_t snap)
+{
+  int rc;
+
+  if (snap->npend == 0 && snap->map)
+    return 0;
+
+  pending_sort (snap);
+  if (snap->nsegs == 0 || snap->nsegs + 1 > SNAP_SEGMENTS_MAX
+      || (snap->map_size - SNAP_HEADER - snap->base_size + snap->pend_bytes
+	  > snap->base_size / 4))
+    rc = snap_rewrite (snap);
+  else
+    rc = snap_append (snap);
+  if (rc)
+    return rc;
+
+  snap_unmap (snap);
+  snap->npend = 0;
+  snap->pend_bytes = 0;
+  obstack_free (&snap->strs, nullptr);
+  obstack_init (&snap->strs);
+  return snap_map (snap);
+}
@@ -0,0 +1,51 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Snapshots of directories for incremental archives.
+
+   A snapshot records, for each directory archived, its device and inode
+   numbers, its modification time and its entries in the format of the
+   contents of GNUTYPE_DUMPDIR members, so that the next run can tell
+   what changed.  The file is mapped in memory when read, and looked up
+   by binary search, by name or by inode.  Changes are appended to it as
+   a new sorted segment, so that a run writes only the directories that
+   changed; the segments are merged into one when there are too many of
+   them.  */
+
+typedef struct pax_snapshot *pax_snapshot_t;
+
+struct pax_snapshot_dir
+{
+  char const *name;           /* Directory name, not null-terminated */
+  idx_t name_len;             /* Length of name */
+  dev_t dev;                  /* Device and inode numbers */
+  ino_t ino;
+  struct timespec mtime;      /* Modification time */
+  char const *contents;       /* Entries, in dumpdir format */
+  idx_t contents_len;         /* Length of contents */
+};
+
+int pax_snapshot_open (pax_snapshot_t *psnap, char const *file_name);
+bool pax_snapshot_lookup (pax_snapshot_t snap, char const *name,
+			  struct pax_snapshot_dir *dir);
+bool pax_snapshot_lookup_inode (pax_snapshot_t snap, dev_t dev, ino_t ino,
+				struct pax_snapshot_dir *dir);
+void pax_snapshot_update (pax_snapshot_t snap,
+			  struct pax_snapshot_dir const *dir);
+void pax_snapshot_remove (pax_snapshot_t snap, char const *name);
+int pax_snapshot_write (pax_snapshot_t snap);
+void pax_snapshot_destroy (pax_snapshot_t *psnap);
@@ -0,0 +1,450 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Sparse files.
+
+   The map of the data regions of a file is asked of the file system
+   first, with SEEK_DATA and SEEK_HOLE, then with the FIEMAP ioctl on
+   Linux.  Either costs time proportional to the number of regions, not
+   to the size of the file.  Only if neither is available is the file
+   read, and blocks of zeros, as told by pax_zero_blocks, taken for
+   holes.
+
+   As in tar, the map always ends with a region that reaches the end of
+   the file, of zero length if the file ends with a hole.
+
+   On extraction, only the data regions are written.  Holes, and blocks
+   of zeros within the data, are skipped over, or punched out of the
+   previous contents of the file.  */
+
+#include <system.h>
+#include <c-ctype.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+#if HAVE_LINUX_FIEMAP_H
+# include <linux/fs.h>
+# include <linux/fiemap.h>
+#endif
+
+/* Add the data region [BEG, END) to the map of ST, merging it with the
+   previous region if they touch.  */
+static void
+sparse_add_region (struct tar_stat_info *st, off_t beg, off_t end)
+{
+  if (st->sparse_map_avail > 0)
+    {
+      struct sp_array *last = &st->sparse_map[st->sparse_map_avail - 1];
+      if (last->offset + last->numbytes == beg)
+	{
+	  last->numbytes = end - last->offset;
+	  return;
+	}
+    }
+  pax_stat_sparse_add (st, beg, end - beg);
+}
+
+/* Terminate the map of ST for a file of SIZE bytes */
+static void
+sparse_finish (struct tar_stat_info *st, off_t size)
+{
+  if (st->sparse_map_avail == 0)
+    pax_stat_sparse_add (st, size, 0);
+  else
+    {
+      struct sp_array *last = &st->sparse_map[st->sparse_map_avail - 1];
+      if (last->offset + last->numbytes < size)
+	pax_stat_sparse_add (st, size, 0);
+    }
+}
+
+/* Build the map with SEEK_DATA and SEEK_HOLE.  Return 0 on success,
+   ENOTSUP if the file system does not support them, another errno value
+   on failure.  */
+static int
+sparse_scan_seek (int fd, struct tar_stat_info *st, off_t size)
+{
+#if defined SEEK_DATA && defined SEEK_HOLE
+  off_t pos = 0;
+
+  while (pos < size)
+    {
+      off_t data = lseek (fd, pos, SEEK_DATA);
+      if (data < 0)
+	{
+	  if (errno == ENXIO)
+	    break;
+	  /* Some file systems accept the request only to say there is
+	     nothing to seek: fall back to other methods.  */
+	  return errno == EINVAL ? ENOTSUP : errno;
+	}
+      off_t hole = lseek (fd, data, SEEK_HOLE);
+      if (hole < 0)
+	return errno;
+      if (hole > size)
+	hole = size;
+      if (data < hole)
+	sparse_add_region (st, data, hole);
+      pos = hole;
+    }
+  return 0;
+#else
+  return ENOTSUP;
+#endif
+}
+
+/* Build the map with the FIEMAP ioctl.  Unwritten extents read as zeros
+   and are treated as holes.  Return values are as for
+   sparse_scan_seek.  */
+static int
+sparse_scan_fiemap (int fd, struct tar_stat_info *st, off_t size)
+{
+#if HAVE_LINUX_FIEMAP_H && defined FS_IOC_FIEMAP
+  enum { NEXTENTS = 128 };
+  union
+  {
+    struct fiemap map;
+    char buf[sizeof (struct fiemap)
+	     + NEXTENTS * sizeof (struct fiemap_extent)];
+  } u;
+  off_t pos = 0;
+
+  while (pos < size)
+    {
+      memset (&u.map, 0, sizeof u.map);
+      u.map.fm_start = pos;
+      u.map.fm_length = size - pos;
+      u.map.fm_flags = FIEMAP_FLAG_SYNC;
+      u.map.fm_extent_count = NEXTENTS;
+      if (ioctl (fd, FS_IOC_FIEMAP, &u.map) < 0)
+	return errno == EOPNOTSUPP || errno == ENOTTY || errno == EINVAL
+	       ? ENOTSUP : errno;
+      if (u.map.fm_mapped_extents == 0)
+	break;
+
+      bool last = false;
+      for (unsigned i = 0; i < u.map.fm_mapped_extents; i++)
+	{
+	  struct fiemap_extent const *ext = &u.map.fm_extents[i];
+	  off_t beg = ext->fe_logical;
+	  off_t end = beg + ext->fe_length;
+
+	  if (end > size)
+	    end = size;
+	  if (!(ext->fe_flags & FIEMAP_EXTENT_UNWRITTEN) && beg < end)
+	    sparse_add_region (st, beg < pos ? pos : beg, end);
+	  pos = end;
+	  if (ext->fe_flags & FIEMAP_EXTENT_LAST)
+	    last = true;
+	}
+      if (last)
+	break;
+    }
+  return 0;
+#else
+  return ENOTSUP;
+#endif
+}
+
+/* Build the map by reading the file and looking for blocks of zeros */
+static int
+sparse_scan_read (int fd, struct tar_stat_info *st, off_t size)
+{
+  enum { CHUNK_BLOCKS = 64, CHUNK = CHUNK_BLOCKS * BLOCKSIZE };
+  union block *buf = xnmalloc (CHUNK_BLOCKS, BLOCKSIZE);
+  bool zero[CHUNK_BLOCKS];
+  off_t pos = 0, data = -1;
+  int rc = 0;
+
+  if (lseek (fd, 0, SEEK_SET) < 0)
+    rc = errno;
+  while (rc == 0 && pos < size)
+    {
+      size_t nread = safe_read (fd, buf, CHUNK);
+      if (nread == SAFE_READ_ERROR)
+	{
+	  rc = errno;
+	  break;
+	}
+      if (nread == 0)
+	break;
+      idx_t n = nread;
+
+      /* A partial last block is compared with zeros as a whole */
+      idx_t nblocks = (n + BLOCKSIZE - 1) / BLOCKSIZE;
+      memset (buf->buffer + n, 0, nblocks * BLOCKSIZE - n);
+      pax_zero_blocks (buf, nblocks, zero);
+      for (idx_t i = 0; i < nblocks; i++)
+	{
+	  off_t off = pos + i * BLOCKSIZE;
+	  if (!zero[i] && data < 0)
+	    data = off;
+	  else if (zero[i] && data >= 0)
+	    {
+	      sparse_add_region (st, data, off);
+	      data = -1;
+	    }
+	}
+      pos += n;
+    }
+  if (rc == 0 && data >= 0)
+    sparse_add_region (st, data, pos < size ? pos : size);
+  free (buf);
+  return rc;
+}
+
+/* Build the sparse map of the file open on FD, described by ST, into
+   ST.  The file offset is left at the start of the file.  Return 0 on
+   success, an errno value otherwise.  ST->is_sparse is set if the file
+   has holes.  */
+int
+pax_sparse_map (int fd, struct tar_stat_info *st)
+{
+  off_t size = st->stat.st_size;
+  int rc;
+
+  st->sparse_map_avail = 0;
+  rc = sparse_scan_seek (fd, st, size);
+  if (rc == ENOTSUP)
+    {
+      st->sparse_map_avail = 0;
+      rc = sparse_scan_fiemap (fd, st, size);
+    }
+  if (rc == ENOTSUP)
+    {
+      st->sparse_map_avail = 0;
+      rc = sparse_scan_read (fd, st, size);
+    }
+  if (rc == 0)
+    {
+      sparse_finish (st, size);
+      st->is_sparse = !(st->sparse_map_avail == 1
+			&& st->sparse_map[0].offset == 0
+			&& st->sparse_map[0].numbytes == size);
+      if (lseek (fd, 0, SEEK_SET) < 0)
+	rc = errno;
+    }
+  return rc;
+}
+
+/* Return the number of bytes of data in the sparse map of ST, which is
+   the size of the member in the archive.  */
+off_t
+pax_sparse_data_size (struct tar_stat_info const *st)
+{
+  off_t n = 0;
+
+  for (idx_t i = 0; i < st->sparse_map_avail; i++)
+    n += st->sparse_map[i].numbytes;
+  return n;
+}
+
+/* Return true if the data regions of the sparse map of ST are in order
+   and add up to at most SIZE bytes, the data left for them in the
+   archive.  */
+bool
+pax_sparse_map_valid (struct tar_stat_info const *st, off_t size)
+{
+  off_t pos = 0;
+  off_t total = 0;
+
+  for (idx_t i = 0; i < st->sparse_map_avail; i++)
+    {
+      struct sp_array const *sp = &st->sparse_map[i];
+      if (sp->offset < pos || sp->numbytes < 0
+	  || ckd_add (&pos, sp->offset, sp->numbytes)
+	  || ckd_add (&total, total, sp->numbytes) || total > size)
+	return false;
+    }
+  return true;
+}
+
+
+
+/* Extraction */
+
+enum { SPARSE_IO_SIZE = 128 * BLOCKSIZE };
+
+/* Make [OFFSET, OFFSET + LEN) a hole in FD.  Only the part below
+   OLD_SIZE, the size of the file before extraction, holds anything:
+   the rest is a hole already, or will be one once the file is
+   extended.  */
+static int
+sparse_make_hole (int fd, off_t offset, off_t len, off_t old_size)
+{
+  if (offset >= old_size)
+    return 0;
+  if (len > old_size - offset)
+    len = old_size - offset;
+
+#if HAVE_FALLOCATE && defined FALLOC_FL_PUNCH_HOLE
+  if (fallocate (fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		 offset, len) == 0)
+    return 0;
+  if (errno != EOPNOTSUPP && errno != ENOSYS)
+    return errno;
+#endif
+
+  /* Overwrite the old contents with zeros */
+  static char const zeros[BLOCKSIZE];
+  while (len > 0)
+    {
+      idx_t n = len < BLOCKSIZE ? len : BLOCKSIZE;
+      ssize_t rc = pwrite (fd, zeros, n, offset);
+      if (rc < 0)
+	return errno;
+      offset += rc;
+      len -= rc;
+    }
+  return 0;
+}
+
+/* Write the N bytes at BUF at OFFSET in FD, skipping blocks of zeros */
+static int
+sparse_write (int fd, char const *buf, idx_t n, off_t offset,
+	      off_t old_size)
+{
+  idx_t i = 0;
+
+  while (i < n)
+    {
+      /* Find a run of zero blocks, then a run of data blocks */
+      idx_t z = i;
+      while (z < n && n - z >= BLOCKSIZE && pax_zero_p (buf + z, BLOCKSIZE))
+	z += BLOCKSIZE;
+      if (z > i)
+	{
+	  int rc = sparse_make_hole (fd, offset + i, z - i, old_size);
+	  if (rc)
+	    return rc;
+	}
+      idx_t d = z;
+      while (d < n && !(n - d >= BLOCKSIZE
+			&& pax_zero_p (buf + d, BLOCKSIZE)))
+	d += n - d < BLOCKSIZE ? n - d : BLOCKSIZE;
+      for (idx_t j = z; j < d; )
+	{
+	  ssize_t rc = pwrite (fd, buf + j, d - j, offset + j);
+	  if (rc < 0)
+	    return errno;
+	  j += rc;
+	}
+      i = d;
+    }
+  return 0;
+}
+
+/* Read the sparse map at the start of the data of the member described
+   by ST from BUF, as found in format 1.0 of POSIX sparse members:
+   decimal numbers on lines of their own, the number of regions followed
+   by the offset and size of each, padded to a block boundary.  Return 0
+   on success, EIO if the archive cannot be read and EINVAL if the map
+   is malformed.  */
+int
+pax_sparse_read_map (paxbuf_t buf, struct tar_stat_info *st)
+{
+  char blk[BLOCKSIZE];
+  idx_t avail = 0, pos = 0, n;
+  intmax_t count = -1, offset = -1, v = 0;
+  bool digits = false;
+
+  while (count < 0 || st->sparse_map_avail < count)
+    {
+      if (pos == avail)
+	{
+	  if (paxbuf_read (buf, blk, BLOCKSIZE, &n) == pax_io_failure
+	      || n != BLOCKSIZE)
+	    return EIO;
+	  avail = BLOCKSIZE;
+	  pos = 0;
+	}
+      char c = blk[pos++];
+      if (c != '\n')
+	{
+	  if (!c_isdigit (c) || ckd_mul (&v, v, 10)
+	      || ckd_add (&v, v, c - '0') || v > TYPE_MAXIMUM (off_t))
+	    return EINVAL;
+	  digits = true;
+	  continue;
+	}
+      if (!digits)
+	return EINVAL;
+      if (count < 0)
+	count = v;
+      else if (offset < 0)
+	offset = v;
+      else
+	{
+	  pax_stat_sparse_add (st, offset, v);
+	  offset = -1;
+	}
+      v = 0;
+      digits = false;
+    }
+  return 0;
+}
+
+/* Restore the sparse member described by ST from BUF into the file
+   open for writing on FD.  BUF is positioned at the data of the member,
+   which are the data regions of the sparse map of ST, in order.
+   Exactly pax_sparse_data_size (ST) bytes are read from BUF.
+
+   Only data are written: the holes of the map, as well as blocks of
+   zeros found in the data, are left unallocated in FD, punching them
+   out of its previous contents if need be.  The file is then given the
+   size of the original.  Return 0 on success, EIO if the archive cannot
+   be read, and an errno value if the file cannot be written.  */
+int
+pax_sparse_extract (paxbuf_t buf, int fd, struct tar_stat_info const *st)
+{
+  struct stat fst;
+  off_t old_size, pos = 0;
+  char *data;
+  int rc = 0;
+
+  if (fstat (fd, &fst))
+    return errno;
+  old_size = S_ISREG (fst.st_mode) ? fst.st_size : 0;
+  data = ximalloc (SPARSE_IO_SIZE);
+
+  for (idx_t i = 0; rc == 0 && i < st->sparse_map_avail; i++)
+    {
+      struct sp_array const *sp = &st->sparse_map[i];
+
+      if (sp->offset > pos)
+	rc = sparse_make_hole (fd, pos, sp->offset - pos, old_size);
+      pos = sp->offset;
+      for (off_t left = sp->numbytes; rc == 0 && left > 0; )
+	{
+	  idx_t n = left < SPARSE_IO_SIZE ? left : SPARSE_IO_SIZE;
+	  idx_t nread;
+	  if (paxbuf_read (buf, data, n, &nread) == pax_io_failure
+	      || nread != n)
+	    rc = EIO;
+	  else
+	    rc = sparse_write (fd, data, n, pos, old_size);
+	  pos += n;
+	  left -= n;
+	}
+    }
+  if (rc == 0 && st->stat.st_size > pos)
+    rc = sparse_make_hole (fd, pos, st->stat.st_size - pos, old_size);
+  if (rc == 0 && ftruncate (fd, st->stat.st_size))
+    rc = errno;
+  free (data);
+  return rc;
+}
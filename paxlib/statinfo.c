@@ -0,0 +1,259 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Storage of tar_stat_info.
+
+   The strings of a tar_stat_info live in an arena that belongs to it.
+   pax_stat_reset rewinds the arena without giving its memory back, and
+   keeps the sparse map array, so that a tar_stat_info reused for every
+   member of an archive stops allocating once it has seen the largest
+   member.
+
+   pax_stat_lstat asks statx for only the fields that archive creation
+   uses, so that network file systems need not fetch the others, and
+   falls back to fstatat where statx is missing.  The tree walker uses
+   it directly, and pax_stat_capture fills a tar_stat_info with it.  */
+
+#include <system.h>
+#include <obstack.h>
+#include <stat-time.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+struct pax_stat_arena
+{
+  struct obstack stk;
+  void *mark;                 /* First object in stk */
+};
+
+/* Initialize ST.  A tar_stat_info filled with zeros is initialized as
+   well: the arena is created on first use.  */
+void
+pax_stat_init (struct tar_stat_info *st)
+{
+  memset (st, 0, sizeof *st);
+}
+
+static struct obstack *
+stat_arena (struct tar_stat_info *st)
+{
+  if (!st->arena)
+    {
+      st->arena = xmalloc (sizeof *st->arena);
+      obstack_init (&st->arena->stk);
+      st->arena->mark = obstack_alloc (&st->arena->stk, 0);
+    }
+  return &st->arena->stk;
+}
+
+/* Allocate SIZE bytes that stay valid until ST is reset */
+void *
+pax_stat_alloc (struct tar_stat_info *st, idx_t size)
+{
+  return obstack_alloc (stat_arena (st), size);
+}
+
+/* Return a null-terminated copy of the LEN bytes at S, allocated in the
+   arena of ST.  */
+char *
+pax_stat_memdup0 (struct tar_stat_info *st, char const *s, idx_t len)
+{
+  struct obstack *stk = stat_arena (st);
+
+  obstack_grow0 (stk, s, len);
+  return obstack_finish (stk);
+}
+
+/* Append a descriptor to the sparse map of ST */
+void
+pax_stat_sparse_add (struct tar_stat_info *st, off_t offset, off_t numbytes)
+{
+  if (st->sparse_map_avail == st->sparse_map_size)
+    st->sparse_map = xpalloc (st->sparse_map, &st->sparse_map_size, 1, -1,
+			      sizeof st->sparse_map[0]);
+  st->sparse_map[st->sparse_map_avail].offset = offset;
+  st->sparse_map[st->sparse_map_avail].numbytes = numbytes;
+  st->sparse_map_avail++;
+}
+
+/* Make ST describe nothing, so that it can be filled for the next
+   member.  The strings it pointed to become invalid.  */
+void
+pax_stat_reset (struct tar_stat_info *st)
+{
+  struct pax_stat_arena *arena = st->arena;
+  struct sp_array *sparse_map = st->sparse_map;
+  idx_t sparse_map_size = st->sparse_map_size;
+
+  if (arena)
+    {
+      obstack_free (&arena->stk, arena->mark);
+      arena->mark = obstack_alloc (&arena->stk, 0);
+    }
+  memset (st, 0, sizeof *st);
+  st->arena = arena;
+  st->sparse_map = sparse_map;
+  st->sparse_map_size = sparse_map_size;
+}
+
+/* Free the storage of ST */
+void
+pax_stat_destroy (struct tar_stat_info *st)
+{
+  if (st->arena)
+    {
+      obstack_free (&st->arena->stk, nullptr);
+      free (st->arena);
+    }
+  free (st->sparse_map);
+  memset (st, 0, sizeof *st);
+}
+
+
+
+/* Capturing the status of files */
+
+/* Return true if FORMAT has room for access and status change times */
+static bool
+format_times_p (enum archive_format format)
+{
+  switch (format)
+    {
+    case V7_FORMAT:
+    case USTAR_FORMAT:
+      return false;
+
+    default:
+      return true;
+    }
+}
+
+#if HAVE_STATX
+/* Cleared once statx is known not to work, as on old kernels */
+static bool statx_works = true;
+
+/* Fill SB with the fields MASK of the status of NAME, relative to DIRFD.
+   Return 0 on success, an errno value on failure, and -1 if statx
+   cannot tell.  */
+static int
+capture_statx (struct stat *sb, int dirfd, char const *name,
+	       unsigned int mask, int flags)
+{
+  int atflags = (AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT
+		 | (flags & PAX_STAT_DONT_SYNC
+		    ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT));
+  struct statx stx;
+
+  if (statx (dirfd, name, atflags, mask, &stx) != 0)
+    {
+      if (errno != ENOSYS)
+	return errno;
+      __atomic_store_n (&statx_works, false, __ATOMIC_RELAXED);
+      return -1;
+    }
+  if ((stx.stx_mask & mask) != mask)
+    return -1;
+
+  memset (sb, 0, sizeof *sb);
+  sb->st_dev = makedev (stx.stx_dev_major, stx.stx_dev_minor);
+  sb->st_ino = stx.stx_ino;
+  sb->st_mode = stx.stx_mode;
+  sb->st_nlink = stx.stx_nlink;
+  sb->st_uid = stx.stx_uid;
+  sb->st_gid = stx.stx_gid;
+  sb->st_rdev = makedev (stx.stx_rdev_major, stx.stx_rdev_minor);
+  sb->st_size = stx.stx_size;
+  sb->st_blksize = stx.stx_blksize;
+  sb->st_mtim.tv_sec = stx.stx_mtime.tv_sec;
+  sb->st_mtim.tv_nsec = stx.stx_mtime.tv_nsec;
+  if (mask & STATX_ATIME)
+    {
+      sb->st_atim.tv_sec = stx.stx_atime.tv_sec;
+      sb->st_atim.tv_nsec = stx.stx_atime.tv_nsec;
+    }
+  if (mask & STATX_CTIME)
+    {
+      sb->st_ctim.tv_sec = stx.stx_ctime.tv_sec;
+      sb->st_ctim.tv_nsec = stx.stx_ctime.tv_nsec;
+    }
+  return 0;
+}
+#endif
+
+/* Fill SB with the status of the file NAME, relative to DIRFD, without
+   following symbolic links.  Get only the header fields and the numbers
+   hard links are found by, and the access and status change times if
+   FLAGS has PAX_STAT_TIMES.  With PAX_STAT_DONT_SYNC, accept the
+   attributes that network file systems have cached.  The fields not
+   asked for may be zero.  Return 0 on success, an errno value
+   otherwise.  */
+int
+pax_stat_lstat (struct stat *sb, int dirfd, char const *name, int flags)
+{
+#if HAVE_STATX
+  if (__atomic_load_n (&statx_works, __ATOMIC_RELAXED))
+    {
+      unsigned int mask = (STATX_TYPE | STATX_MODE | STATX_NLINK
+			   | STATX_UID | STATX_GID | STATX_INO | STATX_SIZE
+			   | STATX_MTIME);
+      if (flags & PAX_STAT_TIMES)
+	mask |= STATX_ATIME | STATX_CTIME;
+      int rc = capture_statx (sb, dirfd, name, mask, flags);
+      if (rc >= 0)
+	return rc;
+    }
+#endif
+
+  return fstatat (dirfd, name, sb, AT_SYMLINK_NOFOLLOW) == 0 ? 0 : errno;
+}
+
+/* Fill the times in nanoseconds of ST from its status, leaving out the
+   access and status change times unless FLAGS has PAX_STAT_TIMES and
+   FORMAT has room for them.  */
+void
+pax_stat_set_times (struct tar_stat_info *st, enum archive_format format,
+		    int flags)
+{
+  st->mtime_nsec = get_stat_mtime_ns (&st->stat);
+  if ((flags & PAX_STAT_TIMES) && format_times_p (format))
+    {
+      st->atime_nsec = get_stat_atime_ns (&st->stat);
+      st->ctime_nsec = get_stat_ctime_ns (&st->stat);
+    }
+  else
+    st->atime_nsec = st->ctime_nsec = 0;
+}
+
+/* Fill the status of ST, and its times in nanoseconds, from the file
+   NAME, relative to DIRFD, as pax_stat_lstat does.  Get the access and
+   status change times only if FLAGS has PAX_STAT_TIMES and FORMAT has
+   room for them.  Return 0 on success, an errno value otherwise.  */
+int
+pax_stat_capture (struct tar_stat_info *st, int dirfd, char const *name,
+		  enum archive_format format, int flags)
+{
+  if (!format_times_p (format))
+    flags &= ~PAX_STAT_TIMES;
+  int rc = pax_stat_lstat (&st->stat, dirfd, name, flags);
+  if (rc == 0)
+    pax_stat_set_times (st, format, flags);
+  return rc;
+}
@@ -16,6 +16,9 @@
    You should have received a copy of the GNU General Public License along
    with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
+#ifndef PAXLIB_TAR_H
+#define PAXLIB_TAR_H
+
 /* tar Header Block, from POSIX 1003.1-1990.  */
 
 /* POSIX header.  */
@@ -276,3 +279,5 @@ union block
 };
 
 /* End of Format description.  */
+
+#endif
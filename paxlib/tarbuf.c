@@ -67,6 +67,17 @@ local_seek (void *closure, off_t offset)
   return pax_io_success;
 }
 
+static off_t
+local_size (void *closure)
+{
+  tar_archive_t *tar = closure;
+  struct stat st;
+
+  if (fstat (tar->fd, &st) == 0 && S_ISREG (st.st_mode))
+    return st.st_size;
+  return -1;
+}
+
 static int
 local_open (void *closure, int pax_mode)
 {
@@ -118,6 +129,21 @@ remote_seek (void *closure, off_t offset)
   return pax_io_success;
 }
 
+static off_t
+remote_size (void *closure)
+{
+  tar_archive_t *tar = closure;
+  off_t cur, end;
+
+  cur = rmt_lseek (tar->fd, 0, SEEK_CUR);
+  if (cur == -1)
+    return -1;
+  end = rmt_lseek (tar->fd, 0, SEEK_END);
+  if (rmt_lseek (tar->fd, cur, SEEK_SET) == -1)
+    return -1;
+  return end;
+}
+
 static int
 remote_open (void *closure, int pax_mode)
 {
@@ -171,11 +197,13 @@ tar_archive_create (paxbuf_t *pbuf, const char *filename,
   if (remote)
     {
       paxbuf_set_io (*pbuf, remote_reader, remote_writer, remote_seek);
+      paxbuf_set_size (*pbuf, remote_size);
       paxbuf_set_term (*pbuf, remote_open, remote_close, tar_destroy);
     }
   else
     {
       paxbuf_set_io (*pbuf, local_reader, local_writer, local_seek);
+      paxbuf_set_size (*pbuf, local_size);
       paxbuf_set_term (*pbuf, local_open, local_close, tar_destroy);
     }
 
@@ -0,0 +1,326 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* A minimal io_uring driver.
+
+   Operations are queued in the submission ring, handed to the kernel
+   by a single io_uring_enter call, and their results collected from
+   the completion ring.  The kernel interface is used directly, so that
+   no library is needed.  */
+
+#include <system.h>
+#include <uring.h>
+#if HAVE_LINUX_IO_URING_H
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+#endif
+
+#if HAVE_LINUX_IO_URING_H && defined __NR_io_uring_setup
+
+struct pax_uring
+{
+  int fd;
+  void *sq_ring;              /* Mapped submission ring */
+  size_t sq_ring_size;
+  void *cq_ring;              /* Mapped completion ring, or sq_ring */
+  size_t cq_ring_size;
+  struct io_uring_sqe *sqes;  /* Mapped submission entries */
+  size_t sqes_size;
+
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned sq_entries;
+  unsigned *sq_array;
+  unsigned sq_local_tail;     /* Tail of the entries queued so far */
+
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+};
+
+/* Create in *PRING a ring for up to ENTRIES operations at a time.
+   Return 0 on success, an errno value otherwise.  */
+int
+pax_uring_create (pax_uring_t *pring, unsigned entries)
+{
+  struct io_uring_params p = { 0 };
+  struct pax_uring *ring;
+  int fd = syscall (__NR_io_uring_setup, entries, &p);
+
+  if (fd < 0)
+    return errno;
+  if (!(p.features & IORING_FEAT_RW_CUR_POS))
+    {
+      /* Kernels before 5.6 lack it, and the operations used here */
+      close (fd);
+      return ENOSYS;
+    }
+  ring = xzalloc (sizeof *ring);
+  ring->fd = fd;
+
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  ring->cq_ring_size = (p.cq_off.cqes
+			+ p.cq_entries * sizeof (struct io_uring_cqe));
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (ring->cq_ring_size > ring->sq_ring_size)
+	ring->sq_ring_size = ring->cq_ring_size;
+      ring->cq_ring_size = 0;
+    }
+  ring->sq_ring = mmap (nullptr, ring->sq_ring_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED)
+    goto fail;
+  if (ring->cq_ring_size)
+    {
+      ring->cq_ring = mmap (nullptr, ring->cq_ring_size,
+			    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			    fd, IORING_OFF_CQ_RING);
+      if (ring->cq_ring == MAP_FAILED)
+	{
+	  ring->cq_ring = nullptr;
+	  goto fail;
+	}
+    }
+  else
+    ring->cq_ring = ring->sq_ring;
+  ring->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+  ring->sqes = mmap (nullptr, ring->sqes_size, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+    {
+      ring->sqes = nullptr;
+      goto fail;
+    }
+
+  char *sq = ring->sq_ring, *cq = ring->cq_ring;
+  ring->sq_head = (unsigned *) (sq + p.sq_off.head);
+  ring->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+  ring->sq_mask = *(unsigned *) (sq + p.sq_off.ring_mask);
+  ring->sq_entries = p.sq_entries;
+  ring->sq_array = (unsigned *) (sq + p.sq_off.array);
+  ring->sq_local_tail = *ring->sq_tail;
+  ring->cq_head = (unsigned *) (cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+  ring->cq_mask = *(unsigned *) (cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+  *pring = ring;
+  return 0;
+
+ fail:
+  {
+    int e = errno;
+    if (ring->sq_ring == MAP_FAILED)
+      ring->sq_ring = nullptr;
+    pax_uring_destroy (&ring);
+    return e;
+  }
+}
+
+void
+pax_uring_destroy (pax_uring_t *pring)
+{
+  struct pax_uring *ring = *pring;
+
+  if (ring->sqes)
+    munmap (ring->sqes, ring->sqes_size);
+  if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+    munmap (ring->cq_ring, ring->cq_ring_size);
+  if (ring->sq_ring)
+    munmap (ring->sq_ring, ring->sq_ring_size);
+  close (ring->fd);
+  free (ring);
+  *pring = nullptr;
+}
+
+/* Return a cleared submission entry, or null if the ring is full */
+static struct io_uring_sqe *
+uring_sqe (struct pax_uring *ring, uint64_t data)
+{
+  unsigned head = __atomic_load_n (ring->sq_head, __ATOMIC_ACQUIRE);
+
+  if (ring->sq_local_tail - head >= ring->sq_entries)
+    return nullptr;
+  unsigned idx = ring->sq_local_tail++ & ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[idx];
+  memset (sqe, 0, sizeof *sqe);
+  sqe->user_data = data;
+  ring->sq_array[idx] = idx;
+  return sqe;
+}
+
+/* Queue the opening of NAME relative to DIRFD.  Return false if the
+   ring is full.  */
+bool
+pax_uring_openat (pax_uring_t ring, int dirfd, char const *name,
+		  int flags, mode_t mode, uint64_t data)
+{
+  struct io_uring_sqe *sqe = uring_sqe (ring, data);
+
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = dirfd;
+  sqe->addr = (uintptr_t) name;
+  sqe->len = mode;
+  sqe->open_flags = flags;
+  return true;
+}
+
+/* Queue the writing of LEN bytes at BUF to FD at OFFSET, or at the
+   current position of FD if OFFSET is -1.  */
+bool
+pax_uring_write (pax_uring_t ring, int fd, void const *buf, unsigned len,
+		 off_t offset, uint64_t data)
+{
+  struct io_uring_sqe *sqe = uring_sqe (ring, data);
+
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = (uintptr_t) buf;
+  sqe->len = len;
+  sqe->off = offset;
+  return true;
+}
+
+/* Queue the closing of FD */
+bool
+pax_uring_close (pax_uring_t ring, int fd, uint64_t data)
+{
+  struct io_uring_sqe *sqe = uring_sqe (ring, data);
+
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->fd = fd;
+  return true;
+}
+
+/* Submit the queued operations and wait until at least WAIT_NR of them
+   have completed.  Return 0 on success, an errno value otherwise.  On
+   failure, the operations that the kernel did not take are dropped, and
+   only those it took are waited for.  */
+int
+pax_uring_submit (pax_uring_t ring, unsigned wait_nr)
+{
+  unsigned submit = ring->sq_local_tail - *ring->sq_tail;
+  unsigned done = 0;
+  int rc = 0;
+
+  __atomic_store_n (ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+  while (done < submit)
+    {
+      int n = syscall (__NR_io_uring_enter, ring->fd, submit - done, 0, 0,
+		       nullptr, 0);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  rc = errno;
+	  ring->sq_local_tail = __atomic_load_n (ring->sq_head,
+						 __ATOMIC_ACQUIRE);
+	  __atomic_store_n (ring->sq_tail, ring->sq_local_tail,
+			    __ATOMIC_RELEASE);
+	  if (wait_nr > done)
+	    wait_nr = done;
+	  break;
+	}
+      done += n;
+    }
+
+  while (wait_nr > 0)
+    {
+      unsigned ready = (__atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE)
+			- *ring->cq_head);
+      if (ready >= wait_nr)
+	break;
+      if (syscall (__NR_io_uring_enter, ring->fd, 0, wait_nr,
+		   IORING_ENTER_GETEVENTS, nullptr, 0) < 0
+	  && errno != EINTR)
+	return errno;
+    }
+  return rc;
+}
+
+/* Take the next completion, storing the data given when it was queued
+   in *DATA and its result (a negated errno value on failure) in *RES.
+   Return false if there is none.  */
+bool
+pax_uring_reap (pax_uring_t ring, uint64_t *data, int *res)
+{
+  unsigned head = *ring->cq_head;
+
+  if (head == __atomic_load_n (ring->cq_tail, __ATOMIC_ACQUIRE))
+    return false;
+  struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+  *data = cqe->user_data;
+  *res = cqe->res;
+  __atomic_store_n (ring->cq_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+#else
+
+int
+pax_uring_create (pax_uring_t *pring, unsigned entries)
+{
+  return ENOSYS;
+}
+
+void
+pax_uring_destroy (pax_uring_t *pring)
+{
+}
+
+bool
+pax_uring_openat (pax_uring_t ring, int dirfd, char const *name,
+		  int flags, mode_t mode, uint64_t data)
+{
+  return false;
+}
+
+bool
+pax_uring_write (pax_uring_t ring, int fd, void const *buf, unsigned len,
+		 off_t offset, uint64_t data)
+{
+  return false;
+}
+
+bool
+pax_uring_close (pax_uring_t ring, int fd, uint64_t data)
+{
+  return false;
+}
+
+int
+pax_uring_submit (pax_uring_t ring, unsigned wait_nr)
+{
+  return ENOSYS;
+}
+
+bool
+pax_uring_reap (pax_uring_t ring, uint64_t *data, int *res)
+{
+  return false;
+}
+#endif
@@ -0,0 +1,31 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Batches of file system operations submitted through io_uring.  Where
+   io_uring is not available, pax_uring_create fails with ENOSYS.  */
+
+typedef struct pax_uring *pax_uring_t;
+
+int pax_uring_create (pax_uring_t *ring, unsigned entries);
+void pax_uring_destroy (pax_uring_t *ring);
+bool pax_uring_openat (pax_uring_t ring, int dirfd, char const *name,
+		       int flags, mode_t mode, uint64_t data);
+bool pax_uring_write (pax_uring_t ring, int fd, void const *buf,
+		      unsigned len, off_t offset, uint64_t data);
+bool pax_uring_close (pax_uring_t ring, int fd, uint64_t data);
+int pax_uring_submit (pax_uring_t ring, unsigned wait_nr);
+bool pax_uring_reap (pax_uring_t ring, uint64_t *data, int *res);
@@ -0,0 +1,656 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Parallel verification.
+
+   The members of an archive are compared with the files they were made
+   from, as tar --compare does, and differences are reported.
+
+   The thread reading the archive only decodes headers and hands out
+   work.  For each member, a worker thread compares the status of the
+   file with the header and, for a regular file, reads it and computes
+   its CRC-32C.  Meanwhile the data of the member are cut into slices of
+   PAX_VERIFY_CHUNK bytes, and the CRC of each slice is computed by
+   another worker.  When all the work on a member is done, the CRCs of
+   the slices, and those of the holes of a sparse member, are combined
+   and compared with that of the file.  Neither side waits for the
+   other, and a large member is hashed by all the workers at once.
+
+   Small members are read whole and hashed by the same worker as the
+   file.  */
+
+#include <system.h>
+#include <obstack.h>
+#include <pthread.h>
+#include <quote.h>
+#include <quotearg.h>
+#include <stat-time.h>
+#include <paxbuf.h>
+#include <pool.h>
+#include <crc32c.h>
+#include <tar.h>
+#include <pax.h>
+#include <reader.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+/* A piece of the contents of a member */
+struct verify_part
+{
+  uint_least32_t crc;
+  off_t len;
+};
+
+/* A member being verified */
+struct verify_member
+{
+  struct pax_verify *pv;
+  idx_t pending;              /* References left, under the mutex */
+  char typeflag;
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  dev_t rdev;
+  struct timespec mtime;
+  off_t size;                 /* Size of the file */
+  char *data;                 /* Whole data of a small member, or null */
+  idx_t nparts;
+  struct verify_part *parts;  /* Pieces of the contents, in order */
+  bool broken;                /* The data could not all be read */
+  bool compare;               /* The file was read */
+  uint_least32_t file_crc;    /* Its CRC */
+  char *link_name;            /* Symbolic or hard link target, or null */
+  char name[];
+};
+
+/* A slice of member data handed to a worker */
+struct verify_slice
+{
+  struct verify_member *m;
+  struct verify_part *part;
+  char *data;
+};
+
+struct pax_verify
+{
+  paxbuf_t buf;
+  pax_pool_t pool;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;        /* Signalled when a job finishes */
+  idx_t njobs;                /* Number of jobs in progress */
+  idx_t max_jobs;             /* Bound on njobs */
+  void *free_bufs;            /* Free buffers of PAX_VERIFY_CHUNK bytes */
+  pax_reader_t reader;        /* Members of the archive */
+  struct tar_stat_info *st;   /* Current member */
+  struct obstack names;       /* Normalized names of the current member */
+  void *names_mark;           /* First object in names */
+};
+
+
+/* Jobs */
+
+/* Return a buffer of PAX_VERIFY_CHUNK bytes */
+static char *
+verify_buf_get (struct pax_verify *pv)
+{
+  pthread_mutex_lock (&pv->mutex);
+  void **p = pv->free_bufs;
+  if (p)
+    pv->free_bufs = *p;
+  pthread_mutex_unlock (&pv->mutex);
+  return p ? (char *) p : ximalloc (PAX_VERIFY_CHUNK);
+}
+
+static void
+verify_buf_put (struct pax_verify *pv, char *buf)
+{
+  void **p = (void **) buf;
+
+  pthread_mutex_lock (&pv->mutex);
+  *p = pv->free_bufs;
+  pv->free_bufs = p;
+  pthread_mutex_unlock (&pv->mutex);
+}
+
+/* Queue JOB with ARG, once there is room for it */
+static void
+verify_submit (struct pax_verify *pv, pax_job_fp job, void *arg)
+{
+  pthread_mutex_lock (&pv->mutex);
+  while (pv->njobs >= pv->max_jobs)
+    pthread_cond_wait (&pv->cond, &pv->mutex);
+  pv->njobs++;
+  pthread_mutex_unlock (&pv->mutex);
+  pax_pool_submit (pv->pool, job, arg);
+}
+
+static void
+verify_job_done (struct pax_verify *pv)
+{
+  pthread_mutex_lock (&pv->mutex);
+  pv->njobs--;
+  pthread_cond_broadcast (&pv->cond);
+  pthread_mutex_unlock (&pv->mutex);
+}
+
+/* Diagnostics of the workers and the reading thread alike */
+#define VERIFY_REPORT(pv, report) PAX_REPORT (&(pv)->mutex, report)
+
+/* Report that the member M differs from its file in the way told by
+   WHAT, if not null, and set the exit status accordingly.  */
+static void
+verify_differs (struct verify_member *m, char const *what)
+{
+  pthread_mutex_lock (&m->pv->mutex);
+  if (what)
+    paxwarn (0, "%s: %s", quotearg_colon (m->name), what);
+  if (exit_status == PAXEXIT_SUCCESS)
+    exit_status = PAXEXIT_DIFFERS;
+  pthread_mutex_unlock (&m->pv->mutex);
+}
+
+/* Compare the contents of M, now that all work on it is done, and free
+   it.  */
+static void
+verify_finish (struct verify_member *m)
+{
+  if (m->compare && !m->broken)
+    {
+      uint_least32_t crc = 0;
+      for (idx_t i = 0; i < m->nparts; i++)
+	crc = pax_crc32c_combine (crc, m->parts[i].crc, m->parts[i].len);
+      if (crc != m->file_crc)
+	verify_differs (m, _("Contents differ"));
+    }
+  if (m->data)
+    verify_buf_put (m->pv, m->data);
+  free (m->parts);
+  free (m);
+}
+
+/* Drop a reference to M */
+static void
+verify_release (struct verify_member *m)
+{
+  struct pax_verify *pv = m->pv;
+
+  pthread_mutex_lock (&pv->mutex);
+  bool last = --m->pending == 0;
+  pthread_mutex_unlock (&pv->mutex);
+  if (last)
+    verify_finish (m);
+}
+
+static void
+verify_slice_run (void *arg)
+{
+  struct verify_slice *s = arg;
+  struct pax_verify *pv = s->m->pv;
+
+  s->part->crc = pax_crc32c (0, s->data, s->part->len);
+  verify_buf_put (pv, s->data);
+  verify_release (s->m);
+  free (s);
+  verify_job_done (pv);
+}
+
+
+/* Files */
+
+/* Compute into M the CRC of the file open on FD, of M->size bytes */
+static void
+verify_read (struct verify_member *m, int fd)
+{
+  char *buf = verify_buf_get (m->pv);
+  uint_least32_t crc = 0;
+  off_t left = m->size;
+
+  while (left > 0)
+    {
+      idx_t len = left < PAX_VERIFY_CHUNK ? left : PAX_VERIFY_CHUNK;
+      ptrdiff_t n = read (fd, buf, len);
+      if (n <= 0)
+	{
+	  if (n < 0)
+	    VERIFY_REPORT (m->pv, read_error (m->name));
+	  else
+	    verify_differs (m, _("Size differs"));
+	  verify_buf_put (m->pv, buf);
+	  return;
+	}
+      crc = pax_crc32c (crc, buf, n);
+      left -= n;
+    }
+  verify_buf_put (m->pv, buf);
+  if (m->data)
+    m->parts[0].crc = pax_crc32c (0, m->data, m->parts[0].len);
+  m->file_crc = crc;
+  m->compare = true;
+}
+
+/* Compare the regular file of M, of status ST */
+static void
+verify_regular (struct verify_member *m, struct stat const *st)
+{
+  if (st->st_size != m->size)
+    {
+      verify_differs (m, _("Size differs"));
+      return;
+    }
+  int fd = open (m->name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+  if (fd < 0)
+    {
+      VERIFY_REPORT (m->pv, open_error (m->name));
+      return;
+    }
+  verify_read (m, fd);
+  if (close (fd) != 0)
+    VERIFY_REPORT (m->pv, close_error (m->name));
+}
+
+/* Compare the symbolic link of M */
+static void
+verify_symlink (struct verify_member *m)
+{
+  idx_t len = strlen (m->link_name);
+  char *buf = ximalloc (len + 1);
+  ptrdiff_t n = readlink (m->name, buf, len + 1);
+
+  if (n < 0)
+    VERIFY_REPORT (m->pv, readlink_error (m->name));
+  else if (n != len || memcmp (buf, m->link_name, len) != 0)
+    verify_differs (m, _("Symlink differs"));
+  free (buf);
+}
+
+/* Check that the file of M is a hard link to its target */
+static void
+verify_hard_link (struct verify_member *m)
+{
+  struct stat st, tst;
+
+  if (lstat (m->name, &st) != 0)
+    {
+      VERIFY_REPORT (m->pv, stat_warn (m->name));
+      verify_differs (m, nullptr);
+    }
+  else if (lstat (m->link_name, &tst) != 0)
+    {
+      VERIFY_REPORT (m->pv, stat_warn (m->link_name));
+      verify_differs (m, nullptr);
+    }
+  else if (st.st_dev != tst.st_dev || st.st_ino != tst.st_ino)
+    {
+      VERIFY_REPORT (m->pv,
+		     paxwarn (0, _("%s: Not linked to %s"),
+			      quotearg_colon (m->name),
+			      quote_n (1, m->link_name)));
+      verify_differs (m, nullptr);
+    }
+}
+
+static void
+verify_file_run (void *arg)
+{
+  struct verify_member *m = arg;
+  struct pax_verify *pv = m->pv;
+  struct stat st;
+
+  if (m->typeflag == LNKTYPE)
+    verify_hard_link (m);
+  else if (lstat (m->name, &st) != 0)
+    {
+      VERIFY_REPORT (m->pv, stat_warn (m->name));
+      verify_differs (m, nullptr);
+    }
+  else if ((st.st_mode & S_IFMT) != (m->mode & S_IFMT))
+    verify_differs (m, _("File type differs"));
+  else
+    {
+      /* Extraction restores the owner and times of every kind of file,
+	 but not the mode of a symbolic link */
+      if (!S_ISLNK (st.st_mode) && (st.st_mode & 07777) != (m->mode & 07777))
+	verify_differs (m, _("Mode differs"));
+      if ((S_ISCHR (st.st_mode) || S_ISBLK (st.st_mode))
+	  && st.st_rdev != m->rdev)
+	verify_differs (m, _("Device number differs"));
+      if (st.st_uid != m->uid)
+	verify_differs (m, _("Uid differs"));
+      if (st.st_gid != m->gid)
+	verify_differs (m, _("Gid differs"));
+      struct timespec mtime = get_stat_mtime (&st);
+      if (mtime.tv_sec != m->mtime.tv_sec
+	  || (m->mtime.tv_nsec && mtime.tv_nsec != m->mtime.tv_nsec))
+	verify_differs (m, _("Mod time differs"));
+      if (S_ISLNK (st.st_mode))
+	verify_symlink (m);
+      else if (S_ISREG (st.st_mode))
+	verify_regular (m, &st);
+    }
+  verify_release (m);
+  verify_job_done (pv);
+}
+
+
+/* Members */
+
+/* Read the next LEN bytes of data of M into slices starting at PART,
+   and hand them to workers.  Return the part after the last one, or
+   null if the archive cannot be read.  */
+static struct verify_part *
+verify_slices (struct verify_member *m, struct verify_part *part, off_t len)
+{
+  struct pax_verify *pv = m->pv;
+
+  for (; len > 0; part++)
+    {
+      idx_t n = len < PAX_VERIFY_CHUNK ? len : PAX_VERIFY_CHUNK;
+      idx_t nread;
+      char *data = verify_buf_get (pv);
+      if (paxbuf_read (pv->buf, data, n, &nread) == pax_io_failure
+	  || nread != n)
+	{
+	  verify_buf_put (pv, data);
+	  return nullptr;
+	}
+      struct verify_slice *s = xmalloc (sizeof *s);
+      s->m = m;
+      s->part = part;
+      s->data = data;
+      part->len = n;
+      pthread_mutex_lock (&pv->mutex);
+      m->pending++;
+      pthread_mutex_unlock (&pv->mutex);
+      verify_submit (pv, verify_slice_run, s);
+      len -= n;
+    }
+  return part;
+}
+
+/* Return the number of slices of LEN bytes of data */
+static idx_t
+slice_count (off_t len)
+{
+  return (len + PAX_VERIFY_CHUNK - 1) / PAX_VERIFY_CHUNK;
+}
+
+/* Verify the data of the sparse member M, described by ST: slices of
+   the data regions, between the holes of the map.  Return 0 on success,
+   EIO if the archive cannot be read and EINVAL if the map is
+   malformed.  */
+static int
+verify_sparse (struct verify_member *m, struct tar_stat_info *st)
+{
+  paxbuf_t buf = m->pv->buf;
+  off_t start = paxbuf_tell (buf);
+  idx_t nparts = 1;
+  off_t pos = 0;
+
+  if (st->sparse_map_avail == 0)
+    {
+      int rc = pax_sparse_read_map (buf, st);
+      if (rc)
+	return rc;
+    }
+  if (!pax_sparse_map_valid (st, (st->archive_file_size
+				  - (paxbuf_tell (buf) - start))))
+    return EINVAL;
+  for (idx_t i = 0; i < st->sparse_map_avail; i++)
+    nparts += 1 + slice_count (st->sparse_map[i].numbytes);
+  m->parts = xicalloc (nparts, sizeof *m->parts);
+
+  struct verify_part *part = m->parts;
+  for (idx_t i = 0; part && i < st->sparse_map_avail; i++)
+    {
+      struct sp_array const *sp = &st->sparse_map[i];
+      if (sp->offset > pos)
+	{
+	  part->len = sp->offset - pos;
+	  part->crc = pax_crc32c_zeros (part->len);
+	  part++;
+	}
+      part = verify_slices (m, part, sp->numbytes);
+      pos = sp->offset + sp->numbytes;
+    }
+  if (!part)
+    return EIO;
+  if (m->size > pos)
+    {
+      part->len = m->size - pos;
+      part->crc = pax_crc32c_zeros (part->len);
+      part++;
+    }
+  m->nparts = part - m->parts;
+  return 0;
+}
+
+/* Normalize the member name NAME with FLAGS, as pax_normalize_names
+   does, into the names of the current member of PV.  */
+static struct pax_name
+verify_name (struct pax_verify *pv, char const *name, int flags)
+{
+  struct pax_name r;
+
+  /* The names may be diagnosed */
+  pthread_mutex_lock (&pv->mutex);
+  pax_normalize_names (&pv->names, &name, 1, flags, &r);
+  pthread_mutex_unlock (&pv->mutex);
+  return r;
+}
+
+/* Verify the member described by ST and BLK, whose data follow in the
+   archive.  Names are normalized as extraction does, and those with a
+   ".." component are refused, since they were not extracted.  */
+static int
+verify_member (struct pax_verify *pv, union block const *blk)
+{
+  struct tar_stat_info *st = pv->st;
+  char typeflag = blk->header.typeflag;
+  char const *link_name = nullptr;
+  off_t data_size = typeflag == LNKTYPE ? 0 : st->archive_file_size;
+  off_t end = (paxbuf_tell (pv->buf)
+	       + (data_size + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE);
+  bool reg = false;
+  int rc = 0;
+
+  obstack_free (&pv->names, pv->names_mark);
+  pv->names_mark = obstack_alloc (&pv->names, 0);
+  struct pax_name pn = verify_name (pv, st->file_name, 0);
+  char const *name = pn.name;
+  if (pn.dot_dot)
+    {
+      VERIFY_REPORT (pv, paxerror (0, _("%s: Member name contains '..'"),
+				   quotearg_colon (st->file_name)));
+      return pax_reader_skip_to (pv->reader, end);
+    }
+  pax_stat_resolve_owner (st);
+  switch (typeflag)
+    {
+    case LNKTYPE:
+      {
+	struct pax_name target = verify_name (pv, st->link_name,
+					      PAX_NAME_LINK_TARGET);
+	if (target.dot_dot)
+	  {
+	    VERIFY_REPORT (pv,
+			   paxerror (0, _("%s: Hard link target contains"
+					  " '..'"),
+				     quotearg_colon (st->link_name)));
+	    return pax_reader_skip_to (pv->reader, end);
+	  }
+	link_name = target.name;
+      }
+      break;
+
+    case SYMTYPE:
+      link_name = st->link_name;
+      break;
+
+    case DIRTYPE:
+    case GNUTYPE_DUMPDIR:
+    case CHRTYPE:
+    case BLKTYPE:
+    case FIFOTYPE:
+      break;
+
+    default:
+      reg = S_ISREG (st->stat.st_mode);
+      break;
+    }
+
+  idx_t nlen = strlen (name) + 1;
+  idx_t llen = link_name ? strlen (link_name) + 1 : 0;
+  struct verify_member *m = xzalloc (offsetof (struct verify_member, name)
+				     + nlen + llen);
+  m->pv = pv;
+  m->pending = 1;
+  m->typeflag = typeflag;
+  memcpy (m->name, name, nlen);
+  if (link_name)
+    m->link_name = memcpy (m->name + nlen, link_name, llen);
+  m->mode = st->stat.st_mode;
+  m->uid = st->stat.st_uid;
+  m->gid = st->stat.st_gid;
+  m->rdev = makedev (st->devmajor, st->devminor);
+  m->mtime.tv_sec = st->stat.st_mtime;
+  m->mtime.tv_nsec = st->mtime_nsec;
+  m->size = st->stat.st_size;
+
+  if (!reg)
+    {
+      m->pending++;
+      verify_submit (pv, verify_file_run, m);
+      verify_release (m);
+      return pax_reader_skip_to (pv->reader, end);
+    }
+
+  if (!st->is_sparse && data_size <= PAX_VERIFY_CHUNK)
+    {
+      /* Read it now, for the worker to hash with the file */
+      m->parts = xmalloc (sizeof *m->parts);
+      m->parts[0].len = data_size;
+      m->nparts = 1;
+      m->data = verify_buf_get (pv);
+      if (data_size > 0)
+	rc = pax_reader_read (pv->reader, m->data, data_size);
+      if (rc == 0)
+	{
+	  m->pending++;
+	  verify_submit (pv, verify_file_run, m);
+	}
+      verify_release (m);
+      return rc;
+    }
+
+  m->pending++;
+  verify_submit (pv, verify_file_run, m);
+  if (st->is_sparse)
+    rc = verify_sparse (m, st);
+  else
+    {
+      m->nparts = slice_count (data_size);
+      m->parts = xicalloc (m->nparts, sizeof *m->parts);
+      if (!verify_slices (m, m->parts, data_size))
+	rc = EIO;
+    }
+  m->broken = rc != 0;
+  verify_release (m);
+  if (rc == EINVAL)
+    {
+      VERIFY_REPORT (pv, paxerror (0, _("%s: Malformed sparse map;"
+					 " skipped"),
+				   quotearg_colon (name)));
+      rc = 0;
+    }
+  return rc == 0 ? pax_reader_skip_to (pv->reader, end) : rc;
+}
+
+
+/* Interface */
+
+/* Create in *PPV a verifier of the archive read from BUF, using
+   NTHREADS worker threads (all available processors if NTHREADS is not
+   positive).  Members are compared with the files of the same names,
+   relative to the working directory.  Return 0 on success, an errno
+   value otherwise.  */
+int
+pax_verify_open (pax_verify_t *ppv, paxbuf_t buf, int nthreads)
+{
+  struct pax_verify *pv = calloc (1, sizeof *pv);
+  if (!pv)
+    return ENOMEM;
+  int rc = pax_pool_create (&pv->pool, nthreads);
+  if (rc)
+    {
+      free (pv);
+      return rc;
+    }
+  pv->buf = buf;
+  pthread_mutex_init (&pv->mutex, nullptr);
+  pthread_cond_init (&pv->cond, nullptr);
+  pv->max_jobs = 4 * pax_pool_size (pv->pool);
+  rc = pax_reader_open (&pv->reader, buf, &pv->mutex);
+  if (rc)
+    xalloc_die ();
+  pv->st = pax_reader_stat (pv->reader);
+  obstack_init (&pv->names);
+  pv->names_mark = obstack_alloc (&pv->names, 0);
+  *ppv = pv;
+  return 0;
+}
+
+/* Verify all members of the archive.  Differences are reported, and
+   make the exit status PAXEXIT_DIFFERS.  Return 0 on success, EIO if
+   the archive cannot be read and EINVAL if it is malformed.  */
+int
+pax_verify_run (pax_verify_t pv)
+{
+  union block const *blk;
+  int rc;
+
+  while ((rc = pax_reader_next (pv->reader, &blk)) == 0 && blk)
+    {
+      rc = verify_member (pv, blk);
+      if (rc)
+	break;
+    }
+
+  pax_pool_wait (pv->pool);
+  return rc;
+}
+
+/* Wait for the jobs in progress and free *PPV */
+void
+pax_verify_destroy (pax_verify_t *ppv)
+{
+  struct pax_verify *pv = *ppv;
+
+  pax_pool_destroy (&pv->pool);
+  while (pv->free_bufs)
+    {
+      void **p = pv->free_bufs;
+      pv->free_bufs = *p;
+      free (p);
+    }
+  pax_reader_destroy (&pv->reader);
+  obstack_free (&pv->names, nullptr);
+  pthread_cond_destroy (&pv->cond);
+  pthread_mutex_destroy (&pv->mutex);
+  free (pv);
+  *ppv = nullptr;
+}
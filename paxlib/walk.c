@@ -0,0 +1,560 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Directories are read by whole, each by one thread: the entries are
+   read, sorted and stat'ed relative to the directory, and the nodes of
+   the subdirectories are pushed on the queue of that thread, the first
+   in order last.  A thread takes its next directory from the end of its
+   own queue, which keeps it going depth first, in about the order the
+   caller will need them; an idle thread takes the oldest directory of
+   another queue, the one nearest the root.
+
+   The caller walks the tree in order.  When it needs a directory that
+   no thread has started, it reads it itself, so that it never waits
+   for the threads to reach it.  The threads stop reading ahead when the
+   directories read and not yet walked hold PAX_WALK_AHEAD entries.  */
+
+#include <system.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <nproc.h>
+#include <obstack.h>
+#include <paxlib.h>
+#include <paxbuf.h>
+#include <pax.h>
+#include <walk.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+enum
+  {
+    PAX_WALK_AHEAD = 64 * 1024,  /* Entries read ahead of the caller */
+    PAX_WALK_FDS = 128           /* Directories kept open for openat */
+  };
+
+/* An entry of a directory */
+struct walk_entry
+{
+  char const *name;           /* Name in the directory */
+  struct stat st;
+  int err;                    /* errno value if it could not be stat'ed */
+  struct walk_dir *dir;       /* Node of a subdirectory not yet walked */
+};
+
+enum walk_state
+  {
+    WALK_QUEUED,              /* Waiting to be read */
+    WALK_READING,             /* Being read */
+    WALK_READ                 /* Entries available */
+  };
+
+/* A directory */
+struct walk_dir
+{
+  struct walk_dir *parent;
+  char *path;                 /* Full name */
+  idx_t path_len;
+  char const *name;           /* Last component of path */
+  enum walk_state state;
+  bool queued;                /* In a queue */
+  bool orphan;                /* Walked while still in a queue */
+  DIR *dirp;                  /* Kept open to open the subdirectories */
+  idx_t unopened;             /* Subdirectories not yet opened */
+  struct walk_entry *ents;    /* Entries, sorted by name */
+  idx_t nents;
+  struct obstack names;       /* Names of the entries */
+  int err;                    /* errno value if it could not be read */
+  void (*diag) (char const *);
+};
+
+/* The directories queued by a thread, oldest first */
+struct walk_queue
+{
+  struct walk_dir **dirs;
+  idx_t lo;
+  idx_t hi;
+  idx_t size;
+};
+
+struct walk_thread
+{
+  struct pax_walk *w;
+  int index;                  /* Index of its queue */
+};
+
+struct pax_walk
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond;   /* Signalled when there is work to take */
+  pthread_cond_t read_cond;   /* Signalled when a directory is read */
+  struct walk_queue *queues;  /* One per thread, the last for the caller */
+  struct walk_thread *threads;
+  pthread_t *tids;
+  int nthreads;
+  int stat_flags;             /* Flags of pax_stat_lstat */
+  idx_t ahead;                /* Entries read and not yet walked */
+  int nfds;                   /* Directories kept open */
+  bool stop;                  /* Threads must exit */
+
+    /* Walking, by the caller */
+  char *root;
+  struct stat root_st;
+  int root_err;
+  bool started;
+  struct walk_dir **stack;    /* Directories being walked */
+  idx_t *pos;                 /* Next entry of each, or -1 */
+  idx_t depth;
+  idx_t stack_size;
+  char *path;                 /* Name of the entry returned */
+  idx_t path_size;
+};
+
+
+/* Queues */
+
+static void
+queue_push (struct walk_queue *q, struct walk_dir *d)
+{
+  if (q->hi == q->size)
+    {
+      if (q->lo > 0)
+	{
+	  memmove (q->dirs, q->dirs + q->lo,
+		   (q->hi - q->lo) * sizeof *q->dirs);
+	  q->hi -= q->lo;
+	  q->lo = 0;
+	}
+      else
+	q->dirs = xpalloc (q->dirs, &q->size, 1, -1, sizeof *q->dirs);
+    }
+  q->dirs[q->hi++] = d;
+  d->queued = true;
+}
+
+/* Free directory D, which has been walked.  */
+static void
+dir_free (struct walk_dir *d)
+{
+  if (d->queued)
+    d->orphan = true;
+  else
+    free (d);
+}
+
+/* Take a directory to read off the queues of W, looking first at the
+   end of queue I, then at the start of the others.  Return null if
+   there is none.  */
+static struct walk_dir *
+walk_take (struct pax_walk *w, int i)
+{
+  int nqueues = w->nthreads + 1;
+
+  for (int k = 0; k < nqueues; k++)
+    {
+      struct walk_queue *q = &w->queues[(i + k) % nqueues];
+      while (q->lo < q->hi)
+	{
+	  struct walk_dir *d = k == 0 ? q->dirs[--q->hi] : q->dirs[q->lo++];
+	  d->queued = false;
+	  if (d->orphan)
+	    free (d);
+	  else if (d->state == WALK_QUEUED)
+	    return d;
+	}
+      q->lo = q->hi = 0;
+    }
+  return nullptr;
+}
+
+
+/* Reading directories */
+
+static int
+entry_cmp (void const *a, void const *b)
+{
+  struct walk_entry const *ea = a;
+  struct walk_entry const *eb = b;
+  return strcmp (ea->name, eb->name);
+}
+
+static struct walk_dir *
+dir_create (struct walk_dir *parent, char const *path, idx_t path_len,
+	    char const *name)
+{
+  struct walk_dir *d = xzalloc (sizeof *d);
+  idx_t sep = path_len > 0 && path[path_len - 1] != '/';
+  idx_t len = strlen (name);
+
+  d->parent = parent;
+  d->path_len = path_len + sep + len;
+  d->path = ximalloc (d->path_len + 1);
+  memcpy (d->path, path, path_len);
+  d->path[path_len] = '/';
+  strcpy (d->path + path_len + sep, name);
+  d->name = d->path + path_len + sep;
+  d->state = WALK_QUEUED;
+  obstack_init (&d->names);
+  return d;
+}
+
+/* Read the entries of D, without the lock, and stat them according to
+   STAT_FLAGS.  */
+static void
+dir_read_entries (struct walk_dir *d, int stat_flags)
+{
+  struct walk_dir *parent = d->parent;
+  int flags = O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_NOCTTY | O_CLOEXEC;
+  int fd = (parent && parent->dirp
+	    ? openat (dirfd (parent->dirp), d->name, flags)
+	    : open (d->path, flags));
+  if (fd < 0 || !(d->dirp = fdopendir (fd)))
+    {
+      d->err = errno;
+      d->diag = open_error;
+      if (fd >= 0)
+	close (fd);
+      return;
+    }
+
+  idx_t size = 0;
+  for (;;)
+    {
+      errno = 0;
+      struct dirent *de = readdir (d->dirp);
+      if (!de)
+	{
+	  if (errno)
+	    {
+	      d->err = errno;
+	      d->diag = savedir_error;
+	    }
+	  break;
+	}
+      if (de->d_name[0] == '.'
+	  && (!de->d_name[1] || (de->d_name[1] == '.' && !de->d_name[2])))
+	continue;
+      if (d->nents == size)
+	d->ents = xpalloc (d->ents, &size, 1, -1, sizeof *d->ents);
+      struct walk_entry *e = &d->ents[d->nents++];
+      e->name = obstack_copy0 (&d->names, de->d_name, strlen (de->d_name));
+      e->dir = nullptr;
+    }
+  qsort (d->ents, d->nents, sizeof *d->ents, entry_cmp);
+
+  int dfd = dirfd (d->dirp);
+  for (idx_t i = 0; i < d->nents; i++)
+    {
+      struct walk_entry *e = &d->ents[i];
+      e->err = pax_stat_lstat (&e->st, dfd, e->name, stat_flags);
+      if (!e->err && S_ISDIR (e->st.st_mode))
+	{
+	  e->dir = dir_create (d, d->path, d->path_len, e->name);
+	  d->unopened++;
+	}
+    }
+}
+
+/* Close the directory D, which has no subdirectories left to open */
+static void
+dir_close (struct pax_walk *w, struct walk_dir *d)
+{
+  if (d->dirp)
+    {
+      closedir (d->dirp);
+      d->dirp = nullptr;
+      w->nfds--;
+    }
+}
+
+/* Read directory D, claimed by the caller of queue I, and queue its
+   subdirectories there.  Called and returns with the lock held.  */
+static void
+walk_read (struct pax_walk *w, struct walk_dir *d, int i)
+{
+  d->state = WALK_READING;
+  pthread_mutex_unlock (&w->mutex);
+  dir_read_entries (d, w->stat_flags);
+  pthread_mutex_lock (&w->mutex);
+
+  if (d->dirp)
+    {
+      w->nfds++;
+      if (d->unopened == 0 || w->nfds > PAX_WALK_FDS)
+	dir_close (w, d);
+    }
+  if (d->parent && --d->parent->unopened == 0)
+    dir_close (w, d->parent);
+
+  bool pushed = false;
+  for (idx_t k = d->nents; k-- > 0; )
+    if (d->ents[k].dir)
+      {
+	queue_push (&w->queues[i], d->ents[k].dir);
+	pushed = true;
+      }
+  d->state = WALK_READ;
+  w->ahead += d->nents;
+  pthread_cond_broadcast (&w->read_cond);
+  if (pushed)
+    pthread_cond_broadcast (&w->work_cond);
+}
+
+static void *
+walk_worker (void *closure)
+{
+  struct walk_thread *t = closure;
+  struct pax_walk *w = t->w;
+
+  pthread_mutex_lock (&w->mutex);
+  for (;;)
+    {
+      struct walk_dir *d = nullptr;
+      while (!w->stop
+	     && !(w->ahead < PAX_WALK_AHEAD && (d = walk_take (w, t->index))))
+	pthread_cond_wait (&w->work_cond, &w->mutex);
+      if (w->stop)
+	break;
+      walk_read (w, d, t->index);
+    }
+  pthread_mutex_unlock (&w->mutex);
+  return nullptr;
+}
+
+
+/* Walking */
+
+/* Release directory D and the subdirectories not yet walked.  Called
+   with the lock held.  */
+static void
+walk_release (struct pax_walk *w, struct walk_dir *d)
+{
+  for (idx_t i = 0; i < d->nents; i++)
+    if (d->ents[i].dir)
+      walk_release (w, d->ents[i].dir);
+  if (d->state == WALK_READ)
+    {
+      if (w->ahead >= PAX_WALK_AHEAD && w->ahead - d->nents < PAX_WALK_AHEAD)
+	pthread_cond_broadcast (&w->work_cond);
+      w->ahead -= d->nents;
+    }
+  dir_close (w, d);
+  obstack_free (&d->names, nullptr);
+  free (d->ents);
+  free (d->path);
+  dir_free (d);
+}
+
+static void
+stack_push (struct pax_walk *w, struct walk_dir *d)
+{
+  if (w->depth == w->stack_size)
+    {
+      w->stack = xpalloc (w->stack, &w->stack_size, 1, -1, sizeof *w->stack);
+      w->pos = xirealloc (w->pos, w->stack_size * sizeof *w->pos);
+    }
+  w->stack[w->depth] = d;
+  w->pos[w->depth] = -1;
+  w->depth++;
+}
+
+/* Start walking the tree at ROOT with NTHREADS threads (all available
+   processors if NTHREADS is not positive), and store the walk in *PW.
+   The files are stat'ed by pax_stat_lstat with STAT_FLAGS.  Return 0 on
+   success, an errno value otherwise.  */
+int
+pax_walk_open (pax_walk_t *pw, char const *root, int nthreads,
+	       int stat_flags)
+{
+  struct pax_walk *w;
+  int rc = 0;
+
+  if (nthreads <= 0)
+    {
+      unsigned long n = num_processors (NPROC_CURRENT);
+      nthreads = n < INT_MAX ? n : INT_MAX;
+    }
+
+  w = xzalloc (sizeof *w);
+  w->root = xstrdup (root);
+  w->stat_flags = stat_flags;
+  w->root_err = pax_stat_lstat (&w->root_st, AT_FDCWD, root, stat_flags);
+  w->queues = xicalloc (nthreads + 1, sizeof *w->queues);
+  w->threads = xinmalloc (nthreads, sizeof *w->threads);
+  w->tids = xinmalloc (nthreads, sizeof *w->tids);
+  pthread_mutex_init (&w->mutex, nullptr);
+  pthread_cond_init (&w->work_cond, nullptr);
+  pthread_cond_init (&w->read_cond, nullptr);
+
+  /* The threads wait for the lock until the queue of the caller, the
+     last one, has its final index.  */
+  pthread_mutex_lock (&w->mutex);
+  for (w->nthreads = 0; w->nthreads < nthreads; w->nthreads++)
+    {
+      struct walk_thread *t = &w->threads[w->nthreads];
+      t->w = w;
+      t->index = w->nthreads;
+      rc = pthread_create (&w->tids[w->nthreads], nullptr, walk_worker, t);
+      if (rc)
+	{
+	  /* Run with whatever we managed to start, even if that is
+	     nothing: the caller reads the directories itself.  */
+	  rc = 0;
+	  break;
+	}
+    }
+
+  if (!w->root_err && S_ISDIR (w->root_st.st_mode))
+    {
+      idx_t len = strlen (root);
+      while (len > 1 && root[len - 1] == '/')
+	len--;
+      char *name = ximemdup0 (root, len);
+      struct walk_dir *d = dir_create (nullptr, "", 0, name);
+      free (name);
+      stack_push (w, d);
+      queue_push (&w->queues[w->nthreads], d);
+      pthread_cond_broadcast (&w->work_cond);
+    }
+  pthread_mutex_unlock (&w->mutex);
+
+  *pw = w;
+  return rc;
+}
+
+/* Store in ENT the next file of the walk W.  Return false at the end.
+   Files that cannot be read are diagnosed and skipped.  The contents of
+   ENT remain valid until the next call.  */
+bool
+pax_walk_next (pax_walk_t w, struct pax_walk_entry *ent)
+{
+  if (!w->started)
+    {
+      w->started = true;
+      if (w->root_err)
+	{
+	  errno = w->root_err;
+	  stat_error (w->root);
+	  return false;
+	}
+      ent->name = w->root;
+      ent->st = &w->root_st;
+      return true;
+    }
+
+  pthread_mutex_lock (&w->mutex);
+  while (w->depth > 0)
+    {
+      struct walk_dir *d = w->stack[w->depth - 1];
+      idx_t *pos = &w->pos[w->depth - 1];
+
+      if (d->state == WALK_QUEUED)
+	walk_read (w, d, w->nthreads);
+      while (d->state != WALK_READ)
+	pthread_cond_wait (&w->read_cond, &w->mutex);
+
+      if (*pos < 0)
+	{
+	  *pos = 0;
+	  if (d->err)
+	    {
+	      pthread_mutex_unlock (&w->mutex);
+	      errno = d->err;
+	      d->diag (d->path);
+	      pthread_mutex_lock (&w->mutex);
+	    }
+	}
+
+      if (*pos < d->nents)
+	{
+	  struct walk_entry *e = &d->ents[(*pos)++];
+	  idx_t sep = d->path[d->path_len - 1] != '/';
+	  idx_t len = strlen (e->name);
+	  idx_t size = d->path_len + sep + len + 1;
+	  if (w->path_size < size)
+	    {
+	      free (w->path);
+	      w->path = xpalloc (nullptr, &w->path_size,
+				 size - w->path_size, -1, 1);
+	    }
+	  memcpy (w->path, d->path, d->path_len);
+	  w->path[d->path_len] = '/';
+	  memcpy (w->path + d->path_len + sep, e->name, len + 1);
+
+	  if (e->err)
+	    {
+	      pthread_mutex_unlock (&w->mutex);
+	      errno = e->err;
+	      stat_error (w->path);
+	      pthread_mutex_lock (&w->mutex);
+	      continue;
+	    }
+	  if (e->dir)
+	    stack_push (w, e->dir);
+	  pthread_mutex_unlock (&w->mutex);
+	  ent->name = w->path;
+	  ent->st = &e->st;
+	  return true;
+	}
+
+      /* Done with D */
+      w->depth--;
+      if (w->depth > 0)
+	w->stack[w->depth - 1]->ents[w->pos[w->depth - 1] - 1].dir = nullptr;
+      walk_release (w, d);
+    }
+  pthread_mutex_unlock (&w->mutex);
+  return false;
+}
+
+void
+pax_walk_destroy (pax_walk_t *pw)
+{
+  struct pax_walk *w = *pw;
+
+  pthread_mutex_lock (&w->mutex);
+  w->stop = true;
+  pthread_cond_broadcast (&w->work_cond);
+  pthread_mutex_unlock (&w->mutex);
+  for (int i = 0; i < w->nthreads; i++)
+    pthread_join (w->tids[i], nullptr);
+
+  /* Directories in the queues are all part of the tree under the
+     bottom of the stack, and are orphans once it is released.  */
+  if (w->depth > 0)
+    walk_release (w, w->stack[0]);
+  for (int i = 0; i <= w->nthreads; i++)
+    {
+      struct walk_queue *q = &w->queues[i];
+      for (idx_t k = q->lo; k < q->hi; k++)
+	free (q->dirs[k]);
+      free (q->dirs);
+    }
+
+  pthread_cond_destroy (&w->read_cond);
+  pthread_cond_destroy (&w->work_cond);
+  pthread_mutex_destroy (&w->mutex);
+  free (w->queues);
+  free (w->threads);
+  free (w->tids);
+  free (w->stack);
+  free (w->pos);
+  free (w->path);
+  free (w->root);
+  free (w);
+  *pw = nullptr;
+}
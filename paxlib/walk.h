@@ -0,0 +1,37 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Parallel walk of a file tree.
+
+   Worker threads read directories and stat their entries ahead of the
+   caller, who gets the files one at a time in a fixed order: each
+   directory is followed by its entries sorted by name, each
+   subdirectory by its own contents, whatever the number of threads.
+   Symbolic links are not followed.  */
+
+typedef struct pax_walk *pax_walk_t;
+
+struct pax_walk_entry
+{
+  char const *name;           /* Name of the file, under the root */
+  struct stat const *st;      /* Its status, from pax_stat_lstat */
+};
+
+int pax_walk_open (pax_walk_t *pw, char const *root, int nthreads,
+		   int stat_flags);
+bool pax_walk_next (pax_walk_t w, struct pax_walk_entry *ent);
+void pax_walk_destroy (pax_walk_t *pw);
@@ -0,0 +1,585 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* POSIX extended headers.
+
+   The data of an extended header is a sequence of records of the form
+   "LEN KEYWORD=VALUE\n", where LEN is the decimal length of the whole
+   record.  The data is read into an arena and tokenized in place: the
+   '=' and the newline of each record are overwritten with nulls, and
+   the records point into the arena.  Keywords are mapped to enum
+   values with a perfect hash, so that looking them up later costs
+   nothing.
+
+   Records of global headers ('g') are kept in an arena of their own
+   for the rest of the archive.  Records of per-member headers ('x') are
+   dropped by pax_xheader_reset, which releases the member arena without
+   returning its memory to the system, so that once it has grown to the
+   size of the largest header, parsing allocates nothing.  */
+
+#include <system.h>
+#include <c-ctype.h>
+#include <obstack.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+
+#define obstack_chunk_alloc xmalloc
+#define obstack_chunk_free free
+
+struct pax_xheader
+{
+  struct obstack global;      /* Data of global headers */
+  struct obstack member;      /* Data of the current member headers */
+  void *member_mark;          /* First object in member */
+
+  struct pax_xrecord *recs;   /* Global records, then member ones */
+  idx_t nrecs;
+  idx_t nglobal;
+  idx_t recs_size;
+
+  /* 1 + index in recs of the record in effect for each keyword, or 0 */
+  idx_t last[PAX_XK_COUNT];
+  idx_t glast[PAX_XK_COUNT];  /* Same, for global records alone */
+};
+
+pax_xheader_t
+pax_xheader_create (void)
+{
+  pax_xheader_t xh = xzalloc (sizeof *xh);
+
+  obstack_init (&xh->global);
+  obstack_init (&xh->member);
+  xh->member_mark = obstack_alloc (&xh->member, 0);
+  return xh;
+}
+
+void
+pax_xheader_destroy (pax_xheader_t *pxh)
+{
+  pax_xheader_t xh = *pxh;
+
+  if (!xh)
+    return;
+  obstack_free (&xh->global, nullptr);
+  obstack_free (&xh->member, nullptr);
+  free (xh->recs);
+  free (xh);
+  *pxh = nullptr;
+}
+
+/* Forget the records of the current member, keeping the global ones */
+void
+pax_xheader_reset (pax_xheader_t xh)
+{
+  obstack_free (&xh->member, xh->member_mark);
+  xh->member_mark = obstack_alloc (&xh->member, 0);
+  xh->nrecs = xh->nglobal;
+  memcpy (xh->last, xh->glast, sizeof xh->last);
+}
+
+
+/* Keywords */
+
+static char const schily_xattr[] = "SCHILY.xattr.";
+static char const libarchive_xattr[] = "LIBARCHIVE.xattr.";
+
+/* The table is indexed by keyword_hash, which was tuned (by trying
+   multipliers) so that no two keywords below collide.  */
+enum { KEYWORD_HASH_BITS = 6 };
+
+static struct
+{
+  char const *name;
+  enum pax_xkeyword keyword;
+} const keyword_table[1 << KEYWORD_HASH_BITS] = {
+  [0] = { "GNU.sparse.minor", PAX_XK_GNU_SPARSE_MINOR },
+  [4] = { "hdrcharset", PAX_XK_HDRCHARSET },
+  [5] = { "uid", PAX_XK_UID },
+  [6] = { "GNU.sparse.realsize", PAX_XK_GNU_SPARSE_REALSIZE },
+  [8] = { "GNU.volume.offset", PAX_XK_GNU_VOLUME_OFFSET },
+  [9] = { "SCHILY.acl.access", PAX_XK_SCHILY_ACL_ACCESS },
+  [10] = { "GNU.volume.size", PAX_XK_GNU_VOLUME_SIZE },
+  [11] = { "uname", PAX_XK_UNAME },
+  [13] = { "SCHILY.ino", PAX_XK_SCHILY_INO },
+  [14] = { "SCHILY.realsize", PAX_XK_SCHILY_REALSIZE },
+  [16] = { "atime", PAX_XK_ATIME },
+  [17] = { "RHT.security.selinux", PAX_XK_SELINUX },
+  [19] = { "GNU.sparse.numblocks", PAX_XK_GNU_SPARSE_NUMBLOCKS },
+  [20] = { "GNU.volume.filename", PAX_XK_GNU_VOLUME_FILENAME },
+  [21] = { "GNU.sparse.name", PAX_XK_GNU_SPARSE_NAME },
+  [23] = { "linkpath", PAX_XK_LINKPATH },
+  [24] = { "path", PAX_XK_PATH },
+  [25] = { "gname", PAX_XK_GNAME },
+  [27] = { "GNU.sparse.numbytes", PAX_XK_GNU_SPARSE_NUMBYTES },
+  [28] = { "charset", PAX_XK_CHARSET },
+  [30] = { "SCHILY.nlink", PAX_XK_SCHILY_NLINK },
+  [32] = { "SCHILY.devmajor", PAX_XK_SCHILY_DEVMAJOR },
+  [33] = { "GNU.volume.label", PAX_XK_GNU_VOLUME_LABEL },
+  [34] = { "SCHILY.dev", PAX_XK_SCHILY_DEV },
+  [35] = { "SCHILY.acl.ace", PAX_XK_SCHILY_ACL_ACE },
+  [38] = { "GNU.sparse.major", PAX_XK_GNU_SPARSE_MAJOR },
+  [39] = { "comment", PAX_XK_COMMENT },
+  [40] = { "ctime", PAX_XK_CTIME },
+  [41] = { "SCHILY.acl.default", PAX_XK_SCHILY_ACL_DEFAULT },
+  [42] = { "GNU.sparse.size", PAX_XK_GNU_SPARSE_SIZE },
+  [46] = { "gid", PAX_XK_GID },
+  [47] = { "GNU.sparse.offset", PAX_XK_GNU_SPARSE_OFFSET },
+  [50] = { "SCHILY.fflags", PAX_XK_SCHILY_FFLAGS },
+  [52] = { "GNU.dumpdir", PAX_XK_GNU_DUMPDIR },
+  [53] = { "SCHILY.filetype", PAX_XK_SCHILY_FILETYPE },
+  [56] = { "GNU.sparse.map", PAX_XK_GNU_SPARSE_MAP },
+  [57] = { "size", PAX_XK_SIZE },
+  [58] = { "SCHILY.devminor", PAX_XK_SCHILY_DEVMINOR },
+  [59] = { "mtime", PAX_XK_MTIME },
+};
+
+static unsigned
+keyword_hash (char const *key, idx_t len)
+{
+  uint_least32_t h = 2166136261u;
+
+  for (idx_t i = 0; i < len; i++)
+    h = ((h ^ (unsigned char) key[i]) * 2742367u) & 0xffffffff;
+  return h >> (32 - KEYWORD_HASH_BITS);
+}
+
+static bool
+has_prefix (char const *key, idx_t len, char const *prefix, idx_t plen)
+{
+  return len > plen && memcmp (key, prefix, plen) == 0;
+}
+
+/* Return the keyword KEY of LEN bytes as an enum value */
+enum pax_xkeyword
+pax_xkeyword_lookup (char const *key, idx_t len)
+{
+  if (has_prefix (key, len, schily_xattr, sizeof schily_xattr - 1))
+    return PAX_XK_SCHILY_XATTR;
+  if (has_prefix (key, len, libarchive_xattr, sizeof libarchive_xattr - 1))
+    return PAX_XK_LIBARCHIVE_XATTR;
+
+  unsigned h = keyword_hash (key, len);
+  char const *name = keyword_table[h].name;
+  if (name && (idx_t) strlen (name) == len && memcmp (name, key, len) == 0)
+    return keyword_table[h].keyword;
+  return PAX_XK_UNKNOWN;
+}
+
+/* Keywords that may occur several times in a header, all occurrences
+   being meaningful */
+static bool
+keyword_repeats (enum pax_xkeyword kw)
+{
+  switch (kw)
+    {
+    case PAX_XK_UNKNOWN:
+    case PAX_XK_SCHILY_XATTR:
+    case PAX_XK_LIBARCHIVE_XATTR:
+    case PAX_XK_GNU_SPARSE_OFFSET:
+    case PAX_XK_GNU_SPARSE_NUMBYTES:
+      return true;
+    default:
+      return false;
+    }
+}
+
+
+/* Parsing */
+
+/* Tokenize the SIZE bytes of extended header data at DATA, which is
+   writable and lives in the arena of the header.  */
+static int
+xheader_tokenize (pax_xheader_t xh, char *data, idx_t size, bool global)
+{
+  char *p = data, *end = data + size;
+
+  while (p < end && *p)
+    {
+      /* Length */
+      idx_t len = 0;
+      char *q = p;
+      for (; q < end && c_isdigit (*q); q++)
+	if (ckd_mul (&len, len, 10) || ckd_add (&len, len, *q - '0'))
+	  return EINVAL;
+      if (q == p || q == end || *q != ' ' || len <= q + 1 - p
+	  || len > end - p || p[len - 1] != '\n')
+	return EINVAL;
+
+      /* Keyword and value */
+      char *key = q + 1;
+      char *rec_end = p + len - 1;
+      char *eq = memchr (key, '=', rec_end - key);
+      if (!eq || eq == key)
+	return EINVAL;
+      *eq = '\0';
+      *rec_end = '\0';
+
+      if (xh->nrecs == xh->recs_size)
+	xh->recs = xpalloc (xh->recs, &xh->recs_size, 1, -1,
+			    sizeof xh->recs[0]);
+      struct pax_xrecord *rec = &xh->recs[xh->nrecs++];
+      rec->keyword = pax_xkeyword_lookup (key, eq - key);
+      rec->key = key;
+      rec->key_len = eq - key;
+      rec->value = eq + 1;
+      rec->value_len = rec_end - (eq + 1);
+      rec->global = global;
+
+      /* An empty value cancels the keyword */
+      if (!keyword_repeats (rec->keyword))
+	xh->last[rec->keyword] = rec->value_len ? xh->nrecs : 0;
+
+      p += len;
+    }
+  return 0;
+}
+
+/* Parse the SIZE bytes of extended header data at DATA.  GLOBAL tells
+   whether they come from a global header, whose records stay in effect
+   for all subsequent members.  Return 0 on success and EINVAL if the
+   data are malformed, in which case the records that could be parsed
+   are kept.  */
+int
+pax_xheader_parse (pax_xheader_t xh, char const *data, idx_t size,
+		   bool global)
+{
+  struct obstack *ob;
+  char *copy;
+  int rc;
+
+  if (global)
+    {
+      /* Global headers come between members */
+      pax_xheader_reset (xh);
+      ob = &xh->global;
+    }
+  else
+    ob = &xh->member;
+  copy = obstack_copy (ob, data, size);
+  rc = xheader_tokenize (xh, copy, size, global);
+  if (global)
+    {
+      xh->nglobal = xh->nrecs;
+      memcpy (xh->glast, xh->last, sizeof xh->glast);
+    }
+  return rc;
+}
+
+/* Read the data of the extended header BLK from BUF and parse them.
+   The data are read straight into the arena.  Return 0 on success,
+   EINVAL if the header or its data are malformed and EIO on read
+   errors.  */
+int
+pax_xheader_read (pax_xheader_t xh, paxbuf_t buf, union block const *blk)
+{
+  bool global = blk->header.typeflag == XGLTYPE;
+  intmax_t size;
+  struct obstack *ob;
+  char *data;
+  idx_t nread;
+  int rc;
+
+  if (!pax_decode_number (blk->header.size, sizeof blk->header.size,
+			  0, IDX_MAX - BLOCKSIZE, &size))
+    return EINVAL;
+
+  idx_t padded = (size + BLOCKSIZE - 1) / BLOCKSIZE * BLOCKSIZE;
+  if (global)
+    {
+      pax_xheader_reset (xh);
+      ob = &xh->global;
+    }
+  else
+    ob = &xh->member;
+  data = obstack_alloc (ob, padded);
+  if (paxbuf_read (buf, data, padded, &nread) == pax_io_failure
+      || nread != padded)
+    return EIO;
+
+  rc = xheader_tokenize (xh, data, size, global);
+  if (global)
+    {
+      xh->nglobal = xh->nrecs;
+      memcpy (xh->glast, xh->last, sizeof xh->glast);
+    }
+  return rc;
+}
+
+
+/* Access to records */
+
+/* Return the records in effect, global ones first, and store their
+   number in *COUNT.  */
+struct pax_xrecord const *
+pax_xheader_records (pax_xheader_t xh, idx_t *count)
+{
+  *count = xh->nrecs;
+  return xh->recs;
+}
+
+/* Return the record in effect for the keyword KW, or null if there is
+   none.  For keywords that may repeat, the last one is returned.  */
+struct pax_xrecord const *
+pax_xheader_find (pax_xheader_t xh, enum pax_xkeyword kw)
+{
+  if (keyword_repeats (kw))
+    {
+      for (idx_t i = xh->nrecs; i > 0; i--)
+	if (xh->recs[i - 1].keyword == kw)
+	  return &xh->recs[i - 1];
+      return nullptr;
+    }
+  return xh->last[kw] ? &xh->recs[xh->last[kw] - 1] : nullptr;
+}
+
+
+/* Applying records to a tar_stat_info */
+
+static bool
+decode_decimal (char const *s, intmax_t minval, uintmax_t maxval,
+		intmax_t *val)
+{
+  bool negative = *s == '-';
+  uintmax_t u = 0;
+  char const *p = s + negative;
+
+  if (!c_isdigit (*p))
+    return false;
+  for (; c_isdigit (*p); p++)
+    if (ckd_mul (&u, u, 10) || ckd_add (&u, u, *p - '0'))
+      return false;
+  if (*p)
+    return false;
+  if (negative)
+    {
+      if (minval >= 0 || u > - (uintmax_t) minval)
+	return false;
+      *val = - (intmax_t) (u - 1) - 1;
+    }
+  else
+    {
+      if (u > maxval)
+	return false;
+      *val = u;
+    }
+  return true;
+}
+
+/* Decode the time stamp S, of the form [-]SECONDS[.FRACTION] */
+static bool
+decode_xtime (char const *s, time_t *sec, unsigned long *nsec)
+{
+  char const *dot = strchr (s, '.');
+  char buf[INT_BUFSIZE_BOUND (intmax_t)];
+  intmax_t v;
+  long ns = 0;
+
+  if (dot)
+    {
+      if (dot - s >= (idx_t) sizeof buf)
+	return false;
+      memcpy (buf, s, dot - s);
+      buf[dot - s] = '\0';
+      s = buf;
+
+      /* Nanoseconds, truncated */
+      char const *p = dot + 1;
+      int digits = 0;
+      for (; c_isdigit (*p); p++)
+	if (digits < 9)
+	  {
+	    ns = ns * 10 + (*p - '0');
+	    digits++;
+	  }
+      if (*p || p == dot + 1)
+	return false;
+      for (; digits < 9; digits++)
+	ns *= 10;
+    }
+  if (!decode_decimal (s, TYPE_MINIMUM (time_t), TYPE_MAXIMUM (time_t), &v))
+    return false;
+
+  /* A negative time stamp counts the fraction backwards */
+  if (*s == '-' && ns)
+    {
+      if (v == TYPE_MINIMUM (time_t))
+	return false;
+      v--;
+      ns = 1000000000 - ns;
+    }
+  *sec = v;
+  *nsec = ns;
+  return true;
+}
+
+static char *
+value_dup (struct tar_stat_info *st, struct pax_xrecord const *rec)
+{
+  return pax_stat_memdup0 (st, rec->value, rec->value_len);
+}
+
+/* Decode the GNU.sparse.map value S: a comma-separated list of offsets
+   and sizes.  */
+static bool
+decode_sparse_map (struct tar_stat_info *st, char const *s)
+{
+  while (*s)
+    {
+      intmax_t v[2];
+
+      for (int i = 0; i < 2; i++)
+	{
+	  char const *comma = strchr (s, ',');
+	  idx_t len = comma ? comma - s : (idx_t) strlen (s);
+	  char buf[INT_BUFSIZE_BOUND (intmax_t)];
+
+	  if (len >= (idx_t) sizeof buf || (i == 0 && !comma))
+	    return false;
+	  memcpy (buf, s, len);
+	  buf[len] = '\0';
+	  if (!decode_decimal (buf, 0, TYPE_MAXIMUM (off_t), &v[i]))
+	    return false;
+	  s += len + (comma != nullptr);
+	}
+      pax_stat_sparse_add (st, v[0], v[1]);
+    }
+  return true;
+}
+
+/* Apply the records in effect to ST, overriding the values decoded
+   from the ustar header.  Return 0 on success and EINVAL if a value is
+   malformed.  Strings are allocated in the arena of ST.  Unknown
+   keywords, and those that do not describe the file, are ignored.  */
+int
+pax_xheader_apply (pax_xheader_t xh, struct tar_stat_info *st)
+{
+  intmax_t v, offset = -1;
+
+  for (idx_t i = 0; i < xh->nrecs; i++)
+    {
+      struct pax_xrecord const *rec = &xh->recs[i];
+
+      /* Skip overridden and cancelled records */
+      if (!keyword_repeats (rec->keyword) && xh->last[rec->keyword] != i + 1)
+	continue;
+
+      switch (rec->keyword)
+	{
+	case PAX_XK_PATH:
+	  st->orig_file_name = value_dup (st, rec);
+	  st->file_name = value_dup (st, rec);
+	  break;
+
+	case PAX_XK_GNU_SPARSE_NAME:
+	  st->file_name = value_dup (st, rec);
+	  break;
+
+	case PAX_XK_LINKPATH:
+	  st->link_name = value_dup (st, rec);
+	  break;
+
+	case PAX_XK_UNAME:
+	  st->uname = value_dup (st, rec);
+	  break;
+
+	case PAX_XK_GNAME:
+	  st->gname = value_dup (st, rec);
+	  break;
+
+	case PAX_XK_UID:
+	  if (!decode_decimal (rec->value, 0, TYPE_MAXIMUM (uid_t), &v))
+	    return EINVAL;
+	  st->stat.st_uid = v;
+	  break;
+
+	case PAX_XK_GID:
+	  if (!decode_decimal (rec->value, 0, TYPE_MAXIMUM (gid_t), &v))
+	    return EINVAL;
+	  st->stat.st_gid = v;
+	  break;
+
+	case PAX_XK_SIZE:
+	  if (!decode_decimal (rec->value, 0, TYPE_MAXIMUM (off_t), &v))
+	    return EINVAL;
+	  st->archive_file_size = v;
+	  if (!st->is_sparse)
+	    st->stat.st_size = v;
+	  break;
+
+	case PAX_XK_MTIME:
+	  if (!decode_xtime (rec->value, &st->stat.st_mtime, &st->mtime_nsec))
+	    return EINVAL;
+	  break;
+
+	case PAX_XK_ATIME:
+	  if (!decode_xtime (rec->value, &st->stat.st_atime, &st->atime_nsec))
+	    return EINVAL;
+	  break;
+
+	case PAX_XK_CTIME:
+	  if (!decode_xtime (rec->value, &st->stat.st_ctime, &st->ctime_nsec))
+	    return EINVAL;
+	  break;
+
+	case PAX_XK_SCHILY_DEVMAJOR:
+	  if (!decode_decimal (rec->value, 0, UINT_MAX, &v))
+	    return EINVAL;
+	  st->devmajor = v;
+	  break;
+
+	case PAX_XK_SCHILY_DEVMINOR:
+	  if (!decode_decimal (rec->value, 0, UINT_MAX, &v))
+	    return EINVAL;
+	  st->devminor = v;
+	  break;
+
+	case PAX_XK_GNU_SPARSE_SIZE:
+	case PAX_XK_GNU_SPARSE_REALSIZE:
+	  if (!decode_decimal (rec->value, 0, TYPE_MAXIMUM (off_t), &v))
+	    return EINVAL;
+	  st->stat.st_size = v;
+	  st->is_sparse = true;
+	  break;
+
+	case PAX_XK_GNU_SPARSE_OFFSET:
+	  if (!decode_decimal (rec->value, 0, TYPE_MAXIMUM (off_t), &offset))
+	    return EINVAL;
+	  break;
+
+	case PAX_XK_GNU_SPARSE_NUMBYTES:
+	  if (offset < 0
+	      || !decode_decimal (rec->value, 0, TYPE_MAXIMUM (off_t), &v))
+	    return EINVAL;
+	  pax_stat_sparse_add (st, offset, v);
+	  offset = -1;
+	  st->is_sparse = true;
+	  break;
+
+	case PAX_XK_GNU_SPARSE_MAP:
+	  st->sparse_map_avail = 0;
+	  if (!decode_sparse_map (st, rec->value))
+	    return EINVAL;
+	  st->is_sparse = true;
+	  break;
+
+	default:
+	  break;
+	}
+    }
+  return 0;
+}
@@ -0,0 +1,160 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Detection of zeros.
+
+   Telling whether a buffer is all zeros serves to find holes in sparse
+   files, the two zero blocks that end an archive, and padding.  The
+   kernel that tests a buffer is chosen at run time according to the
+   capabilities of the CPU, as for the header checksums.  */
+
+#include <system.h>
+#include <pthread.h>
+#include <paxbuf.h>
+#include <tar.h>
+#include <pax.h>
+#if HAVE_X86_SIMD
+# include <immintrin.h>
+#endif
+
+typedef bool (*zero_fp) (unsigned char const *p, idx_t n);
+
+static bool
+zero_generic (unsigned char const *p, idx_t n)
+{
+  uintptr_t acc = 0;
+  idx_t i = 0;
+
+  for (; n - i >= (idx_t) sizeof acc; i += sizeof acc)
+    {
+      uintptr_t w;
+      memcpy (&w, p + i, sizeof w);
+      acc |= w;
+    }
+  for (; i < n; i++)
+    acc |= p[i];
+  return acc == 0;
+}
+
+#if HAVE_X86_SIMD
+/* Both kernels OR four vectors at a time, and test the result once per
+   iteration, so that nonzero data are found early without a branch per
+   vector.  */
+__attribute__ ((target ("sse2")))
+static bool
+zero_sse2 (unsigned char const *p, idx_t n)
+{
+  __m128i const zero = _mm_setzero_si128 ();
+  idx_t i = 0;
+
+  for (; n - i >= 4 * (idx_t) sizeof (__m128i); i += 4 * sizeof (__m128i))
+    {
+      __m128i const *v = (__m128i const *) (p + i);
+      __m128i acc = _mm_or_si128 (_mm_or_si128 (_mm_loadu_si128 (v),
+						_mm_loadu_si128 (v + 1)),
+				  _mm_or_si128 (_mm_loadu_si128 (v + 2),
+						_mm_loadu_si128 (v + 3)));
+      if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (acc, zero)) != 0xffff)
+	return false;
+    }
+  return zero_generic (p + i, n - i);
+}
+
+__attribute__ ((target ("avx2")))
+static bool
+zero_avx2 (unsigned char const *p, idx_t n)
+{
+  idx_t i = 0;
+
+  for (; n - i >= 4 * (idx_t) sizeof (__m256i); i += 4 * sizeof (__m256i))
+    {
+      __m256i const *v = (__m256i const *) (p + i);
+      __m256i acc = _mm256_or_si256 (_mm256_or_si256
+				     (_mm256_loadu_si256 (v),
+				      _mm256_loadu_si256 (v + 1)),
+				     _mm256_or_si256
+				     (_mm256_loadu_si256 (v + 2),
+				      _mm256_loadu_si256 (v + 3)));
+      if (!_mm256_testz_si256 (acc, acc))
+	return false;
+    }
+  return zero_generic (p + i, n - i);
+}
+#endif
+
+static zero_fp zero_kernel = zero_generic;
+static pthread_once_t zero_once = PTHREAD_ONCE_INIT;
+
+static void
+zero_select (void)
+{
+#if HAVE_X86_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2"))
+    zero_kernel = zero_avx2;
+  else if (__builtin_cpu_supports ("sse2"))
+    zero_kernel = zero_sse2;
+#endif
+}
+
+/* Return true if the N bytes at BUF are all zeros */
+bool
+pax_zero_p (void const *buf, idx_t n)
+{
+  pthread_once (&zero_once, zero_select);
+  return zero_kernel (buf, n);
+}
+
+/* Tell which of the N blocks at BLK are all zeros, storing the result
+   for each in ZERO, if it is not null.  Return the number of zero
+   blocks.  */
+idx_t
+pax_zero_blocks (union block const *blk, idx_t n, bool *zero)
+{
+  idx_t count = 0;
+
+  pthread_once (&zero_once, zero_select);
+  for (idx_t i = 0; i < n; i++)
+    {
+      bool z = zero_kernel ((unsigned char const *) blk[i].buffer,
+			    BLOCKSIZE);
+      if (zero)
+	zero[i] = z;
+      count += z;
+    }
+  return count;
+}
+
+/* Return the index of the first of the N blocks at BLK that is not all
+   zeros, or N if there is none.  */
+idx_t
+pax_nonzero_block (union block const *blk, idx_t n)
+{
+  pthread_once (&zero_once, zero_select);
+  for (idx_t i = 0; i < n; i++)
+    if (!zero_kernel ((unsigned char const *) blk[i].buffer, BLOCKSIZE))
+      return i;
+  return n;
+}
+
+/* Return true if the N blocks at BLK start with the end-of-archive
+   marker, two blocks of zeros.  */
+bool
+pax_end_of_archive_p (union block const *blk, idx_t n)
+{
+  return n >= 2 && pax_zero_p (blk, 2 * BLOCKSIZE);
+}
@@ -0,0 +1,1042 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Block-parallel decompression on read.
+
+   A compressed stream made of independent frames (zstd frames, or gzip
+   members declaring their own length) is split into frames by the
+   reading thread, without decoding them.  The frames are decoded on a
+   pool of worker threads and delivered to the paxbuf in stream order.
+   Streams that cannot be split this way are decoded serially by the
+   reading thread.  */
+
+#include <system.h>
+#include <pthread.h>
+#include <paxbuf.h>
+#include <pool.h>
+#include <compress.h>
+#if HAVE_LIBZ
+# include <zlib.h>
+#endif
+#if HAVE_LIBZSTD
+# include <zstd.h>
+# include <zstd_errors.h>
+#endif
+
+/* Compressed input is read from the transport in chunks of this size */
+enum { ZREAD_CHUNK = 128 * 1024 };
+
+/* Frames longer than this are not buffered, but decoded serially */
+enum { ZREAD_MAX_FRAME = 64 * 1024 * 1024 };
+
+static unsigned char const gzip_magic[] = { 0x1f, 0x8b };
+static unsigned char const zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+static unsigned long
+get_le (unsigned char const *p, int n)
+{
+  unsigned long v = 0;
+  while (n--)
+    v = (v << 8) | p[n];
+  return v;
+}
+
+enum pax_compression
+pax_compression_detect (const char *data, idx_t size)
+{
+  unsigned char const *p = (unsigned char const *) data;
+
+  if (size >= 2
+      && memcmp (p, gzip_magic, sizeof gzip_magic) == 0)
+    return PAX_COMPRESS_GZIP;
+  if (size >= 4
+      && (memcmp (p, zstd_magic, sizeof zstd_magic) == 0
+	  || (get_le (p, 4) & 0xfffffff0) == 0x184d2a50))
+    return PAX_COMPRESS_ZSTD;
+  return PAX_COMPRESS_NONE;
+}
+
+static bool
+compression_supported (enum pax_compression type)
+{
+  switch (type)
+    {
+    case PAX_COMPRESS_NONE:
+    case PAX_COMPRESS_AUTO:
+      return true;
+#if HAVE_LIBZ
+    case PAX_COMPRESS_GZIP:
+      return true;
+#endif
+#if HAVE_LIBZSTD
+    case PAX_COMPRESS_ZSTD:
+      return true;
+#endif
+    default:
+      return false;
+    }
+}
+
+#if HAVE_LIBZ || HAVE_LIBZSTD
+
+struct zread;
+
+/* Start offsets of a frame in the compressed and decompressed data */
+struct zindex
+{
+  off_t coff;
+  off_t doff;
+};
+
+/* A compressed frame and its decoded contents */
+struct zframe
+{
+  struct zread *zr;           /* Owning filter */
+  char *in;                   /* Compressed data */
+  idx_t in_len;               /* Length of compressed data */
+  idx_t in_size;              /* Allocated size of in */
+  char *out;                  /* Decoded data */
+  idx_t out_len;              /* Length of decoded data */
+  idx_t out_size;             /* Allocated size of out */
+  bool done;                  /* Decoding finished */
+  bool failed;                /* Decoding failed */
+  void *ctx;                  /* Decoder state, reused by this slot */
+};
+
+struct zread
+{
+  enum pax_compression type;
+
+    /* Compressed data staged from the transport */
+  char *in;
+  idx_t in_size;              /* Allocated size of in */
+  idx_t in_start;             /* Start of unconsumed data */
+  idx_t in_end;               /* End of data */
+  bool in_eof;                /* Transport reported end of file */
+  off_t in_off;               /* Transport offset of in_end */
+
+    /* Frames being decoded, in stream order */
+  pax_pool_t pool;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;        /* Signalled when a frame is decoded */
+  struct zframe *ring;
+  idx_t depth;                /* Number of slots in ring */
+  idx_t head;                 /* Frame being delivered */
+  idx_t tail;                 /* Next frame to be scheduled */
+  idx_t out_pos;              /* Read position in the head frame */
+  idx_t nframes;              /* Number of frames seen so far */
+
+    /* Serial decoding */
+  bool serial;                /* The rest of the stream can't be split */
+  bool in_frame;              /* Serial decoder is inside a frame */
+  void *sctx;                 /* Serial decoder state */
+
+    /* Seeking */
+  off_t pos;                  /* Offset of the next decompressed byte */
+  off_t skip;                 /* Number of bytes to discard before reading */
+  char *scratch;              /* Buffer for discarded data */
+  bool index_tried;           /* Loading the index was attempted */
+  struct zindex *index;       /* Frame index; nindex + 1 entries */
+  idx_t nindex;               /* Number of indexed frames, 0 if none */
+  idx_t index_size;           /* Allocated size of index */
+};
+
+static void
+frame_reserve (struct zframe *fr, idx_t size)
+{
+  if (fr->out_size < size)
+    fr->out = xpalloc (fr->out, &fr->out_size, size - fr->out_size, -1, 1);
+}
+
+
+/* gzip */
+
+# if HAVE_LIBZ
+/* If the LEN bytes at P start a gzip member header declaring the
+   member length, return that length.  Return 0 if the header is
+   incomplete and -1 if there is no length in it.  */
+static idx_t
+gzip_member_length (unsigned char const *p, idx_t len)
+{
+  enum { FEXTRA = 4 };
+  if (len < 12)
+    return 0;
+  if (p[2] != 8 || !(p[3] & FEXTRA))
+    return -1;
+  idx_t xlen = get_le (p + 10, 2);
+  if (len < 12 + xlen)
+    return 0;
+  for (unsigned char const *q = p + 12; q + 4 <= p + 12 + xlen; )
+    {
+      idx_t slen = get_le (q + 2, 2);
+      if (q[0] == GZIP_SI_BGZF1 && q[1] == GZIP_SI_BGZF2 && slen == 2)
+	return get_le (q + 4, 2) + 1;
+      if (q[0] == GZIP_SI_PAX1 && q[1] == GZIP_SI_PAX2 && slen == 4)
+	return get_le (q + 4, 4);
+      q += 4 + slen;
+    }
+  return -1;
+}
+
+static z_stream *
+gzip_context (void **pctx)
+{
+  z_stream *zs = *pctx;
+  if (!zs)
+    {
+      zs = xzalloc (sizeof *zs);
+      if (inflateInit2 (zs, 16 + MAX_WBITS) != Z_OK)
+	xalloc_die ();
+      *pctx = zs;
+    }
+  else
+    inflateReset (zs);
+  return zs;
+}
+
+static void
+gzip_context_free (void *ctx)
+{
+  if (ctx)
+    {
+      inflateEnd (ctx);
+      free (ctx);
+    }
+}
+
+static bool
+gzip_decode (struct zframe *fr)
+{
+  z_stream *zs = gzip_context (&fr->ctx);
+
+  /* The trailer keeps the uncompressed length, modulo 2**32.  It comes
+     from the stream, so a length beyond what a frame may expand to is
+     not trusted: the output then grows as it is decoded.  */
+  if (fr->in_len >= 4)
+    {
+      idx_t isize = get_le ((unsigned char *) fr->in + fr->in_len - 4, 4);
+      if (isize <= ZREAD_MAX_FRAME * 16)
+	frame_reserve (fr, isize + 1);
+    }
+  zs->next_in = (Bytef *) fr->in;
+  zs->avail_in = fr->in_len;
+  for (;;)
+    {
+      if (fr->out_len == fr->out_size)
+	frame_reserve (fr, fr->out_size + 1);
+      zs->next_out = (Bytef *) fr->out + fr->out_len;
+      zs->avail_out = fr->out_size - fr->out_len;
+      int rc = inflate (zs, Z_NO_FLUSH);
+      fr->out_len = (char *) zs->next_out - fr->out;
+      if (rc == Z_STREAM_END)
+	{
+	  if (zs->avail_in == 0)
+	    return true;
+	  inflateReset (zs);
+	}
+      else if (rc != Z_OK && !(rc == Z_BUF_ERROR && zs->avail_out == 0))
+	return false;
+    }
+}
+
+static pax_io_status_t
+gzip_serial (struct zread *zr, void *data, idx_t size, idx_t *ret_size)
+{
+  z_stream *zs = zr->sctx;
+
+  if (!zs)
+    zs = gzip_context (&zr->sctx);
+  zs->next_in = (Bytef *) zr->in + zr->in_start;
+  zs->avail_in = zr->in_end - zr->in_start;
+  zs->next_out = data;
+  zs->avail_out = size;
+  int rc = inflate (zs, Z_NO_FLUSH);
+  zr->in_start = (char *) zs->next_in - zr->in;
+  *ret_size = size - zs->avail_out;
+  zr->in_frame = true;
+  if (rc == Z_STREAM_END)
+    {
+      inflateReset (zs);
+      zr->in_frame = false;
+      zr->nframes++;
+    }
+  else if (rc == Z_BUF_ERROR && *ret_size == 0 && zs->avail_in == 0)
+    return pax_io_success;    /* Needs more input */
+  else if (rc != Z_OK)
+    return pax_io_failure;
+  return pax_io_success;
+}
+# endif
+
+
+/* zstd */
+
+# if HAVE_LIBZSTD
+static bool
+zstd_skippable_p (char const *p, idx_t len)
+{
+  return len >= 4
+    && (get_le ((unsigned char const *) p, 4) & ZSTD_MAGIC_SKIPPABLE_MASK)
+       == ZSTD_MAGIC_SKIPPABLE_START;
+}
+
+static ZSTD_DCtx *
+zstd_context (void **pctx)
+{
+  ZSTD_DCtx *dctx = *pctx;
+  if (!dctx)
+    {
+      dctx = ZSTD_createDCtx ();
+      if (!dctx)
+	xalloc_die ();
+      *pctx = dctx;
+    }
+  else
+    ZSTD_DCtx_reset (dctx, ZSTD_reset_session_only);
+  return dctx;
+}
+
+static void
+zstd_context_free (void *ctx)
+{
+  ZSTD_freeDCtx (ctx);
+}
+
+static bool
+zstd_decode (struct zframe *fr)
+{
+  ZSTD_DCtx *dctx = zstd_context (&fr->ctx);
+  unsigned long long csize;
+
+  if (zstd_skippable_p (fr->in, fr->in_len))
+    return true;
+
+  csize = ZSTD_getFrameContentSize (fr->in, fr->in_len);
+  if (csize != ZSTD_CONTENTSIZE_UNKNOWN && csize != ZSTD_CONTENTSIZE_ERROR
+      && csize <= ZREAD_MAX_FRAME * 16ULL)
+    {
+      frame_reserve (fr, csize);
+      size_t n = ZSTD_decompressDCtx (dctx, fr->out, csize,
+				      fr->in, fr->in_len);
+      fr->out_len = ZSTD_isError (n) ? 0 : n;
+      return !ZSTD_isError (n) && n == csize;
+    }
+
+  /* Unknown content size: decode in streaming mode */
+  ZSTD_inBuffer in = { fr->in, fr->in_len, 0 };
+  for (;;)
+    {
+      if (fr->out_len == fr->out_size)
+	frame_reserve (fr, fr->out_size + ZSTD_DStreamOutSize ());
+      ZSTD_outBuffer out = { fr->out, fr->out_size, fr->out_len };
+      size_t rc = ZSTD_decompressStream (dctx, &out, &in);
+      fr->out_len = out.pos;
+      if (ZSTD_isError (rc))
+	return false;
+      if (rc == 0)
+	return in.pos == in.size;
+      if (in.pos == in.size && out.pos < out.size)
+	return false;
+    }
+}
+
+static pax_io_status_t
+zstd_serial (struct zread *zr, void *data, idx_t size, idx_t *ret_size)
+{
+  ZSTD_DCtx *dctx = zr->sctx;
+
+  if (!dctx)
+    dctx = zstd_context (&zr->sctx);
+  ZSTD_inBuffer in = { zr->in + zr->in_start, zr->in_end - zr->in_start, 0 };
+  ZSTD_outBuffer out = { data, size, 0 };
+  size_t rc = ZSTD_decompressStream (dctx, &out, &in);
+  zr->in_start += in.pos;
+  *ret_size = out.pos;
+  if (ZSTD_isError (rc))
+    return pax_io_failure;
+  zr->in_frame = rc != 0;
+  if (rc == 0)
+    zr->nframes++;
+  return pax_io_success;
+}
+# endif
+
+
+/* Input staging */
+
+/* Read more compressed data from the transport.  */
+static pax_io_status_t
+zread_more (paxbuf_t buf, struct zread *zr)
+{
+  idx_t n;
+  pax_io_status_t status;
+
+  if (zr->in_start > 0)
+    {
+      memmove (zr->in, zr->in + zr->in_start, zr->in_end - zr->in_start);
+      zr->in_end -= zr->in_start;
+      zr->in_start = 0;
+    }
+  if (zr->in_size - zr->in_end < ZREAD_CHUNK)
+    zr->in = xpalloc (zr->in, &zr->in_size,
+		      ZREAD_CHUNK - (zr->in_size - zr->in_end), -1, 1);
+  status = paxbuf_transport_read (buf, zr->in + zr->in_end,
+				  zr->in_size - zr->in_end, &n);
+  zr->in_end += n;
+  zr->in_off += n;
+  if (status == pax_io_eof)
+    zr->in_eof = true;
+  return status == pax_io_failure ? pax_io_failure : pax_io_success;
+}
+
+/* Return the length of the frame at the start of staged input, reading
+   more data as needed.  Return 0 at end of input and -1 if the frame
+   cannot be delimited without decoding it.  */
+static idx_t
+zread_frame_length (paxbuf_t buf, struct zread *zr, pax_io_status_t *status)
+{
+  *status = pax_io_success;
+  for (;;)
+    {
+      char *p = zr->in + zr->in_start;
+      idx_t avail = zr->in_end - zr->in_start;
+      idx_t len = 0;
+
+      if (avail == 0 && zr->in_eof)
+	return 0;
+      if (avail >= 4
+	  && pax_compression_detect (p, avail) != zr->type)
+	return -1;
+
+      switch (zr->type)
+	{
+# if HAVE_LIBZ
+	case PAX_COMPRESS_GZIP:
+	  len = gzip_member_length ((unsigned char *) p, avail);
+	  if (len > avail)
+	    len = 0;
+	  break;
+# endif
+# if HAVE_LIBZSTD
+	case PAX_COMPRESS_ZSTD:
+	  if (avail >= 4)
+	    {
+	      size_t n = ZSTD_findFrameCompressedSize (p, avail);
+	      if (!ZSTD_isError (n))
+		len = n;
+	      else if (ZSTD_getErrorCode (n) != ZSTD_error_srcSize_wrong)
+		return -1;
+	    }
+	  break;
+# endif
+	default:
+	  abort ();
+	}
+
+      if (len != 0)
+	return len;
+      if (zr->in_eof || avail >= ZREAD_MAX_FRAME)
+	return -1;
+      *status = zread_more (buf, zr);
+      if (*status != pax_io_success)
+	return 0;
+    }
+}
+
+
+/* Parallel decoding */
+
+static void
+zread_decode_job (void *arg)
+{
+  struct zframe *fr = arg;
+  struct zread *zr = fr->zr;
+  bool ok = false;
+
+  fr->out_len = 0;
+  switch (zr->type)
+    {
+# if HAVE_LIBZ
+    case PAX_COMPRESS_GZIP:
+      ok = gzip_decode (fr);
+      break;
+# endif
+# if HAVE_LIBZSTD
+    case PAX_COMPRESS_ZSTD:
+      ok = zstd_decode (fr);
+      break;
+# endif
+    default:
+      break;
+    }
+
+  pthread_mutex_lock (&zr->mutex);
+  fr->failed = !ok;
+  fr->done = true;
+  pthread_cond_broadcast (&zr->cond);
+  pthread_mutex_unlock (&zr->mutex);
+}
+
+/* Split off as many frames as there are free slots in the ring and
+   queue them for decoding.  */
+static pax_io_status_t
+zread_schedule (paxbuf_t buf, struct zread *zr)
+{
+  while (!zr->serial && zr->tail - zr->head < zr->depth)
+    {
+      pax_io_status_t status;
+      idx_t len = zread_frame_length (buf, zr, &status);
+
+      if (status != pax_io_success)
+	return status;
+      if (len == 0)
+	break;
+      if (len < 0)
+	{
+	  zr->serial = true;
+	  break;
+	}
+
+      struct zframe *fr = &zr->ring[zr->tail % zr->depth];
+      if (fr->in_size < len)
+	fr->in = xpalloc (fr->in, &fr->in_size, len - fr->in_size, -1, 1);
+      memcpy (fr->in, zr->in + zr->in_start, len);
+      fr->in_len = len;
+      fr->done = fr->failed = false;
+      zr->in_start += len;
+      zr->tail++;
+      zr->nframes++;
+      pax_pool_submit (zr->pool, zread_decode_job, fr);
+    }
+  return pax_io_success;
+}
+
+static pax_io_status_t
+zread_serial (paxbuf_t buf, struct zread *zr,
+	      void *data, idx_t size, idx_t *ret_size)
+{
+  for (;;)
+    {
+      pax_io_status_t status;
+
+      if (zr->in_start == zr->in_end)
+	{
+	  if (zr->in_eof)
+	    return zr->in_frame ? pax_io_failure : pax_io_eof;
+	  status = zread_more (buf, zr);
+	  if (status != pax_io_success)
+	    return status;
+	  continue;
+	}
+
+      /* Garbage after the last complete frame is ignored, as gzip does.
+	 This takes care of the padding added by tape blocking.  */
+      if (!zr->in_frame && zr->nframes > 0
+	  && zr->in_end - zr->in_start < 4 && !zr->in_eof)
+	{
+	  status = zread_more (buf, zr);
+	  if (status != pax_io_success)
+	    return status;
+	  continue;
+	}
+      if (!zr->in_frame && zr->nframes > 0
+	  && pax_compression_detect (zr->in + zr->in_start,
+				     zr->in_end - zr->in_start) != zr->type)
+	{
+	  zr->in_start = zr->in_end;
+	  if (!zr->in_eof)
+	    continue;
+	  return pax_io_eof;
+	}
+
+      switch (zr->type)
+	{
+# if HAVE_LIBZ
+	case PAX_COMPRESS_GZIP:
+	  status = gzip_serial (zr, data, size, ret_size);
+	  break;
+# endif
+# if HAVE_LIBZSTD
+	case PAX_COMPRESS_ZSTD:
+	  status = zstd_serial (zr, data, size, ret_size);
+	  break;
+# endif
+	default:
+	  abort ();
+	}
+      if (status != pax_io_success || *ret_size > 0)
+	return status;
+      if (zr->in_start == zr->in_end && zr->in_eof)
+	return zr->in_frame ? pax_io_failure : pax_io_eof;
+      if (zr->in_start == zr->in_end || zr->in_frame)
+	{
+	  status = zread_more (buf, zr);
+	  if (status != pax_io_success)
+	    return status;
+	}
+    }
+}
+
+
+/* Seek index */
+
+/* Read LEN bytes at OFFSET in the compressed stream */
+static bool
+zread_pread (paxbuf_t buf, off_t offset, void *data, idx_t len)
+{
+  char *p = data;
+
+  if (paxbuf_transport_seek (buf, offset))
+    return false;
+  while (len > 0)
+    {
+      idx_t n;
+      if (paxbuf_transport_read (buf, p, len, &n) == pax_io_failure
+	  || n == 0)
+	return false;
+      p += n;
+      len -= n;
+    }
+  return true;
+}
+
+static void
+zread_index_add (struct zread *zr, off_t clen, off_t dlen)
+{
+  if (zr->nindex + 1 >= zr->index_size)
+    zr->index = xpalloc (zr->index, &zr->index_size,
+			 zr->nindex + 2 - zr->index_size, -1,
+			 sizeof zr->index[0]);
+  if (zr->nindex == 0)
+    zr->index[0].coff = zr->index[0].doff = 0;
+  zr->nindex++;
+  zr->index[zr->nindex].coff = zr->index[zr->nindex - 1].coff + clen;
+  zr->index[zr->nindex].doff = zr->index[zr->nindex - 1].doff + dlen;
+}
+
+# if HAVE_LIBZSTD
+/* Load the seek table stored at the end of a seekable zstd stream of
+   SIZE bytes.  */
+static bool
+zstd_load_index (paxbuf_t buf, struct zread *zr, off_t size)
+{
+  unsigned char footer[ZSTD_SEEK_TABLE_FOOTER];
+  unsigned char head[8];
+
+  if (size < ZSTD_SEEK_TABLE_FOOTER + 8
+      || !zread_pread (buf, size - sizeof footer, footer, sizeof footer)
+      || get_le (footer + 5, 4) != ZSTD_SEEKABLE_MAGIC)
+    return false;
+
+  idx_t nframes = get_le (footer, 4);
+  idx_t esize = ZSTD_SEEK_TABLE_ENTRY + (footer[4] & 0x80 ? 4 : 0);
+  idx_t tsize;
+  if (ckd_mul (&tsize, nframes, esize)
+      || size < tsize + ZSTD_SEEK_TABLE_FOOTER + 8)
+    return false;
+  off_t start = size - sizeof footer - tsize - 8;
+  if (!zread_pread (buf, start, head, sizeof head)
+      || get_le (head, 4) != ZSTD_SEEK_TABLE_MAGIC
+      || (get_le (head + 4, 4)
+	  != (unsigned long) tsize + ZSTD_SEEK_TABLE_FOOTER))
+    return false;
+
+  unsigned char *table = ximalloc (tsize + 1);
+  bool ok = zread_pread (buf, start + 8, table, tsize);
+  for (idx_t i = 0; ok && i < nframes; i++)
+    zread_index_add (zr, get_le (table + i * esize, 4),
+		     get_le (table + i * esize + 4, 4));
+  free (table);
+  return ok;
+}
+# endif
+
+# if HAVE_LIBZ
+/* Build the index of a gzip stream of SIZE bytes by walking the member
+   headers.  Each member must declare its length; its uncompressed
+   length is taken from the trailer.  */
+static bool
+gzip_load_index (paxbuf_t buf, struct zread *zr, off_t size)
+{
+  off_t off = 0;
+  unsigned char head[512];
+  idx_t hsize = sizeof head;
+
+  while (off < size)
+    {
+      idx_t n = size - off < hsize ? size - off : hsize;
+      if (!zread_pread (buf, off, head, n))
+	return false;
+      if (pax_compression_detect ((char *) head, n) != PAX_COMPRESS_GZIP)
+	/* Trailing garbage */
+	return zr->nindex > 0;
+      idx_t len = gzip_member_length (head, n);
+      if (len <= 0 || size - off < len)
+	return false;
+      if (!zread_pread (buf, off + len - 4, head, 4))
+	return false;
+      zread_index_add (zr, len, get_le (head, 4));
+      off += len;
+    }
+  return true;
+}
+# endif
+
+static bool
+zread_load_index (paxbuf_t buf, struct zread *zr)
+{
+  off_t size = paxbuf_transport_size (buf);
+  bool ok = false;
+
+  if (size < 0)
+    return false;
+  switch (zr->type)
+    {
+# if HAVE_LIBZ
+    case PAX_COMPRESS_GZIP:
+      ok = gzip_load_index (buf, zr, size);
+      break;
+# endif
+# if HAVE_LIBZSTD
+    case PAX_COMPRESS_ZSTD:
+      ok = zstd_load_index (buf, zr, size);
+      break;
+# endif
+    default:
+      break;
+    }
+  if (!ok)
+    zr->nindex = 0;
+  return ok;
+}
+
+
+/* Filter interface */
+
+static pax_io_status_t
+zread_fetch (paxbuf_t buf, struct zread *zr, void *data, idx_t size,
+	     idx_t *ret_size)
+{
+  pax_io_status_t status;
+
+  *ret_size = 0;
+  for (;;)
+    {
+      if (zr->head < zr->tail)
+	{
+	  struct zframe *fr = &zr->ring[zr->head % zr->depth];
+
+	  pthread_mutex_lock (&zr->mutex);
+	  while (!fr->done)
+	    pthread_cond_wait (&zr->cond, &zr->mutex);
+	  pthread_mutex_unlock (&zr->mutex);
+
+	  if (fr->failed)
+	    return pax_io_failure;
+	  if (zr->out_pos < fr->out_len)
+	    {
+	      idx_t n = fr->out_len - zr->out_pos;
+	      if (n > size)
+		n = size;
+	      memcpy (data, fr->out + zr->out_pos, n);
+	      zr->out_pos += n;
+	      *ret_size = n;
+	      return pax_io_success;
+	    }
+	  zr->head++;
+	  zr->out_pos = 0;
+	  /* Keep the workers busy while the caller consumes data */
+	  status = zread_schedule (buf, zr);
+	  if (status != pax_io_success)
+	    return status;
+	  continue;
+	}
+
+      if (zr->serial)
+	return zread_serial (buf, zr, data, size, ret_size);
+
+      status = zread_schedule (buf, zr);
+      if (status != pax_io_success)
+	return status;
+      if (zr->head == zr->tail && !zr->serial)
+	{
+	  /* Let the caller switch volumes and read on, if it wants to */
+	  zr->in_eof = false;
+	  return pax_io_eof;
+	}
+    }
+}
+
+static bool
+zread_detect (paxbuf_t buf, struct zread *zr)
+{
+  if (zr->type == PAX_COMPRESS_AUTO)
+    {
+      while (zr->in_end < 4 && !zr->in_eof)
+	if (zread_more (buf, zr) != pax_io_success)
+	  return false;
+      zr->type = pax_compression_detect (zr->in, zr->in_end);
+      if (!compression_supported (zr->type))
+	{
+	  errno = ENOSYS;
+	  return false;
+	}
+    }
+  return true;
+}
+
+static pax_io_status_t
+zread_reader (paxbuf_t buf, void *fclosure, void *data, idx_t size,
+	      idx_t *ret_size)
+{
+  struct zread *zr = fclosure;
+  pax_io_status_t status;
+
+  *ret_size = 0;
+  if (!zread_detect (buf, zr))
+    return pax_io_failure;
+
+  if (zr->type == PAX_COMPRESS_NONE)
+    {
+      /* Not compressed: pass data through */
+      if (zr->in_start < zr->in_end)
+	{
+	  idx_t n = zr->in_end - zr->in_start;
+	  if (n > size)
+	    n = size;
+	  memcpy (data, zr->in + zr->in_start, n);
+	  zr->in_start += n;
+	  *ret_size = n;
+	  return pax_io_success;
+	}
+      return paxbuf_transport_read (buf, data, size, ret_size);
+    }
+
+  /* Discard data up to the position requested by the last seek */
+  while (zr->skip > 0)
+    {
+      idx_t n;
+
+      if (!zr->scratch)
+	zr->scratch = ximalloc (ZREAD_CHUNK);
+      status = zread_fetch (buf, zr, zr->scratch,
+			    zr->skip < ZREAD_CHUNK ? zr->skip : ZREAD_CHUNK,
+			    &n);
+      zr->skip -= n;
+      zr->pos += n;
+      if (status != pax_io_success)
+	return status;
+    }
+
+  status = zread_fetch (buf, zr, data, size, ret_size);
+  zr->pos += *ret_size;
+  return status;
+}
+
+/* Forget all buffered and in-flight data, and prepare to read
+   compressed data from OFFSET on.  */
+static void
+zread_reset (struct zread *zr, off_t offset)
+{
+  pax_pool_wait (zr->pool);
+  zr->in_off = offset;
+  zr->head = zr->tail = 0;
+  zr->out_pos = 0;
+  zr->in_start = zr->in_end = 0;
+  zr->in_eof = false;
+  zr->serial = false;
+  zr->in_frame = false;
+  switch (zr->type)
+    {
+# if HAVE_LIBZ
+    case PAX_COMPRESS_GZIP:
+      if (zr->sctx)
+	gzip_context (&zr->sctx);
+      break;
+# endif
+# if HAVE_LIBZSTD
+    case PAX_COMPRESS_ZSTD:
+      if (zr->sctx)
+	zstd_context (&zr->sctx);
+      break;
+# endif
+    default:
+      break;
+    }
+}
+
+/* Seek the transport to OFFSET.  Return 0 on success, -1 with errno
+   set on failure.  */
+static int
+zread_transport_seek (paxbuf_t buf, off_t offset)
+{
+  return paxbuf_transport_seek (buf, offset) == 0 ? 0 : -1;
+}
+
+/* Position the stream so that the next read returns decompressed data
+   starting at OFFSET.  If the stream is seekable, i.e. it carries an
+   index of its frames, this decodes at most one frame.  Otherwise,
+   the data are decoded from the current position, or from the start
+   of the stream if OFFSET lies behind it.  Return 0 on success, -1 with
+   errno set on failure.  */
+static int
+zread_seek (paxbuf_t buf, void *fclosure, off_t offset)
+{
+  struct zread *zr = fclosure;
+
+  if (offset < 0)
+    {
+      errno = EINVAL;
+      return -1;
+    }
+  if (!zread_detect (buf, zr))
+    return -1;
+  if (zr->type == PAX_COMPRESS_NONE)
+    {
+      zr->in_start = zr->in_end = 0;
+      zr->in_eof = false;
+      return zread_transport_seek (buf, offset);
+    }
+
+  if (!zr->index_tried)
+    {
+      zr->index_tried = true;
+      if (!zread_load_index (buf, zr))
+	{
+	  /* Go on reading where we were */
+	  if (zread_transport_seek (buf, zr->in_off))
+	    return -1;
+	}
+    }
+
+  if (zr->nindex > 0)
+    {
+      /* Find the frame containing OFFSET */
+      idx_t lo = 0, hi = zr->nindex;
+      while (hi - lo > 1)
+	{
+	  idx_t mid = lo + (hi - lo) / 2;
+	  if (zr->index[mid].doff <= offset)
+	    lo = mid;
+	  else
+	    hi = mid;
+	}
+      zread_reset (zr, zr->index[lo].coff);
+      zr->nframes = lo;
+      zr->pos = zr->index[lo].doff;
+      zr->skip = offset - zr->pos;
+      return zread_transport_seek (buf, zr->in_off);
+    }
+
+  if (offset >= zr->pos)
+    {
+      zr->skip = offset - zr->pos;
+      return 0;
+    }
+
+  zread_reset (zr, 0);
+  zr->nframes = 0;
+  zr->pos = 0;
+  zr->skip = offset;
+  return zread_transport_seek (buf, 0);
+}
+
+static int
+zread_destroy (void *fclosure)
+{
+  struct zread *zr = fclosure;
+  void (*ctx_free) (void *) = nullptr;
+
+  pax_pool_destroy (&zr->pool);
+  switch (zr->type)
+    {
+# if HAVE_LIBZ
+    case PAX_COMPRESS_GZIP:
+      ctx_free = gzip_context_free;
+      break;
+# endif
+# if HAVE_LIBZSTD
+    case PAX_COMPRESS_ZSTD:
+      ctx_free = zstd_context_free;
+      break;
+# endif
+    default:
+      break;
+    }
+  for (idx_t i = 0; i < zr->depth; i++)
+    {
+      if (ctx_free)
+	ctx_free (zr->ring[i].ctx);
+      free (zr->ring[i].in);
+      free (zr->ring[i].out);
+    }
+  if (ctx_free)
+    ctx_free (zr->sctx);
+  pthread_cond_destroy (&zr->cond);
+  pthread_mutex_destroy (&zr->mutex);
+  free (zr->ring);
+  free (zr->in);
+  free (zr->scratch);
+  free (zr->index);
+  free (zr);
+  return 0;
+}
+#endif /* HAVE_LIBZ || HAVE_LIBZSTD */
+
+/* Install on BUF a filter decompressing data of the given TYPE, using
+   NTHREADS worker threads (all available processors if NTHREADS is not
+   positive).  If TYPE is PAX_COMPRESS_AUTO, the compression is detected
+   from the data; uncompressed data are then passed through unchanged.
+   Return 0 on success, an errno value otherwise.  */
+int
+paxbuf_set_decompress (paxbuf_t buf, enum pax_compression type, int nthreads)
+{
+  if (type == PAX_COMPRESS_NONE)
+    return 0;
+  if (!compression_supported (type))
+    return ENOSYS;
+
+#if HAVE_LIBZ || HAVE_LIBZSTD
+  struct zread *zr = calloc (1, sizeof *zr);
+  if (!zr)
+    return ENOMEM;
+  int rc = pax_pool_create (&zr->pool, nthreads);
+  if (rc)
+    {
+      free (zr);
+      return rc;
+    }
+  zr->type = type;
+  zr->depth = 2 * pax_pool_size (zr->pool);
+  zr->ring = calloc (zr->depth, sizeof zr->ring[0]);
+  if (!zr->ring)
+    {
+      pax_pool_destroy (&zr->pool);
+      free (zr);
+      return ENOMEM;
+    }
+  for (idx_t i = 0; i < zr->depth; i++)
+    zr->ring[i].zr = zr;
+  pthread_mutex_init (&zr->mutex, nullptr);
+  pthread_cond_init (&zr->cond, nullptr);
+  paxbuf_set_filter (buf, zr, zread_reader, nullptr, zread_destroy);
+  paxbuf_set_filter_seek (buf, zread_seek);
+  return 0;
+#else
+  return ENOSYS;
+#endif
+}
@@ -0,0 +1,478 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Seekable compression on write.
+
+   The archive is compressed in independent frames, each holding a
+   fixed amount of uncompressed data.  Frames always end on a record
+   boundary.  A zstd stream is terminated by a seek table listing the
+   sizes of all frames.  A gzip stream is a sequence of members, each
+   declaring its own length in a 'PX' extra subfield: the reader finds
+   the member boundaries by walking the headers, and the uncompressed
+   sizes in the member trailers.  Either stream is readable by the
+   stock decompressors.
+
+   Since the frames are independent, the writing thread only fills
+   them: they are compressed on a pool of worker threads, and written
+   out in stream order as they are done.  */
+
+#include <system.h>
+#include <pthread.h>
+#include <paxbuf.h>
+#include <pool.h>
+#include <compress.h>
+#if HAVE_LIBZ
+# include <zlib.h>
+#endif
+#if HAVE_LIBZSTD
+# include <zstd.h>
+#endif
+
+#if HAVE_LIBZ || HAVE_LIBZSTD
+
+struct zwrite;
+
+/* A frame and its compressed contents */
+struct zwframe
+{
+  struct zwrite *zw;          /* Owning filter */
+  char *in;                   /* Uncompressed data */
+  idx_t in_len;               /* Length of data in in */
+  unsigned char *out;         /* Compressed data */
+  idx_t out_len;              /* Their length, or -1 on failure */
+  idx_t out_size;             /* Allocated size of out */
+  bool done;                  /* Compression finished */
+  void *ctx;                  /* Compressor state, reused by this slot */
+};
+
+struct zwrite
+{
+  enum pax_compression type;
+  int level;                  /* Compression level */
+  idx_t frame_size;           /* Uncompressed size of a full frame */
+
+    /* Frames being compressed, in stream order */
+  pax_pool_t pool;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;        /* Signalled when a frame is compressed */
+  struct zwframe *ring;
+  idx_t depth;                /* Number of slots in ring */
+  idx_t head;                 /* Next frame to be written out */
+  idx_t tail;                 /* Frame being filled */
+
+  unsigned char *table;       /* Seek table entries */
+  idx_t table_len;            /* Length of data in table */
+  idx_t table_size;           /* Allocated size of table */
+};
+
+static void
+put_le (unsigned char *p, unsigned long v, int n)
+{
+  while (n--)
+    {
+      *p++ = v & 0xff;
+      v >>= 8;
+    }
+}
+
+static void
+out_reserve (struct zwframe *fr, idx_t size)
+{
+  if (fr->out_size < size)
+    {
+      free (fr->out);
+      fr->out = ximalloc (size);
+      fr->out_size = size;
+    }
+}
+
+
+/* gzip */
+
+# if HAVE_LIBZ
+/* Member header: magic, CM = deflate, FLG = FEXTRA, MTIME = 0, XFL = 0,
+   OS = unknown, XLEN = 8 and the 'PX' subfield, whose value is filled
+   in when the member length is known.  */
+static unsigned char const gzip_header[] = {
+  0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 255,
+  8, 0, GZIP_SI_PAX1, GZIP_SI_PAX2, 4, 0, 0, 0, 0, 0
+};
+enum { GZIP_TRAILER = 8 };
+
+static idx_t
+gzip_compress (struct zwframe *fr, int level)
+{
+  z_stream *zs = fr->ctx;
+  idx_t hlen = sizeof gzip_header;
+
+  if (!zs)
+    {
+      zs = xzalloc (sizeof *zs);
+      if (deflateInit2 (zs, level > 0 ? level : Z_DEFAULT_COMPRESSION,
+			Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	xalloc_die ();
+      fr->ctx = zs;
+    }
+  else
+    deflateReset (zs);
+
+  out_reserve (fr, hlen + deflateBound (zs, fr->in_len) + GZIP_TRAILER);
+  memcpy (fr->out, gzip_header, hlen);
+  zs->next_in = (Bytef *) fr->in;
+  zs->avail_in = fr->in_len;
+  zs->next_out = fr->out + hlen;
+  zs->avail_out = fr->out_size - hlen - GZIP_TRAILER;
+  if (deflate (zs, Z_FINISH) != Z_STREAM_END)
+    return -1;
+
+  idx_t len = (zs->next_out - fr->out) + GZIP_TRAILER;
+  put_le (fr->out + len - GZIP_TRAILER,
+	  crc32 (crc32 (0, Z_NULL, 0), (Bytef *) fr->in, fr->in_len), 4);
+  put_le (fr->out + len - 4, fr->in_len, 4);
+  put_le (fr->out + hlen - 4, len, 4);
+  return len;
+}
+
+static void
+gzip_free (void *ctx)
+{
+  if (ctx)
+    {
+      deflateEnd (ctx);
+      free (ctx);
+    }
+}
+# endif
+
+
+/* zstd */
+
+# if HAVE_LIBZSTD
+static idx_t
+zstd_compress (struct zwframe *fr, int level)
+{
+  ZSTD_CCtx *cctx = fr->ctx;
+
+  if (!cctx)
+    {
+      cctx = ZSTD_createCCtx ();
+      if (!cctx)
+	xalloc_die ();
+      if (level > 0)
+	ZSTD_CCtx_setParameter (cctx, ZSTD_c_compressionLevel, level);
+      ZSTD_CCtx_setParameter (cctx, ZSTD_c_contentSizeFlag, 1);
+      ZSTD_CCtx_setParameter (cctx, ZSTD_c_checksumFlag, 1);
+      fr->ctx = cctx;
+    }
+
+  out_reserve (fr, ZSTD_compressBound (fr->in_len));
+  size_t n = ZSTD_compress2 (cctx, fr->out, fr->out_size,
+			     fr->in, fr->in_len);
+  if (ZSTD_isError (n))
+    return -1;
+  return n;
+}
+
+static void
+zstd_free (void *ctx)
+{
+  ZSTD_freeCCtx (ctx);
+}
+# endif
+
+
+/* Filter interface */
+
+static pax_io_status_t
+zwrite_out (paxbuf_t buf, void const *data, idx_t size)
+{
+  char const *p = data;
+
+  while (size > 0)
+    {
+      idx_t n;
+      if (paxbuf_transport_write (buf, (void *) p, size, &n) != pax_io_success)
+	return pax_io_failure;
+      if (n == 0)
+	return pax_io_failure;
+      p += n;
+      size -= n;
+    }
+  return pax_io_success;
+}
+
+/* Compress the frame ARG; run by a worker */
+static void
+zwrite_compress_job (void *arg)
+{
+  struct zwframe *fr = arg;
+  struct zwrite *zw = fr->zw;
+  idx_t len;
+
+  switch (zw->type)
+    {
+# if HAVE_LIBZ
+    case PAX_COMPRESS_GZIP:
+      len = gzip_compress (fr, zw->level);
+      break;
+# endif
+# if HAVE_LIBZSTD
+    case PAX_COMPRESS_ZSTD:
+      len = zstd_compress (fr, zw->level);
+      break;
+# endif
+    default:
+      abort ();
+    }
+
+  pthread_mutex_lock (&zw->mutex);
+  fr->out_len = len;
+  fr->done = true;
+  pthread_cond_broadcast (&zw->cond);
+  pthread_mutex_unlock (&zw->mutex);
+}
+
+/* Queue the frame being filled for compression, unless it is empty */
+static void
+zwrite_submit (struct zwrite *zw)
+{
+  struct zwframe *fr = &zw->ring[zw->tail % zw->depth];
+
+  if (fr->in_len == 0)
+    return;
+  fr->done = false;
+  zw->tail++;
+  pax_pool_submit (zw->pool, zwrite_compress_job, fr);
+}
+
+/* Write out the compressed frames in stream order, waiting for them
+   until no more than MAX are in progress.  Frames found done after that
+   are written out as well.  */
+static pax_io_status_t
+zwrite_drain (paxbuf_t buf, struct zwrite *zw, idx_t max)
+{
+  while (zw->head < zw->tail)
+    {
+      struct zwframe *fr = &zw->ring[zw->head % zw->depth];
+      bool wait = zw->tail - zw->head > max;
+
+      pthread_mutex_lock (&zw->mutex);
+      if (!fr->done && !wait)
+	{
+	  pthread_mutex_unlock (&zw->mutex);
+	  break;
+	}
+      while (!fr->done)
+	pthread_cond_wait (&zw->cond, &zw->mutex);
+      pthread_mutex_unlock (&zw->mutex);
+
+      if (fr->out_len < 0
+	  || zwrite_out (buf, fr->out, fr->out_len) != pax_io_success)
+	return pax_io_failure;
+      if (zw->table_size - zw->table_len < ZSTD_SEEK_TABLE_ENTRY)
+	zw->table = xpalloc (zw->table, &zw->table_size,
+			     ZSTD_SEEK_TABLE_ENTRY, -1, 1);
+      put_le (zw->table + zw->table_len, fr->out_len, 4);
+      put_le (zw->table + zw->table_len + 4, fr->in_len, 4);
+      zw->table_len += ZSTD_SEEK_TABLE_ENTRY;
+      fr->in_len = 0;
+      zw->head++;
+    }
+  return pax_io_success;
+}
+
+static pax_io_status_t
+zwrite_writer (paxbuf_t buf, void *fclosure, void *data, idx_t size,
+	       idx_t *ret_size)
+{
+  struct zwrite *zw = fclosure;
+  char const *p = data;
+
+  *ret_size = 0;
+  while (size > 0)
+    {
+      /* Make room for the frame to be filled */
+      if (zw->tail - zw->head == zw->depth
+	  && zwrite_drain (buf, zw, zw->depth - 1) != pax_io_success)
+	return pax_io_failure;
+
+      struct zwframe *fr = &zw->ring[zw->tail % zw->depth];
+      if (!fr->in)
+	fr->in = ximalloc (zw->frame_size);
+      idx_t n = zw->frame_size - fr->in_len;
+      if (n > size)
+	n = size;
+      memcpy (fr->in + fr->in_len, p, n);
+      fr->in_len += n;
+      p += n;
+      size -= n;
+      *ret_size += n;
+      if (fr->in_len == zw->frame_size)
+	{
+	  zwrite_submit (zw);
+	  if (zwrite_drain (buf, zw, zw->depth) != pax_io_success)
+	    return pax_io_failure;
+	}
+    }
+  return pax_io_success;
+}
+
+/* Write the seek table of a zstd stream */
+static pax_io_status_t
+zwrite_seek_table (paxbuf_t buf, struct zwrite *zw)
+{
+  unsigned char head[8], footer[ZSTD_SEEK_TABLE_FOOTER];
+  idx_t nframes = zw->table_len / ZSTD_SEEK_TABLE_ENTRY;
+
+  put_le (head, ZSTD_SEEK_TABLE_MAGIC, 4);
+  put_le (head + 4, zw->table_len + ZSTD_SEEK_TABLE_FOOTER, 4);
+  put_le (footer, nframes, 4);
+  footer[4] = 0;
+  put_le (footer + 5, ZSTD_SEEKABLE_MAGIC, 4);
+  if (zwrite_out (buf, head, sizeof head) != pax_io_success
+      || zwrite_out (buf, zw->table, zw->table_len) != pax_io_success
+      || zwrite_out (buf, footer, sizeof footer) != pax_io_success)
+    return pax_io_failure;
+  return pax_io_success;
+}
+
+static int
+zwrite_close (paxbuf_t buf, void *fclosure, int mode)
+{
+  struct zwrite *zw = fclosure;
+
+  if (!(mode & PAXBUF_WRITE))
+    return 0;
+  zwrite_submit (zw);
+  if (zwrite_drain (buf, zw, 0) != pax_io_success)
+    return -1;
+  if (zw->type == PAX_COMPRESS_ZSTD
+      && zwrite_seek_table (buf, zw) != pax_io_success)
+    return -1;
+  zw->table_len = 0;
+  return 0;
+}
+
+static int
+zwrite_destroy (void *fclosure)
+{
+  struct zwrite *zw = fclosure;
+  void (*ctx_free) (void *) = nullptr;
+
+  pax_pool_destroy (&zw->pool);
+  switch (zw->type)
+    {
+# if HAVE_LIBZ
+    case PAX_COMPRESS_GZIP:
+      ctx_free = gzip_free;
+      break;
+# endif
+# if HAVE_LIBZSTD
+    case PAX_COMPRESS_ZSTD:
+      ctx_free = zstd_free;
+      break;
+# endif
+    default:
+      break;
+    }
+  for (idx_t i = 0; i < zw->depth; i++)
+    {
+      if (ctx_free)
+	ctx_free (zw->ring[i].ctx);
+      free (zw->ring[i].in);
+      free (zw->ring[i].out);
+    }
+  pthread_cond_destroy (&zw->cond);
+  pthread_mutex_destroy (&zw->mutex);
+  free (zw->ring);
+  free (zw->table);
+  free (zw);
+  return 0;
+}
+#endif /* HAVE_LIBZ || HAVE_LIBZSTD */
+
+/* Install on BUF a filter compressing data written to it into a
+   seekable stream of the given TYPE, at compression LEVEL (the default
+   one if LEVEL is not positive), using NTHREADS worker threads (all
+   available processors if NTHREADS is not positive).  Each frame holds
+   FRAME_SIZE bytes of uncompressed data, rounded up to a multiple of
+   the record size (PAX_COMPRESS_FRAME_SIZE if FRAME_SIZE is not
+   positive).  Return 0 on success, an errno value otherwise.  */
+int
+paxbuf_set_compress (paxbuf_t buf, enum pax_compression type, int level,
+		     idx_t frame_size, int nthreads)
+{
+  switch (type)
+    {
+    case PAX_COMPRESS_NONE:
+      return 0;
+#if HAVE_LIBZ
+    case PAX_COMPRESS_GZIP:
+      /* The member length is kept in 32 bits */
+      if (frame_size > UINT32_MAX / 2)
+	return EINVAL;
+      break;
+#endif
+#if HAVE_LIBZSTD
+    case PAX_COMPRESS_ZSTD:
+      if (frame_size > UINT32_MAX / 2)
+	return EINVAL;
+      break;
+#endif
+    case PAX_COMPRESS_AUTO:
+      return EINVAL;
+    default:
+      return ENOSYS;
+    }
+
+#if HAVE_LIBZ || HAVE_LIBZSTD
+  idx_t record_size = paxbuf_get_record_size (buf);
+  if (frame_size <= 0)
+    frame_size = PAX_COMPRESS_FRAME_SIZE;
+  frame_size = (frame_size + record_size - 1) / record_size * record_size;
+
+  struct zwrite *zw = calloc (1, sizeof *zw);
+  if (!zw)
+    return ENOMEM;
+  int rc = pax_pool_create (&zw->pool, nthreads);
+  if (rc)
+    {
+      free (zw);
+      return rc;
+    }
+  zw->type = type;
+  zw->level = level;
+  zw->frame_size = frame_size;
+  zw->depth = 2 * pax_pool_size (zw->pool);
+  zw->ring = calloc (zw->depth, sizeof zw->ring[0]);
+  if (!zw->ring)
+    {
+      pax_pool_destroy (&zw->pool);
+      free (zw);
+      return ENOMEM;
+    }
+  for (idx_t i = 0; i < zw->depth; i++)
+    zw->ring[i].zw = zw;
+  pthread_mutex_init (&zw->mutex, nullptr);
+  pthread_cond_init (&zw->cond, nullptr);
+  paxbuf_set_filter (buf, zw, nullptr, zwrite_writer, zwrite_destroy);
+  paxbuf_set_filter_close (buf, zwrite_close);
+  return 0;
+#else
+  return ENOSYS;
+#endif
+}
@@ -0,0 +1,215 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+#include <ftw.h>
+
+void
+xalloc_die (void)
+{
+  error (0, ENOMEM, "Exiting");
+  exit (EXIT_FAILURE);
+}
+
+void
+fatal_exit (void)
+{
+  error (0, 0, "Fatal error");
+  exit (EXIT_FAILURE);
+}
+
+static int failures;
+
+void
+check_fail (char const *file, int line, char const *cond)
+{
+  fprintf (stderr, "%s:%d: check failed: %s\n", file, line, cond);
+  failures++;
+}
+
+/* Return the exit status of the test */
+int
+check_status (void)
+{
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+/* Scratch directory */
+
+static char *scratch;
+
+static int
+remove_entry (char const *name, struct stat const *st, int flag,
+	      struct FTW *ftw)
+{
+  return remove (name) == 0 ? 0 : -1;
+}
+
+static void
+remove_scratch (void)
+{
+  nftw (scratch, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+  free (scratch);
+}
+
+/* Return the name of the scratch directory, creating it on first
+   use.  */
+char const *
+check_scratch (void)
+{
+  if (!scratch)
+    {
+      char const *tmp = getenv ("TMPDIR");
+      if (!tmp)
+	tmp = "/tmp";
+      char *tmpl = xmalloc (strlen (tmp) + sizeof "/paxtest.XXXXXX");
+      sprintf (tmpl, "%s/paxtest.XXXXXX", tmp);
+      if (!mkdtemp (tmpl))
+	error (EXIT_FAILURE, errno, "%s", tmpl);
+      scratch = tmpl;
+      atexit (remove_scratch);
+    }
+  return scratch;
+}
+
+/* Return the name of BASE in the scratch directory */
+char *
+check_file_name (char const *base)
+{
+  char const *dir = check_scratch ();
+  char *name = xmalloc (strlen (dir) + strlen (base) + 2);
+  sprintf (name, "%s/%s", dir, base);
+  return name;
+}
+
+void
+check_write_file (char const *name, char const *data, idx_t size)
+{
+  int fd = open (name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || full_write (fd, data, size) != size || close (fd) != 0)
+    error (EXIT_FAILURE, errno, "%s", name);
+}
+
+/* Return the contents of NAME and store their size in *PSIZE, or
+   return null if NAME cannot be read.  */
+char *
+check_read_file (char const *name, idx_t *psize)
+{
+  int fd = open (name, O_RDONLY);
+  struct stat st;
+  if (fd < 0)
+    return nullptr;
+  if (fstat (fd, &st) != 0)
+    error (EXIT_FAILURE, errno, "%s", name);
+  char *data = ximalloc (st.st_size + 1);
+  idx_t n = 0;
+  while (n < st.st_size)
+    {
+      ptrdiff_t r = read (fd, data + n, st.st_size - n);
+      if (r <= 0)
+	error (EXIT_FAILURE, errno, "%s", name);
+      n += r;
+    }
+  close (fd);
+  *psize = n;
+  return data;
+}
+
+
+/* Test archives */
+
+struct check_archive
+{
+  char *name;
+  FILE *fp;
+};
+
+check_archive_t
+check_archive_create (char const *name)
+{
+  check_archive_t ar = xmalloc (sizeof *ar);
+  ar->name = xstrdup (name);
+  ar->fp = fopen (name, "wb");
+  if (!ar->fp)
+    error (EXIT_FAILURE, errno, "%s", name);
+  return ar;
+}
+
+/* Add to AR the member NAME of the given header TYPE and MODE, with
+   LINK_NAME and the SIZE bytes of DATA, in the GNU format.  */
+void
+check_archive_add (check_archive_t ar, char const *name, char type,
+		   mode_t mode, char const *link_name,
+		   char const *data, idx_t size)
+{
+  struct tar_stat_info st;
+  union block blk;
+
+  pax_stat_init (&st);
+  st.file_name = (char *) name;
+  st.link_name = (char *) (link_name ? link_name : "");
+  st.uname = st.gname = (char *) "";
+  st.stat.st_mode = mode;
+  st.stat.st_uid = getuid ();
+  st.stat.st_gid = getgid ();
+  st.stat.st_mtime = 1700000000;
+  st.stat.st_size = st.archive_file_size = size;
+  if (pax_encode_header (&blk, &st, type, GNU_FORMAT) != 0)
+    error (EXIT_FAILURE, 0, "%s: cannot encode", name);
+  fwrite (blk.buffer, BLOCKSIZE, 1, ar->fp);
+  if (size > 0)
+    {
+      static char const zeros[BLOCKSIZE];
+      fwrite (data, size, 1, ar->fp);
+      fwrite (zeros, -size & (BLOCKSIZE - 1), 1, ar->fp);
+    }
+}
+
+/* Write the end of AR and free it */
+void
+check_archive_close (check_archive_t ar)
+{
+  static char const zeros[2 * BLOCKSIZE];
+  fwrite (zeros, sizeof zeros, 1, ar->fp);
+  if (fclose (ar->fp) != 0)
+    error (EXIT_FAILURE, errno, "%s", ar->name);
+  free (ar->name);
+  free (ar);
+}
+
+/* Return a buffer reading the archive NAME */
+paxbuf_t
+check_archive_open (char const *name)
+{
+  paxbuf_t buf;
+  tar_archive_create (&buf, name, 0, PAXBUF_READ, 20);
+  if (paxbuf_open (buf))
+    error (EXIT_FAILURE, errno, "%s", name);
+  return buf;
+}
+
+void
+check_archive_release (paxbuf_t buf)
+{
+  paxbuf_close (buf);
+  paxbuf_destroy (&buf);
+}
@@ -0,0 +1,47 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Support for the test programs run by "make check".
+
+   Each test is a program that exits with status 0 if it passed and 1
+   if it failed, after reporting what went wrong on stderr.  Tests work
+   in a scratch directory of their own, removed at exit.  */
+
+#include <paxtest.h>
+
+/* Report a failure of the check COND, at FILE:LINE, unless it holds */
+#define CHECK(cond) \
+  ((cond) ? (void) 0 : check_fail (__FILE__, __LINE__, #cond))
+
+void check_fail (char const *file, int line, char const *cond);
+int check_status (void);
+
+char const *check_scratch (void);
+char *check_file_name (char const *base);
+void check_write_file (char const *name, char const *data, idx_t size);
+char *check_read_file (char const *name, idx_t *psize);
+
+/* Writing test archives */
+typedef struct check_archive *check_archive_t;
+
+check_archive_t check_archive_create (char const *name);
+void check_archive_add (check_archive_t ar, char const *name, char type,
+			mode_t mode, char const *link_name,
+			char const *data, idx_t size);
+void check_archive_close (check_archive_t ar);
+paxbuf_t check_archive_open (char const *name);
+void check_archive_release (paxbuf_t buf);
@@ -0,0 +1,246 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Microbenchmark for the header decoder.
+
+   Usage: hdrbench [-n ITERATIONS] [ARCHIVE]
+
+   Decodes a set of headers ITERATIONS times and reports the time spent
+   per header, along with the time spent verifying the checksum alone,
+   header by header and in batches, and the time spent encoding the
+   decoded headers back.  The headers are taken from ARCHIVE,
+   if given (every block with a valid checksum is used), or synthesized
+   in all supported formats.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <paxtest.h>
+
+void
+xalloc_die (void)
+{
+  error (0, ENOMEM, "Exiting");
+  exit (EXIT_FAILURE);
+}
+
+void
+fatal_exit (void)
+{
+  error (0, 0, "Fatal error");
+  exit (EXIT_FAILURE);
+}
+
+static void
+set_octal (char *field, idx_t size, uintmax_t v)
+{
+  field[size - 1] = 0;
+  for (idx_t i = size - 2; i >= 0; i--, v >>= 3)
+    field[i] = '0' + (v & 7);
+}
+
+static void
+set_base256 (char *field, idx_t size, intmax_t v)
+{
+  for (idx_t i = size - 1; i > 0; i--, v >>= 8)
+    field[i] = v & 0xff;
+  field[0] = v < 0 ? 0xff : 0x80;
+}
+
+static void
+set_checksum (union block *blk)
+{
+  unsigned sum = 0;
+
+  memset (blk->header.chksum, ' ', sizeof blk->header.chksum);
+  for (int i = 0; i < BLOCKSIZE; i++)
+    sum += (unsigned char) blk->buffer[i];
+  set_octal (blk->header.chksum, sizeof blk->header.chksum - 1, sum);
+  blk->header.chksum[7] = ' ';
+}
+
+static void
+make_header (union block *blk, enum archive_format format, int n)
+{
+  struct posix_header *h = &blk->header;
+
+  memset (blk, 0, sizeof *blk);
+  snprintf (h->name, sizeof h->name, "dir%03d/subdir/file-%06d.dat",
+	    n % 1000, n);
+  set_octal (h->mode, sizeof h->mode, 0644);
+  set_octal (h->uid, sizeof h->uid, 1000 + n % 7);
+  set_octal (h->gid, sizeof h->gid, 100 + n % 3);
+  set_octal (h->size, sizeof h->size, n * 1021);
+  set_octal (h->mtime, sizeof h->mtime, 1700000000 + n);
+  h->typeflag = REGTYPE;
+
+  switch (format)
+    {
+    case V7_FORMAT:
+      break;
+
+    case OLDGNU_FORMAT:
+      memcpy (h->magic, OLDGNU_MAGIC, sizeof OLDGNU_MAGIC);
+      set_base256 (h->size, sizeof h->size, (intmax_t) n << 34);
+      strcpy (h->uname, "user");
+      strcpy (h->gname, "group");
+      break;
+
+    case STAR_FORMAT:
+      memcpy (h->magic, TMAGIC, TMAGLEN);
+      memcpy (h->version, TVERSION, TVERSLEN);
+      set_octal (blk->star_header.atime, sizeof blk->star_header.atime,
+		 1700000000);
+      blk->star_header.atime[11] = ' ';
+      set_octal (blk->star_header.ctime, sizeof blk->star_header.ctime,
+		 1700000000);
+      blk->star_header.ctime[11] = ' ';
+      break;
+
+    default:
+      memcpy (h->magic, TMAGIC, TMAGLEN);
+      memcpy (h->version, TVERSION, TVERSLEN);
+      strcpy (h->uname, "user");
+      strcpy (h->gname, "group");
+      strcpy (h->prefix, "some/rather/long/prefix/directory");
+      break;
+    }
+  set_checksum (blk);
+}
+
+static struct timespec
+now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts;
+}
+
+static void
+report (char const *what, struct timespec start, double n)
+{
+  struct timespec end = now ();
+  double ns = (end.tv_sec - start.tv_sec) * 1e9
+	      + (end.tv_nsec - start.tv_nsec);
+  printf ("%-20s %8.1f ns/header\n", what, ns / n);
+}
+
+static union block *
+load_archive (char const *file_name, idx_t *count)
+{
+  FILE *fp = fopen (file_name, "rb");
+  union block *blocks = nullptr;
+  idx_t n = 0, size = 0;
+  union block blk;
+
+  if (!fp)
+    error (EXIT_FAILURE, errno, "%s", file_name);
+  while (fread (&blk, sizeof blk, 1, fp) == 1)
+    if (pax_header_checksum (&blk) == PAX_HEADER_SUCCESS)
+      {
+	if (n == size)
+	  blocks = xpalloc (blocks, &size, 1, -1, sizeof blocks[0]);
+	blocks[n++] = blk;
+      }
+  fclose (fp);
+  *count = n;
+  return blocks;
+}
+
+int
+main (int argc, char **argv)
+{
+  static enum archive_format const formats[] =
+    { V7_FORMAT, OLDGNU_FORMAT, USTAR_FORMAT, STAR_FORMAT };
+  enum { NSYNTH = 1024 };
+  long iterations = 1000;
+  union block *blocks;
+  idx_t count;
+  int c;
+
+  while ((c = getopt (argc, argv, "n:")) != EOF)
+    switch (c)
+      {
+      case 'n':
+	iterations = atol (optarg);
+	break;
+      default:
+	error (EXIT_FAILURE, 0, "usage: hdrbench [-n ITERATIONS] [ARCHIVE]");
+      }
+
+  if (optind < argc)
+    blocks = load_archive (argv[optind], &count);
+  else
+    {
+      count = NSYNTH;
+      blocks = xnmalloc (count, sizeof blocks[0]);
+      for (idx_t i = 0; i < count; i++)
+	make_header (&blocks[i], formats[i % (sizeof formats
+					      / sizeof formats[0])], i);
+    }
+  if (count == 0)
+    error (EXIT_FAILURE, 0, "no headers found");
+
+  struct tar_stat_info st;
+  struct timespec start;
+  idx_t failures = 0;
+  enum pax_header_status *status = xnmalloc (count, sizeof status[0]);
+
+  printf ("%td headers x %ld iterations\n", count, iterations);
+
+  pax_stat_init (&st);
+  start = now ();
+  for (long it = 0; it < iterations; it++)
+    for (idx_t i = 0; i < count; i++)
+      failures += pax_decode_header (&blocks[i], &st, nullptr)
+		  != PAX_HEADER_SUCCESS;
+  report ("decode", start, count * iterations);
+
+  start = now ();
+  for (long it = 0; it < iterations; it++)
+    for (idx_t i = 0; i < count; i++)
+      failures += pax_header_checksum (&blocks[i]) != PAX_HEADER_SUCCESS;
+  report ("checksum", start, count * iterations);
+
+  start = now ();
+  for (long it = 0; it < iterations; it++)
+    failures += count - pax_header_checksum_n (blocks, count, status);
+  report ("checksum, batched", start, count * iterations);
+
+  struct tar_stat_info *sts = xnmalloc (count, sizeof sts[0]);
+  enum archive_format *fmts = xnmalloc (count, sizeof fmts[0]);
+  union block out;
+  for (idx_t i = 0; i < count; i++)
+    {
+      pax_stat_init (&sts[i]);
+      pax_decode_header (&blocks[i], &sts[i], &fmts[i]);
+    }
+  start = now ();
+  for (long it = 0; it < iterations; it++)
+    for (idx_t i = 0; i < count; i++)
+      pax_encode_header (&out, &sts[i], blocks[i].header.typeflag, fmts[i]);
+  report ("encode", start, count * iterations);
+
+  pax_stat_destroy (&st);
+  for (idx_t i = 0; i < count; i++)
+    pax_stat_destroy (&sts[i]);
+
+  if (failures)
+    printf ("%td failures\n", failures / iterations);
+  return failures != 0;
+}
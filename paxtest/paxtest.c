@@ -83,6 +83,9 @@ main (int argc, char **argv)
     error (EXIT_FAILURE, 0, "Not enough arguments");
 
   tar_archive_create (&pbuf, argv[1], 0, PAXBUF_READ, DEFAULT_BLOCKING_FACTOR);
+  rc = paxbuf_set_decompress (pbuf, PAX_COMPRESS_AUTO, 0);
+  if (rc)
+    error (EXIT_FAILURE, rc, "Cannot set up decompression");
 
   rc = paxbuf_open (pbuf);
   printf ("Open: %d\n", rc);
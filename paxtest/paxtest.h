@@ -22,3 +22,4 @@
 #include <paxbuf.h>
 #include <tar.h>
 #include <pax.h>
+#include <compress.h>
@@ -0,0 +1,129 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Header checksums.  The sums of random blocks, signed and unsigned,
+   must be those computed byte by byte; headers carrying either sum are
+   valid, others not, and the batched check must agree with the check
+   of each block on a run of blocks that is not a multiple of its
+   batch.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+enum { BLOCKS = 203 };
+
+static uint_least32_t seed = 1;
+
+static unsigned
+rnd (void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+/* Compute the sums of BLK byte by byte, the checksum field counting as
+   blanks.  Return the unsigned sum, and store the signed one in
+   *SSUM.  */
+static int
+reference_sum (union block const *blk, int *ssum)
+{
+  int usum = 0;
+
+  *ssum = 0;
+  for (int i = 0; i < BLOCKSIZE; i++)
+    {
+      bool in_chksum = (blk->header.chksum - blk->buffer <= i
+			&& i < (blk->header.chksum - blk->buffer
+				+ sizeof blk->header.chksum));
+      char c = in_chksum ? ' ' : blk->buffer[i];
+      usum += (unsigned char) c;
+      *ssum += (signed char) c;
+    }
+  return usum;
+}
+
+/* Store V in the checksum field of BLK as tar does */
+static void
+set_chksum (union block *blk, int v)
+{
+  sprintf (blk->header.chksum, "%06o", v);
+  blk->header.chksum[7] = ' ';
+}
+
+int
+main (int argc, char **argv)
+{
+  union block *blk = xnmalloc (BLOCKS, sizeof *blk);
+  enum pax_header_status want[BLOCKS], got[BLOCKS];
+  idx_t nvalid = 0;
+
+  for (idx_t i = 0; i < BLOCKS; i++)
+    {
+      int usum, ssum;
+
+      /* Random bytes, low bytes with a few high ones, or zeros */
+      for (int j = 0; j < BLOCKSIZE; j++)
+	blk[i].buffer[j] = (i % 3 == 0 ? rnd ()
+			    : i % 3 == 1 ? rnd () % 128 | (j % 64 ? 0 : 128)
+			    : 0);
+      usum = reference_sum (&blk[i], &ssum);
+      int u = pax_header_sum (&blk[i], nullptr), s;
+      CHECK (u == usum && pax_header_sum (&blk[i], &s) == u && s == ssum);
+
+      switch (i % 6)
+	{
+	case 0:
+	case 1:
+	  set_chksum (&blk[i], usum);
+	  want[i] = PAX_HEADER_SUCCESS;
+	  break;
+
+	case 2:
+	  want[i] = PAX_HEADER_ZERO_BLOCK;
+	  break;
+
+	case 3:
+	  set_chksum (&blk[i], usum + 1);
+	  want[i] = PAX_HEADER_FAILURE;
+	  break;
+
+	case 4:
+	  /* What old tars computed */
+	  CHECK (0 <= ssum && ssum < usum);
+	  set_chksum (&blk[i], ssum);
+	  want[i] = PAX_HEADER_SUCCESS;
+	  break;
+
+	case 5:
+	  memcpy (blk[i].header.chksum, "0012x4 ", 8);
+	  want[i] = PAX_HEADER_FAILURE;
+	  break;
+	}
+      CHECK (pax_header_checksum (&blk[i]) == want[i]);
+      nvalid += want[i] == PAX_HEADER_SUCCESS;
+    }
+
+  CHECK (pax_header_checksum_n (blk, BLOCKS, got) == nvalid);
+  for (idx_t i = 0; i < BLOCKS; i++)
+    CHECK (got[i] == want[i]);
+
+  free (blk);
+  return check_status ();
+}
@@ -0,0 +1,187 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Compression: the frames are compressed in parallel, but the stream
+   written must not depend on the number of threads, and must read back
+   the same through paxbuf_set_decompress, from the start or from where
+   a seek leads.  Both gzip and, when available, zstd are tried.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+enum
+  {
+    DATA_SIZE = 5 * 1024 * 1024 + 1000,
+    FRAME_SIZE = 256 * 1024
+  };
+
+/* Write the SIZE bytes at DATA to ARCHIVE, compressed as TYPE by
+   NTHREADS threads, in pieces of varying size.  */
+static void
+write_archive (char const *archive, enum pax_compression type,
+	       int nthreads, char *data, idx_t size)
+{
+  paxbuf_t buf;
+  idx_t n;
+
+  tar_archive_create (&buf, archive, 0, PAXBUF_WRITE | PAXBUF_CREAT, 20);
+  CHECK (paxbuf_set_compress (buf, type, 0, FRAME_SIZE, nthreads) == 0);
+  CHECK (paxbuf_open (buf) == 0);
+  for (idx_t off = 0, len = 1; off < size; off += len, len = len * 7 % 99991)
+    {
+      if (len > size - off)
+	len = size - off;
+      CHECK (paxbuf_write (buf, data + off, len, &n) == pax_io_success);
+    }
+  CHECK (paxbuf_close (buf) == 0);
+  paxbuf_destroy (&buf);
+}
+
+/* Read ARCHIVE back and compare it with the SIZE bytes at DATA.  Return
+   false if they differ.  */
+static bool
+read_archive (char const *archive, char const *data, idx_t size)
+{
+  static char rbuf[10000];
+  paxbuf_t buf;
+  idx_t n;
+  pax_io_status_t rc;
+  bool ok = true;
+  off_t off;
+
+  tar_archive_create (&buf, archive, 0, PAXBUF_READ, 20);
+  CHECK (paxbuf_set_decompress (buf, PAX_COMPRESS_AUTO, 2) == 0);
+  CHECK (paxbuf_open (buf) == 0);
+  for (off = 0;
+       (rc = paxbuf_read (buf, rbuf, sizeof rbuf, &n)) == pax_io_success
+	 && n > 0;
+       off += n)
+    {
+      /* The data are followed by the rest of the last record */
+      idx_t m = off >= size ? 0 : n < size - off ? n : size - off;
+      if (memcmp (rbuf, data + off, m) != 0)
+	{
+	  fprintf (stderr, "data differ at %jd\n", (intmax_t) off);
+	  ok = false;
+	  break;
+	}
+    }
+  if (rc == pax_io_failure || off < size)
+    ok = false;
+  paxbuf_close (buf);
+  paxbuf_destroy (&buf);
+  return ok;
+}
+
+/* Seek in ARCHIVE, whose data are the SIZE bytes at DATA, to a few
+   offsets in turn, and check the data read there.  Return false if
+   they differ.  */
+static bool
+seek_archive (char const *archive, char const *data, idx_t size)
+{
+  static off_t const offsets[] = { 3 * FRAME_SIZE + 17, 100,
+				   DATA_SIZE - 50, FRAME_SIZE };
+  char rbuf[100];
+  paxbuf_t buf;
+  idx_t n;
+  bool ok = true;
+
+  tar_archive_create (&buf, archive, 0, PAXBUF_READ, 20);
+  CHECK (paxbuf_set_decompress (buf, PAX_COMPRESS_AUTO, 2) == 0);
+  CHECK (paxbuf_open (buf) == 0);
+  for (int i = 0; i < sizeof offsets / sizeof *offsets; i++)
+    {
+      off_t off = offsets[i];
+      idx_t len = size - off < sizeof rbuf ? size - off : sizeof rbuf;
+      if (paxbuf_seek (buf, off) != 0
+	  || paxbuf_read (buf, rbuf, len, &n) == pax_io_failure
+	  || n != len || memcmp (rbuf, data + off, len) != 0)
+	{
+	  fprintf (stderr, "bad data after seeking to %jd\n", (intmax_t) off);
+	  ok = false;
+	}
+    }
+  errno = 0;
+  if (paxbuf_seek (buf, -1) != -1 || errno != EINVAL)
+    ok = false;
+  paxbuf_close (buf);
+  paxbuf_destroy (&buf);
+  return ok;
+}
+
+/* Compress the SIZE bytes at DATA as TYPE into the files ONE and MANY,
+   by one thread and by several, and check the results.  */
+static void
+check_compression (enum pax_compression type, char const *one_base,
+		   char const *many_base, char *data, idx_t size)
+{
+  char *one = check_file_name (one_base);
+  char *many = check_file_name (many_base);
+  idx_t one_size, many_size;
+
+  write_archive (one, type, 1, data, size);
+  write_archive (many, type, 4, data, size);
+  char *p1 = check_read_file (one, &one_size);
+  char *p2 = check_read_file (many, &many_size);
+  CHECK (p1 && p2 && one_size == many_size
+	 && memcmp (p1, p2, one_size) == 0);
+  CHECK (one_size < size / 2);
+
+  /* A zstd stream ends with its seek table */
+  if (type == PAX_COMPRESS_ZSTD && p1 && one_size >= 4)
+    {
+      unsigned char const *f = (unsigned char const *) p1 + one_size - 4;
+      CHECK ((f[0] | f[1] << 8 | f[2] << 16 | (uint_least32_t) f[3] << 24)
+	     == ZSTD_SEEKABLE_MAGIC);
+    }
+
+  CHECK (read_archive (one, data, size));
+  CHECK (read_archive (many, data, size));
+  CHECK (seek_archive (many, data, size));
+
+  free (p1);
+  free (p2);
+  free (one);
+  free (many);
+}
+
+int
+main (int argc, char **argv)
+{
+  char *data = ximalloc (DATA_SIZE);
+  uint_least32_t r = 1;
+
+  /* Compressible data: random letters */
+  for (idx_t i = 0; i < DATA_SIZE; i++)
+    {
+      r = r * 1103515245 + 12345;
+      data[i] = 'a' + (r >> 16) % 8;
+    }
+
+  check_compression (PAX_COMPRESS_GZIP, "one.gz", "many.gz", data,
+		     DATA_SIZE);
+#if HAVE_LIBZSTD
+  check_compression (PAX_COMPRESS_ZSTD, "one.zst", "many.zst", data,
+		     DATA_SIZE);
+#endif
+
+  free (data);
+  return check_status ();
+}
@@ -0,0 +1,231 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Header decoding.  Numeric fields are decoded in octal and base-256,
+   within the bounds asked for; headers built by hand in each format are
+   recognized and decoded, and damaged ones rejected.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+/* Return true if the SIZE-byte field F decodes to V within [MIN, MAX] */
+static bool
+number_is (char const *f, idx_t size, intmax_t min, uintmax_t max,
+	   intmax_t v)
+{
+  intmax_t val;
+  return pax_decode_number (f, size, min, max, &val) && val == v;
+}
+
+static bool
+number_bad (char const *f, idx_t size, intmax_t min, uintmax_t max)
+{
+  intmax_t val;
+  return !pax_decode_number (f, size, min, max, &val);
+}
+
+static void
+set_octal (char *field, idx_t size, uintmax_t v)
+{
+  field[size - 1] = 0;
+  for (idx_t i = size - 2; i >= 0; i--, v >>= 3)
+    field[i] = '0' + (v & 7);
+}
+
+static void
+set_checksum (union block *blk)
+{
+  unsigned sum = 0;
+
+  memset (blk->header.chksum, ' ', sizeof blk->header.chksum);
+  for (int i = 0; i < BLOCKSIZE; i++)
+    sum += (unsigned char) blk->buffer[i];
+  set_octal (blk->header.chksum, sizeof blk->header.chksum - 1, sum);
+  blk->header.chksum[7] = ' ';
+}
+
+/* Fill BLK with a header for NAME of the given TYPEFLAG, with MAGIC
+   and VERSION unless null, and no checksum yet.  The old GNU magic
+   runs into the version field.  */
+static void
+make_header (union block *blk, char const *name, char typeflag,
+	     char const *magic, char const *version)
+{
+  struct posix_header *h = &blk->header;
+
+  memset (blk, 0, sizeof *blk);
+  strcpy (h->name, name);
+  set_octal (h->mode, sizeof h->mode, 0644);
+  set_octal (h->uid, sizeof h->uid, 1000);
+  set_octal (h->gid, sizeof h->gid, 100);
+  set_octal (h->size, sizeof h->size, 1234);
+  set_octal (h->mtime, sizeof h->mtime, 1700000000);
+  h->typeflag = typeflag;
+  strcpy (h->uname, "user");
+  strcpy (h->gname, "group");
+  if (magic)
+    memcpy (h->magic, magic, strlen (magic) + 1);
+  if (version)
+    memcpy (h->version, version, sizeof h->version);
+}
+
+static void
+check_numbers (void)
+{
+  /* Octal, with leading blanks and a blank or null terminator */
+  CHECK (number_is ("0000644", 8, 0, INTMAX_MAX, 0644));
+  CHECK (number_is ("   644 ", 8, 0, INTMAX_MAX, 0644));
+  CHECK (number_is ("644\0\0\0\0", 8, 0, INTMAX_MAX, 0644));
+  CHECK (number_is ("77777777777", 12, 0, INTMAX_MAX, 077777777777));
+  CHECK (number_bad ("        ", 8, 0, INTMAX_MAX));
+  CHECK (number_bad ("0000648", 8, 0, INTMAX_MAX));
+  CHECK (number_bad ("64x    ", 8, 0, INTMAX_MAX));
+  CHECK (number_bad ("0000644", 8, 0, 0643));
+  CHECK (number_bad ("", 0, 0, INTMAX_MAX));
+
+  /* Base-256: positive, negative, and too large for the bounds */
+  static char const b1[] = "\200\0\0\0\0\0\0\1\0\0\0\0";
+  CHECK (number_is (b1, 12, 0, INTMAX_MAX, (intmax_t) 1 << 32));
+  CHECK (number_bad (b1, 12, 0, UINT32_MAX));
+  static char const b2[] = "\377\377\377\377\377\377\377\377\377\377\377\377";
+  CHECK (number_is (b2, 12, INTMAX_MIN, INTMAX_MAX, -1));
+  CHECK (number_bad (b2, 12, 0, INTMAX_MAX));
+  static char const b3[] = "\200\1\0\0\0\0\0\0\0\0\0\0";
+  CHECK (number_bad (b3, 12, INTMAX_MIN, INTMAX_MAX));
+}
+
+static void
+check_formats (void)
+{
+  union block blk;
+
+  make_header (&blk, "v7", REGTYPE, nullptr, nullptr);
+  CHECK (pax_header_format (&blk) == V7_FORMAT);
+  make_header (&blk, "gnu", REGTYPE, OLDGNU_MAGIC, nullptr);
+  CHECK (pax_header_format (&blk) == OLDGNU_FORMAT);
+  make_header (&blk, "ustar", REGTYPE, TMAGIC, TVERSION);
+  CHECK (pax_header_format (&blk) == USTAR_FORMAT);
+  make_header (&blk, "posix", XHDTYPE, TMAGIC, TVERSION);
+  CHECK (pax_header_format (&blk) == POSIX_FORMAT);
+  make_header (&blk, "star", REGTYPE, TMAGIC, TVERSION);
+  set_octal (blk.star_header.atime, sizeof blk.star_header.atime, 1);
+  blk.star_header.atime[11] = ' ';
+  set_octal (blk.star_header.ctime, sizeof blk.star_header.ctime, 2);
+  blk.star_header.ctime[11] = ' ';
+  CHECK (pax_header_format (&blk) == STAR_FORMAT);
+}
+
+static void
+check_headers (void)
+{
+  struct tar_stat_info st;
+  enum archive_format format;
+  union block blk;
+
+  pax_stat_init (&st);
+
+  /* A ustar header, whose name has a prefix */
+  make_header (&blk, "name", REGTYPE, TMAGIC, TVERSION);
+  strcpy (blk.header.prefix, "some/dir");
+  set_checksum (&blk);
+  CHECK (pax_decode_header (&blk, &st, &format) == PAX_HEADER_SUCCESS);
+  CHECK (format == USTAR_FORMAT);
+  CHECK (strcmp (st.file_name, "some/dir/name") == 0);
+  CHECK (st.stat.st_mode == (S_IFREG | 0644));
+  CHECK (st.stat.st_uid == 1000 && st.stat.st_gid == 100);
+  CHECK (st.stat.st_size == 1234 && st.archive_file_size == 1234);
+  CHECK (st.stat.st_mtime == 1700000000);
+  CHECK (strcmp (st.uname, "user") == 0 && strcmp (st.gname, "group") == 0);
+
+  /* A V7 header has no owner names, nor a prefix, and marks directories
+     with a trailing slash */
+  make_header (&blk, "dir/", AREGTYPE, nullptr, nullptr);
+  strcpy (blk.header.prefix, "ignored");
+  set_checksum (&blk);
+  CHECK (pax_decode_header (&blk, &st, &format) == PAX_HEADER_SUCCESS);
+  CHECK (format == V7_FORMAT);
+  CHECK (strcmp (st.file_name, "dir/") == 0);
+  CHECK (S_ISDIR (st.stat.st_mode) && !st.uname && !st.gname);
+
+  /* A device, and a name filling its field */
+  make_header (&blk, "", CHRTYPE, TMAGIC, TVERSION);
+  memset (blk.header.name, 'n', sizeof blk.header.name);
+  set_octal (blk.header.devmajor, sizeof blk.header.devmajor, 4);
+  set_octal (blk.header.devminor, sizeof blk.header.devminor, 64);
+  set_checksum (&blk);
+  CHECK (pax_decode_header (&blk, &st, &format) == PAX_HEADER_SUCCESS);
+  CHECK (strlen (st.file_name) == sizeof blk.header.name);
+  CHECK (S_ISCHR (st.stat.st_mode));
+  CHECK (st.devmajor == 4 && st.devminor == 64);
+
+  /* An old GNU sparse header, with access times */
+  make_header (&blk, "sparse", GNUTYPE_SPARSE, OLDGNU_MAGIC, nullptr);
+  struct oldgnu_header *gh = &blk.oldgnu_header;
+  set_octal (gh->atime, sizeof gh->atime, 1600000000);
+  set_octal (gh->realsize, sizeof gh->realsize, 1 << 20);
+  set_octal (gh->sp[0].offset, sizeof gh->sp[0].offset, 0);
+  set_octal (gh->sp[0].numbytes, sizeof gh->sp[0].numbytes, 512);
+  set_octal (gh->sp[1].offset, sizeof gh->sp[1].offset, 1 << 19);
+  set_octal (gh->sp[1].numbytes, sizeof gh->sp[1].numbytes, 722);
+  set_checksum (&blk);
+  CHECK (pax_decode_header (&blk, &st, &format) == PAX_HEADER_SUCCESS);
+  CHECK (format == OLDGNU_FORMAT);
+  CHECK (st.stat.st_atime == 1600000000);
+  CHECK (st.stat.st_ctime == 1700000000);
+  CHECK (st.is_sparse && st.stat.st_size == 1 << 20);
+  CHECK (st.archive_file_size == 1234);
+  CHECK (st.sparse_map_avail == 2
+	 && st.sparse_map[0].offset == 0
+	 && st.sparse_map[0].numbytes == 512
+	 && st.sparse_map[1].offset == 1 << 19
+	 && st.sparse_map[1].numbytes == 722);
+
+  /* A size beyond the octal range, in base-256 */
+  make_header (&blk, "big", REGTYPE, OLDGNU_MAGIC, nullptr);
+  memset (blk.header.size, 0, sizeof blk.header.size);
+  blk.header.size[0] = (char) 0x80;
+  blk.header.size[7] = 1;
+  set_checksum (&blk);
+  CHECK (pax_decode_header (&blk, &st, &format) == PAX_HEADER_SUCCESS);
+  CHECK (st.stat.st_size == (off_t) 1 << 32);
+
+  /* Damaged headers, and a block of zeros */
+  make_header (&blk, "bad", REGTYPE, TMAGIC, TVERSION);
+  set_checksum (&blk);
+  blk.header.name[0] ^= 1;
+  CHECK (pax_decode_header (&blk, &st, &format) == PAX_HEADER_FAILURE);
+  make_header (&blk, "bad", REGTYPE, TMAGIC, TVERSION);
+  memcpy (blk.header.mode, "0006x4", 7);
+  set_checksum (&blk);
+  CHECK (pax_decode_header (&blk, &st, &format) == PAX_HEADER_FAILURE);
+  memset (&blk, 0, sizeof blk);
+  CHECK (pax_decode_header (&blk, &st, &format) == PAX_HEADER_ZERO_BLOCK);
+
+  pax_stat_destroy (&st);
+}
+
+int
+main (int argc, char **argv)
+{
+  check_numbers ();
+  check_formats ();
+  check_headers ();
+  return check_status ();
+}
@@ -0,0 +1,156 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Deduplication: data written through paxbuf_set_dedup must read back
+   the same through paxbuf_set_undedup, from the start and after a
+   seek, and a damaged chunk must be detected.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+#include <dirent.h>
+#include <dedup.h>
+
+enum { DATA_SIZE = 3 * 1024 * 1024 + 1000 };
+
+/* Write the SIZE bytes at DATA to ARCHIVE, deduplicated into STORE, in
+   pieces of varying size.  */
+static void
+write_archive (char const *archive, char const *store,
+	       char *data, idx_t size)
+{
+  paxbuf_t buf;
+  idx_t n;
+
+  tar_archive_create (&buf, archive, 0, PAXBUF_WRITE | PAXBUF_CREAT, 20);
+  CHECK (paxbuf_set_dedup (buf, store) == 0);
+  CHECK (paxbuf_open (buf) == 0);
+  for (idx_t off = 0, len = 1; off < size; off += len, len = len * 7 % 9973)
+    {
+      if (len > size - off)
+	len = size - off;
+      CHECK (paxbuf_write (buf, data + off, len, &n) == pax_io_success);
+    }
+  CHECK (paxbuf_close (buf) == 0);
+  paxbuf_destroy (&buf);
+}
+
+/* Read ARCHIVE back from STORE, starting at OFFSET, and compare it with
+   the SIZE bytes at DATA.  Return false if reading fails.  */
+static bool
+read_archive (char const *archive, char const *store, off_t offset,
+	      char const *data, idx_t size)
+{
+  static char rbuf[10000];
+  paxbuf_t buf;
+  idx_t n;
+  pax_io_status_t rc;
+  bool ok = true;
+  off_t off;
+
+  tar_archive_create (&buf, archive, 0, PAXBUF_READ, 20);
+  CHECK (paxbuf_set_undedup (buf, store) == 0);
+  CHECK (paxbuf_open (buf) == 0);
+  if (offset)
+    CHECK (paxbuf_seek (buf, offset) == 0);
+  for (off = offset;
+       (rc = paxbuf_read (buf, rbuf, sizeof rbuf, &n)) == pax_io_success
+	 && n > 0;
+       off += n)
+    {
+      /* The data are followed by the rest of the last record */
+      idx_t m = off >= size ? 0 : n < size - off ? n : size - off;
+      if (memcmp (rbuf, data + off, m) != 0)
+	{
+	  fprintf (stderr, "data differ at %jd\n", (intmax_t) off);
+	  ok = false;
+	  break;
+	}
+    }
+  if (rc == pax_io_failure || off < size)
+    ok = false;
+  paxbuf_close (buf);
+  paxbuf_destroy (&buf);
+  return ok;
+}
+
+/* Damage one chunk in STORE */
+static void
+damage_chunk (char const *store)
+{
+  DIR *dir = opendir (store);
+  struct dirent *ent;
+  char *name = nullptr;
+
+  while (!name && (ent = readdir (dir)))
+    if (ent->d_name[0] != '.')
+      {
+	char *sub = xmalloc (strlen (store) + strlen (ent->d_name) + 2);
+	sprintf (sub, "%s/%s", store, ent->d_name);
+	DIR *d = opendir (sub);
+	struct dirent *e;
+	while ((e = readdir (d)))
+	  if (e->d_name[0] != '.')
+	    {
+	      name = xmalloc (strlen (sub) + strlen (e->d_name) + 2);
+	      sprintf (name, "%s/%s", sub, e->d_name);
+	      break;
+	    }
+	closedir (d);
+	free (sub);
+      }
+  closedir (dir);
+
+  int fd = open (name, O_RDWR);
+  char c;
+  CHECK (fd >= 0 && pread (fd, &c, 1, 100) == 1);
+  c ^= 1;
+  CHECK (pwrite (fd, &c, 1, 100) == 1);
+  close (fd);
+  free (name);
+}
+
+int
+main (int argc, char **argv)
+{
+  char *archive = check_file_name ("a.pax");
+  char *store = check_file_name ("store");
+  char *data = ximalloc (DATA_SIZE);
+  uint_least32_t r = 1;
+
+  /* Random data, with a long stretch repeated */
+  for (idx_t i = 0; i < DATA_SIZE; i++)
+    {
+      r = r * 1103515245 + 12345;
+      data[i] = r >> 16;
+    }
+  memcpy (data + 2 * 1024 * 1024, data + 100, 1024 * 1024);
+
+  write_archive (archive, store, data, DATA_SIZE);
+  CHECK (read_archive (archive, store, 0, data, DATA_SIZE));
+  CHECK (read_archive (archive, store, 121 * 10240, data, DATA_SIZE));
+
+  damage_chunk (store);
+  CHECK (!read_archive (archive, store, 0, data, DATA_SIZE));
+
+  free (data);
+  free (archive);
+  free (store);
+  return check_status ();
+}
@@ -0,0 +1,123 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Header encoding.  Members encoded in each format must decode back to
+   what was encoded, with a valid checksum; the fields a format cannot
+   hold must be reported, and owner names must end with a null.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+static enum archive_format const formats[] =
+  { V7_FORMAT, OLDGNU_FORMAT, GNU_FORMAT, USTAR_FORMAT, POSIX_FORMAT };
+
+/* Encode ST in FORMAT, decode it back into OUT, and check that the two
+   agree.  Return the fields that did not fit.  A POSIX header other
+   than an extended one reads as ustar.  */
+static int
+round_trip (struct tar_stat_info *st, enum archive_format format,
+	    struct tar_stat_info *out)
+{
+  union block blk;
+  int overflow = pax_encode_header (&blk, st, 0, format);
+  enum archive_format f;
+
+  CHECK (pax_decode_header (&blk, out, &f) == PAX_HEADER_SUCCESS);
+  CHECK (f == (format == GNU_FORMAT ? OLDGNU_FORMAT
+	       : format == POSIX_FORMAT ? USTAR_FORMAT : format));
+  if (!(overflow & PAX_ENCODE_NAME))
+    CHECK (strcmp (out->file_name, st->file_name) == 0);
+  CHECK (out->stat.st_mode == st->stat.st_mode);
+  if (!(overflow & PAX_ENCODE_UID))
+    CHECK (out->stat.st_uid == st->stat.st_uid);
+  if (!(overflow & PAX_ENCODE_SIZE))
+    CHECK (out->archive_file_size == st->archive_file_size);
+  if (!(overflow & PAX_ENCODE_MTIME))
+    CHECK (out->stat.st_mtime == st->stat.st_mtime);
+  if (format != V7_FORMAT && !(overflow & PAX_ENCODE_UNAME))
+    CHECK (strcmp (out->uname, st->uname) == 0);
+  return overflow;
+}
+
+int
+main (int argc, char **argv)
+{
+  struct tar_stat_info st, out;
+  union block blk;
+  char name[160];
+
+  pax_stat_init (&st);
+  pax_stat_init (&out);
+  st.file_name = (char *) "dir/file";
+  st.uname = (char *) "user";
+  st.gname = (char *) "group";
+  st.stat.st_mode = S_IFREG | 0640;
+  st.stat.st_uid = 1000;
+  st.stat.st_gid = 100;
+  st.stat.st_mtime = 1700000000;
+  st.archive_file_size = 12345;
+
+  for (int i = 0; i < sizeof formats / sizeof *formats; i++)
+    CHECK (round_trip (&st, formats[i], &out) == 0);
+
+  /* Numbers beyond the octal range go in base-256 in the GNU formats
+     only */
+  st.stat.st_uid = 1 << 30;
+  st.archive_file_size = (off_t) 1 << 36;
+  st.stat.st_mtime = -1;
+  for (int i = 0; i < sizeof formats / sizeof *formats; i++)
+    if (formats[i] == OLDGNU_FORMAT || formats[i] == GNU_FORMAT)
+      CHECK (round_trip (&st, formats[i], &out) == 0);
+    else
+      CHECK (pax_encode_header (&blk, &st, 0, formats[i])
+	     == (PAX_ENCODE_UID | PAX_ENCODE_SIZE | PAX_ENCODE_MTIME));
+  st.stat.st_uid = 1000;
+  st.archive_file_size = 0;
+  st.stat.st_mtime = 1700000000;
+
+  /* A long name is split at a slash in the ustar formats */
+  memset (name, 'a', sizeof name - 1);
+  name[sizeof name - 1] = '\0';
+  name[70] = '/';
+  st.file_name = name;
+  CHECK (round_trip (&st, USTAR_FORMAT, &out) == 0);
+  CHECK (round_trip (&st, GNU_FORMAT, &out) == PAX_ENCODE_NAME);
+  st.file_name = (char *) "dir/file";
+
+  /* An owner name that would fill its field is truncated, so that the
+     field keeps its null */
+  char uname[33];
+  memset (uname, 'u', 32);
+  uname[32] = '\0';
+  st.uname = uname + 1;
+  CHECK (round_trip (&st, GNU_FORMAT, &out) == 0);
+  st.uname = uname;
+  for (int i = 1; i < sizeof formats / sizeof *formats; i++)
+    {
+      CHECK (pax_encode_header (&blk, &st, 0, formats[i])
+	     == PAX_ENCODE_UNAME);
+      CHECK (blk.header.uname[sizeof blk.header.uname - 1] == '\0');
+      CHECK (pax_decode_header (&blk, &out, nullptr) == PAX_HEADER_SUCCESS);
+      CHECK (strcmp (out.uname, uname + 1) == 0);
+    }
+
+  pax_stat_destroy (&out);
+  return check_status ();
+}
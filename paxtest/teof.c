@@ -0,0 +1,133 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* The end of an archive.  A lone zero block does not end the archive,
+   only two in a row do; an archive that ends after a lone zero block is
+   read to the end.  The blocks and record padding after the end are
+   told to be zeros or not.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+/* Extract the archive NAME in the directory DIR, and return the
+   result.  */
+static int
+extract (char const *name, char const *dir)
+{
+  if (mkdir (dir, 0755) != 0 || chdir (dir) != 0)
+    error (EXIT_FAILURE, errno, "%s", dir);
+  paxbuf_t buf = check_archive_open (name);
+  pax_extract_t px;
+  CHECK (pax_extract_open (&px, buf, 2) == 0);
+  int rc = pax_extract_run (px);
+  pax_extract_destroy (&px);
+  check_archive_release (buf);
+  if (chdir (check_scratch ()) != 0)
+    error (EXIT_FAILURE, errno, "%s", check_scratch ());
+  return rc;
+}
+
+/* Return whether the rest of the record that holds the end of the
+   archive NAME, of one member of a single block, is zeros.  */
+static bool
+padding_zero_p (char const *name)
+{
+  paxbuf_t buf = check_archive_open (name);
+  union block blk[4];
+  idx_t n;
+
+  CHECK (paxbuf_read (buf, blk->buffer, sizeof blk, &n) != pax_io_failure
+	 && n == sizeof blk);
+  CHECK (pax_nonzero_block (blk, 4) == 0);
+  CHECK (pax_nonzero_block (blk + 2, 2) == 2);
+  CHECK (pax_end_of_archive_p (blk + 2, 2));
+  bool zero = paxbuf_record_zero_p (buf);
+  check_archive_release (buf);
+  return zero;
+}
+
+int
+main (int argc, char **argv)
+{
+  static char const zeros[BLOCKSIZE];
+  char *one = check_file_name ("one.tar");
+  char *two = check_file_name ("two.tar");
+  char *lone = check_file_name ("lone.tar");
+  char *last = check_file_name ("last.tar");
+  idx_t one_size, two_size, size;
+  check_archive_t ar;
+
+  if (chdir (check_scratch ()) != 0)
+    error (EXIT_FAILURE, errno, "%s", check_scratch ());
+  ar = check_archive_create (one);
+  check_archive_add (ar, "f1", REGTYPE, S_IFREG | 0644, nullptr, "one", 3);
+  check_archive_close (ar);
+  ar = check_archive_create (two);
+  check_archive_add (ar, "f2", REGTYPE, S_IFREG | 0644, nullptr, "two", 3);
+  check_archive_close (ar);
+  char *p1 = check_read_file (one, &one_size);
+  char *p2 = check_read_file (two, &two_size);
+  CHECK (p1 && one_size == 4 * BLOCKSIZE);
+  CHECK (p2 && two_size == 4 * BLOCKSIZE);
+
+  /* f1, a zero block, f2 and the end of the archive */
+  char *data = ximalloc (3 * BLOCKSIZE + two_size);
+  memcpy (data, p1, 2 * BLOCKSIZE);
+  memcpy (data + 2 * BLOCKSIZE, zeros, BLOCKSIZE);
+  memcpy (data + 3 * BLOCKSIZE, p2, two_size);
+  check_write_file (lone, data, 3 * BLOCKSIZE + two_size);
+
+  /* f1 and a single zero block */
+  check_write_file (last, p1, 3 * BLOCKSIZE);
+
+  CHECK (extract (lone, "lone") == 0);
+  char *f = check_read_file ("lone/f1", &size);
+  CHECK (f && size == 3 && memcmp (f, "one", 3) == 0);
+  free (f);
+  f = check_read_file ("lone/f2", &size);
+  CHECK (f && size == 3 && memcmp (f, "two", 3) == 0);
+  free (f);
+
+  CHECK (extract (last, "last") == 0);
+  f = check_read_file ("last/f1", &size);
+  CHECK (f && size == 3 && memcmp (f, "one", 3) == 0);
+  free (f);
+
+  /* f1, padded to a whole record, with or without garbage in the
+     padding */
+  data = xirealloc (data, 20 * BLOCKSIZE);
+  memset (data, 0, 20 * BLOCKSIZE);
+  memcpy (data, p1, one_size);
+  check_write_file (last, data, 20 * BLOCKSIZE);
+  CHECK (padding_zero_p (last));
+  data[19 * BLOCKSIZE + 7] = 1;
+  check_write_file (last, data, 20 * BLOCKSIZE);
+  CHECK (!padding_zero_p (last));
+  CHECK (extract (last, "garbage") == 0);
+
+  free (data);
+  free (p1);
+  free (p2);
+  free (one);
+  free (two);
+  free (lone);
+  free (last);
+  return check_status ();
+}
@@ -0,0 +1,131 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Extraction of a hostile archive, whose symbolic links lead out of the
+   extraction directory and whose later members go through them.  Nothing
+   may be written outside, and the links must be there at the end.
+   Member names and hard link targets are normalized, and those with a
+   ".." component are refused.  Members going through a link within the
+   directory wait for it, and end up where it leads.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+static bool
+link_is (char const *name, char const *target)
+{
+  char buf[PATH_MAX];
+  ptrdiff_t n = readlink (name, buf, sizeof buf - 1);
+  if (n < 0)
+    return false;
+  buf[n] = '\0';
+  return strcmp (buf, target) == 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  char *out = check_file_name ("out");
+  char *work = check_file_name ("work");
+  char *archive = check_file_name ("hostile.tar");
+  char *out_x = check_file_name ("out/x");
+  char *out_y = check_file_name ("out/y");
+  char *up = check_file_name ("up");
+  struct stat st1, st2;
+  char name[32], target[32];
+  idx_t size;
+
+  if (mkdir (out, 0755) != 0 || mkdir (work, 0755) != 0)
+    error (EXIT_FAILURE, errno, "mkdir");
+
+  check_archive_t ar = check_archive_create (archive);
+  check_archive_add (ar, "a", SYMTYPE, S_IFLNK | 0777, out, nullptr, 0);
+  check_archive_add (ar, "a/x", REGTYPE, S_IFREG | 0644, nullptr,
+		     "escaped\n", 8);
+  check_archive_add (ar, "b", SYMTYPE, S_IFLNK | 0777, "../out", nullptr, 0);
+  check_archive_add (ar, "b/y", REGTYPE, S_IFREG | 0644, nullptr,
+		     "escaped\n", 8);
+  check_archive_add (ar, "d/", DIRTYPE, S_IFDIR | 0755, nullptr, nullptr, 0);
+  check_archive_add (ar, "c", SYMTYPE, S_IFLNK | 0777, "d", nullptr, 0);
+  check_archive_add (ar, "e", SYMTYPE, S_IFLNK | 0777, "/", nullptr, 0);
+  check_archive_add (ar, "e", REGTYPE, S_IFREG | 0644, nullptr,
+		     "replaced\n", 9);
+  check_archive_add (ar, ".//f//g/./h", REGTYPE, S_IFREG | 0644, nullptr,
+		     "normal\n", 7);
+  check_archive_add (ar, "/abs", REGTYPE, S_IFREG | 0644, nullptr,
+		     "normal\n", 7);
+  check_archive_add (ar, "f/../../up", REGTYPE, S_IFREG | 0644, nullptr,
+		     "escaped\n", 8);
+  check_archive_add (ar, "hl", LNKTYPE, S_IFREG | 0644, "./f/g//h",
+		     nullptr, 0);
+  check_archive_add (ar, "hl2", LNKTYPE, S_IFREG | 0644, "f/../../up",
+		     nullptr, 0);
+  for (int i = 0; i < 1000; i++)
+    {
+      sprintf (name, "s%d", i);
+      check_archive_add (ar, name, SYMTYPE, S_IFLNK | 0777, "d", nullptr, 0);
+      sprintf (name, "s%d/f%d", i, i);
+      check_archive_add (ar, name, REGTYPE, S_IFREG | 0644, nullptr,
+			 "through\n", 8);
+    }
+  check_archive_close (ar);
+
+  if (chdir (work) != 0)
+    error (EXIT_FAILURE, errno, "%s", work);
+  paxbuf_t buf = check_archive_open (archive);
+  pax_extract_t px;
+  CHECK (pax_extract_open (&px, buf, 2) == 0);
+  CHECK (pax_extract_run (px) == 0);
+  pax_extract_destroy (&px);
+  check_archive_release (buf);
+
+  CHECK (access (out_x, F_OK) != 0);
+  CHECK (access (out_y, F_OK) != 0);
+  CHECK (link_is ("a", out));
+  CHECK (link_is ("b", "../out"));
+  CHECK (link_is ("c", "d"));
+  char *e = check_read_file ("e", &size);
+  CHECK (e && size == 9 && memcmp (e, "replaced\n", 9) == 0);
+  free (e);
+  e = check_read_file ("f/g/h", &size);
+  CHECK (e && size == 7 && memcmp (e, "normal\n", 7) == 0);
+  free (e);
+  e = check_read_file ("abs", &size);
+  CHECK (e && size == 7 && memcmp (e, "normal\n", 7) == 0);
+  CHECK (access (up, F_OK) != 0);
+  CHECK (stat ("f/g/h", &st1) == 0 && stat ("hl", &st2) == 0
+	 && st1.st_ino == st2.st_ino && st1.st_dev == st2.st_dev);
+  CHECK (access ("hl2", F_OK) != 0);
+  for (int i = 0; i < 1000; i++)
+    {
+      sprintf (name, "s%d", i);
+      sprintf (target, "d/f%d", i);
+      CHECK (link_is (name, "d") && access (target, F_OK) == 0);
+    }
+
+  free (e);
+  free (out);
+  free (work);
+  free (archive);
+  free (out_x);
+  free (out_y);
+  free (up);
+  return check_status ();
+}
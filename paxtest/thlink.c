@@ -0,0 +1,117 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Tables of hard links.  A table allowed a few kilobytes of memory
+   spills most of its records to its file; it must then answer as one
+   that keeps them all in memory.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+#include <hlink.h>
+
+enum
+  {
+    LINKS = 20000,
+    LIMIT = 4096,               /* Memory for the records of the table */
+    LONG_NAME = 3 * LIMIT       /* A name longer than that */
+  };
+
+/* Store in BUF the name recorded for key K */
+static char *
+link_name (char *buf, int k)
+{
+  sprintf (buf, "dir%d/file%d", k % 37, k);
+  return buf;
+}
+
+/* Check that H gives the names recorded for the keys 0 to N - 1, none
+   for key N, and LONG_NAME for key -1.  */
+static void
+check_table (pax_hlink_t h, int n, char const *long_name)
+{
+  char buf[64];
+  char const *p;
+
+  for (int k = 0; k < n; k++)
+    {
+      p = pax_hlink_find (h, &k, sizeof k);
+      CHECK (p && strcmp (p, link_name (buf, k)) == 0);
+    }
+  CHECK (!pax_hlink_find (h, &n, sizeof n));
+  int k = -1;
+  p = pax_hlink_find (h, &k, sizeof k);
+  CHECK (p && strcmp (p, long_name) == 0);
+  CHECK (pax_hlink_count (h) == n + 1);
+}
+
+int
+main (int argc, char **argv)
+{
+  pax_hlink_t small = pax_hlink_create (LIMIT);
+  pax_hlink_t all = pax_hlink_create (0);
+  char *long_name = ximalloc (LONG_NAME + 1);
+  char buf[64];
+  int k;
+
+  memset (long_name, 'x', LONG_NAME);
+  long_name[LONG_NAME] = '\0';
+  for (k = 0; k < LINKS; k++)
+    {
+      link_name (buf, k);
+      CHECK (!pax_hlink_add (small, &k, sizeof k, buf));
+      CHECK (!pax_hlink_add (all, &k, sizeof k, buf));
+
+      /* A record larger than the limit, in the middle of the others */
+      if (k == LINKS / 2)
+	{
+	  int key = -1;
+	  CHECK (!pax_hlink_add (small, &key, sizeof key, long_name));
+	  CHECK (!pax_hlink_add (all, &key, sizeof key, long_name));
+	}
+    }
+  check_table (small, LINKS, long_name);
+  check_table (all, LINKS, long_name);
+
+  /* Adding a key again gives the name it had, and records nothing */
+  k = 12;
+  char const *p = pax_hlink_add (small, &k, sizeof k, "other");
+  CHECK (p && strcmp (p, link_name (buf, k)) == 0);
+  k = LINKS - 1;
+  p = pax_hlink_add (small, &k, sizeof k, "other");
+  CHECK (p && strcmp (p, link_name (buf, k)) == 0);
+  CHECK (pax_hlink_count (small) == LINKS + 1);
+
+  /* Files are keyed by device and inode numbers */
+  struct stat st1 = { .st_dev = 1, .st_ino = 2 };
+  struct stat st2 = { .st_dev = 1, .st_ino = 2, .st_nlink = 2 };
+  struct stat st3 = { .st_dev = 2, .st_ino = 2 };
+  CHECK (!pax_hlink_add_stat (small, &st1, "a"));
+  p = pax_hlink_find_stat (small, &st2);
+  CHECK (p && strcmp (p, "a") == 0);
+  CHECK (!pax_hlink_find_stat (small, &st3));
+  p = pax_hlink_add_stat (small, &st2, "b");
+  CHECK (p && strcmp (p, "a") == 0);
+
+  pax_hlink_destroy (&small);
+  pax_hlink_destroy (&all);
+  CHECK (!small && !all);
+  free (long_name);
+  return check_status ();
+}
@@ -0,0 +1,223 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Selection of members by patterns.  Random sets of patterns are
+   compiled and tested against random names, and the results compared
+   with those of trying each pattern in turn with fnmatch, as tar
+   does.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+#include <fnmatch.h>
+#include <match.h>
+
+enum
+  {
+    ROUNDS = 20000,             /* Pattern sets tried */
+    MAX_PATTERNS = 4,           /* Patterns in a set */
+    NAMES = 40,                 /* Names tested against each set */
+    MAX_LEN = 8                 /* Length of patterns and names */
+  };
+
+/* A fixed generator, so that failures can be reproduced */
+static uint_least32_t seed = 1;
+
+static unsigned
+rnd (unsigned n)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % n;
+}
+
+/* Store in BUF a random string of 1 to MAX_LEN characters from
+   ALPHABET.  */
+static void
+random_string (char *buf, char const *alphabet)
+{
+  idx_t n = strlen (alphabet);
+  idx_t len = 1 + rnd (MAX_LEN);
+
+  for (idx_t i = 0; i < len; i++)
+    buf[i] = alphabet[rnd (n)];
+  buf[len] = '\0';
+}
+
+/* Return true if PATTERN has a '[' that starts no bracket expression.
+   POSIX has it match itself, but some versions of fnmatch match
+   nothing then.  */
+static bool
+unterminated_bracket (char const *pattern)
+{
+  for (char const *p = pattern; *p; p++)
+    if (*p == '\\' && p[1])
+      p++;
+    else if (*p == '[')
+      {
+	char const *q = p + 1;
+	if (*q == '!' || *q == '^')
+	  q++;
+	if (*q == ']')
+	  q++;
+	for (; *q != ']'; q++)
+	  {
+	    if (!*q)
+	      return true;
+	    if (*q == '\\' && q[1])
+	      q++;
+	    else if (*q == '[' && (q[1] == ':' || q[1] == '.' || q[1] == '='))
+	      {
+		/* A class or collating symbol, whose name is not empty */
+		char const *end = nullptr;
+		if (q[2])
+		  end = strstr (q + 3, (char const []) { q[1], ']', 0 });
+		if (!end)
+		  return true;
+		q = end + 1;
+	      }
+	  }
+	p = q;
+      }
+  return false;
+}
+
+struct pattern
+{
+  char str[MAX_LEN + 1];
+  int flags;
+};
+
+/* Return true if PATTERN, with FLAGS, matches NAME at its start */
+static bool
+match_at (char const *pattern, int flags, char const *name)
+{
+  if (flags & PAX_MATCH_LITERAL)
+    {
+      idx_t len = strlen (pattern);
+      return (strncmp (pattern, name, len) == 0
+	      && (name[len] == '\0' || name[len] == '/'));
+    }
+  return fnmatch (pattern, name, FNM_LEADING_DIR) == 0;
+}
+
+/* Return true if the pattern P matches NAME, as tar would find */
+static bool
+pattern_match (struct pattern const *p, char const *name)
+{
+  char pattern[MAX_LEN + 1];
+  idx_t len = strlen (p->str);
+
+  /* Trailing slashes are ignored, unless quoted */
+  memcpy (pattern, p->str, len + 1);
+  while (len > 1 && pattern[len - 1] == '/'
+	 && ((p->flags & PAX_MATCH_LITERAL) || pattern[len - 2] != '\\'))
+    pattern[--len] = '\0';
+
+  if (match_at (pattern, p->flags, name))
+    return true;
+  if (p->flags & PAX_MATCH_UNANCHORED)
+    for (char const *s = name; (s = strchr (s, '/')); )
+      if (match_at (pattern, p->flags, ++s))
+	return true;
+  return false;
+}
+
+/* Return true if NAME is selected by the N patterns P */
+static bool
+selected (struct pattern const *p, int n, char const *name)
+{
+  bool include = false, any_include = false;
+
+  for (int i = 0; i < n; i++)
+    if (pattern_match (&p[i], name))
+      {
+	if (p[i].flags & PAX_MATCH_EXCLUDE)
+	  return false;
+	include = true;
+      }
+    else if (! (p[i].flags & PAX_MATCH_EXCLUDE))
+      any_include = true;
+  return include || !any_include;
+}
+
+int
+main (int argc, char **argv)
+{
+  static char const pattern_chars[] = "ab/*?[]!^-.\\";
+  static char const name_chars[] = "ab/*[]^-.\\";
+  int failures = 0;
+
+  for (int round = 0; round < ROUNDS && failures < 10; round++)
+    {
+      struct pattern p[MAX_PATTERNS];
+      int n = 1 + rnd (MAX_PATTERNS);
+      pax_match_t m = pax_match_create ();
+
+      for (int i = 0; i < n; i++)
+	{
+	  do
+	    random_string (p[i].str, pattern_chars);
+	  while (unterminated_bracket (p[i].str));
+	  p[i].flags = (rnd (3) == 0 ? PAX_MATCH_EXCLUDE : 0)
+	    | (rnd (2) ? PAX_MATCH_UNANCHORED : 0)
+	    | (rnd (4) == 0 ? PAX_MATCH_LITERAL : 0);
+	  pax_match_add (m, p[i].str, p[i].flags);
+	}
+      CHECK (pax_match_compile (m) == 0);
+
+      for (int j = 0; j < NAMES; j++)
+	{
+	  char name[MAX_LEN + 1];
+
+	  /* Use the patterns as names too, which makes matches likely */
+	  if (rnd (4) == 0)
+	    strcpy (name, p[rnd (n)].str);
+	  else
+	    random_string (name, name_chars);
+	  bool want = selected (p, n, name);
+	  if (pax_match_p (m, name) != want)
+	    {
+	      fprintf (stderr, "\"%s\" should %sbe selected by", name,
+		       want ? "" : "not ");
+	      for (int i = 0; i < n; i++)
+		fprintf (stderr, " \"%s\" (%#x)", p[i].str, p[i].flags);
+	      fputc ('\n', stderr);
+	      failures++;
+	    }
+	}
+      pax_match_destroy (&m);
+    }
+  CHECK (failures == 0);
+
+  /* A '[' that starts no bracket expression matches itself */
+  pax_match_t m = pax_match_create ();
+  pax_match_add (m, "a[b", 0);
+  pax_match_add (m, "*[!]c", 0);
+  pax_match_add (m, "d[", PAX_MATCH_UNANCHORED);
+  CHECK (pax_match_compile (m) == 0);
+  CHECK (pax_match_p (m, "a[b"));
+  CHECK (pax_match_p (m, "a[b/x"));
+  CHECK (!pax_match_p (m, "ab"));
+  CHECK (pax_match_p (m, "x[!]c"));
+  CHECK (!pax_match_p (m, "xc"));
+  CHECK (pax_match_p (m, "x/d["));
+  CHECK (!pax_match_p (m, "x/d"));
+  pax_match_destroy (&m);
+  return check_status ();
+}
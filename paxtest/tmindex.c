@@ -0,0 +1,201 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Member indexes.  An index is written for an archive of members added
+   out of order, some of them twice; it is read back, looked up, used to
+   position the archive, and rejected once damaged.  Then one is built
+   by the creation pipeline while it writes an archive.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+#include <mindex.h>
+
+enum { MEMBERS = 1000 };
+
+/* Seek BUF to the member NAME found in IDX, of the given TYPE and SIZE,
+   and check that its first header is there, named HEADER_NAME.  */
+static void
+check_member (pax_mindex_t idx, paxbuf_t buf, char const *name, char type,
+	      off_t size, char const *header_name)
+{
+  struct pax_mindex_entry ent;
+  union block blk;
+  idx_t n;
+
+  CHECK (pax_mindex_seek (idx, buf, name, &ent) == 0);
+  CHECK (ent.type == type && ent.size == size);
+  /* The last record of the archive comes with its end reported */
+  CHECK (paxbuf_read (buf, blk.buffer, BLOCKSIZE, &n) != pax_io_failure
+	 && n == BLOCKSIZE);
+  CHECK (strcmp (blk.header.name, header_name) == 0);
+}
+
+/* Archive a few files through the creation pipeline, with an index,
+   and look them up in it.  */
+static void
+check_create (void)
+{
+  char *archive = check_file_name ("c.tar");
+  char *index = check_file_name ("c.idx");
+  char long_name[160];
+  char data[1000] = { 0 };
+  paxbuf_t buf;
+  pax_create_t pc;
+  pax_mindex_t idx = pax_mindex_create ();
+
+  if (chdir (check_scratch ()) != 0 || mkdir ("d", 0755) != 0)
+    error (EXIT_FAILURE, errno, "%s", check_scratch ());
+  check_write_file ("d/a", data, sizeof data);
+  strcpy (long_name, "d/");
+  memset (long_name + 2, 'l', sizeof long_name - 3);
+  long_name[sizeof long_name - 1] = '\0';
+  check_write_file (long_name, data, 10);
+
+  tar_archive_create (&buf, archive, 0, PAXBUF_WRITE | PAXBUF_CREAT, 20);
+  CHECK (paxbuf_open (buf) == 0);
+  CHECK (pax_create_open (&pc, buf, GNU_FORMAT, 2) == 0);
+  pax_create_set_mindex (pc, idx);
+  CHECK (pax_create_add (pc, "d", nullptr) == 0);
+  CHECK (pax_create_add (pc, "d/a", nullptr) == 0);
+  CHECK (pax_create_add (pc, long_name, nullptr) == 0);
+  CHECK (pax_create_finish (pc) == 0);
+  pax_create_destroy (&pc);
+  CHECK (paxbuf_close (buf) == 0);
+  paxbuf_destroy (&buf);
+  CHECK (pax_mindex_write (idx, index) == 0);
+  pax_mindex_destroy (&idx);
+
+  CHECK (pax_mindex_open (&idx, index) == 0);
+  CHECK (pax_mindex_count (idx) == 3);
+  buf = check_archive_open (archive);
+  check_member (idx, buf, "d/", DIRTYPE, 0, "d/");
+  check_member (idx, buf, "d/a", REGTYPE, sizeof data, "d/a");
+  /* A long name is indexed at the header holding it */
+  check_member (idx, buf, long_name, REGTYPE, 10, "././@LongLink");
+  check_archive_release (buf);
+  pax_mindex_destroy (&idx);
+  free (archive);
+  free (index);
+}
+
+int
+main (int argc, char **argv)
+{
+  char *archive = check_file_name ("m.tar");
+  char *index = check_file_name ("m.idx");
+  pax_mindex_t idx = pax_mindex_create ();
+  struct pax_mindex_entry ent;
+  check_archive_t ar = check_archive_create (archive);
+  off_t offset = 0;
+  off_t last[MEMBERS];
+  char name[32];
+
+  /* Members f0000 to f0999 in a scrambled order, with the last 100
+     added again, each with its number as data.  */
+  for (int i = 0; i < MEMBERS + 100; i++)
+    {
+      int k = i < MEMBERS ? i * 7 % MEMBERS : MEMBERS - 1 - (i - MEMBERS);
+      int len = sprintf (name, "f%04d", k);
+      check_archive_add (ar, name, REGTYPE, S_IFREG | 0644, nullptr,
+			 name, len);
+      pax_mindex_add (idx, name, offset, len, REGTYPE);
+      last[k] = offset;
+      offset += 2 * BLOCKSIZE;
+    }
+  check_archive_close (ar);
+  CHECK (pax_mindex_write (idx, index) == 0);
+  pax_mindex_destroy (&idx);
+
+  CHECK (pax_mindex_open (&idx, index) == 0);
+  CHECK (pax_mindex_count (idx) == MEMBERS + 100);
+
+  /* The entries are in name order, then in archive order */
+  struct pax_mindex_entry prev = { 0 };
+  for (idx_t n = 0; n < pax_mindex_count (idx); n++)
+    {
+      CHECK (pax_mindex_entry (idx, n, &ent));
+      if (n > 0)
+	{
+	  int rc = memcmp (prev.name, ent.name, 5);
+	  CHECK (rc < 0 || (rc == 0 && prev.offset < ent.offset));
+	}
+      CHECK (ent.name_len == 5 && ent.size == 5 && ent.type == REGTYPE);
+      prev = ent;
+    }
+  CHECK (!pax_mindex_entry (idx, pax_mindex_count (idx), &ent));
+
+  /* A lookup finds the last member of a name */
+  for (int k = 0; k < MEMBERS; k++)
+    {
+      sprintf (name, "f%04d", k);
+      CHECK (pax_mindex_lookup (idx, name, &ent) && ent.offset == last[k]);
+    }
+  CHECK (!pax_mindex_lookup (idx, "f", &ent));
+  CHECK (!pax_mindex_lookup (idx, "f00000", &ent));
+  CHECK (!pax_mindex_lookup (idx, "g", &ent));
+
+  /* Seeking positions the archive at the header of the member */
+  paxbuf_t buf = check_archive_open (archive);
+  for (int k = 0; k < MEMBERS; k += 97)
+    {
+      union block blk;
+      idx_t n;
+
+      sprintf (name, "f%04d", k);
+      CHECK (pax_mindex_seek (idx, buf, name, &ent) == 0);
+      CHECK (paxbuf_read (buf, blk.buffer, BLOCKSIZE, &n) == pax_io_success
+	     && n == BLOCKSIZE);
+      CHECK (strcmp (blk.header.name, name) == 0);
+      CHECK (paxbuf_read (buf, blk.buffer, BLOCKSIZE, &n) == pax_io_success
+	     && n == BLOCKSIZE);
+      CHECK (memcmp (blk.buffer, name, 5) == 0);
+    }
+  CHECK (pax_mindex_seek (idx, buf, "nonesuch", &ent) == ENOENT);
+  check_archive_release (buf);
+  pax_mindex_destroy (&idx);
+
+  /* Damaged indexes are rejected */
+  idx_t size;
+  char *data = check_read_file (index, &size);
+  CHECK (data != nullptr);
+  check_write_file (index, data, 31);
+  CHECK (pax_mindex_open (&idx, index) == EINVAL);
+  data[0] ^= 1;
+  check_write_file (index, data, size);
+  CHECK (pax_mindex_open (&idx, index) == EINVAL);
+  data[0] ^= 1;
+  check_write_file (index, data, size - 1);
+  CHECK (pax_mindex_open (&idx, index) == EINVAL);
+
+  /* So are entries whose names lie outside the name area */
+  data[32 + 16 + 7] = 0x7f;
+  check_write_file (index, data, size);
+  CHECK (pax_mindex_open (&idx, index) == 0);
+  CHECK (!pax_mindex_entry (idx, 0, &ent));
+  CHECK (pax_mindex_entry (idx, 1, &ent));
+  pax_mindex_destroy (&idx);
+
+  free (data);
+  free (archive);
+  free (index);
+
+  check_create ();
+  return check_status ();
+}
@@ -0,0 +1,218 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Checksums on the rmt link.  Records written and read in checksum mode
+   must get through a link damaging them, each damaged record alone
+   being sent again; a record damaged every time must fail, and a server
+   without the checksum mode must be used without it.
+
+   The remote shell is this program itself.  Run with a host name and
+   the command of the server, it runs RMT_PROGRAM, the server of this
+   package, and relays between the two, damaging records as the host
+   name says.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+enum { RECORD_SIZE = 10 * BLOCKSIZE, NRECORDS = 4 };
+
+static char records[NRECORDS][RECORD_SIZE];
+
+/* What the link does to the records it carries */
+enum link_damage
+  {
+    DAMAGE_ONCE,              /* Damage the first record each way */
+    DAMAGE_ALWAYS,            /* Damage every record */
+    DAMAGE_OLD                /* Stand for a server without checksums */
+  };
+
+/* Copy the commands or replies read from IN to OUT, with the data
+   after those starting with KIND, W or A.  Damage the data that carry a
+   checksum as DAMAGE says.  */
+static void
+relay (FILE *in, FILE *out, char kind, enum link_damage damage)
+{
+  char line[1024];
+  bool message = false;       /* The line is the message of an error */
+  bool damaged = false;
+
+  while (fgets (line, sizeof line, in))
+    {
+      bool checked = !message && strchr (line, ' ');
+      bool data = !message && line[0] == kind && (kind == 'W' || checked);
+
+      if (damage == DAMAGE_OLD)
+	{
+	  /* Such a server exits on the command, and the client must not
+	     send checksums after that */
+	  if (line[0] == 'K' || (data && checked))
+	    exit (line[0] == 'K' ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+      message = !message && line[0] == 'E';
+      fputs (line, out);
+      if (data)
+	{
+	  idx_t size = strtol (line + 1, nullptr, 10);
+	  char *buf = ximalloc (size);
+	  if (fread (buf, 1, size, in) != size)
+	    exit (EXIT_FAILURE);
+	  if (checked && size > 0 && (damage == DAMAGE_ALWAYS || !damaged))
+	    {
+	      buf[size / 2] ^= 1;
+	      damaged = true;
+	    }
+	  fwrite (buf, 1, size, out);
+	  free (buf);
+	}
+      fflush (out);
+    }
+}
+
+/* Run as the remote shell, for HOST: run the server COMMAND and relay
+   between it and the client.  */
+static int
+remote_shell (char const *host, char const *command)
+{
+  enum link_damage damage = (strcmp (host, "once") == 0 ? DAMAGE_ONCE
+			     : strcmp (host, "always") == 0 ? DAMAGE_ALWAYS
+			     : DAMAGE_OLD);
+  /* Replies from a server standing for an old one are not relayed */
+  bool replies = damage != DAMAGE_OLD;
+  int to[2], from[2];
+  pid_t pid;
+
+  if (pipe (to) != 0 || (replies && pipe (from) != 0))
+    error (EXIT_FAILURE, errno, "pipe");
+  pid = fork ();
+  if (pid < 0)
+    error (EXIT_FAILURE, errno, "fork");
+  if (pid == 0)
+    {
+      if (dup2 (to[0], STDIN_FILENO) < 0
+	  || (replies && dup2 (from[1], STDOUT_FILENO) < 0))
+	error (EXIT_FAILURE, errno, "dup2");
+      close (to[0]);
+      close (to[1]);
+      if (replies)
+	{
+	  close (from[0]);
+	  close (from[1]);
+	}
+      execl (command, command, nullptr);
+      error (EXIT_FAILURE, errno, "%s", command);
+    }
+  close (to[0]);
+
+  if (replies)
+    {
+      close (from[1]);
+      pid = fork ();
+      if (pid < 0)
+	error (EXIT_FAILURE, errno, "fork");
+      if (pid == 0)
+	{
+	  close (to[1]);
+	  relay (fdopen (from[0], "r"), stdout, 'A', damage);
+	  return EXIT_SUCCESS;
+	}
+      close (from[0]);
+    }
+  relay (stdin, fdopen (to[1], "w"), 'W', damage);
+  return EXIT_SUCCESS;
+}
+
+/* Open NAME through the link HOST, whose remote shell is SHELL */
+static int
+open_link (char const *shell, char const *host, char const *name,
+	   int flags)
+{
+  char *file = xmalloc (strlen (host) + strlen (name) + 2);
+  sprintf (file, "%s:%s", host, name);
+  int handle = rmt_open (file, flags, 0, shell, RMT_PROGRAM);
+  if (handle < 0)
+    error (EXIT_FAILURE, errno, "%s", file);
+  free (file);
+  return handle;
+}
+
+/* Write the records to NAME through the link HOST, and read them
+   back */
+static void
+check_link (char const *shell, char const *host, char const *name)
+{
+  char buf[RECORD_SIZE];
+  idx_t size;
+  int handle;
+
+  handle = open_link (shell, host, name, O_WRONLY | O_CREAT | O_TRUNC);
+  for (int i = 0; i < NRECORDS; i++)
+    CHECK (rmt_write (handle, records[i], RECORD_SIZE) == RECORD_SIZE);
+  CHECK (rmt_close (handle) == 0);
+  char *data = check_read_file (name, &size);
+  CHECK (data && size == sizeof records
+	 && memcmp (data, records, size) == 0);
+  free (data);
+
+  handle = open_link (shell, host, name, O_RDONLY);
+  for (int i = 0; i < NRECORDS; i++)
+    CHECK (rmt_read (handle, buf, RECORD_SIZE) == RECORD_SIZE
+	   && memcmp (buf, records[i], RECORD_SIZE) == 0);
+  CHECK (rmt_read (handle, buf, RECORD_SIZE) == 0);
+  CHECK (rmt_close (handle) == 0);
+}
+
+int
+main (int argc, char **argv)
+{
+  if (argc == 3 && strcmp (argv[2], RMT_PROGRAM) == 0)
+    return remote_shell (argv[1], argv[2]);
+
+  char const *shell = argv[0];
+  char *name = check_file_name ("tape");
+  char buf[RECORD_SIZE];
+  int handle;
+
+  for (int i = 0; i < NRECORDS; i++)
+    for (int j = 0; j < RECORD_SIZE; j++)
+      records[i][j] = i * 31 + j % 251;
+  rmt_checksum_option = true;
+
+  /* A damaged record is sent again, in either direction */
+  check_link (shell, "once", name);
+
+  /* A record damaged each time it is sent is not written, and cannot be
+     read */
+  handle = open_link (shell, "always", name, O_WRONLY | O_TRUNC);
+  CHECK (rmt_write (handle, records[0], RECORD_SIZE) == 0);
+  CHECK (rmt_close (handle) == 0);
+  idx_t size;
+  free (check_read_file (name, &size));
+  CHECK (size == 0);
+  check_write_file (name, records[0], RECORD_SIZE);
+  handle = open_link (shell, "always", name, O_RDONLY);
+  CHECK (rmt_read (handle, buf, RECORD_SIZE) < 0 && errno == EBADMSG);
+
+  /* A server that does not know the checksum mode is used without it */
+  check_link (shell, "old", name);
+  CHECK (rmt_checksum_option);
+
+  free (name);
+  return check_status ();
+}
@@ -0,0 +1,115 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Snapshots: of several changes to a directory before a write, the last
+   one must win, whatever order the sort leaves them in; and the
+   snapshot must read back the same once reopened.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+#include <snapshot.h>
+
+enum { NDIRS = 50, NUPDATES = 40 };
+
+static void
+update (pax_snapshot_t snap, int i, int version)
+{
+  char name[32], contents[32];
+  int len = sprintf (name, "dir/%d", i);
+  int clen = sprintf (contents, "Yfile%d", version) + 2;
+  contents[clen - 1] = '\0';
+  struct pax_snapshot_dir dir = {
+    .name = name, .name_len = len,
+    .dev = 1, .ino = 1000 + i,
+    .mtime = { version, 0 },
+    .contents = contents, .contents_len = clen
+  };
+  pax_snapshot_update (snap, &dir);
+}
+
+/* Return the version of the directory numbered I, or -1 if it is not
+   in SNAP.  */
+static int
+version (pax_snapshot_t snap, int i)
+{
+  char name[32];
+  struct pax_snapshot_dir dir;
+
+  sprintf (name, "dir/%d", i);
+  if (!pax_snapshot_lookup (snap, name, &dir))
+    return -1;
+  return dir.mtime.tv_sec;
+}
+
+int
+main (int argc, char **argv)
+{
+  char *file = check_file_name ("snap");
+  pax_snapshot_t snap;
+  int bad = 0;
+
+  CHECK (pax_snapshot_open (&snap, file) == 0);
+
+  /* Many updates of each directory, interleaved */
+  for (int v = 1; v <= NUPDATES; v++)
+    for (int i = 0; i < NDIRS; i++)
+      update (snap, i, v);
+  CHECK (pax_snapshot_write (snap) == 0);
+  for (int i = 0; i < NDIRS; i++)
+    bad += version (snap, i) != NUPDATES;
+  CHECK (bad == 0);
+
+  /* An update followed by a remove, and the other way round, in a new
+     segment */
+  update (snap, 0, 100);
+  pax_snapshot_remove (snap, "dir/0");
+  pax_snapshot_remove (snap, "dir/1");
+  update (snap, 1, 101);
+  for (int v = 200; v < 210; v++)
+    update (snap, 2, v);
+  pax_snapshot_remove (snap, "dir/3");
+  CHECK (pax_snapshot_write (snap) == 0);
+  CHECK (version (snap, 0) == -1);
+  CHECK (version (snap, 1) == 101);
+  CHECK (version (snap, 2) == 209);
+  CHECK (version (snap, 3) == -1);
+  CHECK (version (snap, 4) == NUPDATES);
+
+  /* The same once read back */
+  pax_snapshot_destroy (&snap);
+  CHECK (pax_snapshot_open (&snap, file) == 0);
+  CHECK (version (snap, 0) == -1);
+  CHECK (version (snap, 1) == 101);
+  CHECK (version (snap, 2) == 209);
+  CHECK (version (snap, 3) == -1);
+  bad = 0;
+  for (int i = 4; i < NDIRS; i++)
+    bad += version (snap, i) != NUPDATES;
+  CHECK (bad == 0);
+
+  struct pax_snapshot_dir dir;
+  CHECK (pax_snapshot_lookup_inode (snap, 1, 1002, &dir)
+	 && dir.name_len == 5 && memcmp (dir.name, "dir/2", 5) == 0);
+  CHECK (!pax_snapshot_lookup_inode (snap, 1, 1003, &dir));
+
+  pax_snapshot_destroy (&snap);
+  free (file);
+  return check_status ();
+}
@@ -0,0 +1,138 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Sparse members.  A member whose sparse map asks for more data than
+   the member holds is skipped, and the members after it are still
+   read.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+/* Append to the archive AR an extended header for NAME giving it the
+   sparse map MAP of a file of SIZE bytes.  */
+static void
+add_sparse_header (check_archive_t ar, char const *name,
+		   char const *map, char const *size)
+{
+  char recs[2 * BLOCKSIZE];
+  idx_t len = 0;
+  char const *kv[][2] = { { "GNU.sparse.size", size },
+			  { "GNU.sparse.map", map } };
+
+  for (int i = 0; i < 2; i++)
+    {
+      /* The length of a record counts its own digits */
+      int n = strlen (kv[i][0]) + strlen (kv[i][1]) + 3;
+      int digits = n < 8 ? 1 : n < 97 ? 2 : 3;
+      len += sprintf (recs + len, "%d %s=%s\n",
+		      n + digits, kv[i][0], kv[i][1]);
+    }
+  char *xname = ximalloc (strlen (name) + sizeof "PaxHeaders/");
+  sprintf (xname, "PaxHeaders/%s", name);
+  check_archive_add (ar, xname, XHDTYPE, S_IFREG | 0644, nullptr,
+		     recs, len);
+  free (xname);
+}
+
+/* Run the archive NAME through extraction in the directory DIR, or
+   verification if VERIFY, and return the result.  */
+static int
+run (char const *name, char const *dir, bool verify)
+{
+  if (chdir (dir) != 0)
+    error (EXIT_FAILURE, errno, "%s", dir);
+  paxbuf_t buf = check_archive_open (name);
+  int rc;
+  if (verify)
+    {
+      pax_verify_t pv;
+      CHECK (pax_verify_open (&pv, buf, 2) == 0);
+      rc = pax_verify_run (pv);
+      pax_verify_destroy (&pv);
+    }
+  else
+    {
+      pax_extract_t px;
+      CHECK (pax_extract_open (&px, buf, 2) == 0);
+      rc = pax_extract_run (px);
+      pax_extract_destroy (&px);
+    }
+  check_archive_release (buf);
+  if (chdir (check_scratch ()) != 0)
+    error (EXIT_FAILURE, errno, "%s", check_scratch ());
+  return rc;
+}
+
+int
+main (int argc, char **argv)
+{
+  char *name = check_file_name ("sparse.tar");
+  char data[2 * BLOCKSIZE];
+  idx_t size;
+  check_archive_t ar;
+
+  if (chdir (check_scratch ()) != 0)
+    error (EXIT_FAILURE, errno, "%s", check_scratch ());
+  memset (data, 'a', BLOCKSIZE);
+  memset (data + BLOCKSIZE, 'b', BLOCKSIZE);
+
+  ar = check_archive_create (name);
+  /* A good map: 512 bytes at 0 and 512 bytes at 2048 */
+  add_sparse_header (ar, "good", "0,512,2048,512", "4096");
+  check_archive_add (ar, "good", REGTYPE, S_IFREG | 0644, nullptr,
+		     data, 2 * BLOCKSIZE);
+  /* A map asking for far more than the 512 bytes of the member */
+  add_sparse_header (ar, "bad", "0,512,2048,1000000", "1002048");
+  check_archive_add (ar, "bad", REGTYPE, S_IFREG | 0644, nullptr,
+		     data, BLOCKSIZE);
+  /* A map whose regions are out of order */
+  add_sparse_header (ar, "order", "2048,256,0,256", "4096");
+  check_archive_add (ar, "order", REGTYPE, S_IFREG | 0644, nullptr,
+		     data, BLOCKSIZE);
+  check_archive_add (ar, "after", REGTYPE, S_IFREG | 0644, nullptr,
+		     "after", 5);
+  check_archive_close (ar);
+
+  if (mkdir ("x", 0755) != 0)
+    error (EXIT_FAILURE, errno, "x");
+  CHECK (run (name, "x", false) == 0);
+
+  char *f = check_read_file ("x/good", &size);
+  CHECK (f && size == 4096);
+  if (f && size == 4096)
+    {
+      static char const zeros[2048 - BLOCKSIZE];
+      CHECK (memcmp (f, data, BLOCKSIZE) == 0);
+      CHECK (memcmp (f + BLOCKSIZE, zeros, sizeof zeros) == 0);
+      CHECK (memcmp (f + 2048, data + BLOCKSIZE, BLOCKSIZE) == 0);
+    }
+  free (f);
+  CHECK (access ("x/bad", F_OK) != 0 && errno == ENOENT);
+  CHECK (access ("x/order", F_OK) != 0 && errno == ENOENT);
+  f = check_read_file ("x/after", &size);
+  CHECK (f && size == 5 && memcmp (f, "after", 5) == 0);
+  free (f);
+
+  /* Verification rejects the bad maps too, and keeps its place */
+  CHECK (run (name, "x", true) == 0);
+
+  free (name);
+  return check_status ();
+}
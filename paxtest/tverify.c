@@ -0,0 +1,214 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Verification.  An archive is extracted and verified against the
+   files extracted, which must match; then each kind of difference is
+   made in turn, and must be found.  The large member is hashed in
+   several slices.  Member names are normalized as extraction does them,
+   and those with a ".." component are refused.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+#include <paxlib.h>
+
+enum { BIG_SIZE = 3 * PAX_VERIFY_CHUNK + 123 };
+
+/* Run the archive NAME through extraction, or verification if VERIFY,
+   in the directory "x", and return the result.  */
+static int
+run (char const *name, bool verify)
+{
+  if (chdir ("x") != 0)
+    error (EXIT_FAILURE, errno, "x");
+  paxbuf_t buf = check_archive_open (name);
+  int rc;
+  if (verify)
+    {
+      pax_verify_t pv;
+      CHECK (pax_verify_open (&pv, buf, 4) == 0);
+      rc = pax_verify_run (pv);
+      pax_verify_destroy (&pv);
+    }
+  else
+    {
+      pax_extract_t px;
+      CHECK (pax_extract_open (&px, buf, 2) == 0);
+      rc = pax_extract_run (px);
+      pax_extract_destroy (&px);
+    }
+  check_archive_release (buf);
+  if (chdir (check_scratch ()) != 0)
+    error (EXIT_FAILURE, errno, "%s", check_scratch ());
+  return rc;
+}
+
+/* Verify the archive NAME, and return true if differences were
+   found.  */
+static bool
+differs (char const *name)
+{
+  exit_status = PAXEXIT_SUCCESS;
+  CHECK (run (name, true) == 0);
+  bool d = exit_status == PAXEXIT_DIFFERS;
+  exit_status = PAXEXIT_SUCCESS;
+  return d;
+}
+
+/* Replace the byte at OFFSET in the file NAME with C, keeping its
+   modification time.  */
+static void
+poke (char const *name, off_t offset, char c)
+{
+  struct stat st;
+  int fd = open (name, O_WRONLY);
+
+  if (fd < 0 || fstat (fd, &st) != 0 || pwrite (fd, &c, 1, offset) != 1)
+    error (EXIT_FAILURE, errno, "%s", name);
+  struct timespec ts[2] = { st.st_atim, st.st_mtim };
+  if (futimens (fd, ts) != 0 || close (fd) != 0)
+    error (EXIT_FAILURE, errno, "%s", name);
+}
+
+int
+main (int argc, char **argv)
+{
+  char *name = check_file_name ("v.tar");
+  char *names = check_file_name ("n.tar");
+  char *big = ximalloc (BIG_SIZE);
+  uint_least32_t r = 1;
+  check_archive_t ar;
+
+  if (chdir (check_scratch ()) != 0)
+    error (EXIT_FAILURE, errno, "%s", check_scratch ());
+  for (idx_t i = 0; i < BIG_SIZE; i++)
+    {
+      r = r * 1103515245 + 12345;
+      big[i] = r >> 16;
+    }
+  ar = check_archive_create (name);
+  check_archive_add (ar, "d", DIRTYPE, S_IFDIR | 0755, nullptr,
+		     nullptr, 0);
+  check_archive_add (ar, "d/small", REGTYPE, S_IFREG | 0644, nullptr,
+		     "small", 5);
+  check_archive_add (ar, "big", REGTYPE, S_IFREG | 0600, nullptr,
+		     big, BIG_SIZE);
+  check_archive_add (ar, "link", SYMTYPE, S_IFLNK | 0777, "d/small",
+		     nullptr, 0);
+  check_archive_add (ar, "hard", LNKTYPE, S_IFREG | 0644, "d/small",
+		     nullptr, 0);
+  check_archive_add (ar, "fifo", FIFOTYPE, S_IFIFO | 0644, nullptr,
+		     nullptr, 0);
+  check_archive_close (ar);
+
+  if (mkdir ("x", 0755) != 0)
+    error (EXIT_FAILURE, errno, "x");
+  CHECK (run (name, false) == 0);
+  CHECK (!differs (name));
+
+  /* Contents, in each slice of the large member and in a small one */
+  for (int i = 0; i < 4; i++)
+    {
+      off_t offset = i * PAX_VERIFY_CHUNK + 100;
+      poke ("x/big", offset, ~big[offset]);
+      CHECK (differs (name));
+      poke ("x/big", offset, big[offset]);
+    }
+  CHECK (!differs (name));
+  poke ("x/d/small", 4, 'L');
+  CHECK (differs (name));
+  poke ("x/d/small", 4, 'l');
+
+  /* Mode, size and modification time */
+  CHECK (chmod ("x/big", 0644) == 0);
+  CHECK (differs (name));
+  CHECK (chmod ("x/big", 0600) == 0);
+  struct stat st;
+  CHECK (stat ("x/big", &st) == 0);
+  CHECK (truncate ("x/big", BIG_SIZE - 1) == 0);
+  CHECK (differs (name));
+  poke ("x/big", BIG_SIZE - 1, big[BIG_SIZE - 1]);
+  struct timespec ts[2] = { { .tv_nsec = UTIME_OMIT }, st.st_mtim };
+  CHECK (utimensat (AT_FDCWD, "x/big", ts, 0) == 0);
+  CHECK (!differs (name));
+  CHECK (stat ("x/d/small", &st) == 0);
+  ts[1] = (struct timespec) { .tv_sec = 1 };
+  CHECK (utimensat (AT_FDCWD, "x/d/small", ts, 0) == 0);
+  CHECK (differs (name));
+  ts[1] = st.st_mtim;
+  CHECK (utimensat (AT_FDCWD, "x/d/small", ts, 0) == 0);
+  CHECK (!differs (name));
+
+  /* The same for the other kinds of files, but the mode of a link */
+  static char const *const others[] = { "x/d", "x/link", "x/fifo" };
+  for (int i = 0; i < sizeof others / sizeof *others; i++)
+    {
+      CHECK (lstat (others[i], &st) == 0);
+      ts[1] = (struct timespec) { .tv_sec = 1 };
+      CHECK (utimensat (AT_FDCWD, others[i], ts, AT_SYMLINK_NOFOLLOW) == 0);
+      CHECK (differs (name));
+      ts[1] = st.st_mtim;
+      CHECK (utimensat (AT_FDCWD, others[i], ts, AT_SYMLINK_NOFOLLOW) == 0);
+      CHECK (!differs (name));
+    }
+  CHECK (chmod ("x/fifo", 0600) == 0);
+  CHECK (differs (name));
+  CHECK (chmod ("x/fifo", 0644) == 0);
+  CHECK (!differs (name));
+
+  /* Links, and missing files */
+  CHECK (lstat ("x/link", &st) == 0);
+  ts[1] = st.st_mtim;
+  CHECK (unlink ("x/link") == 0 && symlink ("big", "x/link") == 0);
+  CHECK (differs (name));
+  CHECK (unlink ("x/link") == 0 && symlink ("d/small", "x/link") == 0);
+  CHECK (utimensat (AT_FDCWD, "x/link", ts, AT_SYMLINK_NOFOLLOW) == 0);
+  CHECK (!differs (name));
+  CHECK (unlink ("x/hard") == 0 && link ("x/big", "x/hard") == 0);
+  CHECK (differs (name));
+  CHECK (unlink ("x/hard") == 0);
+  CHECK (differs (name));
+
+  /* Names */
+  ar = check_archive_create (names);
+  check_archive_add (ar, "./d//small/", REGTYPE, S_IFREG | 0644, nullptr,
+		     "small", 5);
+  check_archive_add (ar, "/big", REGTYPE, S_IFREG | 0600, nullptr,
+		     big, BIG_SIZE);
+  check_archive_add (ar, "link", LNKTYPE, S_IFREG | 0644, "./big",
+		     nullptr, 0);
+  check_archive_close (ar);
+  CHECK (unlink ("x/link") == 0 && link ("x/big", "x/link") == 0);
+  CHECK (!differs (names));
+  ar = check_archive_create (names);
+  check_archive_add (ar, "d/../big", REGTYPE, S_IFREG | 0600, nullptr,
+		     "other", 5);
+  check_archive_add (ar, "hard", LNKTYPE, S_IFREG | 0644, "d/../big",
+		     nullptr, 0);
+  check_archive_close (ar);
+  exit_status = PAXEXIT_SUCCESS;
+  CHECK (run (names, true) == 0);
+  CHECK (exit_status == PAXEXIT_FAILURE);
+  exit_status = PAXEXIT_SUCCESS;
+
+  free (big);
+  free (name);
+  free (names);
+  return check_status ();
+}
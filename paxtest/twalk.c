@@ -0,0 +1,161 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* Parallel tree walk.  A tree created in no particular order must be
+   walked in the order of a serial walk sorting each directory by name,
+   with the status of each file and without following symbolic links,
+   whatever the number of threads.  A walk may be given up halfway.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+#include <dirent.h>
+#include <walk.h>
+
+/* Names of the files of a serial walk */
+static char **names;
+static idx_t nnames, names_size;
+
+static int
+name_cmp (void const *a, void const *b)
+{
+  return strcmp (*(char *const *) a, *(char *const *) b);
+}
+
+static void
+add_name (char *name)
+{
+  if (nnames == names_size)
+    names = xpalloc (names, &names_size, 1, -1, sizeof *names);
+  names[nnames++] = name;
+}
+
+/* Walk the tree at NAME serially, adding the names of its files */
+static void
+serial_walk (char const *name)
+{
+  struct stat st;
+  char **ents = nullptr;
+  idx_t n = 0, size = 0;
+
+  add_name (xstrdup (name));
+  if (lstat (name, &st) != 0)
+    error (EXIT_FAILURE, errno, "%s", name);
+  if (!S_ISDIR (st.st_mode))
+    return;
+
+  DIR *dir = opendir (name);
+  if (!dir)
+    error (EXIT_FAILURE, errno, "%s", name);
+  for (struct dirent *d; (d = readdir (dir)); )
+    if (strcmp (d->d_name, ".") != 0 && strcmp (d->d_name, "..") != 0)
+      {
+	if (n == size)
+	  ents = xpalloc (ents, &size, 1, -1, sizeof *ents);
+	ents[n] = xmalloc (strlen (name) + strlen (d->d_name) + 2);
+	sprintf (ents[n++], "%s/%s", name, d->d_name);
+      }
+  closedir (dir);
+  qsort (ents, n, sizeof *ents, name_cmp);
+  for (idx_t i = 0; i < n; i++)
+    {
+      serial_walk (ents[i]);
+      free (ents[i]);
+    }
+  free (ents);
+}
+
+/* Create a tree at NAME of DEPTH levels below it, with entries made in
+   reverse order of their names.  */
+static void
+make_tree (char const *name, int depth)
+{
+  char *sub = xmalloc (strlen (name) + 16);
+
+  if (mkdir (name, 0755) != 0)
+    error (EXIT_FAILURE, errno, "%s", name);
+  for (int i = 9; i >= 0; i--)
+    {
+      sprintf (sub, "%s/f%d", name, i);
+      check_write_file (sub, sub, strlen (sub));
+      if (depth > 0 && i % 3 == 0)
+	{
+	  sprintf (sub, "%s/d%d", name, i);
+	  make_tree (sub, depth - 1);
+	}
+    }
+  sprintf (sub, "%s/link", name);
+  if (symlink (".", sub) != 0)
+    error (EXIT_FAILURE, errno, "%s", sub);
+  free (sub);
+}
+
+/* Walk ROOT with NTHREADS threads, and check the walk against the
+   serial one, up to STOP files.  */
+static void
+check_walk (char const *root, int nthreads, idx_t stop)
+{
+  pax_walk_t w;
+  struct pax_walk_entry ent;
+  struct stat st;
+  idx_t i = 0;
+
+  CHECK (pax_walk_open (&w, root, nthreads, 0) == 0);
+  for (; i < stop && pax_walk_next (w, &ent); i++)
+    {
+      if (i >= nnames || strcmp (ent.name, names[i]) != 0)
+	{
+	  fprintf (stderr, "%d threads: %s out of order\n", nthreads,
+		   ent.name);
+	  CHECK (false);
+	  break;
+	}
+      CHECK (lstat (ent.name, &st) == 0
+	     && st.st_mode == ent.st->st_mode
+	     && st.st_size == ent.st->st_size
+	     && st.st_ino == ent.st->st_ino);
+    }
+  CHECK (i == (stop < nnames ? stop : nnames));
+  pax_walk_destroy (&w);
+  CHECK (!w);
+}
+
+int
+main (int argc, char **argv)
+{
+  char *root = check_file_name ("tree");
+
+  make_tree (root, 3);
+  serial_walk (root);
+  /* 85 directories of 11 other files each, all but the root listed */
+  CHECK (nnames == 85 + 85 * 11);
+
+  static int const threads[] = { 1, 2, 8, 0 };
+  for (int i = 0; i < sizeof threads / sizeof *threads; i++)
+    {
+      check_walk (root, threads[i], IDX_MAX);
+      check_walk (root, threads[i], nnames / 3);
+    }
+
+  for (idx_t i = 0; i < nnames; i++)
+    free (names[i]);
+  free (names);
+  free (root);
+  return check_status ();
+}
@@ -0,0 +1,293 @@
+/* This file is part of GNU paxutils
+
+   Copyright (C) 2025 Free Software Foundation, Inc.
+
+   GNU paxutils is free software; you can redistribute it and/or modify it
+   under the terms of the GNU General Public License as published by the
+   Free Software Foundation; either version 3, or (at your option) any later
+   version.
+
+   GNU paxutils is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+   Public License for more details.
+
+   You should have received a copy of the GNU General Public License along
+   with GNU paxutils.  If not, see <http://www.gnu.org/licenses/>. */
+
+/* POSIX extended headers.  Every keyword must be found by the perfect
+   hash; records of global and member headers must be parsed, applied,
+   overridden, cancelled and forgotten as POSIX says; malformed data
+   must be rejected; and a header must be read from an archive.  */
+
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <check.h>
+
+static struct
+{
+  char const *name;
+  enum pax_xkeyword keyword;
+} const keywords[] = {
+  { "atime", PAX_XK_ATIME },
+  { "charset", PAX_XK_CHARSET },
+  { "comment", PAX_XK_COMMENT },
+  { "ctime", PAX_XK_CTIME },
+  { "gid", PAX_XK_GID },
+  { "gname", PAX_XK_GNAME },
+  { "hdrcharset", PAX_XK_HDRCHARSET },
+  { "linkpath", PAX_XK_LINKPATH },
+  { "mtime", PAX_XK_MTIME },
+  { "path", PAX_XK_PATH },
+  { "size", PAX_XK_SIZE },
+  { "uid", PAX_XK_UID },
+  { "uname", PAX_XK_UNAME },
+  { "GNU.dumpdir", PAX_XK_GNU_DUMPDIR },
+  { "GNU.sparse.major", PAX_XK_GNU_SPARSE_MAJOR },
+  { "GNU.sparse.minor", PAX_XK_GNU_SPARSE_MINOR },
+  { "GNU.sparse.name", PAX_XK_GNU_SPARSE_NAME },
+  { "GNU.sparse.realsize", PAX_XK_GNU_SPARSE_REALSIZE },
+  { "GNU.sparse.size", PAX_XK_GNU_SPARSE_SIZE },
+  { "GNU.sparse.numblocks", PAX_XK_GNU_SPARSE_NUMBLOCKS },
+  { "GNU.sparse.offset", PAX_XK_GNU_SPARSE_OFFSET },
+  { "GNU.sparse.numbytes", PAX_XK_GNU_SPARSE_NUMBYTES },
+  { "GNU.sparse.map", PAX_XK_GNU_SPARSE_MAP },
+  { "GNU.volume.label", PAX_XK_GNU_VOLUME_LABEL },
+  { "GNU.volume.filename", PAX_XK_GNU_VOLUME_FILENAME },
+  { "GNU.volume.size", PAX_XK_GNU_VOLUME_SIZE },
+  { "GNU.volume.offset", PAX_XK_GNU_VOLUME_OFFSET },
+  { "SCHILY.dev", PAX_XK_SCHILY_DEV },
+  { "SCHILY.devmajor", PAX_XK_SCHILY_DEVMAJOR },
+  { "SCHILY.devminor", PAX_XK_SCHILY_DEVMINOR },
+  { "SCHILY.ino", PAX_XK_SCHILY_INO },
+  { "SCHILY.nlink", PAX_XK_SCHILY_NLINK },
+  { "SCHILY.filetype", PAX_XK_SCHILY_FILETYPE },
+  { "SCHILY.realsize", PAX_XK_SCHILY_REALSIZE },
+  { "SCHILY.fflags", PAX_XK_SCHILY_FFLAGS },
+  { "SCHILY.acl.access", PAX_XK_SCHILY_ACL_ACCESS },
+  { "SCHILY.acl.default", PAX_XK_SCHILY_ACL_DEFAULT },
+  { "SCHILY.acl.ace", PAX_XK_SCHILY_ACL_ACE },
+  { "RHT.security.selinux", PAX_XK_SELINUX },
+  { "SCHILY.xattr.user.x", PAX_XK_SCHILY_XATTR },
+  { "LIBARCHIVE.xattr.user.x", PAX_XK_LIBARCHIVE_XATTR },
+  { "SCHILY.xattr.", PAX_XK_UNKNOWN },
+  { "paths", PAX_XK_UNKNOWN },
+  { "pat", PAX_XK_UNKNOWN },
+  { "", PAX_XK_UNKNOWN },
+};
+
+/* Append to the buffer X, holding *XLEN bytes, a record for KEY and the
+   VLEN bytes of VALUE.  */
+static void
+add_record (char *x, idx_t *xlen, char const *key, char const *value,
+	    idx_t vlen)
+{
+  /* The length of a record counts its own digits */
+  idx_t n = strlen (key) + vlen + 3;
+  idx_t len = n + (n < 9 ? 1 : n < 98 ? 2 : 3);
+  *xlen += sprintf (x + *xlen, "%td %s=", len, key);
+  memcpy (x + *xlen, value, vlen);
+  *xlen += vlen;
+  x[(*xlen)++] = '\n';
+}
+
+static void
+add (char *x, idx_t *xlen, char const *key, char const *value)
+{
+  add_record (x, xlen, key, value, strlen (value));
+}
+
+/* Return true if the record for KW in XH has the value VALUE */
+static bool
+value_is (pax_xheader_t xh, enum pax_xkeyword kw, char const *value)
+{
+  struct pax_xrecord const *rec = pax_xheader_find (xh, kw);
+  return rec && strcmp (rec->value, value) == 0;
+}
+
+static void
+check_keywords (void)
+{
+  for (int i = 0; i < sizeof keywords / sizeof *keywords; i++)
+    {
+      char const *name = keywords[i].name;
+      if (pax_xkeyword_lookup (name, strlen (name)) != keywords[i].keyword)
+	{
+	  fprintf (stderr, "keyword \"%s\" not found\n", name);
+	  CHECK (false);
+	}
+    }
+}
+
+static void
+check_records (void)
+{
+  pax_xheader_t xh = pax_xheader_create ();
+  struct tar_stat_info st;
+  char x[1024];
+  idx_t xlen;
+  idx_t n;
+
+  pax_stat_init (&st);
+
+  /* A global header, then a member header overriding part of it */
+  xlen = 0;
+  add (x, &xlen, "uname", "global");
+  add (x, &xlen, "gname", "staff");
+  add (x, &xlen, "comment", "ignored");
+  CHECK (pax_xheader_parse (xh, x, xlen, true) == 0);
+  xlen = 0;
+  add (x, &xlen, "path", "a/very/long/name");
+  add (x, &xlen, "size", "123456789012");
+  add (x, &xlen, "mtime", "-1.25");
+  add (x, &xlen, "atime", "1700000000.123456789999");
+  add (x, &xlen, "uid", "4000000000");
+  add (x, &xlen, "uname", "member");
+  add (x, &xlen, "gname", "");
+  add_record (x, &xlen, "SCHILY.xattr.user.a", "v\0w", 3);
+  add (x, &xlen, "SCHILY.xattr.user.b", "2");
+  add (x, &xlen, "SCHILY.devmajor", "8");
+  CHECK (pax_xheader_parse (xh, x, xlen, false) == 0);
+
+  struct pax_xrecord const *recs = pax_xheader_records (xh, &n);
+  CHECK (n == 13 && recs[0].global && !recs[3].global);
+  CHECK (recs[10].keyword == PAX_XK_SCHILY_XATTR
+	 && recs[10].value_len == 3 && memcmp (recs[10].value, "v\0w", 3) == 0
+	 && strcmp (recs[10].key, "SCHILY.xattr.user.a") == 0);
+  CHECK (value_is (xh, PAX_XK_SCHILY_XATTR, "2"));
+  CHECK (value_is (xh, PAX_XK_UNAME, "member"));
+  CHECK (!pax_xheader_find (xh, PAX_XK_GNAME));
+
+  st.uname = (char *) "ustar";
+  st.gname = (char *) "ustar";
+  CHECK (pax_xheader_apply (xh, &st) == 0);
+  CHECK (strcmp (st.file_name, "a/very/long/name") == 0);
+  CHECK (st.archive_file_size == 123456789012
+	 && st.stat.st_size == 123456789012);
+  CHECK (st.stat.st_mtime == -2 && st.mtime_nsec == 750000000);
+  CHECK (st.stat.st_atime == 1700000000 && st.atime_nsec == 123456789);
+  CHECK (st.stat.st_uid == 4000000000u);
+  CHECK (strcmp (st.uname, "member") == 0);
+  CHECK (strcmp (st.gname, "ustar") == 0);
+  CHECK (st.devmajor == 8);
+
+  /* The next member sees the global records alone */
+  pax_xheader_reset (xh);
+  recs = pax_xheader_records (xh, &n);
+  CHECK (n == 3);
+  CHECK (value_is (xh, PAX_XK_UNAME, "global"));
+  CHECK (value_is (xh, PAX_XK_GNAME, "staff"));
+  CHECK (!pax_xheader_find (xh, PAX_XK_PATH));
+  CHECK (!pax_xheader_find (xh, PAX_XK_SCHILY_XATTR));
+
+  /* Sparse maps, in either form */
+  pax_stat_reset (&st);
+  xlen = 0;
+  add (x, &xlen, "GNU.sparse.size", "1048576");
+  add (x, &xlen, "GNU.sparse.offset", "0");
+  add (x, &xlen, "GNU.sparse.numbytes", "512");
+  add (x, &xlen, "GNU.sparse.offset", "4096");
+  add (x, &xlen, "GNU.sparse.numbytes", "10");
+  CHECK (pax_xheader_parse (xh, x, xlen, false) == 0);
+  CHECK (pax_xheader_apply (xh, &st) == 0);
+  CHECK (st.is_sparse && st.stat.st_size == 1048576);
+  CHECK (st.sparse_map_avail == 2 && st.sparse_map[1].offset == 4096
+	 && st.sparse_map[1].numbytes == 10);
+  pax_xheader_reset (xh);
+  pax_stat_reset (&st);
+  xlen = 0;
+  add (x, &xlen, "GNU.sparse.map", "0,512,4096,10,8192,0");
+  CHECK (pax_xheader_parse (xh, x, xlen, false) == 0);
+  CHECK (pax_xheader_apply (xh, &st) == 0);
+  CHECK (st.sparse_map_avail == 3 && st.sparse_map[2].offset == 8192);
+  pax_xheader_reset (xh);
+
+  /* Malformed values */
+  static char const *const bad[][2] = {
+    { "uid", "-1" }, { "uid", "1x" }, { "size", "" },
+    { "mtime", "1." }, { "mtime", "x" }, { "GNU.sparse.numbytes", "1" },
+    { "GNU.sparse.map", "0,512,4096" }
+  };
+  for (int i = 0; i < sizeof bad / sizeof *bad; i++)
+    {
+      xlen = 0;
+      add (x, &xlen, bad[i][0], bad[i][1]);
+      CHECK (pax_xheader_parse (xh, x, xlen, false) == 0);
+      if (*bad[i][1])
+	CHECK (pax_xheader_apply (xh, &st) == EINVAL);
+      pax_xheader_reset (xh);
+    }
+
+  /* Malformed records; those before them are kept */
+  static char const *const bad_data[] = {
+    "12 path=abc", "11 path=abc\n", "13 path=abc\n", "x path=abc\n",
+    "9 =abcd\n", "10 pathabc\n", "99999999999999999999 path=a\n"
+  };
+  for (int i = 0; i < sizeof bad_data / sizeof *bad_data; i++)
+    {
+      xlen = 0;
+      add (x, &xlen, "uname", "kept");
+      xlen += sprintf (x + xlen, "%s", bad_data[i]);
+      CHECK (pax_xheader_parse (xh, x, xlen, false) == EINVAL);
+      CHECK (value_is (xh, PAX_XK_UNAME, "kept"));
+      pax_xheader_reset (xh);
+    }
+
+  pax_stat_destroy (&st);
+  pax_xheader_destroy (&xh);
+  CHECK (!xh);
+}
+
+/* Read an extended header from an archive, with enough records to
+   span several blocks.  */
+static void
+check_read (void)
+{
+  char *name = check_file_name ("x.tar");
+  pax_xheader_t xh = pax_xheader_create ();
+  check_archive_t ar = check_archive_create (name);
+  char x[4 * BLOCKSIZE];
+  idx_t xlen = 0;
+  char key[32];
+  union block blk;
+  idx_t n;
+
+  for (int i = 0; i < 50; i++)
+    {
+      sprintf (key, "SCHILY.xattr.user.%02d", i);
+      add (x, &xlen, key, "value");
+    }
+  add (x, &xlen, "path", "long/name");
+  check_archive_add (ar, "PaxHeaders/name", XHDTYPE, S_IFREG | 0644,
+		     nullptr, x, xlen);
+  check_archive_add (ar, "name", REGTYPE, S_IFREG | 0644, nullptr,
+		     "data", 4);
+  check_archive_close (ar);
+
+  paxbuf_t buf = check_archive_open (name);
+  CHECK (paxbuf_read (buf, blk.buffer, BLOCKSIZE, &n) != pax_io_failure
+	 && n == BLOCKSIZE);
+  CHECK (pax_xheader_read (xh, buf, &blk) == 0);
+  struct pax_xrecord const *recs = pax_xheader_records (xh, &n);
+  CHECK (n == 51 && strcmp (recs[49].key, "SCHILY.xattr.user.49") == 0);
+  CHECK (value_is (xh, PAX_XK_PATH, "long/name"));
+
+  /* The data were read up to the next header */
+  CHECK (paxbuf_read (buf, blk.buffer, BLOCKSIZE, &n) != pax_io_failure
+	 && n == BLOCKSIZE);
+  CHECK (strcmp (blk.header.name, "name") == 0);
+  check_archive_release (buf);
+  pax_xheader_destroy (&xh);
+  free (name);
+}
+
+int
+main (int argc, char **argv)
+{
+  check_keywords ();
+  check_records ();
+  check_read ();
+  return check_status ();
+}
@@ -0,0 +1 @@
+#include "../lib/crc32c.c"
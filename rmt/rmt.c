@@ -15,6 +15,7 @@
    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
 #include "system.h"
+#include <crc32c.h>
 
 #if HAVE_SYS_MTIO_H
 # include <sys/mtio.h>
@@ -117,6 +118,14 @@ rmt_error (int code)
 static char *record_buffer_ptr;
 static idx_t record_buffer_size;
 
+/* Length of the last record read, kept in record_buffer_ptr for
+   resending, or -1 */
+static idx_t last_record = -1;
+
+/* Integrity checks of the data, as set by the K command */
+enum { CHECKSUM_NONE, CHECKSUM_CRC32C };
+static int checksum_mode = CHECKSUM_NONE;
+
 static void
 prepare_record_buffer (idx_t size)
 {
@@ -465,6 +474,18 @@ lseek_device (const char *str)
     rmt_reply (off);
 }
 
+/* Send the reply to a read of the last record, and its data */
+static void
+send_record (void)
+{
+  if (checksum_mode == CHECKSUM_CRC32C)
+    rmt_write ("A%td %08jx\n", last_record,
+	       (uintmax_t) pax_crc32c (0, record_buffer_ptr, last_record));
+  else
+    rmt_reply (last_record);
+  full_write (STDOUT_FILENO, record_buffer_ptr, last_record);
+}
+
 /* Syntax
    ------
    R<count>\n
@@ -480,7 +501,8 @@ lseek_device (const char *str)
    Reply
    -----
    On success: A<rdcount>\n, followed by <rdcount> bytes of data read from
-   the device.
+   the device.  In checksum mode, A<rdcount> <crc>\n, where <crc> is the
+   CRC-32C of the data in hex.
    On error: E0\n<msg>\n
 */
 
@@ -506,13 +528,50 @@ read_device (const char *str)
   prepare_record_buffer (size);
   ptrdiff_t status = safe_read (device_fd, record_buffer_ptr, size);
   if (status < 0)
-    rmt_error (errno);
+    {
+      last_record = -1;
+      rmt_error (errno);
+    }
   else
     {
-      rmt_reply (status);
-      full_write (STDOUT_FILENO, record_buffer_ptr, status);
+      last_record = status;
+      send_record ();
     }
 }
+
+/* Syntax
+   ------
+   T\n
+
+   Function
+   --------
+   Send again the data of the last R command, in checksum mode.  The
+   client asks for it when the data it got do not match their CRC.
+
+   Arguments
+   ---------
+   None
+
+   Reply
+   -----
+   As for R.
+   On error: E0\n<msg>\n
+
+   Extensions
+   ----------
+   BSD version does not have this command.
+*/
+
+static void
+resend_device (const char *str)
+{
+  if (*str)
+    rmt_error_message (EINVAL, N_("Unexpected arguments"));
+  else if (checksum_mode == CHECKSUM_NONE || last_record < 0)
+    rmt_error_message (EINVAL, N_("No record to resend"));
+  else
+    send_record ();
+}
 
 /* Syntax
    ------
@@ -526,10 +585,15 @@ read_device (const char *str)
    ---------
    <count>  - number of bytes.
 
+   In checksum mode, the syntax is W<count> <crc>\n, where <crc> is the
+   CRC-32C of the data in hex.  Data that do not match it are not
+   written, and the client may send them again.
+
    Reply
    -----
    On success: A<wrcount>\n, where <wrcount> is number of bytes actually
    written.
+   In checksum mode, if the data do not match <crc>: C<count>\n
    On error: E0\n<msg>\n
 */
 
@@ -538,6 +602,12 @@ write_device (const char *str)
 {
   char *p;
   uintmax_t n = strtoumax (str, &p, 10);
+  uintmax_t crc = 0;
+  if (p != str && checksum_mode == CHECKSUM_CRC32C && *p == ' ')
+    {
+      str = p + 1;
+      crc = strtoumax (str, &p, 16);
+    }
   if (p == str || *p)
     {
       rmt_error_message (EINVAL, N_("Invalid byte count"));
@@ -552,6 +622,7 @@ write_device (const char *str)
     }
 
   prepare_record_buffer (size);
+  last_record = -1;
   if (fread (record_buffer_ptr, size, 1, stdin) != 1)
     {
       if (feof (stdin))
@@ -560,6 +631,13 @@ write_device (const char *str)
 	rmt_error (errno);
       return;
     }
+  if (checksum_mode == CHECKSUM_CRC32C
+      && pax_crc32c (0, record_buffer_ptr, size) != crc)
+    {
+      DEBUG (1, "error: Checksum mismatch\n");
+      rmt_write ("C%jd\n", (intmax_t) size);
+      return;
+    }
 
   idx_t status = full_write (device_fd, record_buffer_ptr, size);
   if (status != size)
@@ -677,6 +755,45 @@ status_device (const char *str)
 #endif
 }
 
+/* Syntax
+   ------
+   K<mode>\n
+
+   Function
+   --------
+   Select the integrity checks of the data transferred.
+
+   Arguments
+   ---------
+   <mode>  -  0 for none, the default; 1 for a CRC-32C of each record,
+	      sent along with it by the R, T and W commands.
+
+   Reply
+   -----
+   A<mode>\n on success.
+   On error: E0\n<msg>\n
+
+   Extensions
+   ----------
+   BSD version does not have this command, and exits on it.  Clients
+   that get an error in reply must open the device again.
+*/
+
+static void
+checksum_device (const char *str)
+{
+  if (strcmp (str, "0") == 0)
+    checksum_mode = CHECKSUM_NONE;
+  else if (strcmp (str, "1") == 0)
+    checksum_mode = CHECKSUM_CRC32C;
+  else
+    {
+      rmt_error_message (EINVAL, N_("Invalid checksum mode"));
+      return;
+    }
+  rmt_reply (checksum_mode);
+}
+
 
 
 const char *argp_program_version = "rmt (" PACKAGE_NAME ") " VERSION;
@@ -793,6 +910,10 @@ main (int argc, char **argv)
 	  iocop_device (buf + 1);
 	  break;
 
+	case 'K':
+	  checksum_device (buf + 1);
+	  break;
+
 	case 'L':
 	  lseek_device (buf + 1);
 	  break;
@@ -809,6 +930,10 @@ main (int argc, char **argv)
 	  status_device (buf + 1);
 	  break;
 
+	case 'T':
+	  resend_device (buf + 1);
+	  break;
+
 	case 'W':
 	  write_device (buf + 1);
 	  break;